@@ -0,0 +1,81 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader Dual-Bank Source
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   bank.c
+ * @brief  This file contains the hardware independent part of the dual-bank
+ *	       (A/B) update. The bank mapped to the start of flash is the active
+ *	       bank; the update is written into the other (inactive) bank, which
+ *	       is always mapped right behind the active one. The BFB2 option bit
+ *	       selects the bank to boot from: when it is set, the system memory
+ *	       boots from bank 2 and maps it to the start of flash.
+ *
+ *	       The flash controller addresses the banks physically, therefore
+ *	       the pages of the memory map have to be translated when bank 2 is
+ *	       the active bank.
+ *
+ * @see    Please refer to README for detailed information.
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "bank.h"
+#include "bootloader.h"
+
+/**
+ * @brief  This function returns the other bank.
+ * @param  bank: ::BANK_1 or ::BANK_2
+ * @return The other bank
+ */
+uint8_t Bootloader_BankOther(uint8_t bank)
+{
+    return (bank == BANK_1) ? BANK_2 : BANK_1;
+}
+
+/**
+ * @brief  This function returns the physical bank of a flash page.
+ * @param  page: index of the page in the memory map (from the start of flash)
+ * @param  active: active bank (mapped to the start of flash)
+ * @return ::BANK_1 or ::BANK_2
+ */
+uint8_t Bootloader_BankOfPage(uint32_t page, uint8_t active)
+{
+    return (page < FLASH_PAGE_NBPERBANK) ? active
+                                         : Bootloader_BankOther(active);
+}
+
+/**
+ * @brief  This function returns the index of a flash page within its bank.
+ * @param  page: index of the page in the memory map (from the start of flash)
+ * @return Index of the page within the bank
+ */
+uint32_t Bootloader_BankPage(uint32_t page)
+{
+    return page % FLASH_PAGE_NBPERBANK;
+}
+
+/**
+ * @brief  This function decides which bank is booted on startup. A valid
+ *         application of the active bank is always preferred; the other bank
+ *         is only booted if the active application is invalid, so a failed
+ *         update never replaces a bootable image.
+ * @param  state: pointer to the state of the banks
+ * @return Action to be performed ::eBankActions
+ */
+uint8_t Bootloader_BankDecide(const BootloaderBankStateTypeDef* state)
+{
+    if(state->activeValid)
+    {
+        /* The system memory fell back to the active bank: the image of the
+         * selected bank is not bootable */
+        return (state->boot == state->active) ? BANK_BOOT : BANK_CONFIRM;
+    }
+    if(state->inactiveValid)
+    {
+        return BANK_SWITCH;
+    }
+    return BANK_NONE;
+}
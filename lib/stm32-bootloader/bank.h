@@ -0,0 +1,53 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader Dual-Bank Header
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   bank.h
+ * @brief  This file contains the definitions and function prototypes of the
+ *	       dual-bank (A/B) update: bank addressing and boot bank selection.
+ *
+ * @see    Please refer to README for detailed information.
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+#ifndef __BANK_H
+#define __BANK_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Defines -------------------------------------------------------------------*/
+#define BANK_1 (1) /*!< Physical flash bank 1 */
+#define BANK_2 (2) /*!< Physical flash bank 2 */
+
+/* Enumerations --------------------------------------------------------------*/
+/** Actions on startup, see Bootloader_BankDecide() */
+enum eBankActions
+{
+    BANK_BOOT = 0, /*!< Launch the application of the active bank */
+    BANK_SWITCH,   /*!< Boot from the other bank (active image is invalid) */
+    BANK_CONFIRM,  /*!< Select the active bank for the next boots */
+    BANK_NONE      /*!< No valid application in any of the banks */
+};
+
+/* Typedefs ------------------------------------------------------------------*/
+/** State of the banks on startup */
+typedef struct
+{
+    uint8_t active;        /*!< Bank mapped to the start of flash (running) */
+    uint8_t boot;          /*!< Bank selected for boot by the BFB2 option */
+    uint8_t activeValid;   /*!< The active bank holds a valid application */
+    uint8_t inactiveValid; /*!< The other bank holds a valid application (only
+                              evaluated if the active one is invalid) */
+} BootloaderBankStateTypeDef;
+
+/* Functions -----------------------------------------------------------------*/
+uint8_t Bootloader_BankOther(uint8_t bank);
+uint8_t Bootloader_BankOfPage(uint32_t page, uint8_t active);
+uint32_t Bootloader_BankPage(uint32_t page);
+uint8_t Bootloader_BankDecide(const BootloaderBankStateTypeDef* state);
+
+#endif /* __BANK_H */
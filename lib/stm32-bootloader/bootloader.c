@@ -5,7 +5,9 @@
  * @author Akos Pasztor
  * @file   bootloader.c
  * @brief  This file contains the functions of the bootloader. The bootloader
- *	       implementation uses the official HAL library of ST.
+ *	       implementation uses the official HAL library of ST. The flash is
+ *	       accessed through a flash backend (see flashops.h), so the flash
+ *	       logic can be built and tested on the host as well.
  *
  * @see    Please refer to README for detailed information.
  *******************************************************************************
@@ -15,6 +17,16 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "bootloader.h"
+#include "bank.h"
+#include "crc.h"
+#include "flashops.h"
+#include "handoff.h"
+#include "image.h"
+#include "imagecache.h"
+#include "rollback.h"
+#include "sha512.h"
+#include "signature.h"
+#include <string.h>
 
 /* Private defines -----------------------------------------------------------*/
 #define BOOTLOADER_VERSION_MAJOR 1 /*!< Major version */
@@ -22,310 +34,1034 @@
 #define BOOTLOADER_VERSION_PATCH 3 /*!< Patch version */
 #define BOOTLOADER_VERSION_RC    0 /*!< Release candidate version */
 
+/** Size of the buffer of Bootloader_FlashWrite(): differential update needs
+ * a complete page to be compared with the flash content. */
+#if(USE_DIFF_UPDATE)
+#define FLASH_BUFFER_SIZE FLASH_PAGE_SIZE
+#else
+#define FLASH_BUFFER_SIZE FLASH_ROW_SIZE
+#endif
+
+/** Pages are erased on demand during programming */
+#define FLASH_ERASE_ON_DEMAND (USE_LAZY_ERASE || USE_DIFF_UPDATE)
+
+/** Index of the flash page containing the given address */
+#define FLASH_PAGE_INDEX(addr) (((addr)-FLASH_BASE) / FLASH_PAGE_SIZE)
+
+/** No unauthenticated data has been programmed since startup */
+#define FLASH_AUTHENTICATED                       \
+    ((flash_signature == FLASH_SIGNATURE_NONE) || \
+     (flash_signature == FLASH_SIGNATURE_OK))
+
+/** Address of the checksum of the application space being updated */
+#define UPDATE_CRC_ADDRESS (CRC_ADDRESS + (UPDATE_ADDRESS - APP_ADDRESS))
+
+/** Address of the vector table of the application space being updated */
+#define UPDATE_VECTORS (APP_VECTORS + (UPDATE_ADDRESS - APP_ADDRESS))
+
 /* Private typedef -----------------------------------------------------------*/
 typedef void (*pFunction)(void); /*!< Function pointer definition */
 
+/** Signature states of the programmed data */
+enum eFlashSignatureStates
+{
+    FLASH_SIGNATURE_NONE = 0, /*!< Nothing programmed since startup */
+    FLASH_SIGNATURE_OPEN,     /*!< Programming session is running */
+    FLASH_SIGNATURE_PENDING,  /*!< Programmed data is not authenticated */
+    FLASH_SIGNATURE_OK        /*!< Programmed data is authenticated */
+};
+
 /* Private variables ---------------------------------------------------------*/
+/** Flash backend performing the flash operations */
+#if defined(USE_HAL_DRIVER)
+static const BootloaderFlashOpsTypeDef* flash_ops = &Bootloader_FlashOpsHal;
+#else
+static const BootloaderFlashOpsTypeDef* flash_ops = NULL;
+#endif
+
 /** Private variable for tracking flashing progress */
-static uint32_t flash_ptr = APP_ADDRESS;
+static uint32_t flash_ptr = UPDATE_ADDRESS;
+
+/** Buffer of Bootloader_FlashWrite(): data waiting to be programmed */
+static uint64_t flash_buf[FLASH_BUFFER_SIZE / 8];
+
+/** Number of bytes held in the buffer */
+static uint32_t flash_buf_len = 0;
+
+/** Fast programming is allowed in the current programming session */
+static uint8_t flash_fast = 0;
+
+/** A fast programming sequence is open (FSTPG bit is left set) */
+static uint8_t flash_fast_open = 0;
+
+/** The bank from ::FLASH_MASS_ERASE_PAGE has been mass erased by the last
+ * erase and neither page erased nor programmed by a finished session since:
+ * fast programming is accepted in it */
+static uint8_t flash_mass_erased = 0;
+
+/** Programming statistics of the current or last programming session */
+static BootloaderStatsTypeDef flash_stats;
+
+/** Tick value at the start of the programming session */
+static uint32_t flash_tick = 0;
+
+/** Checksum of the data programmed in the current programming session */
+static BootloaderCrcTypeDef flash_crc;
+
+#if(USE_SIGNATURE)
+/** Hash of the data programmed in the current programming session */
+static BootloaderSha512TypeDef flash_sha;
+
+/** Digest of the data programmed in the last programming session */
+static uint8_t flash_digest[SHA512_DIGEST_LENGTH];
+
+/** Signature state of the programmed data ::eFlashSignatureStates */
+static uint8_t flash_signature = FLASH_SIGNATURE_NONE;
+
+/** Double word holding the initial stack pointer of the programmed image,
+ * which is held back until the signature is verified */
+static uint64_t flash_vectors;
+
+/** Public key of the image signatures */
+static const uint8_t flash_key[SIGNATURE_KEY_LENGTH] = SIGNATURE_PUBLIC_KEY;
+#endif
+
+/** Snapshot of the flash protection, taken outside of the programming
+ * sessions */
+static BootloaderProtectionTypeDef flash_protection;
+
+/** The snapshot of the flash protection has been taken */
+static uint8_t flash_protection_valid = 0;
+
+#if(FLASH_ERASE_ON_DEMAND)
+/** Bitmap of the pages erased in the current programming session */
+static uint32_t flash_erased[(2 * FLASH_PAGE_NBPERBANK) / 32];
+#endif
+
+/* Private function prototypes -----------------------------------------------*/
+static uint8_t Bootloader_ProgramDoubleWord(uint64_t data);
+static uint8_t Bootloader_ProgramBuffer(uint8_t last);
+static uint8_t Bootloader_ProgramRow(const uint64_t* data,
+                                     uint32_t length,
+                                     uint8_t last);
+static uint8_t Bootloader_CheckProgrammed(const uint64_t* data,
+                                          uint32_t length);
+static void Bootloader_CloseFastProgramming(void);
+#if(USE_SIGNATURE)
+static void Bootloader_HoldVectors(uint64_t* data, uint32_t length);
+static uint8_t Bootloader_ReleaseVectors(void);
+#endif
+static uint8_t Bootloader_FlashUnlock(void);
+static uint8_t Bootloader_ErasePages(uint32_t page, uint32_t count);
+static uint8_t Bootloader_EraseSpace(uint32_t page, uint32_t count);
+static uint8_t Bootloader_PreparePage(uint32_t address);
+static void Bootloader_LoadProtection(void);
+static const BootloaderProtectionTypeDef* Bootloader_Protection(void);
+static uint8_t Bootloader_RangeOverlaps(const BootloaderRangeTypeDef* range,
+                                        uint32_t start,
+                                        uint32_t end);
+static uint8_t Bootloader_VerifyImage(uint32_t address);
+static uint8_t Bootloader_CountBoot(void);
+#if(USE_DUAL_BANK)
+static uint8_t Bootloader_SwitchBank(void);
+static uint8_t Bootloader_SetBootBank(uint8_t bank);
+static uint8_t Bootloader_CopyBootloader(void);
+#endif
 
 /**
- * @brief  This function initializes bootloader and flash.
+ * @brief  This function initializes bootloader and flash, and takes the
+ *         snapshot of the flash protection.
  * @return Bootloader error code ::eBootloaderErrorCodes
  * @retval BL_OK is returned in every case
  */
 uint8_t Bootloader_Init(void)
 {
-    __HAL_RCC_SYSCFG_CLK_ENABLE();
-    __HAL_RCC_FLASH_CLK_ENABLE();
+    flash_ops->init();
 
-    /* Clear flash flags */
-    HAL_FLASH_Unlock();
-    __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ALL_ERRORS);
-    HAL_FLASH_Lock();
+    Bootloader_LoadProtection();
 
     return BL_OK;
 }
 
 /**
- * @brief  This function erases the user application area in flash
+ * @brief  This function selects the flash backend performing the flash
+ *         operations (see flashops.h). The HAL backend is used by default,
+ *         host builds must select their backend before Bootloader_Init().
+ * @param  ops: pointer to the flash backend
+ */
+void Bootloader_SetFlashOps(const BootloaderFlashOpsTypeDef* ops)
+{
+    flash_ops = ops;
+}
+
+/**
+ * @brief  This function erases the user application area in flash (of the
+ *         inactive bank if ::USE_DUAL_BANK is enabled)
  * @return Bootloader error code ::eBootloaderErrorCodes
  * @retval BL_OK: upon success
- * @retval BL_ERR: upon failure
+ * @retval BL_ERASE_ERROR: if the area is protected, the flash cannot be
+ *         unlocked or a page cannot be erased
  */
 uint8_t Bootloader_Erase(void)
 {
     uint32_t NbrOfPages = 0;
-    uint32_t PageError  = 0;
-    FLASH_EraseInitTypeDef pEraseInit;
-    HAL_StatusTypeDef status = HAL_OK;
-
-    HAL_FLASH_Unlock();
+    uint8_t status      = BL_OK;
 
     /* Get the number of pages to erase */
-    NbrOfPages = (FLASH_BASE + FLASH_SIZE - APP_ADDRESS) / FLASH_PAGE_SIZE;
+    NbrOfPages = (FLASH_BASE + FLASH_SIZE - UPDATE_ADDRESS) / FLASH_PAGE_SIZE;
+
+    if((Bootloader_IsRangeWritable(UPDATE_ADDRESS,
+                                   NbrOfPages * FLASH_PAGE_SIZE) != BL_OK) ||
+       (Bootloader_FlashUnlock() != BL_OK))
+    {
+        return BL_ERASE_ERROR;
+    }
+
+    status =
+        Bootloader_EraseSpace(FLASH_PAGE_INDEX(UPDATE_ADDRESS), NbrOfPages);
+
+    flash_ops->lock();
+
+    return status;
+}
+
+/**
+ * @brief  This function erases only those pages of the application area that
+ *         are covered by the new application image. If ::USE_CHECKSUM is
+ *         enabled (without ::USE_IMAGE_HEADER), the page containing the
+ *         application checksum is erased as well. If the image reaches the
+ *         bank from ::FLASH_MASS_ERASE_PAGE, that bank is mass erased.
+ * @param  size: size of the new application image in bytes
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ * @retval BL_OK: upon success
+ * @retval BL_SIZE_ERROR: if the image does not fit into the application area
+ * @retval BL_ERASE_ERROR: if the pages are protected, the flash cannot be
+ *         unlocked or a page cannot be erased
+ */
+uint8_t Bootloader_EraseRange(uint32_t size)
+{
+    uint32_t first;
+    uint32_t last;
+    uint8_t status = BL_OK;
 
-    if(NbrOfPages > FLASH_PAGE_NBPERBANK)
+    if(Bootloader_CheckSize(size) != BL_OK)
     {
-        pEraseInit.Banks     = FLASH_BANK_1;
-        pEraseInit.NbPages   = NbrOfPages % FLASH_PAGE_NBPERBANK;
-        pEraseInit.Page      = FLASH_PAGE_NBPERBANK - pEraseInit.NbPages;
-        pEraseInit.TypeErase = FLASH_TYPEERASE_PAGES;
-        status               = HAL_FLASHEx_Erase(&pEraseInit, &PageError);
+        return BL_SIZE_ERROR;
+    }
+    if(size == 0)
+    {
+        return BL_OK;
+    }
+
+    /* Get the first and last page covered by the image */
+    first = FLASH_PAGE_INDEX(UPDATE_ADDRESS);
+    last  = FLASH_PAGE_INDEX(UPDATE_ADDRESS + size - 1);
 
-        NbrOfPages = FLASH_PAGE_NBPERBANK;
+    if((Bootloader_IsRangeWritable(UPDATE_ADDRESS, size) != BL_OK) ||
+       (Bootloader_FlashUnlock() != BL_OK))
+    {
+        return BL_ERASE_ERROR;
     }
 
-    if(status == HAL_OK)
+    status = Bootloader_EraseSpace(first, last - first + 1);
+
+#if(USE_CHECKSUM && !USE_IMAGE_HEADER)
+    /* The checksum is located at the end of the application area (unless
+     * its bank is mass erased) */
+    if((status == BL_OK) && !flash_mass_erased &&
+       (FLASH_PAGE_INDEX(UPDATE_CRC_ADDRESS) > last))
     {
-        pEraseInit.Banks     = FLASH_BANK_2;
-        pEraseInit.NbPages   = NbrOfPages;
-        pEraseInit.Page      = FLASH_PAGE_NBPERBANK - pEraseInit.NbPages;
-        pEraseInit.TypeErase = FLASH_TYPEERASE_PAGES;
-        status               = HAL_FLASHEx_Erase(&pEraseInit, &PageError);
+        status = Bootloader_ErasePages(FLASH_PAGE_INDEX(UPDATE_CRC_ADDRESS), 1);
     }
+#endif
 
-    HAL_FLASH_Lock();
+    flash_ops->lock();
 
-    return (status == HAL_OK) ? BL_OK : BL_ERASE_ERROR;
+    return status;
 }
 
 /**
  * @brief  Begin flash programming: this function unlocks the flash and sets
- *         the data pointer to the start of application flash area.
+ *         the data pointer to the start of application flash area (of the
+ *         inactive bank if ::USE_DUAL_BANK is enabled).
  * @see    README for futher information
  * @return Bootloader error code ::eBootloaderErrorCodes
- * @retval BL_OK is returned in every case
+ * @retval BL_OK: upon success
+ * @retval BL_WRITE_ERROR: if the flash cannot be unlocked
  */
 uint8_t Bootloader_FlashBegin(void)
 {
     /* Reset flash destination address */
-    flash_ptr = APP_ADDRESS;
+    flash_ptr = UPDATE_ADDRESS;
 
-    /* Unlock flash */
-    HAL_FLASH_Unlock();
+    /* Take the protection snapshot before the session if not taken yet */
+    Bootloader_Protection();
 
-    return BL_OK;
+    /* Reset buffer and statistics */
+    flash_buf_len   = 0;
+    flash_fast      = USE_FAST_PROGRAMMING;
+    flash_fast_open = 0;
+    memset(&flash_stats, 0, sizeof(flash_stats));
+    flash_tick = flash_ops->getTick();
+    Bootloader_CrcInit(&flash_crc);
+#if(USE_SIGNATURE)
+    Bootloader_Sha512Init(&flash_sha);
+    flash_signature = FLASH_SIGNATURE_OPEN;
+    flash_vectors   = 0xFFFFFFFFFFFFFFFF;
+#endif
+#if(FLASH_ERASE_ON_DEMAND)
+    memset(flash_erased, 0, sizeof(flash_erased));
+#endif
+
+    /* Unlock flash */
+    return (Bootloader_FlashUnlock() == BL_OK) ? BL_OK : BL_WRITE_ERROR;
 }
 
 /**
  * @brief  Program 64bit data into flash: this function writes an 8byte (64bit)
- *         data chunk into the flash and increments the data pointer.
+ *         data chunk into the flash and increments the data pointer. Data that
+ *         is buffered by Bootloader_FlashWrite() is programmed first.
  * @see    README for futher information
  * @param  data: 64bit data chunk to be written into flash
  * @return Bootloader error code ::eBootloaderErrorCodes
  * @retval BL_OK: upon success
  * @retval BL_WRITE_ERROR: upon failure
+ * @retval BL_VERIFY_ERROR: if the flash content does not match the data
  */
 uint8_t Bootloader_FlashNext(uint64_t data)
 {
-    if(!(flash_ptr <= (FLASH_BASE + FLASH_SIZE - 8)) ||
-       (flash_ptr < APP_ADDRESS))
-    {
-        HAL_FLASH_Lock();
-        return BL_WRITE_ERROR;
-    }
+    uint8_t status;
 
-    if(HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, flash_ptr, data) ==
-       HAL_OK)
+    if(flash_buf_len > 0)
     {
-        /* Check the written value */
-        if(*(uint64_t*)flash_ptr != data)
+        /* Buffered data can only be flushed in whole double words */
+        status =
+            (flash_buf_len % 8) ? BL_WRITE_ERROR : Bootloader_ProgramBuffer(0);
+        if(status != BL_OK)
         {
-            /* Flash content doesn't match source content */
-            HAL_FLASH_Lock();
-            return BL_WRITE_ERROR;
+            flash_ops->lock();
+            return status;
         }
-        /* Increment Flash destination address */
-        flash_ptr += 8;
     }
-    else
+
+    Bootloader_CrcUpdate(&flash_crc, (uint8_t*)&data, sizeof(data));
+#if(USE_SIGNATURE)
+    Bootloader_Sha512Update(&flash_sha, (uint8_t*)&data, sizeof(data));
+    Bootloader_HoldVectors(&data, sizeof(data));
+#endif
+    Bootloader_CloseFastProgramming();
+    return Bootloader_ProgramDoubleWord(data);
+}
+
+/**
+ * @brief  Program arbitrary amount of data into flash: this function buffers
+ *         the data into rows of 32 double words and programs every completed
+ *         row at once. The data chunks do not need to be aligned and their
+ *         length can be arbitrary. The last, incomplete row is programmed by
+ *         Bootloader_FlashEnd(). If ::USE_DIFF_UPDATE is enabled, complete
+ *         pages are buffered and pages matching the flash content are skipped.
+ * @see    README for futher information
+ * @param  data: pointer to the data to be written into flash
+ * @param  length: number of bytes to be written
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ * @retval BL_OK: upon success
+ * @retval BL_WRITE_ERROR: upon failure
+ * @retval BL_VERIFY_ERROR: if the flash content does not match the data
+ */
+uint8_t Bootloader_FlashWrite(const uint8_t* data, uint32_t length)
+{
+    uint32_t chunk;
+    uint8_t status;
+
+    while(length > 0)
     {
-        /* Error occurred while writing data into Flash */
-        HAL_FLASH_Lock();
-        return BL_WRITE_ERROR;
+        /* A full buffer is only programmed when more data arrives, so that the
+         * last row of the image can close the fast programming sequence. */
+        if((flash_buf_len > 0) &&
+           (((flash_ptr + flash_buf_len) % FLASH_BUFFER_SIZE) == 0))
+        {
+            status = Bootloader_ProgramBuffer(0);
+            if(status != BL_OK)
+            {
+                return status;
+            }
+        }
+
+        /* Fill the buffer up to the next row (or page) boundary */
+        chunk = FLASH_BUFFER_SIZE -
+                ((flash_ptr + flash_buf_len) % FLASH_BUFFER_SIZE);
+        if(chunk > length)
+        {
+            chunk = length;
+        }
+        memcpy((uint8_t*)flash_buf + flash_buf_len, data, chunk);
+        Bootloader_CrcUpdate(&flash_crc, data, chunk);
+#if(USE_SIGNATURE)
+        Bootloader_Sha512Update(&flash_sha, data, chunk);
+#endif
+
+        flash_buf_len += chunk;
+        data += chunk;
+        length -= chunk;
     }
 
     return BL_OK;
 }
 
 /**
- * @brief  Finish flash programming: this function finalizes the flash
- *         programming by locking the flash.
+ * @brief  Finish flash programming: this function programs the data left in
+ *         the buffer and finalizes the flash programming by locking the
+ *         flash. An incomplete double word at the end of the data is padded
+ *         with 0xFF bytes. The checksum of the programmed data is calculated
+ *         during programming and is returned by Bootloader_GetStats().
  * @see    README for futher information
  * @return Bootloader error code ::eBootloaderErrorCodes
- * @retval BL_OK is returned in every case
+ * @retval BL_OK: upon success
+ * @retval BL_WRITE_ERROR: if the remaining data could not be programmed
+ * @retval BL_VERIFY_ERROR: if the flash content does not match the data
  */
 uint8_t Bootloader_FlashEnd(void)
 {
+    uint8_t status = BL_OK;
+
+    if(flash_buf_len > 0)
+    {
+        /* Pad the last double word with erased flash value */
+        while(flash_buf_len % 8)
+        {
+            ((uint8_t*)flash_buf)[flash_buf_len++] = 0xFF;
+        }
+        status = Bootloader_ProgramBuffer(1);
+    }
+    Bootloader_CloseFastProgramming();
+
+    flash_stats.ticks = flash_ops->getTick() - flash_tick;
+    flash_stats.crc   = Bootloader_CrcFinal(&flash_crc);
+
+    /* The next session programs over this one: no fast programming */
+    flash_mass_erased = 0;
+#if(USE_SIGNATURE)
+    Bootloader_Sha512Final(&flash_sha, flash_digest);
+    flash_signature = FLASH_SIGNATURE_PENDING;
+#endif
+
     /* Lock flash */
-    HAL_FLASH_Lock();
+    flash_ops->lock();
+
+    return status;
+}
+
+/**
+ * @brief  This function returns the statistics of the current or the last
+ *         flash programming session.
+ * @param  stats: pointer to the structure to be filled
+ */
+void Bootloader_GetStats(BootloaderStatsTypeDef* stats)
+{
+    *stats = flash_stats;
 
+    if(stats->ticks > 0)
+    {
+        stats->rate =
+            (uint32_t)(((uint64_t)stats->bytes * 1000) / stats->ticks);
+    }
+}
+
+/**
+ * @brief  This function verifies the signature of the data programmed in the
+ *         last programming session: the SHA-512 digest calculated during
+ *         programming is checked against ::SIGNATURE_PUBLIC_KEY, the flash
+ *         content is not read again. The initial stack pointer of the image
+ *         is held back during programming, so the image is not launched
+ *         after a reset until it is programmed here, upon a valid signature.
+ *         If the signature is invalid, the application space is erased.
+ * @param  signature: Ed25519ph signature of the image (::SIGNATURE_LENGTH
+ *         bytes)
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ * @retval BL_OK: if the signature is valid
+ * @retval BL_SIGNATURE_ERROR: if the signature is invalid, no programming
+ *         session has been finished or ::USE_SIGNATURE is disabled
+ * @retval BL_WRITE_ERROR: if the initial stack pointer cannot be programmed
+ */
+uint8_t Bootloader_VerifySignature(const uint8_t* signature)
+{
+#if(USE_SIGNATURE)
+    if(flash_signature != FLASH_SIGNATURE_PENDING)
+    {
+        return (flash_signature == FLASH_SIGNATURE_OK) ? BL_OK
+                                                       : BL_SIGNATURE_ERROR;
+    }
+    if(Bootloader_SignatureVerify(flash_digest, signature, flash_key) != BL_OK)
+    {
+        Bootloader_Erase();
+        return BL_SIGNATURE_ERROR;
+    }
+    if(Bootloader_ReleaseVectors() != BL_OK)
+    {
+        return BL_WRITE_ERROR;
+    }
+    flash_signature = FLASH_SIGNATURE_OK;
     return BL_OK;
+#else
+    return BL_SIGNATURE_ERROR;
+#endif
 }
 
 /**
- * @brief  This function returns the protection status of flash.
- * @return Flash protection status ::eFlashProtectionTypes
+ * @brief  This function programs a double word at the current flash
+ *         destination address and checks the written value. The flash is
+ *         locked upon failure.
+ * @param  data: 64bit data chunk to be written into flash
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ * @retval BL_OK: upon success
+ * @retval BL_WRITE_ERROR: upon failure
+ * @retval BL_VERIFY_ERROR: if the flash content does not match the data
  */
-uint8_t Bootloader_GetProtectionStatus(void)
+static uint8_t Bootloader_ProgramDoubleWord(uint64_t data)
 {
-    FLASH_OBProgramInitTypeDef OBStruct = {0};
-    uint8_t protection                  = BL_PROTECTION_NONE;
+    if((flash_ptr < UPDATE_ADDRESS) ||
+       (Bootloader_IsRangeWritable(flash_ptr, 8) != BL_OK) ||
+       (Bootloader_PreparePage(flash_ptr) != BL_OK))
+    {
+        flash_ops->lock();
+        return BL_WRITE_ERROR;
+    }
 
-    HAL_FLASH_Unlock();
+    if(flash_ops->program(flash_ptr, data) != BL_OK)
+    {
+        /* Error occurred while writing data into Flash */
+        flash_ops->lock();
+        return BL_WRITE_ERROR;
+    }
 
-    /* Bank 1 */
-    OBStruct.PCROPConfig = FLASH_BANK_1;
-    OBStruct.WRPArea     = OB_WRPAREA_BANK1_AREAA;
-    HAL_FLASHEx_OBGetConfig(&OBStruct);
-    /* PCROP */
-    if(OBStruct.PCROPEndAddr > OBStruct.PCROPStartAddr)
+    /* Check the written value */
+    return Bootloader_CheckProgrammed(&data, 8);
+}
+
+/**
+ * @brief  This function programs the content of the buffer into flash row by
+ *         row. If ::USE_DIFF_UPDATE is enabled and the buffer matches the
+ *         flash content, programming is skipped.
+ * @param  last: the last row closes the fast programming sequence
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ * @retval BL_OK: upon success
+ * @retval BL_WRITE_ERROR: upon failure
+ * @retval BL_VERIFY_ERROR: if the flash content does not match the data
+ */
+static uint8_t Bootloader_ProgramBuffer(uint8_t last)
+{
+    uint32_t offset = 0;
+    uint32_t chunk;
+    uint8_t status;
+
+#if(USE_SIGNATURE)
+    Bootloader_HoldVectors(flash_buf, flash_buf_len);
+#endif
+#if(USE_DIFF_UPDATE)
+    if((flash_ptr >= UPDATE_ADDRESS) &&
+       (flash_ptr <= (FLASH_BASE + FLASH_SIZE - flash_buf_len)) &&
+       (memcmp((void*)flash_ptr, flash_buf, flash_buf_len) == 0))
     {
-        if(OBStruct.PCROPStartAddr >= APP_ADDRESS)
-        {
-            protection |= BL_PROTECTION_PCROP;
-        }
+        /* Flash content is identical: no need to erase and program */
+        flash_ptr += flash_buf_len;
+        flash_buf_len = 0;
+        flash_stats.skipped++;
+        return BL_OK;
     }
-    /* WRP Area_A */
-    if(OBStruct.WRPEndOffset > OBStruct.WRPStartOffset)
+#endif
+
+    while(offset < flash_buf_len)
     {
-        if((OBStruct.WRPStartOffset * FLASH_PAGE_SIZE + FLASH_BASE) >=
-           APP_ADDRESS)
+        /* Program up to the next row boundary */
+        chunk = FLASH_ROW_SIZE - (flash_ptr % FLASH_ROW_SIZE);
+        if(chunk > (flash_buf_len - offset))
         {
-            protection |= BL_PROTECTION_WRP;
+            chunk = flash_buf_len - offset;
         }
+
+        status = Bootloader_ProgramRow(
+            &flash_buf[offset / 8], chunk,
+            ((offset + chunk) < flash_buf_len) ? 0 : last);
+        if(status != BL_OK)
+        {
+            return status;
+        }
+        offset += chunk;
     }
+    flash_buf_len = 0;
+
+    return BL_OK;
+}
+
+/**
+ * @brief  This function programs a row (or a part of a row) into flash.
+ *         A complete and aligned row of a mass erased bank is programmed
+ *         with fast programming, otherwise the data is programmed double
+ *         word by double word.
+ * @param  data: pointer to the data to be programmed, aligned to 8 bytes
+ * @param  length: number of bytes to be programmed, multiple of 8
+ * @param  last: the row closes the fast programming sequence
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ * @retval BL_OK: upon success
+ * @retval BL_WRITE_ERROR: upon failure
+ * @retval BL_VERIFY_ERROR: if the flash content does not match the data
+ */
+static uint8_t Bootloader_ProgramRow(const uint64_t* data,
+                                     uint32_t length,
+                                     uint8_t last)
+{
+    uint8_t status = BL_OK;
+    uint32_t i;
 
-    OBStruct.WRPArea = OB_WRPAREA_BANK1_AREAB;
-    HAL_FLASHEx_OBGetConfig(&OBStruct);
-    /* WRP Area_B */
-    if(OBStruct.WRPEndOffset > OBStruct.WRPStartOffset)
+    if(flash_fast && flash_mass_erased && (length == FLASH_ROW_SIZE) &&
+       (FLASH_PAGE_INDEX(flash_ptr) >= FLASH_MASS_ERASE_PAGE) &&
+       (flash_ptr >= UPDATE_ADDRESS) &&
+       (Bootloader_IsRangeWritable(flash_ptr, FLASH_ROW_SIZE) == BL_OK))
     {
-        if((OBStruct.WRPStartOffset * FLASH_PAGE_SIZE + FLASH_BASE) >=
-           APP_ADDRESS)
+        if(Bootloader_PreparePage(flash_ptr) != BL_OK)
+        {
+            flash_ops->lock();
+            return BL_WRITE_ERROR;
+        }
+
+        if(flash_ops->programRow(flash_ptr, data, last) == BL_OK)
         {
-            protection |= BL_PROTECTION_WRP;
+            flash_fast_open = !last;
+
+            /* Check the written row */
+            return Bootloader_CheckProgrammed(data, FLASH_ROW_SIZE);
+        }
+
+        /* Fast programming is rejected: use double words from now on */
+        flash_fast      = 0;
+        flash_fast_open = 0;
+
+        for(i = 0; i < FLASH_ROW_NBDWORDS; i++)
+        {
+            if(((uint64_t*)flash_ptr)[i] != 0xFFFFFFFFFFFFFFFF)
+            {
+                /* Row is partially programmed, it cannot be recovered */
+                flash_ops->lock();
+                return BL_WRITE_ERROR;
+            }
         }
     }
 
-    /* Bank 2 */
-    OBStruct.PCROPConfig = FLASH_BANK_2;
-    OBStruct.WRPArea     = OB_WRPAREA_BANK2_AREAA;
-    HAL_FLASHEx_OBGetConfig(&OBStruct);
-    /* PCROP */
-    if(OBStruct.PCROPEndAddr > OBStruct.PCROPStartAddr)
+    Bootloader_CloseFastProgramming();
+    for(i = 0; (i < (length / 8)) && (status == BL_OK); i++)
+    {
+        status = Bootloader_ProgramDoubleWord(data[i]);
+    }
+
+    return status;
+}
+
+/**
+ * @brief  This function checks the data programmed at the current flash
+ *         destination address against its source and advances the
+ *         destination address. The flash content is verified while it is
+ *         programmed, so the source does not need to be read again. Upon
+ *         mismatch, the offset of the first differing byte is recorded in
+ *         the statistics and the flash is locked.
+ * @param  data: pointer to the source of the programmed data
+ * @param  length: number of programmed bytes
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ * @retval BL_OK: upon success
+ * @retval BL_VERIFY_ERROR: if the flash content does not match the source
+ */
+static uint8_t Bootloader_CheckProgrammed(const uint64_t* data, uint32_t length)
+{
+    const uint8_t* flash  = (const uint8_t*)flash_ptr;
+    const uint8_t* source = (const uint8_t*)data;
+    uint32_t i;
+
+    if(memcmp(flash, source, length) != 0)
     {
-        if(OBStruct.PCROPStartAddr >= APP_ADDRESS)
+        for(i = 0; flash[i] == source[i]; i++)
         {
-            protection |= BL_PROTECTION_PCROP;
         }
+        flash_stats.mismatch = (flash_ptr - UPDATE_ADDRESS) + i;
+
+        Bootloader_CloseFastProgramming();
+        flash_ops->lock();
+        return BL_VERIFY_ERROR;
+    }
+
+    /* Increment Flash destination address */
+    flash_ptr += length;
+    flash_stats.bytes += length;
+    return BL_OK;
+}
+
+/**
+ * @brief  This function closes an open fast programming sequence, so that
+ *         standard double word programming can be performed.
+ */
+static void Bootloader_CloseFastProgramming(void)
+{
+    if(flash_fast_open)
+    {
+        flash_ops->closeRow();
+        flash_fast_open = 0;
+    }
+}
+
+#if(USE_SIGNATURE)
+/**
+ * @brief  This function holds back the initial stack pointer of the image if
+ *         it is in the data to be programmed at the current flash
+ *         destination address: the double word is saved and replaced by the
+ *         erased flash value. Until Bootloader_ReleaseVectors() programs it,
+ *         Bootloader_CheckForApplication() fails, also after a reset. The
+ *         data must already be hashed.
+ * @param  data: pointer to the data to be programmed
+ * @param  length: number of bytes to be programmed, multiple of 8
+ */
+static void Bootloader_HoldVectors(uint64_t* data, uint32_t length)
+{
+    if((UPDATE_VECTORS >= flash_ptr) && (UPDATE_VECTORS < (flash_ptr + length)))
+    {
+        flash_vectors = data[(UPDATE_VECTORS - flash_ptr) / 8];
+        data[(UPDATE_VECTORS - flash_ptr) / 8] = 0xFFFFFFFFFFFFFFFF;
+    }
+}
+
+/**
+ * @brief  This function programs the initial stack pointer held back during
+ *         the last programming session.
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ * @retval BL_OK: upon success or if the image has no vector table
+ * @retval BL_WRITE_ERROR: upon failure
+ */
+static uint8_t Bootloader_ReleaseVectors(void)
+{
+    uint8_t status = BL_OK;
+
+    if(flash_vectors == 0xFFFFFFFFFFFFFFFF)
+    {
+        return BL_OK;
+    }
+    if(Bootloader_FlashUnlock() != BL_OK)
+    {
+        return BL_WRITE_ERROR;
+    }
+    if((flash_ops->program(UPDATE_VECTORS, flash_vectors) != BL_OK) ||
+       (*(uint64_t*)UPDATE_VECTORS != flash_vectors))
+    {
+        status = BL_WRITE_ERROR;
+    }
+    flash_ops->lock();
+
+    return status;
+}
+#endif
+
+/**
+ * @brief  This function unlocks the flash for modification. Every flash write
+ *         path of the bootloader unlocks the flash with this function, so that
+ *         the record of the verified image is invalidated (if
+ *         ::USE_VERIFY_CACHE is enabled).
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ */
+static uint8_t Bootloader_FlashUnlock(void)
+{
+#if(USE_VERIFY_CACHE)
+    Bootloader_CacheInvalidate();
+#endif
+    return flash_ops->unlock();
+}
+
+/**
+ * @brief  This function erases consecutive flash pages. The pages are numbered
+ *         continuously from the start of flash, the erase operation is split
+ *         between the banks accordingly. The pages are mapped to the physical
+ *         banks according to the active bank. The flash must be unlocked.
+ * @param  page: index of the first page to be erased
+ * @param  count: number of pages to be erased
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ * @retval BL_OK: upon success
+ * @retval BL_ERASE_ERROR: upon failure
+ */
+static uint8_t Bootloader_ErasePages(uint32_t page, uint32_t count)
+{
+    uint8_t status = BL_OK;
+    uint8_t active = Bootloader_GetActiveBank();
+    uint32_t first;
+    uint32_t nbpages;
+
+    if((page + count) > (2 * FLASH_PAGE_NBPERBANK))
+    {
+        return BL_ERASE_ERROR;
+    }
+    if((page + count) > FLASH_MASS_ERASE_PAGE)
+    {
+        /* A page erase ends the mass erased state of the bank */
+        flash_mass_erased = 0;
     }
-    /* WRP Area_A */
-    if(OBStruct.WRPEndOffset > OBStruct.WRPStartOffset)
+
+    while((count > 0) && (status == BL_OK))
     {
-        if((OBStruct.WRPStartOffset * FLASH_PAGE_SIZE + FLASH_BASE +
-            FLASH_PAGE_SIZE * FLASH_PAGE_NBPERBANK) >= APP_ADDRESS)
+        first = Bootloader_BankPage(page);
+
+        /* Do not cross the bank boundary */
+        nbpages = FLASH_PAGE_NBPERBANK - first;
+        if(nbpages > count)
         {
-            protection |= BL_PROTECTION_WRP;
+            nbpages = count;
         }
+
+        status = flash_ops->erase(Bootloader_BankOfPage(page, active), first,
+                                  nbpages);
+
+        page += nbpages;
+        count -= nbpages;
+    }
+
+    return status;
+}
+
+/**
+ * @brief  This function erases consecutive pages of the application space
+ *         being updated. The pages before ::FLASH_MASS_ERASE_PAGE are page
+ *         erased. The bank from ::FLASH_MASS_ERASE_PAGE is mass erased as a
+ *         whole if any of its pages is to be erased: it is faster than a
+ *         page erase of two pages already, and it allows fast programming.
+ *         The flash must be unlocked.
+ * @param  page: index of the first page to be erased
+ * @param  count: number of pages to be erased
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ * @retval BL_OK: upon success
+ * @retval BL_ERASE_ERROR: if the mass erased bank is protected or upon
+ *         failure
+ */
+static uint8_t Bootloader_EraseSpace(uint32_t page, uint32_t count)
+{
+    uint32_t nbpages = count;
+    uint8_t status   = BL_OK;
+
+    flash_mass_erased = 0;
+    if(((page + count) > FLASH_MASS_ERASE_PAGE) &&
+       (Bootloader_IsRangeWritable(
+            FLASH_BASE + (FLASH_MASS_ERASE_PAGE * FLASH_PAGE_SIZE),
+            (2 * FLASH_PAGE_NBPERBANK - FLASH_MASS_ERASE_PAGE) *
+                FLASH_PAGE_SIZE) != BL_OK))
+    {
+        return BL_ERASE_ERROR;
     }
 
-    OBStruct.WRPArea = OB_WRPAREA_BANK2_AREAB;
-    HAL_FLASHEx_OBGetConfig(&OBStruct);
-    /* WRP Area_B */
-    if(OBStruct.WRPEndOffset > OBStruct.WRPStartOffset)
+    if(page < FLASH_MASS_ERASE_PAGE)
     {
-        if((OBStruct.WRPStartOffset * FLASH_PAGE_SIZE + FLASH_BASE +
-            FLASH_PAGE_SIZE * FLASH_PAGE_NBPERBANK) >= APP_ADDRESS)
+        if(nbpages > (FLASH_MASS_ERASE_PAGE - page))
         {
-            protection |= BL_PROTECTION_WRP;
+            nbpages = FLASH_MASS_ERASE_PAGE - page;
         }
+        status = Bootloader_ErasePages(page, nbpages);
+        count -= nbpages;
     }
 
-    /* RDP */
-    if(OBStruct.RDPLevel != OB_RDP_LEVEL_0)
+    if((status == BL_OK) && (count > 0))
     {
-        protection |= BL_PROTECTION_RDP;
+        status            = flash_ops->eraseBank(Bootloader_BankOfPage(
+                       FLASH_MASS_ERASE_PAGE, Bootloader_GetActiveBank()));
+        flash_mass_erased = (status == BL_OK);
     }
 
-    HAL_FLASH_Lock();
-    return protection;
+    return status;
 }
 
 /**
- * @brief  This function configures the wirte protection of flash.
- * @param  protection: protection type ::eFlashProtectionTypes
+ * @brief  This function makes sure that the page containing the given address
+ *         can be programmed. If ::USE_LAZY_ERASE or ::USE_DIFF_UPDATE is
+ *         enabled, the page is erased upon the first write into it in the
+ *         current programming session. Otherwise the function does nothing.
+ * @param  address: flash address to be programmed
  * @return Bootloader error code ::eBootloaderErrorCodes
  * @retval BL_OK: upon success
- * @retval BL_OBP_ERROR: upon failure
+ * @retval BL_ERASE_ERROR: if the page could not be erased
  */
-uint8_t Bootloader_ConfigProtection(uint32_t protection)
+static uint8_t Bootloader_PreparePage(uint32_t address)
+{
+#if(FLASH_ERASE_ON_DEMAND)
+    uint32_t page = FLASH_PAGE_INDEX(address);
+
+    if(flash_erased[page / 32] & (1U << (page % 32)))
+    {
+        return BL_OK;
+    }
+
+    /* A page cannot be erased during a fast programming sequence */
+    Bootloader_CloseFastProgramming();
+    if(Bootloader_ErasePages(page, 1) != BL_OK)
+    {
+        return BL_ERASE_ERROR;
+    }
+
+    flash_erased[page / 32] |= (1U << (page % 32));
+    flash_stats.erased++;
+#else
+    (void)address;
+#endif
+    return BL_OK;
+}
+
+/**
+ * @brief  This function returns the protection status of the application
+ *         space from the snapshot of the flash protection.
+ * @return Flash protection status ::eFlashProtectionTypes
+ */
+uint8_t Bootloader_GetProtectionStatus(void)
+{
+    return Bootloader_Protection()->status;
+}
+
+/**
+ * @brief  This function returns the snapshot of the flash protection: the
+ *         WRP and PCROP ranges of both banks and the RDP level. The option
+ *         bytes are only decoded by Bootloader_Init(), after
+ *         Bootloader_ConfigProtection() and upon the first use of the
+ *         snapshot if Bootloader_Init() has not been called yet.
+ * @param  protection: pointer to the structure to be filled
+ */
+void Bootloader_GetProtection(BootloaderProtectionTypeDef* protection)
+{
+    *protection = *Bootloader_Protection();
+}
+
+/**
+ * @brief  This function checks whether a flash range can be erased and
+ *         programmed, i.e. it is inside the flash and it is not covered by a
+ *         WRP or PCROP area. The check is based on the snapshot of the flash
+ *         protection, the option bytes are not accessed.
+ * @param  address: start address of the range
+ * @param  length: length of the range in bytes
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ * @retval BL_OK: if the range is writable
+ * @retval BL_WRITE_ERROR: if the range is protected or out of flash
+ */
+uint8_t Bootloader_IsRangeWritable(uint32_t address, uint32_t length)
 {
-    FLASH_OBProgramInitTypeDef OBStruct = {0};
-    HAL_StatusTypeDef status            = HAL_ERROR;
+    const BootloaderProtectionTypeDef* protection = Bootloader_Protection();
+    const BootloaderRangeTypeDef* wrp             = &protection->wrp[0][0];
+    uint8_t i;
 
-    status = HAL_FLASH_Unlock();
-    status |= HAL_FLASH_OB_Unlock();
+    if((address < FLASH_BASE) || (address > (FLASH_BASE + FLASH_SIZE)) ||
+       (length > (FLASH_BASE + FLASH_SIZE - address)))
+    {
+        return BL_WRITE_ERROR;
+    }
 
-    /* Bank 1 */
-    OBStruct.WRPArea    = OB_WRPAREA_BANK1_AREAA;
-    OBStruct.OptionType = OPTIONBYTE_WRP;
-    if(protection & BL_PROTECTION_WRP)
+    for(i = 0; i < 4; i++)
     {
-        /* Enable WRP protection for application space */
-        OBStruct.WRPStartOffset = (APP_ADDRESS - FLASH_BASE) / FLASH_PAGE_SIZE;
-        OBStruct.WRPEndOffset   = FLASH_PAGE_NBPERBANK - 1;
+        if(Bootloader_RangeOverlaps(&wrp[i], address, address + length))
+        {
+            return BL_WRITE_ERROR;
+        }
     }
-    else
+    for(i = 0; i < 2; i++)
     {
-        /* Remove WRP protection */
-        OBStruct.WRPStartOffset = 0xFF;
-        OBStruct.WRPEndOffset   = 0x00;
+        if(Bootloader_RangeOverlaps(&protection->pcrop[i], address,
+                                    address + length))
+        {
+            return BL_WRITE_ERROR;
+        }
     }
-    status |= HAL_FLASHEx_OBProgram(&OBStruct);
 
-    /* Area B is not used */
-    OBStruct.WRPArea        = OB_WRPAREA_BANK1_AREAB;
-    OBStruct.OptionType     = OPTIONBYTE_WRP;
-    OBStruct.WRPStartOffset = 0xFF;
-    OBStruct.WRPEndOffset   = 0x00;
-    status |= HAL_FLASHEx_OBProgram(&OBStruct);
+    return BL_OK;
+}
+
+/**
+ * @brief  This function takes the snapshot of the flash protection: the option
+ *         bytes are decoded. It is only called outside of the programming
+ *         sessions, by Bootloader_Init(), Bootloader_ConfigProtection() and
+ *         Bootloader_Protection(), so the option bytes are never accessed
+ *         while the flash is programmed.
+ */
+static void Bootloader_LoadProtection(void)
+{
+    const BootloaderRangeTypeDef* wrp = &flash_protection.wrp[0][0];
+    uint8_t i;
+
+    flash_ops->readProtection(&flash_protection);
 
-    /* Bank 2 */
-    OBStruct.WRPArea    = OB_WRPAREA_BANK2_AREAA;
-    OBStruct.OptionType = OPTIONBYTE_WRP;
-    if(protection & BL_PROTECTION_WRP)
+    /* Protection of the application space */
+    flash_protection.status = BL_PROTECTION_NONE;
+    for(i = 0; i < 4; i++)
     {
-        /* Enable WRP protection for application space */
-        OBStruct.WRPStartOffset = 0x00;
-        OBStruct.WRPEndOffset   = FLASH_PAGE_NBPERBANK - 1;
+        if(Bootloader_RangeOverlaps(&wrp[i], APP_ADDRESS,
+                                    FLASH_BASE + FLASH_SIZE))
+        {
+            flash_protection.status |= BL_PROTECTION_WRP;
+        }
     }
-    else
+    for(i = 0; i < 2; i++)
+    {
+        if(Bootloader_RangeOverlaps(&flash_protection.pcrop[i], APP_ADDRESS,
+                                    FLASH_BASE + FLASH_SIZE))
+        {
+            flash_protection.status |= BL_PROTECTION_PCROP;
+        }
+    }
+    if(flash_protection.rdp != 0)
+    {
+        flash_protection.status |= BL_PROTECTION_RDP;
+    }
+    flash_protection_valid = 1;
+}
+
+/**
+ * @brief  This function returns the snapshot of the flash protection. If
+ *         Bootloader_Init() has not been called since startup, the snapshot
+ *         is taken upon its first use. Bootloader_FlashBegin() uses it before
+ *         unlocking the flash, so it is never taken during a programming
+ *         session.
+ * @return Pointer to the snapshot of the flash protection
+ */
+static const BootloaderProtectionTypeDef* Bootloader_Protection(void)
+{
+    if(!flash_protection_valid)
     {
-        /* Remove WRP protection */
-        OBStruct.WRPStartOffset = 0xFF;
-        OBStruct.WRPEndOffset   = 0x00;
+        Bootloader_LoadProtection();
     }
-    status |= HAL_FLASHEx_OBProgram(&OBStruct);
+    return &flash_protection;
+}
+
+/**
+ * @brief  This function checks whether a range of the flash protection
+ *         overlaps the range [start, end).
+ * @param  range: range of the flash protection
+ * @param  start: start address
+ * @param  end: address behind the last byte
+ * @return 1 if the ranges overlap, otherwise 0
+ */
+static uint8_t Bootloader_RangeOverlaps(const BootloaderRangeTypeDef* range,
+                                        uint32_t start,
+                                        uint32_t end)
+{
+    return (start < range->end) && (range->start < end);
+}
 
-    /* Area B is not used */
-    OBStruct.WRPArea        = OB_WRPAREA_BANK2_AREAB;
-    OBStruct.OptionType     = OPTIONBYTE_WRP;
-    OBStruct.WRPStartOffset = 0xFF;
-    OBStruct.WRPEndOffset   = 0x00;
-    status |= HAL_FLASHEx_OBProgram(&OBStruct);
+/**
+ * @brief  This function configures the wirte protection of flash. The
+ *         snapshot of the flash protection is taken again.
+ * @param  protection: protection type ::eFlashProtectionTypes
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ * @retval BL_OK: upon success
+ * @retval BL_OBP_ERROR: upon failure
+ */
+uint8_t Bootloader_ConfigProtection(uint32_t protection)
+{
+    uint8_t status = Bootloader_FlashUnlock();
 
-    if(status == HAL_OK)
+    if(status == BL_OK)
     {
-        /* Loading Flash Option Bytes - this generates a system reset. */
-        status |= HAL_FLASH_OB_Launch();
+        status = flash_ops->setProtection(protection);
     }
+    flash_ops->lock();
 
-    status |= HAL_FLASH_OB_Lock();
-    status |= HAL_FLASH_Lock();
+    /* The flash is locked: the option bytes can be decoded again */
+    Bootloader_LoadProtection();
 
-    return (status == HAL_OK) ? BL_OK : BL_OBP_ERROR;
+    return (status == BL_OK) ? BL_OK : BL_OBP_ERROR;
 }
 
 /**
@@ -337,93 +1073,415 @@ uint8_t Bootloader_ConfigProtection(uint32_t protection)
  */
 uint8_t Bootloader_CheckSize(uint32_t appsize)
 {
-    return ((FLASH_BASE + FLASH_SIZE - APP_ADDRESS) >= appsize) ? BL_OK
-                                                                : BL_SIZE_ERROR;
+    return (APP_SPACE_SIZE >= appsize) ? BL_OK : BL_SIZE_ERROR;
 }
 
 /**
  * @brief  This function verifies the checksum of application located in flash.
  *         If ::USE_CHECKSUM configuration parameter is disabled then the
  *         function always returns an error code.
+ *         If ::USE_IMAGE_HEADER is enabled, the checksum covers only the
+ *         application described by the image header.
+ *         If ::USE_VERIFY_CACHE is enabled, the checksum is only calculated if
+ *         the image has not been verified since the last flash modification.
  * @return Bootloader error code ::eBootloaderErrorCodes
  * @retval BL_OK: if calculated checksum matches the application checksum
- * @retval BL_CHKS_ERROR: upon checksum mismatch or when ::USE_CHECKSUM is
- *         disabled
+ * @retval BL_CHKS_ERROR: upon checksum mismatch, invalid image header or
+ *         when ::USE_CHECKSUM is disabled
  */
 uint8_t Bootloader_VerifyChecksum(void)
+{
+    return Bootloader_VerifyImage(APP_ADDRESS);
+}
+
+/**
+ * @brief  This function checks whether a valid application exists in flash.
+ *         The check is performed by checking the very first DWORD (4 bytes) of
+ *         the application firmware. In case of a valid application, this DWORD
+ *         must represent the initialization location of stack pointer - which
+ *         must be within the boundaries of RAM.
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ * @retval BL_OK: if first DWORD represents a valid stack pointer location
+ * @retval BL_NO_APP: first DWORD value is out of RAM boundaries
+ */
+uint8_t Bootloader_CheckForApplication(void)
+{
+    return (((*(uint32_t*)APP_VECTORS) - RAM_BASE) <= RAM_SIZE) ? BL_OK
+                                                                : BL_NO_APP;
+}
+
+/**
+ * @brief  This function returns the active bank, i.e. the bank mapped to the
+ *         start of flash, which the bootloader is running from.
+ * @return ::BANK_1 or ::BANK_2
+ */
+uint8_t Bootloader_GetActiveBank(void)
+{
+    return flash_ops->getActiveBank();
+}
+
+/**
+ * @brief  This function verifies the checksum of the programmed update: the
+ *         application of the inactive bank if ::USE_DUAL_BANK is enabled,
+ *         otherwise the application in flash (see Bootloader_VerifyChecksum).
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ * @retval BL_OK: if calculated checksum matches the application checksum
+ * @retval BL_CHKS_ERROR: upon checksum mismatch or invalid image header
+ */
+uint8_t Bootloader_VerifyUpdate(void)
+{
+    return Bootloader_VerifyImage(UPDATE_ADDRESS);
+}
+
+/**
+ * @brief  This function activates the update programmed into the inactive
+ *         bank: the update is verified, the bootloader is copied into the
+ *         inactive bank (if it differs), then the inactive bank is selected
+ *         for boot with the BFB2 option bit. Loading the option bytes
+ *         generates a system reset, so the function only returns upon
+ *         failure. If ::USE_DUAL_BANK is disabled, the update is already
+ *         active. If ::USE_ROLLBACK is enabled, the trial of the update is
+ *         started. If ::USE_SIGNATURE is enabled, the update must be
+ *         authenticated by Bootloader_VerifySignature() first: an update
+ *         programmed before a reset without being authenticated has no
+ *         initial stack pointer and is not activated either.
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ * @retval BL_OK: if ::USE_DUAL_BANK is disabled
+ * @retval BL_CHKS_ERROR: if the update is invalid
+ * @retval BL_WRITE_ERROR: if the bootloader cannot be copied
+ * @retval BL_OBP_ERROR: if the option bytes cannot be programmed
+ * @retval BL_SIGNATURE_ERROR: if the update is not authenticated
+ */
+uint8_t Bootloader_ActivateUpdate(void)
+{
+    uint8_t status = BL_OK;
+
+#if(USE_SIGNATURE)
+    if(!FLASH_AUTHENTICATED ||
+       (((*(uint32_t*)UPDATE_VECTORS) - RAM_BASE) > RAM_SIZE))
+    {
+        return BL_SIGNATURE_ERROR;
+    }
+#endif
+#if(USE_ROLLBACK)
+    Bootloader_RollbackStart();
+#endif
+#if(USE_DUAL_BANK)
+    status = Bootloader_SwitchBank();
+#if(USE_ROLLBACK)
+    /* The update is not activated: the running image stays confirmed */
+    Bootloader_ConfirmImage();
+#endif
+#endif
+    return status;
+}
+
+/**
+ * @brief  This function selects the bank to boot from on startup (see
+ *         Bootloader_BankDecide): the application of the active bank is
+ *         preferred. If it is invalid and the inactive bank holds a valid
+ *         application, the inactive bank is activated (system reset). If
+ *         ::USE_DUAL_BANK is disabled, only the application in flash is
+ *         checked. If ::USE_ROLLBACK is enabled, the boot is counted and an
+ *         unconfirmed image is reverted after ::ROLLBACK_MAX_ATTEMPTS boots
+ *         (see Bootloader_CountBoot).
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ * @retval BL_OK: if the application of the active bank can be launched
+ * @retval BL_NO_APP: if no valid application is found or the application
+ *         must not be launched anymore
+ */
+uint8_t Bootloader_SelectBank(void)
+{
+#if(USE_DUAL_BANK)
+    BootloaderBankStateTypeDef state;
+
+    state.active      = Bootloader_GetActiveBank();
+    state.boot        = flash_ops->getBootBank();
+    state.activeValid = (Bootloader_CheckForApplication() == BL_OK) &&
+                        (Bootloader_VerifyChecksum() == BL_OK);
+    state.inactiveValid =
+        !state.activeValid && (Bootloader_VerifyUpdate() == BL_OK);
+
+    switch(Bootloader_BankDecide(&state))
+    {
+        case BANK_BOOT:
+            return Bootloader_CountBoot();
+
+        case BANK_CONFIRM:
+#if(USE_ROLLBACK)
+            /* The update has not been booted: no trial is running */
+            Bootloader_ConfirmImage();
+#endif
+            /* Launch the application even if BFB2 cannot be programmed */
+            Bootloader_SetBootBank(state.active);
+            return BL_OK;
+
+        case BANK_SWITCH:
+#if(USE_ROLLBACK)
+            /* The image of the other bank has been running before */
+            Bootloader_ConfirmImage();
+#endif
+            Bootloader_SwitchBank();
+            return BL_NO_APP;
+
+        default:
+            return BL_NO_APP;
+    }
+#else
+    if(Bootloader_CheckForApplication() != BL_OK)
+    {
+        return BL_NO_APP;
+    }
+    return Bootloader_CountBoot();
+#endif
+}
+
+/**
+ * @brief  This function verifies the checksum of the application space
+ *         starting at the given address. The record of the verified image is
+ *         only cached for the active application space.
+ * @param  address: start of the application space (::APP_ADDRESS or
+ *         ::UPDATE_ADDRESS)
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ * @retval BL_OK: if calculated checksum matches the application checksum
+ * @retval BL_CHKS_ERROR: upon checksum mismatch, invalid image header or
+ *         when ::USE_CHECKSUM is disabled
+ */
+static uint8_t Bootloader_VerifyImage(uint32_t address)
 {
 #if(USE_CHECKSUM)
-    CRC_HandleTypeDef CrcHandle;
-    volatile uint32_t calculatedCrc = 0;
-
-    __HAL_RCC_CRC_CLK_ENABLE();
-    CrcHandle.Instance                     = CRC;
-    CrcHandle.Init.DefaultPolynomialUse    = DEFAULT_POLYNOMIAL_ENABLE;
-    CrcHandle.Init.DefaultInitValueUse     = DEFAULT_INIT_VALUE_ENABLE;
-    CrcHandle.Init.InputDataInversionMode  = CRC_INPUTDATA_INVERSION_NONE;
-    CrcHandle.Init.OutputDataInversionMode = CRC_OUTPUTDATA_INVERSION_DISABLE;
-    CrcHandle.InputDataFormat              = CRC_INPUTDATA_FORMAT_WORDS;
-    if(HAL_CRC_Init(&CrcHandle) != HAL_OK)
+    BootloaderCrcTypeDef crc;
+    uint8_t status = BL_CHKS_ERROR;
+    uint32_t size;
+    uint32_t checksum;
+#if(USE_IMAGE_HEADER)
+    BootloaderImageHeaderTypeDef header;
+
+    /* Only the application described by the header is verified: the
+     * parser makes sure that it fits into the application space */
+    if(Bootloader_ImageParse((uint8_t*)address, &header) != BL_OK)
     {
         return BL_CHKS_ERROR;
     }
+    size     = header.length;
+    checksum = header.crc;
+#else
+    size     = APP_SIZE * 4;
+    checksum = *(uint32_t*)(CRC_ADDRESS + (address - APP_ADDRESS));
+#endif
 
-    calculatedCrc =
-        HAL_CRC_Calculate(&CrcHandle, (uint32_t*)APP_ADDRESS, APP_SIZE);
+#if(USE_VERIFY_CACHE)
+    /* The image has been verified already and not modified since then */
+    if((address == APP_ADDRESS) &&
+       (Bootloader_CacheCheck(size, checksum) == BL_OK))
+    {
+        return BL_OK;
+    }
+#endif
+
+    Bootloader_CrcInit(&crc);
+    Bootloader_CrcUpdate(
+        &crc, (uint8_t*)(APP_VECTORS + (address - APP_ADDRESS)), size);
+
+    if(checksum == Bootloader_CrcFinal(&crc))
+    {
+#if(USE_VERIFY_CACHE)
+        if(address == APP_ADDRESS)
+        {
+            Bootloader_CacheStore(size, checksum);
+        }
+#endif
+        status = BL_OK;
+    }
 
     __HAL_RCC_CRC_FORCE_RESET();
     __HAL_RCC_CRC_RELEASE_RESET();
 
-    if((*(uint32_t*)CRC_ADDRESS) == calculatedCrc)
+    return status;
+#else
+    return BL_CHKS_ERROR;
+#endif
+}
+
+/**
+ * @brief  This function counts the boot of the application if
+ *         ::USE_ROLLBACK is enabled. After ::ROLLBACK_MAX_ATTEMPTS
+ *         unconfirmed boots the previous image of the other bank is
+ *         activated (system reset) if ::USE_DUAL_BANK is enabled and the
+ *         image is valid. Otherwise the application is not launched. The
+ *         previous image is only confirmed when it is booted: if it cannot be
+ *         activated, the revert is retried on the next boot.
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ * @retval BL_OK: if the application can be launched
+ * @retval BL_NO_APP: if the application must not be launched
+ */
+static uint8_t Bootloader_CountBoot(void)
+{
+#if(USE_ROLLBACK)
+    if(Bootloader_RollbackBoot(Bootloader_GetActiveBank()) != ROLLBACK_REVERT)
     {
         return BL_OK;
     }
+#if(USE_DUAL_BANK)
+    /* The previous image is the last known good one */
+    if(Bootloader_VerifyUpdate() == BL_OK)
+    {
+        Bootloader_RollbackRevert(
+            Bootloader_BankOther(Bootloader_GetActiveBank()));
+        Bootloader_SwitchBank();
+    }
+#endif
+    return BL_NO_APP;
+#else
+    return BL_OK;
 #endif
-    return BL_CHKS_ERROR;
 }
 
+#if(USE_DUAL_BANK)
 /**
- * @brief  This function checks whether a valid application exists in flash.
- *         The check is performed by checking the very first DWORD (4 bytes) of
- *         the application firmware. In case of a valid application, this DWORD
- *         must represent the initialization location of stack pointer - which
- *         must be within the boundaries of RAM.
+ * @brief  This function activates the application of the inactive bank: the
+ *         application is verified, the bootloader is copied into the
+ *         inactive bank (if it differs), then the inactive bank is selected
+ *         for boot. The function only returns upon failure.
  * @return Bootloader error code ::eBootloaderErrorCodes
- * @retval BL_OK: if first DWORD represents a valid stack pointer location
- * @retval BL_NO_APP: first DWORD value is out of RAM boundaries
+ * @retval BL_CHKS_ERROR: if the application is invalid
+ * @retval BL_WRITE_ERROR: if the bootloader cannot be copied
+ * @retval BL_OBP_ERROR: if the option bytes cannot be programmed
  */
-uint8_t Bootloader_CheckForApplication(void)
+static uint8_t Bootloader_SwitchBank(void)
 {
-    return (((*(uint32_t*)APP_ADDRESS) - RAM_BASE) <= RAM_SIZE) ? BL_OK
-                                                                : BL_NO_APP;
+    if(Bootloader_VerifyUpdate() != BL_OK)
+    {
+        return BL_CHKS_ERROR;
+    }
+    if(Bootloader_CopyBootloader() != BL_OK)
+    {
+        return BL_WRITE_ERROR;
+    }
+    return Bootloader_SetBootBank(
+        Bootloader_BankOther(Bootloader_GetActiveBank()));
+}
+
+/**
+ * @brief  This function selects the bank to boot from by programming the BFB2
+ *         option bit. Loading the option bytes generates a system reset.
+ * @param  bank: ::BANK_1 or ::BANK_2
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ * @retval BL_OBP_ERROR: upon failure
+ */
+static uint8_t Bootloader_SetBootBank(uint8_t bank)
+{
+    uint8_t status = Bootloader_FlashUnlock();
+
+    if(status == BL_OK)
+    {
+        status = flash_ops->setBootBank(bank);
+    }
+    flash_ops->lock();
+
+    return (status == BL_OK) ? BL_OK : BL_OBP_ERROR;
+}
+
+/**
+ * @brief  This function copies the bootloader (the flash area in front of the
+ *         application space) into the inactive bank, so that the inactive
+ *         bank is bootable. Nothing is written if the copy is up to date.
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ * @retval BL_OK: upon success
+ * @retval BL_ERASE_ERROR: upon erase failure
+ * @retval BL_WRITE_ERROR: if the copy is protected, the flash cannot be
+ *         unlocked or upon programming failure
+ */
+static uint8_t Bootloader_CopyBootloader(void)
+{
+    uint32_t addr;
+    uint64_t data;
+    uint8_t status = BL_OK;
+
+    if(memcmp((void*)FLASH_BASE, (void*)(FLASH_BASE + FLASH_BANK_OFFSET),
+              APP_ADDRESS - FLASH_BASE) == 0)
+    {
+        return BL_OK;
+    }
+
+    if((Bootloader_IsRangeWritable(FLASH_BASE + FLASH_BANK_OFFSET,
+                                   APP_ADDRESS - FLASH_BASE) != BL_OK) ||
+       (Bootloader_FlashUnlock() != BL_OK))
+    {
+        return BL_WRITE_ERROR;
+    }
+    if(Bootloader_ErasePages(FLASH_PAGE_INDEX(FLASH_BASE + FLASH_BANK_OFFSET),
+                             (APP_ADDRESS - FLASH_BASE) / FLASH_PAGE_SIZE) !=
+       BL_OK)
+    {
+        status = BL_ERASE_ERROR;
+    }
+
+    for(addr = FLASH_BASE; (addr < APP_ADDRESS) && (status == BL_OK); addr += 8)
+    {
+        data = *(uint64_t*)addr;
+        if(data == 0xFFFFFFFFFFFFFFFF)
+        {
+            /* Erased double words do not need to be programmed */
+            continue;
+        }
+        if((flash_ops->program(addr + FLASH_BANK_OFFSET, data) != BL_OK) ||
+           (*(uint64_t*)(addr + FLASH_BANK_OFFSET) != data))
+        {
+            status = BL_WRITE_ERROR;
+        }
+    }
+
+    flash_ops->lock();
+    return status;
 }
+#endif
 
 /**
  * @brief  This function performs the jump to the user application in flash.
  * @details The function carries out the following operations:
- *  - De-initialize the clock and peripheral configuration
+ *  - De-initialize the clock and peripheral configuration (if
+ *    ::USE_CLOCK_HANDOFF is enabled, only the peripherals are reset and the
+ *    clock configuration is published in the handoff block)
  *  - Stop the systick
  *  - Set the vector table location (if ::SET_VECTOR_TABLE is enabled)
  *  - Sets the stack pointer location
  *  - Perform the jump
+ *
+ * If ::USE_SIGNATURE is enabled and data has been programmed since startup
+ * without being authenticated by Bootloader_VerifySignature(), or the
+ * application has no initial stack pointer (held back by a programming
+ * session interrupted by a reset), the function returns without jumping.
  */
 void Bootloader_JumpToApplication(void)
 {
-    uint32_t JumpAddress = *(__IO uint32_t*)(APP_ADDRESS + 4);
+    uint32_t JumpAddress = *(__IO uint32_t*)(APP_VECTORS + 4);
     pFunction Jump       = (pFunction)JumpAddress;
 
+#if(USE_SIGNATURE)
+    if(!FLASH_AUTHENTICATED || (Bootloader_CheckForApplication() != BL_OK))
+    {
+        return;
+    }
+#endif
+
+#if(USE_CLOCK_HANDOFF)
+    /* Keep the clock configuration and publish it for the application */
+    Bootloader_HandoffPrepare();
+#else
     HAL_RCC_DeInit();
     HAL_DeInit();
+#endif
 
     SysTick->CTRL = 0;
     SysTick->LOAD = 0;
     SysTick->VAL  = 0;
 
 #if(SET_VECTOR_TABLE)
-    SCB->VTOR = APP_ADDRESS;
+    SCB->VTOR = APP_VECTORS;
 #endif
 
-    __set_MSP(*(__IO uint32_t*)APP_ADDRESS);
+    __set_MSP(*(__IO uint32_t*)APP_VECTORS);
     Jump();
 }
 
@@ -30,9 +30,113 @@
 /** Check application checksum on startup */
 #define USE_CHECKSUM 0
 
+/** Cache the result of the checksum verification (see imagecache.h): after a
+ * successful verification a record of the image is stored in RTC backup
+ * registers and the following boots skip the verification. Every flash write
+ * of the bootloader invalidates the record. Requires ::USE_CHECKSUM.
+ */
+#define USE_VERIFY_CACHE 0
+
 /** Enable write protection after performing in-app-programming */
 #define USE_WRITE_PROTECTION 0
 
+/** Use fast programming: full rows of 32 double words are programmed at once
+ * by Bootloader_FlashWrite(). The flash controller only accepts fast
+ * programming in a mass erased bank: it is used in the second half of the
+ * flash after Bootloader_Erase() or Bootloader_EraseRange() mass erased its
+ * bank (see ::FLASH_MASS_ERASE_PAGE), otherwise and if the flash controller
+ * rejects a row, the bootloader programs double words.
+ */
+#define USE_FAST_PROGRAMMING 1
+
+/** Flash erase and programming routines executed from RAM (see flashops.c):
+ * the CPU is not stalled by instruction fetches from the bank being erased or
+ * programmed. Requires the ".RamFunc" section to be placed in RAM by the
+ * linker script (GCC); IAR places __ramfunc functions in RAM.
+ */
+#define USE_FLASH_RAMFUNC 1
+
+/** Erase flash pages on demand during programming: every page of the
+ * application area is erased right before the first write into it. If
+ * enabled, the application area does not have to be erased before calling
+ * Bootloader_FlashBegin().
+ */
+#define USE_LAZY_ERASE 0
+
+/** Differential update: Bootloader_FlashWrite() compares every page of the
+ * new image with the flash content. Identical pages are left untouched, only
+ * the differing pages are erased and programmed. If enabled, the application
+ * area must not be erased before programming and the image must be programmed
+ * with Bootloader_FlashWrite(). The flash content beyond the end of the new
+ * image is not modified.
+ */
+#define USE_DIFF_UPDATE 0
+
+/** Delta update: the new image can be built from the installed image and a
+ * patch file on the SD card (see patch.h). The installed image must be kept on
+ * the SD card, as it is used as the base of the patch.
+ */
+#define USE_DELTA_PATCH 0
+
+/** Compressed images: the application image on the SD card can be compressed
+ * (see decompress.h). It is decompressed on the fly during programming.
+ */
+#define USE_COMPRESSION 0
+
+/** Image header: the application image starts with a header (see image.h)
+ * which holds the length and the checksum of the application. The checksum
+ * verification only covers the real image, and no checksum is stored at
+ * ::CRC_ADDRESS. The application must be linked to ::APP_VECTORS, i.e. behind
+ * the header area of ::IMAGE_HEADER_SIZE bytes.
+ */
+#define USE_IMAGE_HEADER 0
+
+/** Dual-bank (A/B) update (see bank.h): the application space is limited to
+ * the first half of the flash, and the bootloader and the application are
+ * kept in both banks. Updates are erased, programmed and verified in the
+ * inactive bank, while the running image is never modified. The update is
+ * activated by Bootloader_ActivateUpdate() through the BFB2 option bit.
+ * Requires ::USE_CHECKSUM.
+ */
+#define USE_DUAL_BANK 0
+
+/** Boot-attempt counter with automatic rollback (see rollback.h): an
+ * activated update is on trial until the application confirms it with
+ * Bootloader_ConfirmImage(). After ::ROLLBACK_MAX_ATTEMPTS unconfirmed boots
+ * Bootloader_SelectBank() reverts to the previous image of the other bank if
+ * ::USE_DUAL_BANK is enabled, otherwise the application is not launched
+ * anymore until a new update is activated.
+ */
+#define USE_ROLLBACK 0
+
+/** Authenticated images (see signature.h): the programmed data is hashed with
+ * SHA-512 during programming and Bootloader_VerifySignature() checks the
+ * Ed25519ph signature of the digest against ::SIGNATURE_PUBLIC_KEY. Until the
+ * signature of the last programming session is verified, the application is
+ * not launched and the update is not activated; its initial stack pointer is
+ * held back in RAM, so it is not launched after a reset either. An image with
+ * an invalid signature is erased.
+ */
+#define USE_SIGNATURE 0
+
+/** Fast boot (see fastboot.h): if neither the button is pressed nor an update
+ * is requested by the application, the application is launched right after
+ * reset, without clock configuration, SD card, UART and LED sequence.
+ */
+#define USE_FAST_BOOT 0
+
+/** Boot timeline (see timeline.h): the end of every boot phase is recorded
+ * with a timestamp of the DWT cycle counter into a ring buffer, which
+ * survives system resets and the jump into the application.
+ */
+#define USE_TIMELINE 0
+
+/** Clock-preserving handoff (see handoff.h): the clock configuration is not
+ * reset before the jump to the application, but published in a handoff block,
+ * so the application can skip its own clock configuration.
+ */
+#define USE_CLOCK_HANDOFF 0
+
 /** Automatically set vector table location before launching application */
 #define SET_VECTOR_TABLE 1
 
@@ -48,10 +152,19 @@
 #define APP_ADDRESS (uint32_t)0x08008000
 
 /** End address of application space (address of last byte) */
+#if(USE_DUAL_BANK)
+#define END_ADDRESS (uint32_t)0x0807FFFB
+#else
 #define END_ADDRESS (uint32_t)0x080FFFFB
+#endif
 
-/** Start address of application checksum in flash */
+/** Start address of application checksum in flash (unless ::USE_IMAGE_HEADER
+ * is enabled) */
+#if(USE_DUAL_BANK)
+#define CRC_ADDRESS (uint32_t)0x0807FFFC
+#else
 #define CRC_ADDRESS (uint32_t)0x080FFFFC
+#endif
 
 /** Address of System Memory (ST Bootloader) */
 #define SYSMEM_ADDRESS (uint32_t)0x1FFF0000
@@ -66,13 +179,61 @@
 #error "Target MCU header file is not defined or unsupported."
 #endif
 
+#if(USE_DUAL_BANK && !USE_CHECKSUM)
+#error "USE_DUAL_BANK requires USE_CHECKSUM."
+#endif
+
 /* Defines -------------------------------------------------------------------*/
 /** Size of application in DWORD (32bits or 4bytes) */
 #define APP_SIZE (uint32_t)(((END_ADDRESS - APP_ADDRESS) + 3) / 4)
 
+/** Size of the image header area in bytes: the vector table of the
+ * application follows it, so it has to meet the alignment of the vector table
+ */
+#define IMAGE_HEADER_SIZE (0x200)
+
+/** Address of the vector table of the application */
+#if(USE_IMAGE_HEADER)
+#define APP_VECTORS (APP_ADDRESS + IMAGE_HEADER_SIZE)
+#else
+#define APP_VECTORS APP_ADDRESS
+#endif
+
 /** Number of pages per bank in flash */
 #define FLASH_PAGE_NBPERBANK (256)
 
+/** Distance of the two banks in the memory map in bytes */
+#define FLASH_BANK_OFFSET (uint32_t)(FLASH_PAGE_NBPERBANK * 0x800)
+
+/** Size of the application space in bytes: limited to the first bank if
+ * ::USE_DUAL_BANK is enabled */
+#if(USE_DUAL_BANK)
+#define APP_SPACE_SIZE (FLASH_BASE + FLASH_BANK_OFFSET - APP_ADDRESS)
+#else
+#define APP_SPACE_SIZE (FLASH_BASE + FLASH_SIZE - APP_ADDRESS)
+#endif
+
+/** Start address of the application space being updated: the application
+ * space of the inactive bank if ::USE_DUAL_BANK is enabled */
+#if(USE_DUAL_BANK)
+#define UPDATE_ADDRESS (APP_ADDRESS + FLASH_BANK_OFFSET)
+#else
+#define UPDATE_ADDRESS APP_ADDRESS
+#endif
+
+/** Index of the first page of the bank which is mass erased by
+ * Bootloader_Erase() and Bootloader_EraseRange(): the second half of the
+ * flash only holds application space being updated (the copy of the
+ * bootloader in the inactive bank is restored by Bootloader_ActivateUpdate()
+ * if ::USE_DUAL_BANK is enabled) */
+#define FLASH_MASS_ERASE_PAGE FLASH_PAGE_NBPERBANK
+
+/** Number of double words in a flash row (unit of fast programming) */
+#define FLASH_ROW_NBDWORDS (32)
+
+/** Size of a flash row in bytes */
+#define FLASH_ROW_SIZE (FLASH_ROW_NBDWORDS * 8)
+
 /* MCU RAM information (to check whether flash contains valid application) */
 #define RAM_BASE SRAM1_BASE     /*!< Start address of RAM */
 #define RAM_SIZE SRAM1_SIZE_MAX /*!< RAM size in bytes */
@@ -81,13 +242,18 @@
 /** Bootloader error codes */
 enum eBootloaderErrorCodes
 {
-    BL_OK = 0,      /*!< No error */
-    BL_NO_APP,      /*!< No application found in flash */
-    BL_SIZE_ERROR,  /*!< New application is too large for flash */
-    BL_CHKS_ERROR,  /*!< Application checksum error */
-    BL_ERASE_ERROR, /*!< Flash erase error */
-    BL_WRITE_ERROR, /*!< Flash write error */
-    BL_OBP_ERROR    /*!< Flash option bytes programming error */
+    BL_OK = 0,           /*!< No error */
+    BL_NO_APP,           /*!< No application found in flash */
+    BL_SIZE_ERROR,       /*!< New application is too large for flash */
+    BL_CHKS_ERROR,       /*!< Application checksum error */
+    BL_ERASE_ERROR,      /*!< Flash erase error */
+    BL_WRITE_ERROR,      /*!< Flash write error */
+    BL_OBP_ERROR,        /*!< Flash option bytes programming error */
+    BL_PATCH_ERROR,      /*!< Invalid delta patch */
+    BL_DECOMPRESS_ERROR, /*!< Invalid compressed image */
+    BL_HEADER_ERROR,     /*!< Invalid image header */
+    BL_SIGNATURE_ERROR,  /*!< Invalid or missing image signature */
+    BL_VERIFY_ERROR      /*!< Programmed data does not match the source */
 };
 
 /** Flash Protection Types */
@@ -99,20 +265,63 @@ enum eFlashProtectionTypes
     BL_PROTECTION_PCROP = 0x4, /*!< Flash propietary code readout protection */
 };
 
+/* Typedefs ------------------------------------------------------------------*/
+/** Flash programming statistics */
+typedef struct
+{
+    uint32_t bytes;    /*!< Number of bytes programmed into flash */
+    uint32_t erased;   /*!< Number of pages erased (rewritten) on demand */
+    uint32_t skipped;  /*!< Number of identical pages skipped */
+    uint32_t ticks;    /*!< Duration of programming in milliseconds */
+    uint32_t rate;     /*!< Achieved programming throughput in bytes/s */
+    uint32_t crc;      /*!< Checksum of the programmed data */
+    uint32_t mismatch; /*!< Offset of the first byte which does not match the
+                          source (upon ::BL_VERIFY_ERROR) */
+} BootloaderStatsTypeDef;
+
+/** Flash address range [start, end) of the memory map, {0, 0} if empty */
+typedef struct
+{
+    uint32_t start; /*!< Address of the first byte */
+    uint32_t end;   /*!< Address behind the last byte */
+} BootloaderRangeTypeDef;
+
+/** Snapshot of the flash protection decoded from the option bytes */
+typedef struct
+{
+    BootloaderRangeTypeDef wrp[2][2]; /*!< WRP areas A and B of bank 1 and 2 */
+    BootloaderRangeTypeDef pcrop[2];  /*!< PCROP areas of bank 1 and 2 */
+    uint8_t rdp;                      /*!< RDP level: 0, 1 or 2 */
+    uint8_t status;                   /*!< Protection of the application space
+                                         ::eFlashProtectionTypes */
+} BootloaderProtectionTypeDef;
+
 /* Functions -----------------------------------------------------------------*/
 uint8_t Bootloader_Init(void);
 uint8_t Bootloader_Erase(void);
+uint8_t Bootloader_EraseRange(uint32_t size);
 
 uint8_t Bootloader_FlashBegin(void);
 uint8_t Bootloader_FlashNext(uint64_t data);
+uint8_t Bootloader_FlashWrite(const uint8_t* data, uint32_t length);
 uint8_t Bootloader_FlashEnd(void);
+void Bootloader_GetStats(BootloaderStatsTypeDef* stats);
+uint8_t Bootloader_VerifySignature(const uint8_t* signature);
 
 uint8_t Bootloader_GetProtectionStatus(void);
+void Bootloader_GetProtection(BootloaderProtectionTypeDef* protection);
+uint8_t Bootloader_IsRangeWritable(uint32_t address, uint32_t length);
 uint8_t Bootloader_ConfigProtection(uint32_t protection);
 
 uint8_t Bootloader_CheckSize(uint32_t appsize);
 uint8_t Bootloader_VerifyChecksum(void);
 uint8_t Bootloader_CheckForApplication(void);
+
+uint8_t Bootloader_GetActiveBank(void);
+uint8_t Bootloader_VerifyUpdate(void);
+uint8_t Bootloader_ActivateUpdate(void);
+uint8_t Bootloader_SelectBank(void);
+
 void Bootloader_JumpToApplication(void);
 void Bootloader_JumpToSysMem(void);
 
@@ -0,0 +1,192 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader Checksum Source
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   crc.c
+ * @brief  This file contains the streaming checksum calculation. The data can
+ *	       be passed in chunks of arbitrary length and alignment. The result
+ *	       equals to the checksum of the CRC peripheral with default settings
+ *	       (CRC32, initial value 0xFFFFFFFF, MSB first, data processed as
+ *	       little-endian 32-bit words). An incomplete last word is padded
+ *	       with 0xFF bytes, i.e. with the content of the erased flash.
+ *
+ *	       The CRC peripheral is used if the HAL CRC module is enabled,
+ *	       otherwise the checksum is calculated by software (e.g. on host).
+ *
+ * @see    Please refer to README for detailed information.
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "crc.h"
+#include "bootloader.h"
+#include <string.h>
+
+/* Private defines -----------------------------------------------------------*/
+#if defined(HAL_CRC_MODULE_ENABLED)
+/** Checksum is calculated by the CRC peripheral */
+#define CRC_USE_HARDWARE 1
+#else
+/** Checksum is calculated by software */
+#define CRC_USE_HARDWARE 0
+#endif
+
+/** Number of words copied at once when the data is not aligned */
+#define CRC_CHUNK_WORDS 16
+
+/* Private variables ---------------------------------------------------------*/
+#if(CRC_USE_HARDWARE)
+/** Handle of the CRC peripheral */
+static CRC_HandleTypeDef CrcHandle;
+#else
+/** Nibble table of the CRC32 polynomial (0x04C11DB7) */
+static const uint32_t CrcTable[16] = {
+    0x00000000, 0x04C11DB7, 0x09823B6E, 0x0D4326D9, 0x130476DC, 0x17C56B6B,
+    0x1A864DB2, 0x1E475005, 0x2608EDB8, 0x22C9F00F, 0x2F8AD6D6, 0x2B4BCB61,
+    0x350C9B64, 0x31CD86D3, 0x3C8EA00A, 0x384FBDBD};
+#endif
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t Bootloader_CrcWords(uint32_t crc,
+                                    const uint8_t* data,
+                                    uint32_t count);
+
+/**
+ * @brief  This function initializes the checksum context. If the CRC
+ *         peripheral is used, it is initialized as well.
+ * @param  crc: pointer to the checksum context
+ */
+void Bootloader_CrcInit(BootloaderCrcTypeDef* crc)
+{
+    crc->crc    = 0xFFFFFFFF;
+    crc->length = 0;
+
+#if(CRC_USE_HARDWARE)
+    __HAL_RCC_CRC_CLK_ENABLE();
+    CrcHandle.Instance                     = CRC;
+    CrcHandle.Init.DefaultPolynomialUse    = DEFAULT_POLYNOMIAL_ENABLE;
+    CrcHandle.Init.DefaultInitValueUse     = DEFAULT_INIT_VALUE_ENABLE;
+    CrcHandle.Init.InputDataInversionMode  = CRC_INPUTDATA_INVERSION_NONE;
+    CrcHandle.Init.OutputDataInversionMode = CRC_OUTPUTDATA_INVERSION_DISABLE;
+    CrcHandle.InputDataFormat              = CRC_INPUTDATA_FORMAT_WORDS;
+    HAL_CRC_Init(&CrcHandle);
+#endif
+}
+
+/**
+ * @brief  This function feeds data into the checksum.
+ * @param  crc: pointer to the checksum context
+ * @param  data: pointer to the data
+ * @param  length: length of the data in bytes
+ */
+void Bootloader_CrcUpdate(BootloaderCrcTypeDef* crc,
+                          const uint8_t* data,
+                          uint32_t length)
+{
+    uint32_t count;
+
+    /* Complete the word left over from the previous call */
+    while((crc->length > 0) && (length > 0))
+    {
+        crc->word[crc->length++] = *data++;
+        length--;
+        if(crc->length == 4)
+        {
+            crc->crc    = Bootloader_CrcWords(crc->crc, crc->word, 1);
+            crc->length = 0;
+        }
+    }
+    if(crc->length > 0)
+    {
+        /* The word is still incomplete: all data is consumed */
+        return;
+    }
+
+    /* Complete words */
+    count = length / 4;
+    if(count > 0)
+    {
+        crc->crc = Bootloader_CrcWords(crc->crc, data, count);
+        data += count * 4;
+        length -= count * 4;
+    }
+
+    /* Keep the remaining bytes for the next call */
+    memcpy(crc->word, data, length);
+    crc->length = (uint8_t)length;
+}
+
+/**
+ * @brief  This function returns the checksum of the data fed so far. The
+ *         context is not modified, so more data can be fed afterwards.
+ * @param  crc: pointer to the checksum context
+ * @return Checksum
+ */
+uint32_t Bootloader_CrcFinal(const BootloaderCrcTypeDef* crc)
+{
+    uint8_t word[4] = {0xFF, 0xFF, 0xFF, 0xFF};
+
+    if(crc->length == 0)
+    {
+        return crc->crc;
+    }
+
+    /* Incomplete last word is padded with 0xFF */
+    memcpy(word, crc->word, crc->length);
+    return Bootloader_CrcWords(crc->crc, word, 1);
+}
+
+/**
+ * @brief  This function calculates the checksum of complete words.
+ * @param  crc: checksum of the preceding data
+ * @param  data: pointer to the words, no alignment is required
+ * @param  count: number of words
+ * @return Updated checksum
+ */
+static uint32_t Bootloader_CrcWords(uint32_t crc,
+                                    const uint8_t* data,
+                                    uint32_t count)
+{
+#if(CRC_USE_HARDWARE)
+    uint32_t buffer[CRC_CHUNK_WORDS];
+    uint32_t chunk;
+
+    /* Continue from the checksum of the context: contexts can be
+     * interleaved, and other users of the peripheral do not interfere */
+    CrcHandle.Instance->INIT = crc;
+    __HAL_CRC_DR_RESET(&CrcHandle);
+
+    if(((uint32_t)data % 4) == 0)
+    {
+        return HAL_CRC_Accumulate(&CrcHandle, (uint32_t*)data, count);
+    }
+
+    while(count > 0)
+    {
+        chunk = (count < CRC_CHUNK_WORDS) ? count : CRC_CHUNK_WORDS;
+        memcpy(buffer, data, chunk * 4);
+        crc = HAL_CRC_Accumulate(&CrcHandle, buffer, chunk);
+        data += chunk * 4;
+        count -= chunk;
+    }
+    return crc;
+#else
+    uint8_t i;
+
+    while(count > 0)
+    {
+        crc ^= (uint32_t)data[0] | ((uint32_t)data[1] << 8) |
+               ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+        for(i = 0; i < 8; i++)
+        {
+            crc = (crc << 4) ^ CrcTable[crc >> 28];
+        }
+        data += 4;
+        count--;
+    }
+    return crc;
+#endif
+}
@@ -0,0 +1,38 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader Checksum Header
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   crc.h
+ * @brief  This file contains the definitions and function prototypes of the
+ *	       streaming checksum calculation.
+ *
+ * @see    Please refer to README for detailed information.
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+#ifndef __CRC_H
+#define __CRC_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Typedefs ------------------------------------------------------------------*/
+/** Streaming checksum context */
+typedef struct
+{
+    uint32_t crc;    /*!< Checksum of the complete words */
+    uint8_t word[4]; /*!< Bytes of the incomplete word */
+    uint8_t length;  /*!< Number of bytes in word */
+} BootloaderCrcTypeDef;
+
+/* Functions -----------------------------------------------------------------*/
+void Bootloader_CrcInit(BootloaderCrcTypeDef* crc);
+void Bootloader_CrcUpdate(BootloaderCrcTypeDef* crc,
+                          const uint8_t* data,
+                          uint32_t length);
+uint32_t Bootloader_CrcFinal(const BootloaderCrcTypeDef* crc);
+
+#endif /* __CRC_H */
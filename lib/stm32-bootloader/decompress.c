@@ -0,0 +1,268 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader Decompression Source
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   decompress.c
+ * @brief  This file contains the streaming decompressor of compressed
+ *	       application images. The compressed data can be passed in chunks
+ *	       of arbitrary length, the decompressed image is passed to a write
+ *	       callback (e.g. Bootloader_FlashWrite()).
+ *
+ *	       Compressed image format:
+ *	        - Header (12 bytes, little-endian): magic, version (8 bit),
+ *	          window size W (8 bit), count size L (8 bit), reserved (8 bit),
+ *	          size of the decompressed image.
+ *	        - LZSS bitstream, compatible with heatshrink: bits are read MSB
+ *	          first. Tag bit 1 is followed by an 8-bit literal, tag bit 0 is
+ *	          followed by a back-reference of W bits (offset - 1) and L bits
+ *	          (count - 1). The last byte is padded with zero bits.
+ *
+ * @see    Please refer to README for detailed information.
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "decompress.h"
+#include "bootloader.h"
+#include <string.h>
+
+/* Private defines -----------------------------------------------------------*/
+#define DECOMPRESS_STATE_HEADER  0 /*!< Collecting the header */
+#define DECOMPRESS_STATE_TAG     1 /*!< Reading a tag bit */
+#define DECOMPRESS_STATE_LITERAL 2 /*!< Reading a literal */
+#define DECOMPRESS_STATE_BACKREF 3 /*!< Reading a back-reference */
+#define DECOMPRESS_STATE_DONE    4 /*!< Image is complete */
+#define DECOMPRESS_STATE_ERROR   5 /*!< Invalid stream or write error */
+
+/* Private function prototypes -----------------------------------------------*/
+static uint8_t Bootloader_DecompressHeader(BootloaderDecompressTypeDef* decomp);
+static uint8_t Bootloader_DecompressBits(BootloaderDecompressTypeDef* decomp);
+static uint8_t Bootloader_DecompressOutput(BootloaderDecompressTypeDef* decomp,
+                                           uint8_t data);
+
+/**
+ * @brief  This function initializes the decompressor context.
+ * @param  decomp: pointer to the decompressor context
+ * @param  write: callback writing the decompressed image
+ */
+void Bootloader_DecompressInit(BootloaderDecompressTypeDef* decomp,
+                               pDecompressWrite write)
+{
+    decomp->Write        = write;
+    decomp->size         = 0;
+    decomp->state        = DECOMPRESS_STATE_HEADER;
+    decomp->headerLength = 0;
+    decomp->bits         = 0;
+    decomp->bitCount     = 0;
+    decomp->written      = 0;
+    decomp->head         = 0;
+    decomp->outLength    = 0;
+}
+
+/**
+ * @brief  This function processes the next chunk of the compressed image.
+ *         Chunks can be of arbitrary length.
+ * @param  decomp: pointer to the decompressor context
+ * @param  data: pointer to the compressed data
+ * @param  length: length of the data in bytes
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ * @retval BL_OK: upon success
+ * @retval BL_DECOMPRESS_ERROR: if the compressed image is invalid
+ * @retval Error code of the write callback upon failure
+ */
+uint8_t Bootloader_DecompressWrite(BootloaderDecompressTypeDef* decomp,
+                                   const uint8_t* data,
+                                   uint32_t length)
+{
+    uint8_t status = BL_OK;
+    uint32_t size;
+
+    while((length > 0) && (status == BL_OK))
+    {
+        switch(decomp->state)
+        {
+            case DECOMPRESS_STATE_HEADER:
+                size = DECOMPRESS_HEADER_SIZE - decomp->headerLength;
+                size = (length < size) ? length : size;
+                memcpy(&decomp->header[decomp->headerLength], data, size);
+                decomp->headerLength += size;
+                if(decomp->headerLength == DECOMPRESS_HEADER_SIZE)
+                {
+                    status = Bootloader_DecompressHeader(decomp);
+                }
+                break;
+
+            case DECOMPRESS_STATE_TAG:
+            case DECOMPRESS_STATE_LITERAL:
+            case DECOMPRESS_STATE_BACKREF:
+                /* Feed the bitstream byte by byte */
+                size         = 1;
+                decomp->bits = (decomp->bits << 8) | *data;
+                decomp->bitCount += 8;
+                status = Bootloader_DecompressBits(decomp);
+                break;
+
+            default:
+                /* Trailing data or previous error */
+                status = BL_DECOMPRESS_ERROR;
+                size   = 0;
+                break;
+        }
+
+        data += size;
+        length -= size;
+    }
+
+    if(status != BL_OK)
+    {
+        decomp->state = DECOMPRESS_STATE_ERROR;
+    }
+    return status;
+}
+
+/**
+ * @brief  This function finishes the decompression.
+ * @param  decomp: pointer to the decompressor context
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ * @retval BL_OK: if the decompressed image is complete
+ * @retval BL_DECOMPRESS_ERROR: otherwise
+ */
+uint8_t Bootloader_DecompressEnd(BootloaderDecompressTypeDef* decomp)
+{
+    return (decomp->state == DECOMPRESS_STATE_DONE) ? BL_OK
+                                                    : BL_DECOMPRESS_ERROR;
+}
+
+/**
+ * @brief  This function parses and validates the collected header.
+ * @param  decomp: pointer to the decompressor context
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ */
+static uint8_t Bootloader_DecompressHeader(BootloaderDecompressTypeDef* decomp)
+{
+    const uint8_t* h = decomp->header;
+    uint32_t magic;
+
+    magic = (uint32_t)h[0] | ((uint32_t)h[1] << 8) | ((uint32_t)h[2] << 16) |
+            ((uint32_t)h[3] << 24);
+    decomp->windowBits = h[5];
+    decomp->countBits  = h[6];
+    decomp->size       = (uint32_t)h[8] | ((uint32_t)h[9] << 8) |
+                   ((uint32_t)h[10] << 16) | ((uint32_t)h[11] << 24);
+
+    if((magic != DECOMPRESS_MAGIC) || (h[4] != DECOMPRESS_VERSION) ||
+       (decomp->windowBits < 4) ||
+       (decomp->windowBits > DECOMPRESS_WINDOW_BITS) ||
+       (decomp->countBits < 3) || (decomp->countBits >= decomp->windowBits) ||
+       (decomp->size == 0))
+    {
+        return BL_DECOMPRESS_ERROR;
+    }
+
+    decomp->state = DECOMPRESS_STATE_TAG;
+    return BL_OK;
+}
+
+/**
+ * @brief  This function decodes the complete symbols of the bit accumulator.
+ * @param  decomp: pointer to the decompressor context
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ */
+static uint8_t Bootloader_DecompressBits(BootloaderDecompressTypeDef* decomp)
+{
+    uint8_t status = BL_OK;
+    uint16_t mask  = (1U << decomp->windowBits) - 1;
+    uint32_t value;
+    uint32_t offset;
+    uint32_t count;
+    uint8_t need;
+
+    while((status == BL_OK) && (decomp->state != DECOMPRESS_STATE_DONE))
+    {
+        if(decomp->state == DECOMPRESS_STATE_TAG)
+        {
+            need = 1;
+        }
+        else if(decomp->state == DECOMPRESS_STATE_LITERAL)
+        {
+            need = 8;
+        }
+        else
+        {
+            need = decomp->windowBits + decomp->countBits;
+        }
+        if(decomp->bitCount < need)
+        {
+            break;
+        }
+
+        decomp->bitCount -= need;
+        value = (decomp->bits >> decomp->bitCount) & ((1UL << need) - 1);
+
+        if(decomp->state == DECOMPRESS_STATE_TAG)
+        {
+            decomp->state =
+                value ? DECOMPRESS_STATE_LITERAL : DECOMPRESS_STATE_BACKREF;
+        }
+        else if(decomp->state == DECOMPRESS_STATE_LITERAL)
+        {
+            decomp->state = DECOMPRESS_STATE_TAG;
+            status        = Bootloader_DecompressOutput(decomp, (uint8_t)value);
+        }
+        else
+        {
+            decomp->state = DECOMPRESS_STATE_TAG;
+            offset        = (value >> decomp->countBits) + 1;
+            count         = (value & ((1UL << decomp->countBits) - 1)) + 1;
+
+            /* Reference must point into the already decompressed data */
+            if((offset > decomp->written) ||
+               (count > (decomp->size - decomp->written)))
+            {
+                return BL_DECOMPRESS_ERROR;
+            }
+            while((count > 0) && (status == BL_OK))
+            {
+                status = Bootloader_DecompressOutput(
+                    decomp, decomp->window[(decomp->head - offset) & mask]);
+                count--;
+            }
+        }
+    }
+
+    return status;
+}
+
+/**
+ * @brief  This function stores a decompressed byte in the window and in the
+ *         output buffer. The output buffer is passed to the write callback if
+ *         it is full or the image is complete.
+ * @param  decomp: pointer to the decompressor context
+ * @param  data: decompressed byte
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ */
+static uint8_t Bootloader_DecompressOutput(BootloaderDecompressTypeDef* decomp,
+                                           uint8_t data)
+{
+    uint8_t status = BL_OK;
+
+    decomp->window[decomp->head] = data;
+    decomp->head = (decomp->head + 1) & ((1U << decomp->windowBits) - 1);
+    decomp->out[decomp->outLength++] = data;
+    decomp->written++;
+
+    if(decomp->written == decomp->size)
+    {
+        decomp->state = DECOMPRESS_STATE_DONE;
+    }
+    if((decomp->outLength == DECOMPRESS_BUFFER_SIZE) ||
+       (decomp->state == DECOMPRESS_STATE_DONE))
+    {
+        status            = decomp->Write(decomp->out, decomp->outLength);
+        decomp->outLength = 0;
+    }
+    return status;
+}
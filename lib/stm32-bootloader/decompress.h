@@ -0,0 +1,75 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader Decompression Header
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   decompress.h
+ * @brief  This file contains the definitions and function prototypes of the
+ *	       streaming decompressor of compressed application images.
+ *
+ * @see    Please refer to README for detailed information.
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+#ifndef __DECOMPRESS_H
+#define __DECOMPRESS_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Defines -------------------------------------------------------------------*/
+/** Largest supported window size (2^N bytes): determines the RAM usage of the
+ * decompressor. Images compressed with a larger window are rejected.
+ */
+#define DECOMPRESS_WINDOW_BITS (10)
+
+/** Size of the output buffer: decompressed data is passed to the write
+ * callback in chunks of this size.
+ */
+#define DECOMPRESS_BUFFER_SIZE (256)
+
+/** Magic number of the compressed image header ("BLHS") */
+#define DECOMPRESS_MAGIC (uint32_t)0x53484C42
+
+/** Version of the compressed image format */
+#define DECOMPRESS_VERSION (1)
+
+/** Size of the compressed image header in bytes */
+#define DECOMPRESS_HEADER_SIZE (12)
+
+/* Typedefs ------------------------------------------------------------------*/
+/** Callback for writing the decompressed image: returns ::BL_OK upon success */
+typedef uint8_t (*pDecompressWrite)(const uint8_t* data, uint32_t length);
+
+/** Streaming decompressor context */
+typedef struct
+{
+    pDecompressWrite Write; /*!< Writes the decompressed image */
+
+    uint32_t size;        /*!< Size of the decompressed image (from header) */
+    uint8_t windowBits;   /*!< Window size of the stream (from header) */
+    uint8_t countBits;    /*!< Back-reference count size (from header) */
+    uint8_t state;        /*!< Decoder state */
+    uint8_t headerLength; /*!< Bytes collected into header */
+    uint8_t header[DECOMPRESS_HEADER_SIZE]; /*!< Header */
+
+    uint32_t bits;      /*!< Bit accumulator of the input stream */
+    uint8_t bitCount;   /*!< Number of valid bits in the accumulator */
+    uint32_t written;   /*!< Bytes of the image decompressed so far */
+    uint16_t head;      /*!< Write position in the window */
+    uint16_t outLength; /*!< Bytes held in the output buffer */
+    uint8_t window[1 << DECOMPRESS_WINDOW_BITS]; /*!< History window */
+    uint8_t out[DECOMPRESS_BUFFER_SIZE];         /*!< Output buffer */
+} BootloaderDecompressTypeDef;
+
+/* Functions -----------------------------------------------------------------*/
+void Bootloader_DecompressInit(BootloaderDecompressTypeDef* decomp,
+                               pDecompressWrite write);
+uint8_t Bootloader_DecompressWrite(BootloaderDecompressTypeDef* decomp,
+                                   const uint8_t* data,
+                                   uint32_t length);
+uint8_t Bootloader_DecompressEnd(BootloaderDecompressTypeDef* decomp);
+
+#endif /* __DECOMPRESS_H */
@@ -0,0 +1,141 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader Fast Boot Source
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   fastboot.c
+ * @brief  This file contains the fast-boot path: right after reset, the
+ *	       update triggers (button and update request of the application) are
+ *	       sampled, and if none of them is active, the application is
+ *	       launched at the reset clock, without bringing up the SD card, the
+ *	       file system, the UART and the LED sequence.
+ *
+ *	       The update request is stored in an RTC backup register, which
+ *	       survives system resets. The application calls
+ *	       Bootloader_RequestUpdate() and resets the device; the request is
+ *	       consumed by the next boot. On host builds the backup register is
+ *	       emulated by a variable.
+ *
+ *	       The boot latency is measured with the DWT cycle counter and is
+ *	       reported to Bootloader_FastBootHook() before the jump.
+ *
+ * @see    Please refer to README for detailed information.
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "fastboot.h"
+#include "bootloader.h"
+
+/* Private defines -----------------------------------------------------------*/
+#if defined(USE_HAL_DRIVER)
+/** Backup register of the update request */
+#define FASTBOOT_REGISTER ((&RTC->BKP0R)[FASTBOOT_BKP_REGISTER])
+#else
+/** Emulated backup register of the update request */
+#define FASTBOOT_REGISTER (Bootloader_FastBootRegister)
+#endif
+
+/* Public variables ----------------------------------------------------------*/
+#if !defined(USE_HAL_DRIVER)
+uint32_t Bootloader_FastBootRegister;
+#endif
+
+/* Private function prototypes -----------------------------------------------*/
+static void Bootloader_FastBootAccess(void);
+
+/**
+ * @brief  This function starts the measurement of the boot latency: the DWT
+ *         cycle counter is cleared and enabled. It is called first thing in
+ *         main().
+ */
+void Bootloader_FastBootStart(void)
+{
+#if defined(USE_HAL_DRIVER)
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+}
+
+/**
+ * @brief  This function samples the update triggers. A pending update request
+ *         is consumed, so a failed update does not trap the device in the
+ *         bootloader. The button takes precedence over the request, so it
+ *         still selects the action of the bootloader.
+ * @param  button: the update button is pressed
+ * @return Action to be performed ::eFastBootActions
+ */
+uint8_t Bootloader_FastBootCheck(uint8_t button)
+{
+    uint8_t requested;
+
+    Bootloader_FastBootAccess();
+    requested = (FASTBOOT_REGISTER == FASTBOOT_UPDATE_REQUEST);
+    if(requested)
+    {
+        FASTBOOT_REGISTER = 0;
+    }
+
+    if(button)
+    {
+        return FASTBOOT_UPDATE;
+    }
+    return requested ? FASTBOOT_REQUESTED : FASTBOOT_LAUNCH;
+}
+
+/**
+ * @brief  This function returns the number of CPU cycles elapsed since
+ *         Bootloader_FastBootStart().
+ * @return Number of cycles (0 on host builds)
+ */
+uint32_t Bootloader_FastBootCycles(void)
+{
+#if defined(USE_HAL_DRIVER)
+    return DWT->CYCCNT;
+#else
+    return 0;
+#endif
+}
+
+#if defined(USE_HAL_DRIVER)
+/**
+ * @brief  Instrumentation hook of the fast-boot path, called right before the
+ *         jump to the application. The default implementation does nothing;
+ *         it can be overridden to report the latency, e.g. on a debug pin or
+ *         into a backup register. The cycle counter keeps running, so the
+ *         application can read the full latency from DWT->CYCCNT as well.
+ * @param  cycles: CPU cycles since Bootloader_FastBootStart() at the reset
+ *         clock (::SystemCoreClock)
+ */
+__weak void Bootloader_FastBootHook(uint32_t cycles)
+{
+    (void)cycles;
+}
+#endif
+
+/**
+ * @brief  This function requests an update from the bootloader at the next
+ *         boot. It is called by the application before a system reset.
+ */
+void Bootloader_RequestUpdate(void)
+{
+    Bootloader_FastBootAccess();
+    FASTBOOT_REGISTER = FASTBOOT_UPDATE_REQUEST;
+}
+
+/**
+ * @brief  This function enables the access to the backup registers.
+ */
+static void Bootloader_FastBootAccess(void)
+{
+#if defined(USE_HAL_DRIVER)
+    __HAL_RCC_PWR_CLK_ENABLE();
+    HAL_PWR_EnableBkUpAccess();
+#if defined(RCC_APB1ENR1_RTCAPBEN)
+    __HAL_RCC_RTCAPB_CLK_ENABLE();
+#endif
+#endif
+}
@@ -0,0 +1,54 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader Fast Boot Header
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   fastboot.h
+ * @brief  This file contains the definitions and function prototypes of the
+ *	       fast-boot path and of the update request.
+ *
+ * @see    Please refer to README for detailed information.
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+#ifndef __FASTBOOT_H
+#define __FASTBOOT_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Defines -------------------------------------------------------------------*/
+/** RTC backup register holding the update request. The application must not
+ * use it for other purposes.
+ */
+#define FASTBOOT_BKP_REGISTER (25)
+
+/** Content of the backup register if an update is requested */
+#define FASTBOOT_UPDATE_REQUEST (uint32_t)0x55504454
+
+/* Enumerations --------------------------------------------------------------*/
+/** Result of Bootloader_FastBootCheck() */
+enum eFastBootActions
+{
+    FASTBOOT_LAUNCH = 0, /*!< No update pending: launch the application */
+    FASTBOOT_UPDATE,     /*!< Button pressed: run the bootloader, which
+                            selects the action by the button */
+    FASTBOOT_REQUESTED   /*!< Update requested by the application: enter the
+                            bootloader update directly */
+};
+
+/* Functions -----------------------------------------------------------------*/
+void Bootloader_FastBootStart(void);
+uint8_t Bootloader_FastBootCheck(uint8_t button);
+uint32_t Bootloader_FastBootCycles(void);
+void Bootloader_FastBootHook(uint32_t cycles);
+void Bootloader_RequestUpdate(void);
+
+#if !defined(USE_HAL_DRIVER)
+/** Backup register of host builds: can be modified by tests */
+extern uint32_t Bootloader_FastBootRegister;
+#endif
+
+#endif /* __FASTBOOT_H */
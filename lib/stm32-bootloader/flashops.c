@@ -0,0 +1,622 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader Flash Backend Source
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   flashops.c
+ * @brief  This file contains the flash backend of the flash controller, which
+ *	       is implemented with the official HAL library of ST. Host builds
+ *	       provide their own backend (see Bootloader_SetFlashOps).
+ *
+ *	       The erase and programming sequences and the polling loop waiting
+ *	       for their completion access the flash registers directly and are
+ *	       executed from RAM if ::USE_FLASH_RAMFUNC is enabled: while a page
+ *	       is erased or programmed, instruction fetches from the same bank
+ *	       would stall the CPU. The time spent in the operations and the
+ *	       iterations of the polling loop are measured with the DWT cycle
+ *	       counter (see Bootloader_FlashOpsGetBusy).
+ *
+ * @see    Please refer to README for detailed information.
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "flashops.h"
+#include "bank.h"
+#include "bootloader.h"
+
+#if defined(USE_HAL_DRIVER)
+/* Private defines -----------------------------------------------------------*/
+/** Functions executed from RAM (".RamFunc" section, placed in RAM by the
+ * linker script) */
+#if(USE_FLASH_RAMFUNC) && defined(__ICCARM__)
+#define FLASH_RAMFUNC __ramfunc
+#elif(USE_FLASH_RAMFUNC)
+#define FLASH_RAMFUNC __attribute__((section(".RamFunc"), noinline))
+#else
+#define FLASH_RAMFUNC
+#endif
+
+/** Error flags of the flash status register */
+#define FLASH_SR_ERRORS                                                       \
+    (FLASH_SR_OPERR | FLASH_SR_PROGERR | FLASH_SR_WRPERR | FLASH_SR_PGAERR |  \
+     FLASH_SR_SIZERR | FLASH_SR_PGSERR | FLASH_SR_MISERR | FLASH_SR_FASTERR | \
+     FLASH_SR_RDERR | FLASH_SR_OPTVERR)
+
+/* Private variables ---------------------------------------------------------*/
+static BootloaderFlashBusyTypeDef flash_busy;
+
+/* Private function prototypes -----------------------------------------------*/
+static FLASH_RAMFUNC uint32_t Bootloader_RamWait(void);
+static FLASH_RAMFUNC uint32_t Bootloader_RamErase(uint32_t bank,
+                                                  uint32_t page,
+                                                  uint32_t count);
+static FLASH_RAMFUNC uint32_t Bootloader_RamEraseBank(uint32_t bank);
+static FLASH_RAMFUNC uint32_t Bootloader_RamProgram(uint32_t address,
+                                                    uint64_t data);
+static FLASH_RAMFUNC uint32_t Bootloader_RamProgramRow(uint32_t address,
+                                                       const uint64_t* data,
+                                                       uint8_t last);
+static uint32_t Bootloader_HalCacheDisable(uint32_t caches);
+static void Bootloader_HalCacheRestore(uint32_t caches);
+static void Bootloader_HalInit(void);
+static uint8_t Bootloader_HalUnlock(void);
+static void Bootloader_HalLock(void);
+static uint8_t Bootloader_HalErase(uint8_t bank, uint32_t page, uint32_t count);
+static uint8_t Bootloader_HalEraseBank(uint8_t bank);
+static uint8_t Bootloader_HalProgram(uint32_t address, uint64_t data);
+static uint8_t Bootloader_HalProgramRow(uint32_t address,
+                                        const uint64_t* data,
+                                        uint8_t last);
+static void Bootloader_HalCloseRow(void);
+static void Bootloader_HalReadProtection(
+    BootloaderProtectionTypeDef* protection);
+static uint8_t Bootloader_HalSetProtection(uint32_t protection);
+static uint8_t Bootloader_HalGetActiveBank(void);
+static uint8_t Bootloader_HalGetBootBank(void);
+static uint8_t Bootloader_HalSetBootBank(uint8_t bank);
+static uint32_t Bootloader_HalGetTick(void);
+
+/* Public variables ----------------------------------------------------------*/
+const BootloaderFlashOpsTypeDef Bootloader_FlashOpsHal = {
+    Bootloader_HalInit,           Bootloader_HalUnlock,
+    Bootloader_HalLock,           Bootloader_HalErase,
+    Bootloader_HalEraseBank,      Bootloader_HalProgram,
+    Bootloader_HalProgramRow,     Bootloader_HalCloseRow,
+    Bootloader_HalReadProtection, Bootloader_HalSetProtection,
+    Bootloader_HalGetActiveBank,  Bootloader_HalGetBootBank,
+    Bootloader_HalSetBootBank,    Bootloader_HalGetTick};
+
+/**
+ * @brief  This function enables the clock of the flash interface and clears
+ *         the flash flags.
+ */
+static void Bootloader_HalInit(void)
+{
+    __HAL_RCC_SYSCFG_CLK_ENABLE();
+    __HAL_RCC_FLASH_CLK_ENABLE();
+
+    /* Clear flash flags */
+    HAL_FLASH_Unlock();
+    __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ALL_ERRORS);
+    HAL_FLASH_Lock();
+
+    /* Cycle counter for the measurement of the flash operations */
+    if(!(DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk))
+    {
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    }
+    flash_busy.operations = 0;
+    flash_busy.cycles     = 0;
+    flash_busy.polls      = 0;
+}
+
+/**
+ * @brief  This function unlocks the flash.
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ * @retval BL_OK: upon success
+ * @retval BL_WRITE_ERROR: upon failure
+ */
+static uint8_t Bootloader_HalUnlock(void)
+{
+    return (HAL_FLASH_Unlock() == HAL_OK) ? BL_OK : BL_WRITE_ERROR;
+}
+
+/**
+ * @brief  This function locks the flash.
+ */
+static void Bootloader_HalLock(void)
+{
+    HAL_FLASH_Lock();
+}
+
+/**
+ * @brief  This function erases consecutive pages of a bank.
+ * @param  bank: ::BANK_1 or ::BANK_2
+ * @param  page: index of the first page in the bank
+ * @param  count: number of pages to be erased
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ * @retval BL_OK: upon success
+ * @retval BL_ERASE_ERROR: upon failure
+ */
+static uint8_t Bootloader_HalErase(uint8_t bank, uint32_t page, uint32_t count)
+{
+    uint32_t caches =
+        Bootloader_HalCacheDisable(FLASH_ACR_ICEN | FLASH_ACR_DCEN);
+    uint32_t start = DWT->CYCCNT;
+    uint32_t error;
+
+    error =
+        Bootloader_RamErase((bank == BANK_1) ? 0 : FLASH_CR_BKER, page, count);
+
+    flash_busy.cycles += DWT->CYCCNT - start;
+    flash_busy.operations += count;
+    Bootloader_HalCacheRestore(caches);
+    return error ? BL_ERASE_ERROR : BL_OK;
+}
+
+/**
+ * @brief  This function erases a bank with a mass erase, so that it can be
+ *         fast programmed.
+ * @param  bank: ::BANK_1 or ::BANK_2
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ * @retval BL_OK: upon success
+ * @retval BL_ERASE_ERROR: upon failure
+ */
+static uint8_t Bootloader_HalEraseBank(uint8_t bank)
+{
+    uint32_t caches =
+        Bootloader_HalCacheDisable(FLASH_ACR_ICEN | FLASH_ACR_DCEN);
+    uint32_t start = DWT->CYCCNT;
+    uint32_t error;
+
+    error = Bootloader_RamEraseBank((bank == BANK_1) ? FLASH_CR_MER1
+                                                     : FLASH_CR_MER2);
+
+    flash_busy.cycles += DWT->CYCCNT - start;
+    flash_busy.operations++;
+    Bootloader_HalCacheRestore(caches);
+    return error ? BL_ERASE_ERROR : BL_OK;
+}
+
+/**
+ * @brief  This function programs a double word.
+ * @param  address: flash address, aligned to 8 bytes
+ * @param  data: 64bit data to be programmed
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ * @retval BL_OK: upon success
+ * @retval BL_WRITE_ERROR: upon failure
+ */
+static uint8_t Bootloader_HalProgram(uint32_t address, uint64_t data)
+{
+    uint32_t caches = Bootloader_HalCacheDisable(FLASH_ACR_DCEN);
+    uint32_t start  = DWT->CYCCNT;
+    uint32_t error;
+
+    error = Bootloader_RamProgram(address, data);
+
+    flash_busy.cycles += DWT->CYCCNT - start;
+    flash_busy.operations++;
+    Bootloader_HalCacheRestore(caches);
+    return error ? BL_WRITE_ERROR : BL_OK;
+}
+
+/**
+ * @brief  This function programs a row with fast programming. The FSTPG bit
+ *         is left set after the row unless it is the last one.
+ * @param  address: flash address, aligned to ::FLASH_ROW_SIZE
+ * @param  data: ::FLASH_ROW_NBDWORDS double words to be programmed
+ * @param  last: the row is the last one of the fast programming sequence
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ * @retval BL_OK: upon success
+ * @retval BL_WRITE_ERROR: upon failure
+ */
+static uint8_t Bootloader_HalProgramRow(uint32_t address,
+                                        const uint64_t* data,
+                                        uint8_t last)
+{
+    uint32_t caches = Bootloader_HalCacheDisable(FLASH_ACR_DCEN);
+    uint32_t start  = DWT->CYCCNT;
+    uint32_t error;
+
+    error = Bootloader_RamProgramRow(address, data, last);
+
+    flash_busy.cycles += DWT->CYCCNT - start;
+    flash_busy.operations++;
+    Bootloader_HalCacheRestore(caches);
+    return error ? BL_WRITE_ERROR : BL_OK;
+}
+
+/**
+ * @brief  This function closes an open fast programming sequence.
+ */
+static void Bootloader_HalCloseRow(void)
+{
+    CLEAR_BIT(FLASH->CR, FLASH_CR_FSTPG);
+}
+
+/**
+ * @brief  This function decodes the WRP areas, the PCROP areas and the RDP
+ *         level from the option bytes. The ranges are converted to the
+ *         memory map according to the active bank. The flash is left locked
+ *         or unlocked as it was found, so a programming session is not
+ *         interrupted.
+ * @param  protection: pointer to the structure to be filled
+ */
+static void Bootloader_HalReadProtection(
+    BootloaderProtectionTypeDef* protection)
+{
+    static const uint32_t areas[2][2] = {
+        {OB_WRPAREA_BANK1_AREAA, OB_WRPAREA_BANK1_AREAB},
+        {OB_WRPAREA_BANK2_AREAA, OB_WRPAREA_BANK2_AREAB}};
+    FLASH_OBProgramInitTypeDef OBStruct = {0};
+    uint8_t locked = (READ_BIT(FLASH->CR, FLASH_CR_LOCK) != 0U);
+    uint32_t base;
+    uint8_t bank;
+    uint8_t area;
+
+    if(locked)
+    {
+        HAL_FLASH_Unlock();
+    }
+
+    for(bank = 0; bank < 2; bank++)
+    {
+        /* Physical bank of the WRP areas in the memory map */
+        base = FLASH_BASE;
+        if((bank + BANK_1) != Bootloader_HalGetActiveBank())
+        {
+            base += FLASH_BANK_OFFSET;
+        }
+
+        OBStruct.PCROPConfig = (bank == 0) ? FLASH_BANK_1 : FLASH_BANK_2;
+        for(area = 0; area < 2; area++)
+        {
+            OBStruct.WRPArea = areas[bank][area];
+            HAL_FLASHEx_OBGetConfig(&OBStruct);
+
+            /* WRP area: pages of the bank, disabled if start > end */
+            protection->wrp[bank][area].start = 0;
+            protection->wrp[bank][area].end   = 0;
+            if(OBStruct.WRPEndOffset >= OBStruct.WRPStartOffset)
+            {
+                protection->wrp[bank][area].start =
+                    base + OBStruct.WRPStartOffset * FLASH_PAGE_SIZE;
+                protection->wrp[bank][area].end =
+                    base + (OBStruct.WRPEndOffset + 1) * FLASH_PAGE_SIZE;
+            }
+        }
+
+        /* PCROP area: addresses of the first and the last double word */
+        protection->pcrop[bank].start = 0;
+        protection->pcrop[bank].end   = 0;
+        if(OBStruct.PCROPEndAddr >= OBStruct.PCROPStartAddr)
+        {
+            protection->pcrop[bank].start = OBStruct.PCROPStartAddr;
+            protection->pcrop[bank].end   = OBStruct.PCROPEndAddr + 8;
+        }
+    }
+
+    /* RDP */
+    if(OBStruct.RDPLevel == OB_RDP_LEVEL_0)
+    {
+        protection->rdp = 0;
+    }
+    else
+    {
+        protection->rdp = (OBStruct.RDPLevel == OB_RDP_LEVEL_2) ? 2 : 1;
+    }
+
+    if(locked)
+    {
+        HAL_FLASH_Lock();
+    }
+}
+
+/**
+ * @brief  This function configures the write protection of flash and loads
+ *         the option bytes.
+ * @param  protection: protection type ::eFlashProtectionTypes
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ * @retval BL_OK: upon success
+ * @retval BL_OBP_ERROR: upon failure
+ */
+static uint8_t Bootloader_HalSetProtection(uint32_t protection)
+{
+    FLASH_OBProgramInitTypeDef OBStruct = {0};
+    HAL_StatusTypeDef status            = HAL_ERROR;
+
+    status = HAL_FLASH_OB_Unlock();
+
+    /* Bank 1 */
+    OBStruct.WRPArea    = OB_WRPAREA_BANK1_AREAA;
+    OBStruct.OptionType = OPTIONBYTE_WRP;
+    if(protection & BL_PROTECTION_WRP)
+    {
+        /* Enable WRP protection for application space */
+        OBStruct.WRPStartOffset = (APP_ADDRESS - FLASH_BASE) / FLASH_PAGE_SIZE;
+        OBStruct.WRPEndOffset   = FLASH_PAGE_NBPERBANK - 1;
+    }
+    else
+    {
+        /* Remove WRP protection */
+        OBStruct.WRPStartOffset = 0xFF;
+        OBStruct.WRPEndOffset   = 0x00;
+    }
+    status |= HAL_FLASHEx_OBProgram(&OBStruct);
+
+    /* Area B is not used */
+    OBStruct.WRPArea        = OB_WRPAREA_BANK1_AREAB;
+    OBStruct.OptionType     = OPTIONBYTE_WRP;
+    OBStruct.WRPStartOffset = 0xFF;
+    OBStruct.WRPEndOffset   = 0x00;
+    status |= HAL_FLASHEx_OBProgram(&OBStruct);
+
+    /* Bank 2 */
+    OBStruct.WRPArea    = OB_WRPAREA_BANK2_AREAA;
+    OBStruct.OptionType = OPTIONBYTE_WRP;
+    if(protection & BL_PROTECTION_WRP)
+    {
+        /* Enable WRP protection for application space */
+        OBStruct.WRPStartOffset = 0x00;
+        OBStruct.WRPEndOffset   = FLASH_PAGE_NBPERBANK - 1;
+    }
+    else
+    {
+        /* Remove WRP protection */
+        OBStruct.WRPStartOffset = 0xFF;
+        OBStruct.WRPEndOffset   = 0x00;
+    }
+    status |= HAL_FLASHEx_OBProgram(&OBStruct);
+
+    /* Area B is not used */
+    OBStruct.WRPArea        = OB_WRPAREA_BANK2_AREAB;
+    OBStruct.OptionType     = OPTIONBYTE_WRP;
+    OBStruct.WRPStartOffset = 0xFF;
+    OBStruct.WRPEndOffset   = 0x00;
+    status |= HAL_FLASHEx_OBProgram(&OBStruct);
+
+    if(status == HAL_OK)
+    {
+        /* Loading Flash Option Bytes - this generates a system reset. */
+        status |= HAL_FLASH_OB_Launch();
+    }
+
+    status |= HAL_FLASH_OB_Lock();
+
+    return (status == HAL_OK) ? BL_OK : BL_OBP_ERROR;
+}
+
+/**
+ * @brief  This function returns the active bank, i.e. the bank mapped to the
+ *         start of flash.
+ * @return ::BANK_1 or ::BANK_2
+ */
+static uint8_t Bootloader_HalGetActiveBank(void)
+{
+    return READ_BIT(SYSCFG->MEMRMP, SYSCFG_MEMRMP_FB_MODE) ? BANK_2 : BANK_1;
+}
+
+/**
+ * @brief  This function returns the bank selected for boot by the BFB2
+ *         option bit.
+ * @return ::BANK_1 or ::BANK_2
+ */
+static uint8_t Bootloader_HalGetBootBank(void)
+{
+    return READ_BIT(FLASH->OPTR, FLASH_OPTR_BFB2) ? BANK_2 : BANK_1;
+}
+
+/**
+ * @brief  This function selects the bank to boot from by programming the BFB2
+ *         option bit and loads the option bytes.
+ * @param  bank: ::BANK_1 or ::BANK_2
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ * @retval BL_OBP_ERROR: upon failure
+ */
+static uint8_t Bootloader_HalSetBootBank(uint8_t bank)
+{
+    FLASH_OBProgramInitTypeDef OBStruct = {0};
+    HAL_StatusTypeDef status            = HAL_ERROR;
+
+    status = HAL_FLASH_OB_Unlock();
+
+    OBStruct.OptionType = OPTIONBYTE_USER;
+    OBStruct.USERType   = OB_USER_BFB2;
+    OBStruct.USERConfig = (bank == BANK_2) ? OB_BFB2_ENABLE : OB_BFB2_DISABLE;
+    status |= HAL_FLASHEx_OBProgram(&OBStruct);
+
+    if(status == HAL_OK)
+    {
+        /* Loading Flash Option Bytes - this generates a system reset. */
+        status |= HAL_FLASH_OB_Launch();
+    }
+
+    status |= HAL_FLASH_OB_Lock();
+
+    return (status == HAL_OK) ? BL_OK : BL_OBP_ERROR;
+}
+
+/**
+ * @brief  This function returns the HAL tick.
+ * @return Time in milliseconds
+ */
+static uint32_t Bootloader_HalGetTick(void)
+{
+    return HAL_GetTick();
+}
+
+/**
+ * @brief  This function disables the flash caches during an operation, which
+ *         would otherwise return stale content.
+ * @param  caches: caches to be disabled (FLASH_ACR_ICEN, FLASH_ACR_DCEN)
+ * @return The caches which were enabled
+ */
+static uint32_t Bootloader_HalCacheDisable(uint32_t caches)
+{
+    uint32_t enabled = FLASH->ACR & caches;
+
+    CLEAR_BIT(FLASH->ACR, enabled);
+    return enabled;
+}
+
+/**
+ * @brief  This function resets and re-enables the flash caches after an
+ *         operation.
+ * @param  caches: caches returned by Bootloader_HalCacheDisable()
+ */
+static void Bootloader_HalCacheRestore(uint32_t caches)
+{
+    if(caches & FLASH_ACR_ICEN)
+    {
+        SET_BIT(FLASH->ACR, FLASH_ACR_ICRST);
+        CLEAR_BIT(FLASH->ACR, FLASH_ACR_ICRST);
+    }
+    if(caches & FLASH_ACR_DCEN)
+    {
+        SET_BIT(FLASH->ACR, FLASH_ACR_DCRST);
+        CLEAR_BIT(FLASH->ACR, FLASH_ACR_DCRST);
+    }
+    SET_BIT(FLASH->ACR, caches);
+}
+
+/**
+ * @brief  This function waits for the end of the flash operation and clears
+ *         the status flags. It is executed from RAM.
+ * @return Error flags of the operation (0 upon success)
+ */
+static FLASH_RAMFUNC uint32_t Bootloader_RamWait(void)
+{
+    uint32_t error;
+
+    while(FLASH->SR & FLASH_SR_BSY)
+    {
+        flash_busy.polls++;
+    }
+
+    error     = FLASH->SR & FLASH_SR_ERRORS;
+    FLASH->SR = error | FLASH_SR_EOP;
+    return error;
+}
+
+/**
+ * @brief  This function erases consecutive pages of a bank. It is executed
+ *         from RAM.
+ * @param  bank: 0 for bank 1, FLASH_CR_BKER for bank 2
+ * @param  page: index of the first page in the bank
+ * @param  count: number of pages to be erased
+ * @return Error flags of the failed erase (0 upon success)
+ */
+static FLASH_RAMFUNC uint32_t Bootloader_RamErase(uint32_t bank,
+                                                  uint32_t page,
+                                                  uint32_t count)
+{
+    uint32_t error = 0;
+
+    for(; (count > 0) && (error == 0); count--, page++)
+    {
+        MODIFY_REG(FLASH->CR, FLASH_CR_BKER | FLASH_CR_PNB,
+                   bank | (page << FLASH_CR_PNB_Pos));
+        SET_BIT(FLASH->CR, FLASH_CR_PER);
+        SET_BIT(FLASH->CR, FLASH_CR_STRT);
+
+        error = Bootloader_RamWait();
+        CLEAR_BIT(FLASH->CR, FLASH_CR_PER | FLASH_CR_PNB);
+    }
+    return error;
+}
+
+/**
+ * @brief  This function erases a bank with a mass erase. It is executed from
+ *         RAM.
+ * @param  bank: FLASH_CR_MER1 for bank 1, FLASH_CR_MER2 for bank 2
+ * @return Error flags of the failed erase (0 upon success)
+ */
+static FLASH_RAMFUNC uint32_t Bootloader_RamEraseBank(uint32_t bank)
+{
+    uint32_t error;
+
+    SET_BIT(FLASH->CR, bank);
+    SET_BIT(FLASH->CR, FLASH_CR_STRT);
+
+    error = Bootloader_RamWait();
+    CLEAR_BIT(FLASH->CR, FLASH_CR_MER1 | FLASH_CR_MER2);
+    return error;
+}
+
+/**
+ * @brief  This function programs a double word. It is executed from RAM.
+ * @param  address: flash address, aligned to 8 bytes
+ * @param  data: 64bit data to be programmed
+ * @return Error flags of the operation (0 upon success)
+ */
+static FLASH_RAMFUNC uint32_t Bootloader_RamProgram(uint32_t address,
+                                                    uint64_t data)
+{
+    uint32_t error;
+
+    SET_BIT(FLASH->CR, FLASH_CR_PG);
+    *(__IO uint32_t*)address       = (uint32_t)data;
+    *(__IO uint32_t*)(address + 4) = (uint32_t)(data >> 32);
+
+    error = Bootloader_RamWait();
+    CLEAR_BIT(FLASH->CR, FLASH_CR_PG);
+    return error;
+}
+
+/**
+ * @brief  This function programs a row with fast programming. The bank must
+ *         be mass erased, otherwise the flash controller sets PGSERR. The
+ *         row is written with interrupts disabled, as required by the flash
+ *         controller. The FSTPG bit is left set after the row unless it is
+ *         the last one or the row is rejected. It is executed from RAM.
+ * @param  address: flash address, aligned to ::FLASH_ROW_SIZE
+ * @param  data: ::FLASH_ROW_NBDWORDS double words to be programmed
+ * @param  last: the row is the last one of the fast programming sequence
+ * @return Error flags of the operation (0 upon success)
+ */
+static FLASH_RAMFUNC uint32_t Bootloader_RamProgramRow(uint32_t address,
+                                                       const uint64_t* data,
+                                                       uint8_t last)
+{
+    __IO uint32_t* dest = (__IO uint32_t*)address;
+    const uint32_t* src = (const uint32_t*)data;
+    uint32_t primask;
+    uint32_t error;
+    uint32_t i;
+
+    SET_BIT(FLASH->CR, FLASH_CR_FSTPG);
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+    for(i = 0; i < (2 * FLASH_ROW_NBDWORDS); i++)
+    {
+        dest[i] = src[i];
+    }
+    __set_PRIMASK(primask);
+
+    error = Bootloader_RamWait();
+    if(last || error)
+    {
+        CLEAR_BIT(FLASH->CR, FLASH_CR_FSTPG);
+    }
+    return error;
+}
+
+/* Public functions ----------------------------------------------------------*/
+/**
+ * @brief  This function returns the time spent in the erase and programming
+ *         operations since Bootloader_Init(). While the CPU is stalled by the
+ *         flash, the polling loop does not run: the number of polls per
+ *         operation shows whether the CPU kept running during the operations
+ *         (::USE_FLASH_RAMFUNC).
+ * @param  busy: pointer to the structure to be filled
+ */
+void Bootloader_FlashOpsGetBusy(BootloaderFlashBusyTypeDef* busy)
+{
+    *busy = flash_busy;
+}
+#endif /* USE_HAL_DRIVER */
@@ -0,0 +1,93 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader Flash Backend Header
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   flashops.h
+ * @brief  This file contains the interface of the flash backends. Every flash
+ *	       operation of the bootloader (erase, programming, option bytes) is
+ *	       performed through a table of functions, so the erase, programming
+ *	       and verification logic of bootloader.c can run on the flash
+ *	       controller (HAL backend, see flashops.c) as well as on a simulated
+ *	       flash on the host.
+ *
+ *	       The flash content is read directly from the memory map by the
+ *	       bootloader, hence a backend must map the flash to ::FLASH_BASE.
+ *
+ * @see    Please refer to README for detailed information.
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+#ifndef __FLASHOPS_H
+#define __FLASHOPS_H
+
+/* Includes ------------------------------------------------------------------*/
+#include "bootloader.h"
+#include <stdint.h>
+
+/* Typedefs ------------------------------------------------------------------*/
+/** Flash backend: the functions return Bootloader error codes
+ * ::eBootloaderErrorCodes unless noted otherwise
+ */
+typedef struct
+{
+    /** Enable the flash interface and clear the error flags */
+    void (*init)(void);
+    /** Unlock the flash for erase and programming */
+    uint8_t (*unlock)(void);
+    /** Lock the flash */
+    void (*lock)(void);
+    /** Erase consecutive pages of a physical bank (::BANK_1 or ::BANK_2) */
+    uint8_t (*erase)(uint8_t bank, uint32_t page, uint32_t count);
+    /** Erase a physical bank (::BANK_1 or ::BANK_2) with a mass erase */
+    uint8_t (*eraseBank)(uint8_t bank);
+    /** Program a double word at an address aligned to 8 bytes */
+    uint8_t (*program)(uint32_t address, uint64_t data);
+    /** Program a row of ::FLASH_ROW_NBDWORDS double words with fast
+     * programming, which requires a mass erased bank. The fast programming
+     * sequence is left open for the next row unless last is set. Upon
+     * failure the sequence is closed. */
+    uint8_t (*programRow)(uint32_t address, const uint64_t* data, uint8_t last);
+    /** Close an open fast programming sequence */
+    void (*closeRow)(void);
+    /** Decode the protection ranges and the RDP level from the option
+     * bytes (the status field is filled in by the caller). The lock state of
+     * the flash is not changed. */
+    void (*readProtection)(BootloaderProtectionTypeDef* protection);
+    /** Configure the write protection of the application space and load the
+     * option bytes (system reset). The flash is unlocked by the caller. */
+    uint8_t (*setProtection)(uint32_t protection);
+    /** Return the bank mapped to the start of flash (::BANK_1 or ::BANK_2) */
+    uint8_t (*getActiveBank)(void);
+    /** Return the bank selected for boot by the BFB2 option bit */
+    uint8_t (*getBootBank)(void);
+    /** Select the bank to boot from and load the option bytes (system
+     * reset). The flash is unlocked by the caller. */
+    uint8_t (*setBootBank)(uint8_t bank);
+    /** Return the time in milliseconds */
+    uint32_t (*getTick)(void);
+} BootloaderFlashOpsTypeDef;
+
+/** Time spent in the erase and programming operations of the HAL backend */
+typedef struct
+{
+    uint32_t operations; /*!< Erased pages, programmed double words and rows */
+    uint32_t cycles;     /*!< DWT cycles spent in the operations */
+    uint32_t polls;      /*!< Iterations of the loop waiting for the flash */
+} BootloaderFlashBusyTypeDef;
+
+/* Variables -----------------------------------------------------------------*/
+#if defined(USE_HAL_DRIVER)
+/** Flash backend of the flash controller (HAL), used by default */
+extern const BootloaderFlashOpsTypeDef Bootloader_FlashOpsHal;
+#endif
+
+/* Functions -----------------------------------------------------------------*/
+void Bootloader_SetFlashOps(const BootloaderFlashOpsTypeDef* ops);
+#if defined(USE_HAL_DRIVER)
+void Bootloader_FlashOpsGetBusy(BootloaderFlashBusyTypeDef* busy);
+#endif
+
+#endif /* __FLASHOPS_H */
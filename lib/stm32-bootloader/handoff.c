@@ -0,0 +1,205 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader Clock Handoff Source
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   handoff.c
+ * @brief  This file contains the clock-preserving handoff: instead of
+ *	       resetting the clock configuration before the jump, the bootloader
+ *	       leaves SYSCLK, the PLL, the flash latency and the voltage scaling
+ *	       configured and publishes them in a versioned handoff block at a
+ *	       fixed RAM address (::HANDOFF_ADDRESS). The application takes the
+ *	       running configuration over instead of bringing up its clocks,
+ *	       which saves the oscillator start-up and the PLL lock time.
+ *
+ *	       The block is only valid if its checksum is correct and the clock
+ *	       registers still hold the published configuration, so a stale
+ *	       block (e.g. after a bootloader without handoff) is ignored.
+ *
+ *	       This file is also intended to be linked into the application. On
+ *	       host builds the block and the clock registers are emulated by
+ *	       variables.
+ *
+ * @see    Please refer to README for detailed information.
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "handoff.h"
+#include "bootloader.h"
+
+/* Private defines -----------------------------------------------------------*/
+#if defined(USE_HAL_DRIVER)
+/** Handoff block in RAM which is not initialized at startup */
+#define HANDOFF ((HandoffTypeDef*)HANDOFF_ADDRESS)
+/** Clock registers */
+#define HANDOFF_CR      (RCC->CR)
+#define HANDOFF_CFGR    (RCC->CFGR)
+#define HANDOFF_PLLCFGR (RCC->PLLCFGR)
+#define HANDOFF_ACR     (FLASH->ACR)
+#define HANDOFF_CR1     (PWR->CR1)
+#else
+/** Emulated handoff block */
+#define HANDOFF         (&Handoff)
+/** Emulated clock registers */
+#define HANDOFF_CR      (Bootloader_HandoffRegisters[0])
+#define HANDOFF_CFGR    (Bootloader_HandoffRegisters[1])
+#define HANDOFF_PLLCFGR (Bootloader_HandoffRegisters[2])
+#define HANDOFF_ACR     (Bootloader_HandoffRegisters[3])
+#define HANDOFF_CR1     (Bootloader_HandoffRegisters[4])
+#endif
+
+/** Ready flags of the oscillators in RCC_CR */
+#define HANDOFF_READY \
+    (RCC_CR_MSIRDY | RCC_CR_HSIRDY | RCC_CR_HSERDY | RCC_CR_PLLRDY)
+
+/* Public variables ----------------------------------------------------------*/
+#if !defined(USE_HAL_DRIVER)
+uint32_t Bootloader_HandoffRegisters[5];
+uint32_t Bootloader_HandoffClock = 4000000;
+#endif
+
+/* Private variables ---------------------------------------------------------*/
+#if !defined(USE_HAL_DRIVER)
+static HandoffTypeDef Handoff;
+#endif
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t Bootloader_HandoffCheck(const HandoffTypeDef* handoff);
+
+#if defined(USE_HAL_DRIVER)
+/**
+ * @brief  This function prepares the jump to the application without
+ *         resetting the clock configuration: the peripherals are reset,
+ *         except the flash interface and the power controller, which hold the
+ *         latency and the voltage scaling of the running clock. The clock
+ *         configuration is then published in the handoff block.
+ */
+void Bootloader_HandoffPrepare(void)
+{
+    RCC->AHB1RSTR  = ~RCC_AHB1RSTR_FLASHRST;
+    RCC->AHB1RSTR  = 0;
+    RCC->AHB2RSTR  = 0xFFFFFFFF;
+    RCC->AHB2RSTR  = 0;
+    RCC->AHB3RSTR  = 0xFFFFFFFF;
+    RCC->AHB3RSTR  = 0;
+    RCC->APB1RSTR1 = ~RCC_APB1RSTR1_PWRRST;
+    RCC->APB1RSTR1 = 0;
+    RCC->APB1RSTR2 = 0xFFFFFFFF;
+    RCC->APB1RSTR2 = 0;
+    RCC->APB2RSTR  = 0xFFFFFFFF;
+    RCC->APB2RSTR  = 0;
+
+    Bootloader_HandoffPublish();
+}
+#endif
+
+/**
+ * @brief  This function publishes the running clock configuration in the
+ *         handoff block.
+ */
+void Bootloader_HandoffPublish(void)
+{
+    HANDOFF->magic   = HANDOFF_MAGIC;
+    HANDOFF->version = HANDOFF_VERSION;
+    HANDOFF->size    = sizeof(HandoffTypeDef);
+#if defined(USE_HAL_DRIVER)
+    HANDOFF->sysclk = HAL_RCC_GetSysClockFreq();
+    HANDOFF->hclk   = HAL_RCC_GetHCLKFreq();
+#else
+    HANDOFF->sysclk = Bootloader_HandoffClock;
+    HANDOFF->hclk   = Bootloader_HandoffClock;
+#endif
+    HANDOFF->cr      = HANDOFF_CR;
+    HANDOFF->cfgr    = HANDOFF_CFGR;
+    HANDOFF->pllcfgr = HANDOFF_PLLCFGR;
+    HANDOFF->acr     = HANDOFF_ACR;
+    HANDOFF->cr1     = HANDOFF_CR1;
+    HANDOFF->check   = Bootloader_HandoffCheck(HANDOFF);
+}
+
+/**
+ * @brief  This function returns the handoff block, e.g. for the application
+ *         to read the published frequencies. The content is only meaningful
+ *         if Bootloader_HandoffValid() returns 1.
+ * @return Pointer to the handoff block
+ */
+const HandoffTypeDef* Bootloader_HandoffGet(void)
+{
+    return HANDOFF;
+}
+
+/**
+ * @brief  This function checks whether the handoff block is valid and the
+ *         clock configuration it describes is still running. It only reads
+ *         registers and the block, so the application can call it in
+ *         SystemInit() to skip the reset of the clock configuration.
+ * @return 1 if the handoff block is valid, otherwise 0
+ */
+uint8_t Bootloader_HandoffValid(void)
+{
+    const HandoffTypeDef* handoff = HANDOFF;
+
+    if((handoff->magic != HANDOFF_MAGIC) ||
+       (handoff->version != HANDOFF_VERSION) ||
+       (handoff->size != sizeof(HandoffTypeDef)) ||
+       (handoff->check != Bootloader_HandoffCheck(handoff)))
+    {
+        return 0;
+    }
+
+    return ((HANDOFF_CR & handoff->cr & HANDOFF_READY) ==
+            (handoff->cr & HANDOFF_READY)) &&
+           (HANDOFF_CFGR == handoff->cfgr) &&
+           (HANDOFF_PLLCFGR == handoff->pllcfgr) &&
+           ((HANDOFF_ACR & FLASH_ACR_LATENCY) ==
+            (handoff->acr & FLASH_ACR_LATENCY)) &&
+           ((HANDOFF_CR1 & PWR_CR1_VOS) == (handoff->cr1 & PWR_CR1_VOS));
+}
+
+/**
+ * @brief  This function takes the clock configuration of the bootloader
+ *         over: if the handoff block is valid and describes the requested
+ *         SYSCLK frequency, ::SystemCoreClock and the tick are updated, and
+ *         the application can skip its clock configuration. It is called by
+ *         the application after HAL_Init().
+ * @param  sysclk: SYSCLK frequency required by the application [Hz]
+ * @return 1 if the clock configuration is taken over, otherwise 0 (the
+ *         application has to configure its clocks)
+ */
+uint8_t Bootloader_HandoffResume(uint32_t sysclk)
+{
+    if(!Bootloader_HandoffValid() || (HANDOFF->sysclk != sysclk))
+    {
+        return 0;
+    }
+
+#if defined(USE_HAL_DRIVER)
+    SystemCoreClock = HANDOFF->hclk;
+    if(HAL_InitTick(TICK_INT_PRIORITY) != HAL_OK)
+    {
+        return 0;
+    }
+#endif
+    return 1;
+}
+
+/**
+ * @brief  This function calculates the checksum of the handoff block.
+ * @param  handoff: pointer to the handoff block
+ * @return Complement of the sum of the words preceding the checksum
+ */
+static uint32_t Bootloader_HandoffCheck(const HandoffTypeDef* handoff)
+{
+    const uint32_t* word = (const uint32_t*)handoff;
+    uint32_t sum         = 0;
+    uint32_t i;
+
+    for(i = 0; i < (sizeof(HandoffTypeDef) / 4) - 1; i++)
+    {
+        sum += word[i];
+    }
+    return ~sum;
+}
@@ -0,0 +1,65 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader Clock Handoff Header
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   handoff.h
+ * @brief  This file contains the definitions and function prototypes of the
+ *	       clock-preserving handoff to the application.
+ *
+ * @see    Please refer to README for detailed information.
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+#ifndef __HANDOFF_H
+#define __HANDOFF_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Defines -------------------------------------------------------------------*/
+/** Address of the handoff block in RAM which is not initialized by the
+ * bootloader nor by the application: SRAM2, after the boot timeline
+ * (timeline.h). The application must not use it for other purposes.
+ */
+#define HANDOFF_ADDRESS (uint32_t)0x10000200
+
+/** Magic number of the handoff block */
+#define HANDOFF_MAGIC (uint32_t)0x484E444F
+
+/** Version of the layout of the handoff block */
+#define HANDOFF_VERSION (1)
+
+/* Typedefs ------------------------------------------------------------------*/
+/** Handoff block: clock configuration left running by the bootloader */
+typedef struct
+{
+    uint32_t magic;   /*!< ::HANDOFF_MAGIC */
+    uint16_t version; /*!< ::HANDOFF_VERSION */
+    uint16_t size;    /*!< Size of the block in bytes */
+    uint32_t sysclk;  /*!< SYSCLK frequency [Hz] */
+    uint32_t hclk;    /*!< HCLK frequency (SystemCoreClock) [Hz] */
+    uint32_t cr;      /*!< RCC_CR: enabled and ready oscillators */
+    uint32_t cfgr;    /*!< RCC_CFGR: clock source and prescalers */
+    uint32_t pllcfgr; /*!< RCC_PLLCFGR: main PLL configuration */
+    uint32_t acr;     /*!< FLASH_ACR: latency, caches and prefetch */
+    uint32_t cr1;     /*!< PWR_CR1: voltage scaling range */
+    uint32_t check;   /*!< Complement of the sum of the previous words */
+} HandoffTypeDef;
+
+/* Functions -----------------------------------------------------------------*/
+void Bootloader_HandoffPrepare(void);
+void Bootloader_HandoffPublish(void);
+const HandoffTypeDef* Bootloader_HandoffGet(void);
+uint8_t Bootloader_HandoffValid(void);
+uint8_t Bootloader_HandoffResume(uint32_t sysclk);
+
+#if !defined(USE_HAL_DRIVER)
+/** Clock registers and frequencies of host builds: can be modified by tests */
+extern uint32_t Bootloader_HandoffRegisters[5];
+extern uint32_t Bootloader_HandoffClock;
+#endif
+
+#endif /* __HANDOFF_H */
@@ -0,0 +1,86 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader Image Header Source
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   image.c
+ * @brief  This file contains the parser of the application image header. The
+ *	       header is located at the start of the application space and holds
+ *	       the length and checksum of the application, so that verification
+ *	       only covers the real image. The vector table of the application
+ *	       follows the header area at ::APP_VECTORS.
+ *
+ * @see    Please refer to README for detailed information.
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "image.h"
+#include "bootloader.h"
+#include "crc.h"
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t Bootloader_ImageGet32(const uint8_t* data);
+
+/**
+ * @brief  This function parses and validates an image header. The
+ *         application must fit into the application space behind the header
+ *         area (::APP_SPACE_SIZE): the length is checked on its own, so the
+ *         size of the image (::IMAGE_HEADER_SIZE + length) cannot wrap.
+ * @param  data: pointer to the header (e.g. in flash or in a file buffer),
+ *         at least ::IMAGE_HEADER_LENGTH bytes
+ * @param  header: pointer to the header structure to be filled
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ * @retval BL_OK: if the header is valid
+ * @retval BL_HEADER_ERROR: upon invalid header, if the image is not linked
+ *         to the application space of the bootloader or does not fit into
+ *         it
+ */
+uint8_t Bootloader_ImageParse(const uint8_t* data,
+                              BootloaderImageHeaderTypeDef* header)
+{
+    BootloaderCrcTypeDef crc;
+
+    header->magic       = Bootloader_ImageGet32(&data[0]);
+    header->version     = (uint16_t)(data[4] | (data[5] << 8));
+    header->headerSize  = (uint16_t)(data[6] | (data[7] << 8));
+    header->length      = Bootloader_ImageGet32(&data[8]);
+    header->loadAddress = Bootloader_ImageGet32(&data[12]);
+    header->crc         = Bootloader_ImageGet32(&data[16]);
+    header->appVersion  = Bootloader_ImageGet32(&data[20]);
+    header->headerCrc   = Bootloader_ImageGet32(&data[24]);
+
+    if((header->magic != IMAGE_MAGIC) || (header->version != IMAGE_VERSION) ||
+       (header->headerSize != IMAGE_HEADER_SIZE))
+    {
+        return BL_HEADER_ERROR;
+    }
+
+    Bootloader_CrcInit(&crc);
+    Bootloader_CrcUpdate(&crc, data, IMAGE_HEADER_CRC_LENGTH);
+    if(Bootloader_CrcFinal(&crc) != header->headerCrc)
+    {
+        return BL_HEADER_ERROR;
+    }
+
+    if((header->loadAddress != (APP_ADDRESS + IMAGE_HEADER_SIZE)) ||
+       (header->length == 0) ||
+       (header->length > (APP_SPACE_SIZE - IMAGE_HEADER_SIZE)))
+    {
+        return BL_HEADER_ERROR;
+    }
+    return BL_OK;
+}
+
+/**
+ * @brief  This function reads a 32-bit little-endian value.
+ * @param  data: pointer to the four bytes
+ * @return Value
+ */
+static uint32_t Bootloader_ImageGet32(const uint8_t* data)
+{
+    return (uint32_t)data[0] | ((uint32_t)data[1] << 8) |
+           ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
@@ -0,0 +1,58 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader Image Header Header
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   image.h
+ * @brief  This file contains the definitions and function prototypes of the
+ *	       application image header.
+ *
+ * @see    Please refer to README for detailed information.
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+#ifndef __IMAGE_H
+#define __IMAGE_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Defines -------------------------------------------------------------------*/
+/** Magic number of the image header ("BLIH") */
+#define IMAGE_MAGIC (uint32_t)0x48494C42
+
+/** Version of the image header format */
+#define IMAGE_VERSION (1)
+
+/** Number of bytes of the header covered by the header checksum */
+#define IMAGE_HEADER_CRC_LENGTH (24)
+
+/** Number of bytes of the header fields: the rest of the header area
+ * (::IMAGE_HEADER_SIZE) is padding.
+ */
+#define IMAGE_HEADER_LENGTH (28)
+
+/* Typedefs ------------------------------------------------------------------*/
+/** Image header, stored in little-endian byte order at the start of the
+ * image. The checksums follow the CRC convention of the bootloader (see
+ * crc.h).
+ */
+typedef struct
+{
+    uint32_t magic;       /*!< ::IMAGE_MAGIC */
+    uint16_t version;     /*!< ::IMAGE_VERSION */
+    uint16_t headerSize;  /*!< Size of the header area (::IMAGE_HEADER_SIZE) */
+    uint32_t length;      /*!< Length of the application in bytes */
+    uint32_t loadAddress; /*!< Address of the vector table of the application */
+    uint32_t crc;         /*!< Checksum of the application */
+    uint32_t appVersion;  /*!< Version of the application */
+    uint32_t headerCrc;   /*!< Checksum of the preceding header fields */
+} BootloaderImageHeaderTypeDef;
+
+/* Functions -----------------------------------------------------------------*/
+uint8_t Bootloader_ImageParse(const uint8_t* data,
+                              BootloaderImageHeaderTypeDef* header);
+
+#endif /* __IMAGE_H */
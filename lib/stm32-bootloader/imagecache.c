@@ -0,0 +1,151 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader Verified Image Cache Source
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   imagecache.c
+ * @brief  This file contains the verified image cache. After a successful
+ *	       checksum verification a record of the verified image is stored in
+ *	       RTC backup registers, so that the following boots can skip the
+ *	       verification. The record is bound to the size and checksum of the
+ *	       image and to a generation counter, which is incremented by every
+ *	       flash write path of the bootloader (see Bootloader_CacheInvalidate).
+ *
+ *	       Register layout (relative to ::CACHE_BKP_REGISTER):
+ *	        - 0: generation counter
+ *	        - 1: generation of the record
+ *	        - 2: size of the verified image
+ *	        - 3: checksum of the verified image
+ *	        - 4: checksum of the record (including ::CACHE_MAGIC)
+ *
+ *	       On host builds the backup registers are emulated by an array.
+ *
+ * @see    Please refer to README for detailed information.
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "imagecache.h"
+#include "bootloader.h"
+#include "crc.h"
+
+/* Private defines -----------------------------------------------------------*/
+#define CACHE_REG_COUNTER    0 /*!< Generation counter */
+#define CACHE_REG_GENERATION 1 /*!< Generation of the record */
+#define CACHE_REG_SIZE       2 /*!< Size of the verified image */
+#define CACHE_REG_CRC        3 /*!< Checksum of the verified image */
+#define CACHE_REG_CHECK      4 /*!< Checksum of the record */
+
+#if defined(USE_HAL_DRIVER)
+/** Backup register of the cache at the given index */
+#define CACHE_REGISTER(index) ((&RTC->BKP0R)[CACHE_BKP_REGISTER + (index)])
+#else
+/** Emulated backup register of the cache at the given index */
+#define CACHE_REGISTER(index) (Bootloader_CacheRegisters[(index)])
+#endif
+
+/* Public variables ----------------------------------------------------------*/
+#if !defined(USE_HAL_DRIVER)
+uint32_t Bootloader_CacheRegisters[CACHE_NBREGISTERS];
+#endif
+
+/* Private function prototypes -----------------------------------------------*/
+static void Bootloader_CacheAccess(void);
+static uint32_t Bootloader_CacheChecksum(const uint32_t* record);
+
+/**
+ * @brief  This function checks whether the cache holds a valid record of an
+ *         image with the given size and checksum, which has not been
+ *         invalidated since it was stored.
+ * @param  size: size of the image in bytes
+ * @param  crc: checksum of the image
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ * @retval BL_OK: if the image has been verified already
+ * @retval BL_CHKS_ERROR: if the image has to be verified
+ */
+uint8_t Bootloader_CacheCheck(uint32_t size, uint32_t crc)
+{
+    uint32_t record[CACHE_NBREGISTERS];
+    uint32_t i;
+
+    Bootloader_CacheAccess();
+    for(i = 0; i < CACHE_NBREGISTERS; i++)
+    {
+        record[i] = CACHE_REGISTER(i);
+    }
+
+    if((record[CACHE_REG_GENERATION] != record[CACHE_REG_COUNTER]) ||
+       (record[CACHE_REG_SIZE] != size) || (record[CACHE_REG_CRC] != crc) ||
+       (record[CACHE_REG_CHECK] != Bootloader_CacheChecksum(record)))
+    {
+        return BL_CHKS_ERROR;
+    }
+    return BL_OK;
+}
+
+/**
+ * @brief  This function stores the record of a verified image. It must only
+ *         be called after the checksum of the image has been verified.
+ * @param  size: size of the image in bytes
+ * @param  crc: checksum of the image
+ */
+void Bootloader_CacheStore(uint32_t size, uint32_t crc)
+{
+    uint32_t record[CACHE_NBREGISTERS];
+
+    Bootloader_CacheAccess();
+    record[CACHE_REG_COUNTER]    = CACHE_REGISTER(CACHE_REG_COUNTER);
+    record[CACHE_REG_GENERATION] = record[CACHE_REG_COUNTER];
+    record[CACHE_REG_SIZE]       = size;
+    record[CACHE_REG_CRC]        = crc;
+    record[CACHE_REG_CHECK]      = Bootloader_CacheChecksum(record);
+
+    CACHE_REGISTER(CACHE_REG_GENERATION) = record[CACHE_REG_GENERATION];
+    CACHE_REGISTER(CACHE_REG_SIZE)       = record[CACHE_REG_SIZE];
+    CACHE_REGISTER(CACHE_REG_CRC)        = record[CACHE_REG_CRC];
+    CACHE_REGISTER(CACHE_REG_CHECK)      = record[CACHE_REG_CHECK];
+}
+
+/**
+ * @brief  This function invalidates the stored record by incrementing the
+ *         generation counter. It is called before every modification of the
+ *         flash, so the next boot verifies the image again.
+ */
+void Bootloader_CacheInvalidate(void)
+{
+    Bootloader_CacheAccess();
+    CACHE_REGISTER(CACHE_REG_COUNTER) = CACHE_REGISTER(CACHE_REG_COUNTER) + 1;
+}
+
+/**
+ * @brief  This function enables the access to the backup registers.
+ */
+static void Bootloader_CacheAccess(void)
+{
+#if defined(USE_HAL_DRIVER)
+    __HAL_RCC_PWR_CLK_ENABLE();
+    HAL_PWR_EnableBkUpAccess();
+#if defined(RCC_APB1ENR1_RTCAPBEN)
+    __HAL_RCC_RTCAPB_CLK_ENABLE();
+#endif
+#endif
+}
+
+/**
+ * @brief  This function calculates the checksum of a record.
+ * @param  record: pointer to the record (register layout)
+ * @return Checksum of the magic number, generation, size and image checksum
+ */
+static uint32_t Bootloader_CacheChecksum(const uint32_t* record)
+{
+    BootloaderCrcTypeDef crc;
+    uint32_t magic = CACHE_MAGIC;
+
+    Bootloader_CrcInit(&crc);
+    Bootloader_CrcUpdate(&crc, (uint8_t*)&magic, sizeof(magic));
+    Bootloader_CrcUpdate(&crc, (const uint8_t*)&record[CACHE_REG_GENERATION],
+                         (CACHE_REG_CHECK - CACHE_REG_GENERATION) * 4);
+    return Bootloader_CrcFinal(&crc);
+}
@@ -0,0 +1,45 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader Verified Image Cache Header
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   imagecache.h
+ * @brief  This file contains the definitions and function prototypes of the
+ *	       verified image cache.
+ *
+ * @see    Please refer to README for detailed information.
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+#ifndef __IMAGECACHE_H
+#define __IMAGECACHE_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Defines -------------------------------------------------------------------*/
+/** First RTC backup register used by the cache. The cache occupies
+ * ::CACHE_NBREGISTERS consecutive registers; the application must not use
+ * them.
+ */
+#define CACHE_BKP_REGISTER (27)
+
+/** Number of backup registers used by the cache */
+#define CACHE_NBREGISTERS (5)
+
+/** Magic number of the record ("BLVC"), included in the record checksum */
+#define CACHE_MAGIC (uint32_t)0x43564C42
+
+/* Functions -----------------------------------------------------------------*/
+uint8_t Bootloader_CacheCheck(uint32_t size, uint32_t crc);
+void Bootloader_CacheStore(uint32_t size, uint32_t crc);
+void Bootloader_CacheInvalidate(void);
+
+#if !defined(USE_HAL_DRIVER)
+/** Backup registers of host builds: can be modified by tests */
+extern uint32_t Bootloader_CacheRegisters[CACHE_NBREGISTERS];
+#endif
+
+#endif /* __IMAGECACHE_H */
@@ -0,0 +1,278 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader Delta Patch Source
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   patch.c
+ * @brief  This file contains the delta patch decoder. The decoder rebuilds the
+ *	       new application image from the currently installed image (base)
+ *	       and a patch file, and passes the result to a write callback in a
+ *	       streaming manner.
+ *
+ *	       Patch format (all fields are little-endian):
+ *	        - Header (20 bytes): magic, version (16 bit), header size
+ *	          (16 bit), base size, target size, target checksum.
+ *	        - Records: copy length, extra length, seek (signed), followed by
+ *	          the extra bytes. Copy bytes are taken from the base image, extra
+ *	          bytes are taken from the patch; the read position of the base
+ *	          image is then moved by seek bytes.
+ *
+ * @see    Please refer to README for detailed information.
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "patch.h"
+#include "bootloader.h"
+#include <string.h>
+
+/* Private defines -----------------------------------------------------------*/
+#define PATCH_STATE_HEADER  0 /*!< Collecting the header */
+#define PATCH_STATE_CONTROL 1 /*!< Collecting a control record */
+#define PATCH_STATE_EXTRA   2 /*!< Processing extra bytes */
+#define PATCH_STATE_DONE    3 /*!< New image is complete */
+#define PATCH_STATE_ERROR   4 /*!< Invalid patch or write error */
+
+/* Private function prototypes -----------------------------------------------*/
+static uint8_t Bootloader_PatchHeader(BootloaderPatchTypeDef* patch);
+static uint8_t Bootloader_PatchControl(BootloaderPatchTypeDef* patch);
+static uint8_t Bootloader_PatchNext(BootloaderPatchTypeDef* patch);
+static uint8_t Bootloader_PatchOutput(BootloaderPatchTypeDef* patch,
+                                      const uint8_t* data,
+                                      uint32_t length);
+static uint32_t Bootloader_PatchGet32(const uint8_t* data);
+
+/**
+ * @brief  This function initializes the patch decoder context.
+ * @param  patch: pointer to the decoder context
+ * @param  readBase: callback reading the base image
+ * @param  write: callback writing the new image, e.g. Bootloader_FlashWrite()
+ */
+void Bootloader_PatchInit(BootloaderPatchTypeDef* patch,
+                          pPatchReadBase readBase,
+                          pPatchWrite write)
+{
+    memset(patch, 0, sizeof(BootloaderPatchTypeDef));
+    patch->ReadBase = readBase;
+    patch->Write    = write;
+    patch->state    = PATCH_STATE_HEADER;
+    Bootloader_CrcInit(&patch->crc);
+}
+
+/**
+ * @brief  This function processes the next chunk of the patch file. Chunks
+ *         can be of arbitrary length.
+ * @param  patch: pointer to the decoder context
+ * @param  data: pointer to the patch data
+ * @param  length: length of the data in bytes
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ * @retval BL_OK: upon success
+ * @retval BL_PATCH_ERROR: if the patch is invalid or does not match the base
+ * @retval Error code of the read or write callback upon failure
+ */
+uint8_t Bootloader_PatchWrite(BootloaderPatchTypeDef* patch,
+                              const uint8_t* data,
+                              uint32_t length)
+{
+    uint8_t status = BL_OK;
+    uint32_t size;
+
+    while((length > 0) && (status == BL_OK))
+    {
+        switch(patch->state)
+        {
+            case PATCH_STATE_HEADER:
+            case PATCH_STATE_CONTROL:
+                size = ((patch->state == PATCH_STATE_HEADER)
+                            ? PATCH_HEADER_SIZE
+                            : PATCH_CONTROL_SIZE) -
+                       patch->fieldLength;
+                size = (length < size) ? length : size;
+                memcpy(&patch->field[patch->fieldLength], data, size);
+                patch->fieldLength += size;
+
+                if(patch->state == PATCH_STATE_HEADER)
+                {
+                    if(patch->fieldLength == PATCH_HEADER_SIZE)
+                    {
+                        status = Bootloader_PatchHeader(patch);
+                    }
+                }
+                else if(patch->fieldLength == PATCH_CONTROL_SIZE)
+                {
+                    status = Bootloader_PatchControl(patch);
+                }
+                break;
+
+            case PATCH_STATE_EXTRA:
+                size =
+                    (length < patch->extraLength) ? length : patch->extraLength;
+                status = Bootloader_PatchOutput(patch, data, size);
+
+                patch->extraLength -= size;
+                if((patch->extraLength == 0) && (status == BL_OK))
+                {
+                    status = Bootloader_PatchNext(patch);
+                }
+                break;
+
+            default:
+                /* Trailing data or previous error */
+                status = BL_PATCH_ERROR;
+                size   = 0;
+                break;
+        }
+
+        data += size;
+        length -= size;
+    }
+
+    if(status != BL_OK)
+    {
+        patch->state = PATCH_STATE_ERROR;
+    }
+    return status;
+}
+
+/**
+ * @brief  This function finishes the decoding and verifies the checksum of the
+ *         new image. The programming session must be closed separately, i.e.
+ *         by calling Bootloader_FlashEnd().
+ * @param  patch: pointer to the decoder context
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ * @retval BL_OK: if the new image is complete and its checksum is correct
+ * @retval BL_PATCH_ERROR: otherwise
+ */
+uint8_t Bootloader_PatchEnd(BootloaderPatchTypeDef* patch)
+{
+    if((patch->state != PATCH_STATE_DONE) ||
+       (Bootloader_CrcFinal(&patch->crc) != patch->targetCrc))
+    {
+        return BL_PATCH_ERROR;
+    }
+    return BL_OK;
+}
+
+/**
+ * @brief  This function parses and validates the collected header.
+ * @param  patch: pointer to the decoder context
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ */
+static uint8_t Bootloader_PatchHeader(BootloaderPatchTypeDef* patch)
+{
+    uint32_t version = Bootloader_PatchGet32(&patch->field[4]);
+
+    patch->baseSize   = Bootloader_PatchGet32(&patch->field[8]);
+    patch->targetSize = Bootloader_PatchGet32(&patch->field[12]);
+    patch->targetCrc  = Bootloader_PatchGet32(&patch->field[16]);
+
+    if((Bootloader_PatchGet32(&patch->field[0]) != PATCH_MAGIC) ||
+       ((version & 0xFFFF) != PATCH_VERSION) ||
+       ((version >> 16) != PATCH_HEADER_SIZE) || (patch->targetSize == 0))
+    {
+        return BL_PATCH_ERROR;
+    }
+
+    patch->fieldLength = 0;
+    patch->state       = PATCH_STATE_CONTROL;
+    return BL_OK;
+}
+
+/**
+ * @brief  This function parses and validates the collected control record.
+ * @param  patch: pointer to the decoder context
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ */
+static uint8_t Bootloader_PatchControl(BootloaderPatchTypeDef* patch)
+{
+    uint8_t status = BL_OK;
+    uint32_t copyLength;
+    uint32_t size;
+
+    copyLength         = Bootloader_PatchGet32(&patch->field[0]);
+    patch->extraLength = Bootloader_PatchGet32(&patch->field[4]);
+    patch->seek        = (int32_t)Bootloader_PatchGet32(&patch->field[8]);
+    patch->fieldLength = 0;
+
+    /* Records must stay within the base and the new image */
+    if((copyLength > (patch->baseSize - patch->basePos)) ||
+       (copyLength > (patch->targetSize - patch->written)) ||
+       (patch->extraLength > (patch->targetSize - patch->written - copyLength)))
+    {
+        return BL_PATCH_ERROR;
+    }
+
+    /* Copy from the base image through the bounded buffer */
+    while((copyLength > 0) && (status == BL_OK))
+    {
+        size =
+            (copyLength < PATCH_BUFFER_SIZE) ? copyLength : PATCH_BUFFER_SIZE;
+        status = patch->ReadBase(patch->basePos, patch->buffer, size);
+        if(status == BL_OK)
+        {
+            status = Bootloader_PatchOutput(patch, patch->buffer, size);
+        }
+        patch->basePos += size;
+        copyLength -= size;
+    }
+
+    patch->state = PATCH_STATE_EXTRA;
+    return (status == BL_OK) ? Bootloader_PatchNext(patch) : status;
+}
+
+/**
+ * @brief  This function applies the seek at the end of the current record
+ *         once all of its extra bytes are processed.
+ * @param  patch: pointer to the decoder context
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ */
+static uint8_t Bootloader_PatchNext(BootloaderPatchTypeDef* patch)
+{
+    int64_t pos;
+
+    if(patch->extraLength == 0)
+    {
+        pos = (int64_t)patch->basePos + patch->seek;
+        if((pos < 0) || (pos > (int64_t)patch->baseSize))
+        {
+            return BL_PATCH_ERROR;
+        }
+        patch->basePos = (uint32_t)pos;
+
+        patch->state = (patch->written == patch->targetSize)
+                           ? PATCH_STATE_DONE
+                           : PATCH_STATE_CONTROL;
+    }
+    return BL_OK;
+}
+
+/**
+ * @brief  This function passes a part of the new image to the write callback
+ *         and updates the checksum.
+ * @param  patch: pointer to the decoder context
+ * @param  data: pointer to the data
+ * @param  length: length of the data in bytes
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ */
+static uint8_t Bootloader_PatchOutput(BootloaderPatchTypeDef* patch,
+                                      const uint8_t* data,
+                                      uint32_t length)
+{
+    Bootloader_CrcUpdate(&patch->crc, data, length);
+    patch->written += length;
+
+    return patch->Write(data, length);
+}
+
+/**
+ * @brief  This function reads a 32-bit little-endian value.
+ * @param  data: pointer to the four bytes
+ * @return Value
+ */
+static uint32_t Bootloader_PatchGet32(const uint8_t* data)
+{
+    return (uint32_t)data[0] | ((uint32_t)data[1] << 8) |
+           ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
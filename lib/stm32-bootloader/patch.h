@@ -0,0 +1,79 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader Delta Patch Header
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   patch.h
+ * @brief  This file contains the definitions and function prototypes of the
+ *	       delta patch decoder.
+ *
+ * @see    Please refer to README for detailed information.
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+#ifndef __PATCH_H
+#define __PATCH_H
+
+/* Includes ------------------------------------------------------------------*/
+#include "crc.h"
+#include <stdint.h>
+
+/* Defines -------------------------------------------------------------------*/
+/** Magic number of the patch header ("BLPT") */
+#define PATCH_MAGIC (uint32_t)0x54504C42
+
+/** Version of the patch format */
+#define PATCH_VERSION (1)
+
+/** Size of the patch header in bytes */
+#define PATCH_HEADER_SIZE (20)
+
+/** Size of a control record in bytes */
+#define PATCH_CONTROL_SIZE (12)
+
+/** Size of the buffer used for copying from the base image */
+#define PATCH_BUFFER_SIZE (256)
+
+/* Typedefs ------------------------------------------------------------------*/
+/** Callback for reading the base image: returns ::BL_OK upon success */
+typedef uint8_t (*pPatchReadBase)(uint32_t offset,
+                                  uint8_t* data,
+                                  uint32_t length);
+
+/** Callback for writing the reconstructed image: returns ::BL_OK upon
+ * success */
+typedef uint8_t (*pPatchWrite)(const uint8_t* data, uint32_t length);
+
+/** Delta patch decoder context */
+typedef struct
+{
+    pPatchReadBase ReadBase; /*!< Reads the base image */
+    pPatchWrite Write;       /*!< Writes the reconstructed image */
+
+    uint32_t baseSize;   /*!< Size of the base image (from header) */
+    uint32_t targetSize; /*!< Size of the new image (from header) */
+    uint32_t targetCrc;  /*!< Checksum of the new image (from header) */
+
+    uint8_t state;                     /*!< Decoder state */
+    uint8_t field[PATCH_HEADER_SIZE];  /*!< Header or control record */
+    uint32_t fieldLength;              /*!< Bytes collected into field */
+    uint32_t extraLength;              /*!< Remaining extra bytes */
+    int32_t seek;                      /*!< Base offset adjustment */
+    uint32_t basePos;                  /*!< Read position in base image */
+    uint32_t written;                  /*!< Bytes of the new image written */
+    BootloaderCrcTypeDef crc;          /*!< Checksum of the written bytes */
+    uint8_t buffer[PATCH_BUFFER_SIZE]; /*!< Base image buffer */
+} BootloaderPatchTypeDef;
+
+/* Functions -----------------------------------------------------------------*/
+void Bootloader_PatchInit(BootloaderPatchTypeDef* patch,
+                          pPatchReadBase readBase,
+                          pPatchWrite write);
+uint8_t Bootloader_PatchWrite(BootloaderPatchTypeDef* patch,
+                              const uint8_t* data,
+                              uint32_t length);
+uint8_t Bootloader_PatchEnd(BootloaderPatchTypeDef* patch);
+
+#endif /* __PATCH_H */
@@ -0,0 +1,111 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader Raw File Stream Source
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   rawstream.c
+ * @brief  This file contains the raw streaming of contiguous files. Images
+ *	       written to a freshly formatted card occupy consecutive clusters:
+ *	       such a file is read by sectors straight from the drive
+ *	       (disk_read), in transfers of the size of the caller's buffer,
+ *	       without the cluster lookups of f_read() and without the copy of
+ *	       partial sectors through the sector window of the file system.
+ *
+ *	       The cluster chain of the file is checked once with the fast seek
+ *	       feature of FatFs (_USE_FASTSEEK): the link map table of a
+ *	       contiguous file holds a single fragment. Fragmented files must be
+ *	       read with f_read().
+ *
+ * @see    Please refer to README for detailed information.
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "rawstream.h"
+#include "diskio.h"
+#include <stddef.h>
+
+/**
+ * @brief  This function checks whether the clusters of an opened file are
+ *         contiguous, and prepares the raw stream of the file from its read
+ *         position, which must be at a sector boundary. The file object is
+ *         not modified.
+ * @param  stream: raw stream of the file
+ * @param  file: file opened for reading
+ * @return 0 if the file can be streamed, 1 if it is fragmented, empty or
+ *         not at a sector boundary
+ */
+uint8_t Bootloader_RawStreamOpen(BootloaderRawStreamTypeDef* stream, FIL* file)
+{
+#if(_USE_FASTSEEK)
+    FATFS* fs = file->obj.fs;
+    FRESULT fr;
+
+    /* Walk the cluster chain once: a table of a single fragment is too small
+     * for a fragmented file */
+    stream->clmt[0] = RAWSTREAM_CLMT_SIZE;
+    file->cltbl     = stream->clmt;
+    fr              = f_lseek(file, CREATE_LINKMAP);
+    file->cltbl     = NULL;
+    if((fr != FR_OK) || (stream->clmt[0] != RAWSTREAM_CLMT_SIZE) ||
+       (f_tell(file) % _MIN_SS))
+    {
+        return 1;
+    }
+
+    stream->drv    = fs->drv;
+    stream->sector = fs->database + ((stream->clmt[2] - 2) * fs->csize);
+    stream->size   = f_size(file);
+    stream->offset = f_tell(file);
+    return 0;
+#else
+    (void)stream;
+    (void)file;
+    return 1;
+#endif
+}
+
+/**
+ * @brief  This function reads the next bytes of a contiguous file in a single
+ *         transfer of whole sectors. It follows f_read(): less bytes than
+ *         requested are read at the end of the file.
+ * @param  stream: raw stream opened by Bootloader_RawStreamOpen()
+ * @param  buff: buffer of whole sectors to store the data
+ * @param  btr: number of bytes to read, a multiple of the sector size except
+ *         for the last read
+ * @param  br: number of bytes read
+ * @return FatFs function common result code
+ */
+FRESULT Bootloader_RawStreamRead(BootloaderRawStreamTypeDef* stream,
+                                 void* buff,
+                                 UINT btr,
+                                 UINT* br)
+{
+    FSIZE_t left = stream->size - stream->offset;
+
+    *br = 0;
+    if(btr > left)
+    {
+        btr = (UINT)left;
+    }
+    if(btr == 0)
+    {
+        return FR_OK;
+    }
+    if(stream->offset % _MIN_SS)
+    {
+        return FR_INVALID_PARAMETER;
+    }
+
+    if(disk_read(stream->drv, (BYTE*)buff,
+                 stream->sector + (DWORD)(stream->offset / _MIN_SS),
+                 (btr + _MIN_SS - 1) / _MIN_SS) != RES_OK)
+    {
+        return FR_DISK_ERR;
+    }
+    stream->offset += btr;
+    *br = btr;
+    return FR_OK;
+}
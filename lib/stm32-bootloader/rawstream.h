@@ -0,0 +1,45 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader Raw File Stream Header
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   rawstream.h
+ * @brief  This file contains the definitions and function prototypes of the
+ *	       raw streaming of contiguous files.
+ * @see    Please refer to README for detailed information.
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+#ifndef __RAWSTREAM_H
+#define __RAWSTREAM_H
+
+/* Includes ------------------------------------------------------------------*/
+#include "ff.h"
+#include <stdint.h>
+
+/* Defines -------------------------------------------------------------------*/
+/** Items of the cluster link map table of a file of a single fragment: table
+ * size, fragment length, fragment start and terminator */
+#define RAWSTREAM_CLMT_SIZE (4)
+
+/* Typedefs ------------------------------------------------------------------*/
+/** Contiguous file read by sectors */
+typedef struct
+{
+    BYTE drv;                        /*!< Physical drive of the volume */
+    DWORD sector;                    /*!< First sector (LBA) of the file */
+    FSIZE_t size;                    /*!< File size in bytes */
+    FSIZE_t offset;                  /*!< Read position in bytes */
+    DWORD clmt[RAWSTREAM_CLMT_SIZE]; /*!< Cluster link map table */
+} BootloaderRawStreamTypeDef;
+
+/* Functions -----------------------------------------------------------------*/
+uint8_t Bootloader_RawStreamOpen(BootloaderRawStreamTypeDef* stream, FIL* file);
+FRESULT Bootloader_RawStreamRead(BootloaderRawStreamTypeDef* stream,
+                                 void* buff,
+                                 UINT btr,
+                                 UINT* br);
+
+#endif /* __RAWSTREAM_H */
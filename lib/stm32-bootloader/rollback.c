@@ -0,0 +1,178 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader Rollback Source
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   rollback.c
+ * @brief  This file contains the boot-attempt counter. When a new image is
+ *	       activated, a trial is started: every boot of the image is counted
+ *	       until the application confirms its health with
+ *	       Bootloader_ConfirmImage(). After ::ROLLBACK_MAX_ATTEMPTS unconfirmed
+ *	       boots the bootloader reverts to the previous image, so the time
+ *	       spent in a reset loop is bounded. The reverted image is confirmed
+ *	       when it is booted, so a revert which fails or is interrupted is
+ *	       retried.
+ *
+ *	       The state is stored in an RTC backup register, which survives
+ *	       system resets:
+ *	        - [31:16] ::ROLLBACK_MAGIC
+ *	        - [15:8]  state ::eRollbackStates
+ *	        - [7:0]   number of unconfirmed boots (::ROLLBACK_TRIAL) or
+ *	                  bank of the reverted image (::ROLLBACK_REVERTING)
+ *
+ *	       This file is also intended to be linked into the application, which
+ *	       calls Bootloader_ConfirmImage(). On host builds the backup register
+ *	       is emulated by a variable.
+ *
+ * @see    Please refer to README for detailed information.
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "rollback.h"
+#include "bootloader.h"
+
+/* Private defines -----------------------------------------------------------*/
+#if defined(USE_HAL_DRIVER)
+/** Backup register of the rollback state */
+#define ROLLBACK_REGISTER ((&RTC->BKP0R)[ROLLBACK_BKP_REGISTER])
+#else
+/** Emulated backup register of the rollback state */
+#define ROLLBACK_REGISTER (Bootloader_RollbackRegister)
+#endif
+
+/* Public variables ----------------------------------------------------------*/
+#if !defined(USE_HAL_DRIVER)
+uint32_t Bootloader_RollbackRegister;
+#endif
+
+/* Private function prototypes -----------------------------------------------*/
+static void Bootloader_RollbackAccess(void);
+static void Bootloader_RollbackSet(uint8_t state, uint8_t attempts);
+
+/**
+ * @brief  This function starts the trial of a new image. It is called when
+ *         the new image is activated.
+ */
+void Bootloader_RollbackStart(void)
+{
+    Bootloader_RollbackSet(ROLLBACK_TRIAL, 0);
+}
+
+/**
+ * @brief  This function counts a boot of the current image: it is called by
+ *         the bootloader on every startup before launching the application.
+ *         If the image is on trial and has been booted
+ *         ::ROLLBACK_MAX_ATTEMPTS times without confirmation, the image has
+ *         to be reverted. The state is kept until the reverted image is
+ *         booted or a new trial is started, so the image is reverted again
+ *         on every boot until the revert succeeds.
+ * @param  bank: bank of the image being booted
+ * @return Action to be performed ::eRollbackActions
+ */
+uint8_t Bootloader_RollbackBoot(uint8_t bank)
+{
+    uint8_t value;
+
+    switch(Bootloader_RollbackGetState(&value))
+    {
+        case ROLLBACK_TRIAL:
+            if(value >= ROLLBACK_MAX_ATTEMPTS)
+            {
+                return ROLLBACK_REVERT;
+            }
+            Bootloader_RollbackSet(ROLLBACK_TRIAL, value + 1);
+            return ROLLBACK_LAUNCH;
+
+        case ROLLBACK_REVERTING:
+            if(value != bank)
+            {
+                /* The reverted image has not been activated */
+                return ROLLBACK_REVERT;
+            }
+            /* The reverted image is the last known good one */
+            Bootloader_ConfirmImage();
+            return ROLLBACK_LAUNCH;
+
+        default:
+            return ROLLBACK_LAUNCH;
+    }
+}
+
+/**
+ * @brief  This function records the revert to the previous image. It is
+ *         called by the bootloader right before it activates the previous
+ *         image: the image is confirmed by its first boot (see
+ *         Bootloader_RollbackBoot), the failed image is never confirmed.
+ * @param  bank: bank of the previous image
+ */
+void Bootloader_RollbackRevert(uint8_t bank)
+{
+    Bootloader_RollbackSet(ROLLBACK_REVERTING, bank);
+}
+
+/**
+ * @brief  This function confirms the current image: the trial is finished
+ *         and the boots are not counted anymore. It is called by the
+ *         application once it is up and running, and by the bootloader when
+ *         it reverts to the previous image.
+ */
+void Bootloader_ConfirmImage(void)
+{
+    Bootloader_RollbackSet(ROLLBACK_CONFIRMED, 0);
+}
+
+/**
+ * @brief  This function returns the rollback state. An invalid register
+ *         content (e.g. after a backup domain reset) is treated as confirmed.
+ * @param  attempts: pointer to the number of unconfirmed boots, or to the
+ *         bank of the reverted image if the state is ::ROLLBACK_REVERTING
+ *         (output)
+ * @return Rollback state ::eRollbackStates
+ */
+uint8_t Bootloader_RollbackGetState(uint8_t* attempts)
+{
+    uint32_t value;
+    uint8_t state;
+
+    Bootloader_RollbackAccess();
+    value = ROLLBACK_REGISTER;
+    state = (uint8_t)((value >> 8) & 0xFF);
+
+    if(((value >> 16) != ROLLBACK_MAGIC) ||
+       ((state != ROLLBACK_TRIAL) && (state != ROLLBACK_REVERTING)))
+    {
+        *attempts = 0;
+        return ROLLBACK_CONFIRMED;
+    }
+    *attempts = (uint8_t)(value & 0xFF);
+    return state;
+}
+
+/**
+ * @brief  This function enables the access to the backup registers.
+ */
+static void Bootloader_RollbackAccess(void)
+{
+#if defined(USE_HAL_DRIVER)
+    __HAL_RCC_PWR_CLK_ENABLE();
+    HAL_PWR_EnableBkUpAccess();
+#if defined(RCC_APB1ENR1_RTCAPBEN)
+    __HAL_RCC_RTCAPB_CLK_ENABLE();
+#endif
+#endif
+}
+
+/**
+ * @brief  This function stores the rollback state.
+ * @param  state: rollback state ::eRollbackStates
+ * @param  attempts: number of unconfirmed boots
+ */
+static void Bootloader_RollbackSet(uint8_t state, uint8_t attempts)
+{
+    Bootloader_RollbackAccess();
+    ROLLBACK_REGISTER =
+        (ROLLBACK_MAGIC << 16) | ((uint32_t)state << 8) | attempts;
+}
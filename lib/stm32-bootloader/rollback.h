@@ -0,0 +1,65 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader Rollback Header
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   rollback.h
+ * @brief  This file contains the definitions and function prototypes of the
+ *	       boot-attempt counter and the automatic rollback.
+ *
+ * @see    Please refer to README for detailed information.
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+#ifndef __ROLLBACK_H
+#define __ROLLBACK_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Defines -------------------------------------------------------------------*/
+/** RTC backup register holding the rollback state. The application must not
+ * use it for other purposes.
+ */
+#define ROLLBACK_BKP_REGISTER (26)
+
+/** Number of boots of a new image without confirmation, after which the
+ * bootloader falls back to the previous image.
+ */
+#define ROLLBACK_MAX_ATTEMPTS (3)
+
+/** Magic number of the rollback state (bits 31:16 of the register) */
+#define ROLLBACK_MAGIC (uint32_t)0xB007
+
+/* Enumerations --------------------------------------------------------------*/
+/** Rollback states */
+enum eRollbackStates
+{
+    ROLLBACK_CONFIRMED = 0, /*!< The image is confirmed (or no state stored) */
+    ROLLBACK_TRIAL,         /*!< New image, not confirmed yet */
+    ROLLBACK_REVERTING      /*!< Previous image activated, not booted yet */
+};
+
+/** Result of Bootloader_RollbackBoot() */
+enum eRollbackActions
+{
+    ROLLBACK_LAUNCH = 0, /*!< Launch the application */
+    ROLLBACK_REVERT      /*!< Too many unconfirmed boots or revert not
+                            completed: revert the image */
+};
+
+/* Functions -----------------------------------------------------------------*/
+void Bootloader_RollbackStart(void);
+uint8_t Bootloader_RollbackBoot(uint8_t bank);
+void Bootloader_RollbackRevert(uint8_t bank);
+void Bootloader_ConfirmImage(void);
+uint8_t Bootloader_RollbackGetState(uint8_t* attempts);
+
+#if !defined(USE_HAL_DRIVER)
+/** Backup register of host builds: can be modified by tests */
+extern uint32_t Bootloader_RollbackRegister;
+#endif
+
+#endif /* __ROLLBACK_H */
@@ -0,0 +1,287 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader SD Request Queue Source
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   sdqueue.c
+ * @brief  This file contains the asynchronous SD card request queue. Read and
+ *	       write requests are submitted to the queue and served in order by
+ *	       the SD card driver in DMA mode (see ::BootloaderSdOpsTypeDef):
+ *	       the completion interrupt of a transfer reports the end of the
+ *	       request (Bootloader_SdComplete), calls its callback and starts the
+ *	       next request, so the caller does not wait for the card. A caller
+ *	       waiting for a request sleeps in WFI until the next interrupt
+ *	       instead of polling.
+ *
+ *	       Queued requests which continue each other (same direction,
+ *	       following sectors, following buffers) are coalesced into a single
+ *	       transfer of at most ::SDQUEUE_MAX_COUNT sectors, so the command
+ *	       overhead of the card is paid once.
+ *
+ *	       A request after a write is only started once the card finished
+ *	       programming: it is started by the waiting caller, which checks the
+ *	       card at every interrupt (at least at every SysTick).
+ *
+ * @see    Please refer to README for detailed information.
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sdqueue.h"
+#include "bootloader.h"
+#include <stddef.h>
+
+/* Private defines -----------------------------------------------------------*/
+#if defined(USE_HAL_DRIVER)
+/** The queue is shared with the completion interrupt */
+#define SDQUEUE_LOCK(primask)      \
+    do                             \
+    {                              \
+        primask = __get_PRIMASK(); \
+        __disable_irq();           \
+    } while(0)
+#define SDQUEUE_UNLOCK(primask) __set_PRIMASK(primask)
+#else
+#define SDQUEUE_LOCK(primask)   ((void)(primask))
+#define SDQUEUE_UNLOCK(primask) ((void)(primask))
+#endif
+
+/* Private variables ---------------------------------------------------------*/
+/** SD card driver */
+static const BootloaderSdOpsTypeDef* sd_ops = NULL;
+
+/** First (running) and last request of the queue */
+static BootloaderSdRequestTypeDef* volatile sd_head = NULL;
+static BootloaderSdRequestTypeDef* volatile sd_tail = NULL;
+
+/** Number of requests served by the running transfer */
+static uint32_t sd_batch = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+static void Bootloader_SdStart(void);
+static void Bootloader_SdFinish(uint8_t state);
+
+/**
+ * @brief  This function selects the SD card driver and empties the queue.
+ * @param  ops: SD card driver
+ */
+void Bootloader_SdInit(const BootloaderSdOpsTypeDef* ops)
+{
+    sd_ops   = ops;
+    sd_head  = NULL;
+    sd_tail  = NULL;
+    sd_batch = 0;
+}
+
+/**
+ * @brief  This function submits a request to the queue and returns without
+ *         waiting for it. The transfer is started right away if the card is
+ *         idle, otherwise the request may be coalesced with the queued ones.
+ *         The request and its buffer must not be modified until the request
+ *         is completed.
+ * @param  request: request to be submitted (buffer, sector, count, write and
+ *         callback are filled in by the caller)
+ */
+void Bootloader_SdSubmit(BootloaderSdRequestTypeDef* request)
+{
+    uint32_t primask = 0;
+
+    request->next  = NULL;
+    request->state = SD_REQUEST_QUEUED;
+    request->tick  = sd_ops->getTick();
+
+    SDQUEUE_LOCK(primask);
+    if(sd_tail)
+    {
+        sd_tail->next = request;
+    }
+    else
+    {
+        sd_head = request;
+    }
+    sd_tail = request;
+    Bootloader_SdStart();
+    SDQUEUE_UNLOCK(primask);
+}
+
+/**
+ * @brief  This function reports the end of the running transfer. It is called
+ *         from the completion interrupt of the SD card driver.
+ * @param  error: 0 upon success, otherwise the transfer failed
+ */
+void Bootloader_SdComplete(uint8_t error)
+{
+    uint32_t primask = 0;
+
+    SDQUEUE_LOCK(primask);
+    if(sd_head && (sd_head->state == SD_REQUEST_BUSY))
+    {
+        Bootloader_SdFinish(error ? SD_REQUEST_ERROR : SD_REQUEST_DONE);
+        Bootloader_SdStart();
+    }
+    SDQUEUE_UNLOCK(primask);
+}
+
+/**
+ * @brief  This function waits for the completion of a request. The CPU sleeps
+ *         until the next interrupt while the transfer is running. A request
+ *         which is not completed within ::SDQUEUE_TIMEOUT is aborted.
+ * @param  request: submitted request
+ * @return 0 upon success, 1 if the request failed or was not submitted
+ */
+uint8_t Bootloader_SdWait(BootloaderSdRequestTypeDef* request)
+{
+    uint32_t primask = 0;
+
+    if(request->state == SD_REQUEST_IDLE)
+    {
+        return 1;
+    }
+
+    SDQUEUE_LOCK(primask);
+    while((request->state == SD_REQUEST_QUEUED) ||
+          (request->state == SD_REQUEST_BUSY))
+    {
+        /* Start the first request if the card was busy */
+        Bootloader_SdStart();
+
+        if((sd_ops->getTick() - sd_head->tick) >= SDQUEUE_TIMEOUT)
+        {
+            if(sd_head->state == SD_REQUEST_BUSY)
+            {
+                sd_ops->abort();
+            }
+            Bootloader_SdFinish(SD_REQUEST_ERROR);
+        }
+        else
+        {
+            /* Sleep until the completion interrupt (or the SysTick) */
+            sd_ops->idle();
+            SDQUEUE_UNLOCK(primask);
+            SDQUEUE_LOCK(primask);
+        }
+    }
+    SDQUEUE_UNLOCK(primask);
+
+    return (request->state == SD_REQUEST_DONE) ? 0 : 1;
+}
+
+/**
+ * @brief  This function waits for the completion of every submitted request.
+ * @return 0 upon success, 1 if the last request failed
+ */
+uint8_t Bootloader_SdFlush(void)
+{
+    BootloaderSdRequestTypeDef* last = sd_tail;
+
+    return last ? Bootloader_SdWait(last) : 0;
+}
+
+/**
+ * @brief  This function submits a request and waits for its completion.
+ * @param  request: request to be performed
+ * @return 0 upon success, 1 upon failure
+ */
+uint8_t Bootloader_SdTransfer(BootloaderSdRequestTypeDef* request)
+{
+    Bootloader_SdSubmit(request);
+    return Bootloader_SdWait(request);
+}
+
+/**
+ * @brief  This function starts the first request of the queue if it is not
+ *         running yet and the card is ready. The following requests are
+ *         coalesced into the transfer if they continue it. Requests which
+ *         cannot be started fail. It is called with the queue locked.
+ */
+static void Bootloader_SdStart(void)
+{
+    BootloaderSdRequestTypeDef* request;
+    BootloaderSdRequestTypeDef* next;
+    uint32_t count;
+    uint32_t i;
+    uint8_t error;
+
+    while(((request = sd_head) != NULL) &&
+          (request->state == SD_REQUEST_QUEUED) && sd_ops->ready())
+    {
+        count    = request->count;
+        sd_batch = 1;
+        for(next = request->next; next != NULL; next = next->next)
+        {
+            if((next->write != request->write) ||
+               (next->sector != (request->sector + count)) ||
+               (next->buffer !=
+                (request->buffer + (count * SDQUEUE_SECTOR_SIZE))) ||
+               ((count + next->count) > SDQUEUE_MAX_COUNT))
+            {
+                break;
+            }
+            count += next->count;
+            sd_batch++;
+        }
+
+        next = request;
+        for(i = 0; i < sd_batch; i++)
+        {
+            next->state = SD_REQUEST_BUSY;
+            next        = next->next;
+        }
+        request->tick = sd_ops->getTick();
+
+        error = request->write
+                    ? sd_ops->write(request->buffer, request->sector, count)
+                    : sd_ops->read(request->buffer, request->sector, count);
+        if(!error)
+        {
+            break;
+        }
+        Bootloader_SdFinish(SD_REQUEST_ERROR);
+    }
+}
+
+/**
+ * @brief  This function removes the requests of the running transfer (or the
+ *         first request if it is not running) from the queue and calls their
+ *         callbacks. It is called with the queue locked.
+ * @param  state: final state of the requests ::eSdRequestStates
+ */
+static void Bootloader_SdFinish(uint8_t state)
+{
+    BootloaderSdRequestTypeDef* request = sd_head;
+    BootloaderSdRequestTypeDef* next;
+    uint32_t count = (request->state == SD_REQUEST_BUSY) ? sd_batch : 1;
+    uint32_t i;
+
+    /* The queue is updated first: a callback may submit a request */
+    next = request;
+    for(i = 0; i < count; i++)
+    {
+        next = next->next;
+    }
+    sd_head  = next;
+    sd_batch = 0;
+    if(sd_head == NULL)
+    {
+        sd_tail = NULL;
+    }
+    else
+    {
+        /* The timeout of the next request starts now */
+        sd_head->tick = sd_ops->getTick();
+    }
+
+    for(i = 0; i < count; i++)
+    {
+        next           = request->next;
+        request->next  = NULL;
+        request->state = state;
+        if(request->callback)
+        {
+            request->callback(request);
+        }
+        request = next;
+    }
+}
@@ -0,0 +1,90 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader SD Request Queue Header
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   sdqueue.h
+ * @brief  This file contains the definitions and function prototypes of the
+ *	       asynchronous SD card request queue.
+ * @see    Please refer to README for detailed information.
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+#ifndef __SDQUEUE_H
+#define __SDQUEUE_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Defines -------------------------------------------------------------------*/
+/** Timeout of a request in milliseconds */
+#define SDQUEUE_TIMEOUT (150)
+
+/** Size of a sector in bytes */
+#define SDQUEUE_SECTOR_SIZE (512)
+
+/** Maximum number of sectors of a transfer of coalesced requests */
+#define SDQUEUE_MAX_COUNT (128)
+
+/* Enumerations --------------------------------------------------------------*/
+/** States of a request */
+enum eSdRequestStates
+{
+    SD_REQUEST_IDLE = 0, /*!< Not submitted */
+    SD_REQUEST_QUEUED,   /*!< Waiting for the card */
+    SD_REQUEST_BUSY,     /*!< Transfer is running */
+    SD_REQUEST_DONE,     /*!< Transfer completed */
+    SD_REQUEST_ERROR     /*!< Transfer failed or timed out */
+};
+
+/* Typedefs ------------------------------------------------------------------*/
+typedef struct BootloaderSdRequest BootloaderSdRequestTypeDef;
+
+/** Completion callback of a request, called from the completion interrupt */
+typedef void (*pSdCallback)(BootloaderSdRequestTypeDef* request);
+
+/** Read or write request of consecutive sectors */
+struct BootloaderSdRequest
+{
+    uint8_t* buffer;        /*!< Data buffer, aligned to 4 bytes */
+    uint32_t sector;        /*!< First sector (LBA) */
+    uint32_t count;         /*!< Number of sectors */
+    uint8_t write;          /*!< 1: write request, 0: read request */
+    pSdCallback callback;   /*!< Completion callback, may be NULL */
+    volatile uint8_t state; /*!< Request state ::eSdRequestStates */
+    uint32_t tick;          /*!< Tick value at the start of the transfer */
+    BootloaderSdRequestTypeDef* next; /*!< Next request of the queue */
+};
+
+/** SD card driver of the queue: the transfers are started in DMA mode and
+ * their end is reported by Bootloader_SdComplete() from the completion
+ * interrupt. The functions returning uint8_t return 0 upon success. */
+typedef struct
+{
+    /** Start reading sectors into a buffer */
+    uint8_t (*read)(uint8_t* buffer, uint32_t sector, uint32_t count);
+    /** Start writing sectors from a buffer */
+    uint8_t (*write)(const uint8_t* buffer, uint32_t sector, uint32_t count);
+    /** Return 1 if the card can accept the next transfer (e.g. a written
+     * block is not being programmed anymore) */
+    uint8_t (*ready)(void);
+    /** Abort the running transfer */
+    void (*abort)(void);
+    /** Wait for an interrupt (WFI). It is called with interrupts masked and
+     * returns when an interrupt is pending. */
+    void (*idle)(void);
+    /** Return the time in milliseconds */
+    uint32_t (*getTick)(void);
+} BootloaderSdOpsTypeDef;
+
+/* Functions -----------------------------------------------------------------*/
+void Bootloader_SdInit(const BootloaderSdOpsTypeDef* ops);
+void Bootloader_SdSubmit(BootloaderSdRequestTypeDef* request);
+void Bootloader_SdComplete(uint8_t error);
+uint8_t Bootloader_SdWait(BootloaderSdRequestTypeDef* request);
+uint8_t Bootloader_SdFlush(void);
+uint8_t Bootloader_SdTransfer(BootloaderSdRequestTypeDef* request);
+
+#endif /* __SDQUEUE_H */
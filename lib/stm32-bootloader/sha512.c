@@ -0,0 +1,256 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader SHA-512 Source
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   sha512.c
+ * @brief  This file contains the streaming SHA-512 hash (FIPS 180-4) used by
+ *	       the signature verification. The data can be fed in chunks of
+ *	       arbitrary length, e.g. while it is being programmed.
+ *
+ *	       The implementation is tuned for the Cortex-M4, which has no 64-bit
+ *	       registers: the message schedule is kept in a rolling window of 16
+ *	       double words instead of 80, and the rounds are unrolled, so that
+ *	       the working variables are renamed instead of being moved.
+ *
+ * @see    Please refer to README for detailed information.
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sha512.h"
+#include <string.h>
+
+/* Private defines -----------------------------------------------------------*/
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (64 - (n))))
+
+#define SIGMA0(x) (ROTR((x), 28) ^ ROTR((x), 34) ^ ROTR((x), 39))
+#define SIGMA1(x) (ROTR((x), 14) ^ ROTR((x), 18) ^ ROTR((x), 41))
+#define GAMMA0(x) (ROTR((x), 1) ^ ROTR((x), 8) ^ ((x) >> 7))
+#define GAMMA1(x) (ROTR((x), 19) ^ ROTR((x), 61) ^ ((x) >> 6))
+
+#define CH(x, y, z)  ((z) ^ ((x) & ((y) ^ (z))))
+#define MAJ(x, y, z) (((x) & (y)) | ((z) & ((x) | (y))))
+
+/** Round i of the current group of 16 rounds */
+#define ROUND(a, b, c, d, e, f, g, h, i)                             \
+    do                                                               \
+    {                                                                \
+        t = h + SIGMA1(e) + CH(e, f, g) + Sha512K[r + (i)] + w[(i)]; \
+        d += t;                                                      \
+        h = t + SIGMA0(a) + MAJ(a, b, c);                            \
+    } while(0)
+
+/** Message schedule of the next group of 16 rounds (in place) */
+#define SCHEDULE(i)                                             \
+    (w[(i)] += GAMMA1(w[((i) + 14) & 15]) + w[((i) + 9) & 15] + \
+               GAMMA0(w[((i) + 1) & 15]))
+
+/* Private variables ---------------------------------------------------------*/
+/** Round constants */
+static const uint64_t Sha512K[80] = {
+    0x428A2F98D728AE22ULL, 0x7137449123EF65CDULL, 0xB5C0FBCFEC4D3B2FULL,
+    0xE9B5DBA58189DBBCULL, 0x3956C25BF348B538ULL, 0x59F111F1B605D019ULL,
+    0x923F82A4AF194F9BULL, 0xAB1C5ED5DA6D8118ULL, 0xD807AA98A3030242ULL,
+    0x12835B0145706FBEULL, 0x243185BE4EE4B28CULL, 0x550C7DC3D5FFB4E2ULL,
+    0x72BE5D74F27B896FULL, 0x80DEB1FE3B1696B1ULL, 0x9BDC06A725C71235ULL,
+    0xC19BF174CF692694ULL, 0xE49B69C19EF14AD2ULL, 0xEFBE4786384F25E3ULL,
+    0x0FC19DC68B8CD5B5ULL, 0x240CA1CC77AC9C65ULL, 0x2DE92C6F592B0275ULL,
+    0x4A7484AA6EA6E483ULL, 0x5CB0A9DCBD41FBD4ULL, 0x76F988DA831153B5ULL,
+    0x983E5152EE66DFABULL, 0xA831C66D2DB43210ULL, 0xB00327C898FB213FULL,
+    0xBF597FC7BEEF0EE4ULL, 0xC6E00BF33DA88FC2ULL, 0xD5A79147930AA725ULL,
+    0x06CA6351E003826FULL, 0x142929670A0E6E70ULL, 0x27B70A8546D22FFCULL,
+    0x2E1B21385C26C926ULL, 0x4D2C6DFC5AC42AEDULL, 0x53380D139D95B3DFULL,
+    0x650A73548BAF63DEULL, 0x766A0ABB3C77B2A8ULL, 0x81C2C92E47EDAEE6ULL,
+    0x92722C851482353BULL, 0xA2BFE8A14CF10364ULL, 0xA81A664BBC423001ULL,
+    0xC24B8B70D0F89791ULL, 0xC76C51A30654BE30ULL, 0xD192E819D6EF5218ULL,
+    0xD69906245565A910ULL, 0xF40E35855771202AULL, 0x106AA07032BBD1B8ULL,
+    0x19A4C116B8D2D0C8ULL, 0x1E376C085141AB53ULL, 0x2748774CDF8EEB99ULL,
+    0x34B0BCB5E19B48A8ULL, 0x391C0CB3C5C95A63ULL, 0x4ED8AA4AE3418ACBULL,
+    0x5B9CCA4F7763E373ULL, 0x682E6FF3D6B2B8A3ULL, 0x748F82EE5DEFB2FCULL,
+    0x78A5636F43172F60ULL, 0x84C87814A1F0AB72ULL, 0x8CC702081A6439ECULL,
+    0x90BEFFFA23631E28ULL, 0xA4506CEBDE82BDE9ULL, 0xBEF9A3F7B2C67915ULL,
+    0xC67178F2E372532BULL, 0xCA273ECEEA26619CULL, 0xD186B8C721C0C207ULL,
+    0xEADA7DD6CDE0EB1EULL, 0xF57D4F7FEE6ED178ULL, 0x06F067AA72176FBAULL,
+    0x0A637DC5A2C898A6ULL, 0x113F9804BEF90DAEULL, 0x1B710B35131C471BULL,
+    0x28DB77F523047D84ULL, 0x32CAAB7B40C72493ULL, 0x3C9EBE0A15C9BEBCULL,
+    0x431D67C49C100D4CULL, 0x4CC5D4BECB3E42B6ULL, 0x597F299CFC657E2AULL,
+    0x5FCB6FAB3AD6FAECULL, 0x6C44198C4A475817ULL,
+};
+
+/** Initial hash value */
+static const uint64_t Sha512H[8] = {
+    0x6A09E667F3BCC908ULL, 0xBB67AE8584CAA73BULL, 0x3C6EF372FE94F82BULL,
+    0xA54FF53A5F1D36F1ULL, 0x510E527FADE682D1ULL, 0x9B05688C2B3E6C1FULL,
+    0x1F83D9ABFB41BD6BULL, 0x5BE0CD19137E2179ULL,
+};
+
+/* Private function prototypes -----------------------------------------------*/
+static uint64_t Bootloader_Sha512Load(const uint8_t* data);
+static void Bootloader_Sha512Block(uint64_t* state, const uint8_t* data);
+
+/**
+ * @brief  This function initializes the hash context.
+ * @param  sha: pointer to the hash context
+ */
+void Bootloader_Sha512Init(BootloaderSha512TypeDef* sha)
+{
+    memcpy(sha->state, Sha512H, sizeof(sha->state));
+    sha->length = 0;
+}
+
+/**
+ * @brief  This function hashes a chunk of data. Complete blocks are hashed
+ *         directly from the input, only the incomplete block is buffered.
+ * @param  sha: pointer to the hash context
+ * @param  data: pointer to the data
+ * @param  length: number of bytes
+ */
+void Bootloader_Sha512Update(BootloaderSha512TypeDef* sha,
+                             const uint8_t* data,
+                             uint32_t length)
+{
+    uint32_t used = (uint32_t)(sha->length % SHA512_BLOCK_LENGTH);
+    uint32_t chunk;
+
+    sha->length += length;
+
+    /* Complete the buffered block */
+    if(used > 0)
+    {
+        chunk = SHA512_BLOCK_LENGTH - used;
+        if(chunk > length)
+        {
+            memcpy(&sha->block[used], data, length);
+            return;
+        }
+        memcpy(&sha->block[used], data, chunk);
+        Bootloader_Sha512Block(sha->state, sha->block);
+        data += chunk;
+        length -= chunk;
+    }
+
+    for(; length >= SHA512_BLOCK_LENGTH; length -= SHA512_BLOCK_LENGTH)
+    {
+        Bootloader_Sha512Block(sha->state, data);
+        data += SHA512_BLOCK_LENGTH;
+    }
+    memcpy(sha->block, data, length);
+}
+
+/**
+ * @brief  This function finishes the hash: the padding is hashed and the
+ *         digest is returned. The context must be initialized again before
+ *         it is reused.
+ * @param  sha: pointer to the hash context
+ * @param  digest: buffer of ::SHA512_DIGEST_LENGTH bytes (output)
+ */
+void Bootloader_Sha512Final(BootloaderSha512TypeDef* sha, uint8_t* digest)
+{
+    uint32_t used = (uint32_t)(sha->length % SHA512_BLOCK_LENGTH);
+    uint64_t bits = sha->length * 8;
+    uint32_t i;
+
+    sha->block[used++] = 0x80;
+    if(used > (SHA512_BLOCK_LENGTH - 16))
+    {
+        memset(&sha->block[used], 0, SHA512_BLOCK_LENGTH - used);
+        Bootloader_Sha512Block(sha->state, sha->block);
+        used = 0;
+    }
+    memset(&sha->block[used], 0, SHA512_BLOCK_LENGTH - used);
+
+    /* Message length in bits (128-bit big-endian, upper half is zero) */
+    for(i = 0; i < 8; i++)
+    {
+        sha->block[SHA512_BLOCK_LENGTH - 1 - i] = (uint8_t)(bits >> (8 * i));
+    }
+    Bootloader_Sha512Block(sha->state, sha->block);
+
+    for(i = 0; i < SHA512_DIGEST_LENGTH; i++)
+    {
+        digest[i] = (uint8_t)(sha->state[i / 8] >> (56 - 8 * (i % 8)));
+    }
+}
+
+/**
+ * @brief  This function loads a big-endian double word. The compiler
+ *         translates the byte accesses into word loads and byte reversals.
+ * @param  data: pointer to the data, no alignment required
+ * @return Double word
+ */
+static uint64_t Bootloader_Sha512Load(const uint8_t* data)
+{
+    uint32_t hi = ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) |
+                  ((uint32_t)data[2] << 8) | data[3];
+    uint32_t lo = ((uint32_t)data[4] << 24) | ((uint32_t)data[5] << 16) |
+                  ((uint32_t)data[6] << 8) | data[7];
+
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/**
+ * @brief  This function hashes a message block.
+ * @param  state: intermediate hash value
+ * @param  data: pointer to the block of ::SHA512_BLOCK_LENGTH bytes
+ */
+static void Bootloader_Sha512Block(uint64_t* state, const uint8_t* data)
+{
+    uint64_t w[16];
+    uint64_t a, b, c, d, e, f, g, h, t;
+    uint32_t r;
+    uint32_t i;
+
+    for(i = 0; i < 16; i++)
+    {
+        w[i] = Bootloader_Sha512Load(&data[8 * i]);
+    }
+
+    a = state[0];
+    b = state[1];
+    c = state[2];
+    d = state[3];
+    e = state[4];
+    f = state[5];
+    g = state[6];
+    h = state[7];
+
+    for(r = 0; r < 80; r += 16)
+    {
+        if(r > 0)
+        {
+            for(i = 0; i < 16; i++)
+            {
+                SCHEDULE(i);
+            }
+        }
+
+        ROUND(a, b, c, d, e, f, g, h, 0);
+        ROUND(h, a, b, c, d, e, f, g, 1);
+        ROUND(g, h, a, b, c, d, e, f, 2);
+        ROUND(f, g, h, a, b, c, d, e, 3);
+        ROUND(e, f, g, h, a, b, c, d, 4);
+        ROUND(d, e, f, g, h, a, b, c, 5);
+        ROUND(c, d, e, f, g, h, a, b, 6);
+        ROUND(b, c, d, e, f, g, h, a, 7);
+        ROUND(a, b, c, d, e, f, g, h, 8);
+        ROUND(h, a, b, c, d, e, f, g, 9);
+        ROUND(g, h, a, b, c, d, e, f, 10);
+        ROUND(f, g, h, a, b, c, d, e, 11);
+        ROUND(e, f, g, h, a, b, c, d, 12);
+        ROUND(d, e, f, g, h, a, b, c, 13);
+        ROUND(c, d, e, f, g, h, a, b, 14);
+        ROUND(b, c, d, e, f, g, h, a, 15);
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
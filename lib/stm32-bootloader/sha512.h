@@ -0,0 +1,42 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader SHA-512 Header
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   sha512.h
+ * @brief  This file contains the definitions and function prototypes of the
+ *	       streaming SHA-512 hash.
+ *
+ * @see    Please refer to README for detailed information.
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+#ifndef __SHA512_H
+#define __SHA512_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Defines -------------------------------------------------------------------*/
+#define SHA512_BLOCK_LENGTH  (128) /*!< Size of a message block in bytes */
+#define SHA512_DIGEST_LENGTH (64)  /*!< Size of the digest in bytes */
+
+/* Typedefs ------------------------------------------------------------------*/
+/** Streaming SHA-512 context */
+typedef struct
+{
+    uint64_t state[8];                  /*!< Intermediate hash value */
+    uint64_t length;                    /*!< Number of bytes hashed */
+    uint8_t block[SHA512_BLOCK_LENGTH]; /*!< Bytes of the incomplete block */
+} BootloaderSha512TypeDef;
+
+/* Functions -----------------------------------------------------------------*/
+void Bootloader_Sha512Init(BootloaderSha512TypeDef* sha);
+void Bootloader_Sha512Update(BootloaderSha512TypeDef* sha,
+                             const uint8_t* data,
+                             uint32_t length);
+void Bootloader_Sha512Final(BootloaderSha512TypeDef* sha, uint8_t* digest);
+
+#endif /* __SHA512_H */
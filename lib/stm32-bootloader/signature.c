@@ -0,0 +1,573 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader Signature Verification Source
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   signature.c
+ * @brief  This file contains the verification of Ed25519ph signatures
+ *	       (RFC 8032, empty context). The signature covers the SHA-512 digest
+ *	       of the image, so the image can be hashed while it is being
+ *	       programmed and only the digest has to be checked at the end.
+ *
+ *	       The field arithmetic is based on TweetNaCl (public domain): field
+ *	       elements are stored in 16 limbs of 16 bits. The limbs of the
+ *	       multiplication operands always fit into 32 bits, so every partial
+ *	       product is a single 32x32->64-bit multiply-accumulate (SMLAL) on
+ *	       the Cortex-M4. The verification only processes public data, so it
+ *	       does not need to run in constant time: [S]B - [k]A is computed
+ *	       with a joint double-and-add over both scalars.
+ *
+ * @see    Please refer to README for detailed information.
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "signature.h"
+#include "bootloader.h"
+#include "sha512.h"
+#include <string.h>
+
+/* Private typedef -----------------------------------------------------------*/
+typedef int64_t Field[16]; /*!< Field element: 16 limbs of 16 bits */
+typedef Field Point[4];    /*!< Point in extended coordinates (X, Y, Z, T) */
+
+/* Private variables ---------------------------------------------------------*/
+/** dom2(1, "") prefix of Ed25519ph: the terminating zero of the string is the
+ * length of the empty context */
+static const uint8_t SignatureDom2[34] = "SigEd25519 no Ed25519 collisions\x01";
+
+/** Curve constant 2*d */
+static const Field FieldD2 = {0xf159, 0x26b2, 0x9b94, 0xebd6, 0xb156, 0x8283,
+                              0x149a, 0x00e0, 0xd130, 0xeef3, 0x80f2, 0x198e,
+                              0xfce7, 0x56df, 0xd9dc, 0x2406};
+
+/** Curve constant d */
+static const Field FieldD = {0x78a3, 0x1359, 0x4dca, 0x75eb, 0xd8ab, 0x4141,
+                             0x0a4d, 0x0070, 0xe898, 0x7779, 0x4079, 0x8cc7,
+                             0xfe73, 0x2b6f, 0x6cee, 0x5203};
+
+/** Square root of -1 */
+static const Field FieldI = {0xa0b0, 0x4a0e, 0x1b27, 0xc4ee, 0xe478, 0xad2f,
+                             0x1806, 0x2f43, 0xd7a7, 0x3dfb, 0x0099, 0x2b4d,
+                             0xdf0b, 0x4fc1, 0x2480, 0x2b83};
+
+/** Coordinates of the base point */
+static const Field FieldX = {0xd51a, 0x8f25, 0x2d60, 0xc956, 0xa7b2, 0x9525,
+                             0xc760, 0x692c, 0xdc5c, 0xfdd6, 0xe231, 0xc0a4,
+                             0x53fe, 0xcd6e, 0x36d3, 0x2169};
+static const Field FieldY = {0x6658, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666,
+                             0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666,
+                             0x6666, 0x6666, 0x6666, 0x6666};
+
+/** Group order L (little-endian) */
+static const uint8_t ScalarL[32] = {
+    0xed, 0xd3, 0xf5, 0x5c, 0x1a, 0x63, 0x12, 0x58, 0xd6, 0x9c, 0xf7,
+    0xa2, 0xde, 0xf9, 0xde, 0x14, 0,    0,    0,    0,    0,    0,
+    0,    0,    0,    0,    0,    0,    0,    0,    0,    0x10};
+
+/* Private function prototypes -----------------------------------------------*/
+static void Bootloader_FieldCarry(Field o);
+static void Bootloader_FieldSelect(Field p, Field q, int32_t b);
+static void Bootloader_FieldPack(uint8_t* o, const Field n);
+static void Bootloader_FieldUnpack(Field o, const uint8_t* n);
+static uint8_t Bootloader_FieldEqual(const Field a, const Field b);
+static uint8_t Bootloader_FieldParity(const Field a);
+static void Bootloader_FieldAdd(Field o, const Field a, const Field b);
+static void Bootloader_FieldSub(Field o, const Field a, const Field b);
+static void Bootloader_FieldMul(Field o, const Field a, const Field b);
+static void Bootloader_FieldInvert(Field o, const Field i);
+static void Bootloader_FieldPow2523(Field o, const Field i);
+static void Bootloader_PointAdd(Point p, Point q);
+static void Bootloader_PointPack(uint8_t* r, Point p);
+static uint8_t Bootloader_PointUnpackNeg(Point r, const uint8_t* p);
+static void Bootloader_ScalarReduce(uint8_t* r, const uint8_t* hash);
+static uint8_t Bootloader_ScalarCheck(const uint8_t* s);
+
+/**
+ * @brief  This function verifies the Ed25519ph signature of an image.
+ * @param  digest: SHA-512 digest of the image (::SHA512_DIGEST_LENGTH bytes)
+ * @param  signature: signature (::SIGNATURE_LENGTH bytes: R, S)
+ * @param  key: public key (::SIGNATURE_KEY_LENGTH bytes)
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ * @retval BL_OK: if the signature is valid
+ * @retval BL_SIGNATURE_ERROR: if the signature or the key is invalid
+ */
+uint8_t Bootloader_SignatureVerify(const uint8_t* digest,
+                                   const uint8_t* signature,
+                                   const uint8_t* key)
+{
+    BootloaderSha512TypeDef sha;
+    uint8_t hash[SHA512_DIGEST_LENGTH];
+    uint8_t k[32];
+    uint8_t r[32];
+    /* Points are static: they would take half of the 4 KB stack */
+    static Point negA;
+    static Point base;
+    static Point both;
+    static Point p;
+    int32_t i;
+    uint8_t bs;
+    uint8_t bk;
+
+    if((Bootloader_PointUnpackNeg(negA, key) != BL_OK) ||
+       (Bootloader_ScalarCheck(&signature[32]) != BL_OK))
+    {
+        return BL_SIGNATURE_ERROR;
+    }
+
+    /* k = SHA-512(dom2 || R || A || PH(M)) mod L */
+    Bootloader_Sha512Init(&sha);
+    Bootloader_Sha512Update(&sha, SignatureDom2, sizeof(SignatureDom2));
+    Bootloader_Sha512Update(&sha, signature, 32);
+    Bootloader_Sha512Update(&sha, key, SIGNATURE_KEY_LENGTH);
+    Bootloader_Sha512Update(&sha, digest, SHA512_DIGEST_LENGTH);
+    Bootloader_Sha512Final(&sha, hash);
+    Bootloader_ScalarReduce(k, hash);
+
+    /* Base point B and B - A for the joint double-and-add */
+    memcpy(base[0], FieldX, sizeof(Field));
+    memcpy(base[1], FieldY, sizeof(Field));
+    memset(base[2], 0, sizeof(Field));
+    base[2][0] = 1;
+    Bootloader_FieldMul(base[3], FieldX, FieldY);
+    memcpy(both, base, sizeof(Point));
+    Bootloader_PointAdd(both, negA);
+
+    /* p = [S]B - [k]A */
+    memset(p, 0, sizeof(Point));
+    p[1][0] = 1;
+    p[2][0] = 1;
+    for(i = 255; i >= 0; i--)
+    {
+        Bootloader_PointAdd(p, p);
+        bs = (signature[32 + i / 8] >> (i & 7)) & 1;
+        bk = (k[i / 8] >> (i & 7)) & 1;
+        if(bs && bk)
+        {
+            Bootloader_PointAdd(p, both);
+        }
+        else if(bs)
+        {
+            Bootloader_PointAdd(p, base);
+        }
+        else if(bk)
+        {
+            Bootloader_PointAdd(p, negA);
+        }
+    }
+
+    /* The signature is valid if p = R */
+    Bootloader_PointPack(r, p);
+    return (memcmp(r, signature, 32) == 0) ? BL_OK : BL_SIGNATURE_ERROR;
+}
+
+/**
+ * @brief  This function propagates the carries of a field element.
+ * @param  o: field element
+ */
+static void Bootloader_FieldCarry(Field o)
+{
+    int64_t c;
+    int32_t i;
+
+    for(i = 0; i < 16; i++)
+    {
+        o[i] += ((int64_t)1 << 16);
+        c = o[i] >> 16;
+        if(i < 15)
+        {
+            o[i + 1] += c - 1;
+        }
+        else
+        {
+            o[0] += 38 * (c - 1);
+        }
+        o[i] -= c * 0x10000;
+    }
+}
+
+/**
+ * @brief  This function swaps two field elements if b is 1.
+ * @param  p: first field element
+ * @param  q: second field element
+ * @param  b: 0 or 1
+ */
+static void Bootloader_FieldSelect(Field p, Field q, int32_t b)
+{
+    int64_t t;
+    int64_t c = ~(int64_t)(b - 1);
+    int32_t i;
+
+    for(i = 0; i < 16; i++)
+    {
+        t = c & (p[i] ^ q[i]);
+        p[i] ^= t;
+        q[i] ^= t;
+    }
+}
+
+/**
+ * @brief  This function converts a field element into its canonical
+ *         32-byte little-endian representation.
+ * @param  o: output buffer of 32 bytes
+ * @param  n: field element
+ */
+static void Bootloader_FieldPack(uint8_t* o, const Field n)
+{
+    Field m;
+    Field t;
+    int32_t i;
+    int32_t j;
+    int32_t b;
+
+    memcpy(t, n, sizeof(Field));
+    Bootloader_FieldCarry(t);
+    Bootloader_FieldCarry(t);
+    Bootloader_FieldCarry(t);
+    for(j = 0; j < 2; j++)
+    {
+        /* Subtract p = 2^255 - 19 if the value is not smaller */
+        m[0] = t[0] - 0xffed;
+        for(i = 1; i < 15; i++)
+        {
+            m[i] = t[i] - 0xffff - ((m[i - 1] >> 16) & 1);
+            m[i - 1] &= 0xffff;
+        }
+        m[15] = t[15] - 0x7fff - ((m[14] >> 16) & 1);
+        b     = (int32_t)((m[15] >> 16) & 1);
+        m[14] &= 0xffff;
+        Bootloader_FieldSelect(t, m, 1 - b);
+    }
+    for(i = 0; i < 16; i++)
+    {
+        o[2 * i]     = (uint8_t)(t[i] & 0xff);
+        o[2 * i + 1] = (uint8_t)(t[i] >> 8);
+    }
+}
+
+/**
+ * @brief  This function converts 32 little-endian bytes into a field
+ *         element. The most significant bit is ignored.
+ * @param  o: field element (output)
+ * @param  n: input buffer of 32 bytes
+ */
+static void Bootloader_FieldUnpack(Field o, const uint8_t* n)
+{
+    int32_t i;
+
+    for(i = 0; i < 16; i++)
+    {
+        o[i] = n[2 * i] + ((int64_t)n[2 * i + 1] << 8);
+    }
+    o[15] &= 0x7fff;
+}
+
+/**
+ * @brief  This function compares two field elements.
+ * @return 1 if the elements are equal, otherwise 0
+ */
+static uint8_t Bootloader_FieldEqual(const Field a, const Field b)
+{
+    uint8_t c[32];
+    uint8_t d[32];
+
+    Bootloader_FieldPack(c, a);
+    Bootloader_FieldPack(d, b);
+    return (memcmp(c, d, 32) == 0);
+}
+
+/**
+ * @brief  This function returns the least significant bit of a field
+ *         element (sign of the x coordinate).
+ */
+static uint8_t Bootloader_FieldParity(const Field a)
+{
+    uint8_t d[32];
+
+    Bootloader_FieldPack(d, a);
+    return d[0] & 1;
+}
+
+/**
+ * @brief  This function adds two field elements (without carry).
+ */
+static void Bootloader_FieldAdd(Field o, const Field a, const Field b)
+{
+    int32_t i;
+
+    for(i = 0; i < 16; i++)
+    {
+        o[i] = a[i] + b[i];
+    }
+}
+
+/**
+ * @brief  This function subtracts two field elements (without carry).
+ */
+static void Bootloader_FieldSub(Field o, const Field a, const Field b)
+{
+    int32_t i;
+
+    for(i = 0; i < 16; i++)
+    {
+        o[i] = a[i] - b[i];
+    }
+}
+
+/**
+ * @brief  This function multiplies two field elements. The limbs of the
+ *         operands fit into 32 bits (results of Bootloader_FieldMul() or
+ *         sums and differences of them), so the partial products are
+ *         calculated with 32x32-bit multiplications.
+ * @param  o: product (output, can be one of the operands)
+ * @param  a: first operand
+ * @param  b: second operand
+ */
+static void Bootloader_FieldMul(Field o, const Field a, const Field b)
+{
+    int64_t t[31];
+    int32_t i;
+    int32_t j;
+
+    memset(t, 0, sizeof(t));
+    for(i = 0; i < 16; i++)
+    {
+        for(j = 0; j < 16; j++)
+        {
+            t[i + j] += (int64_t)(int32_t)a[i] * (int32_t)b[j];
+        }
+    }
+    /* 2^256 = 38 (mod p) */
+    for(i = 0; i < 15; i++)
+    {
+        t[i] += 38 * t[i + 16];
+    }
+    memcpy(o, t, sizeof(Field));
+    Bootloader_FieldCarry(o);
+    Bootloader_FieldCarry(o);
+}
+
+/**
+ * @brief  This function calculates the inverse of a field element (i^(p-2)).
+ */
+static void Bootloader_FieldInvert(Field o, const Field i)
+{
+    Field c;
+    int32_t a;
+
+    memcpy(c, i, sizeof(Field));
+    for(a = 253; a >= 0; a--)
+    {
+        Bootloader_FieldMul(c, c, c);
+        if((a != 2) && (a != 4))
+        {
+            Bootloader_FieldMul(c, c, i);
+        }
+    }
+    memcpy(o, c, sizeof(Field));
+}
+
+/**
+ * @brief  This function calculates i^((p-5)/8), used for the square root.
+ */
+static void Bootloader_FieldPow2523(Field o, const Field i)
+{
+    Field c;
+    int32_t a;
+
+    memcpy(c, i, sizeof(Field));
+    for(a = 250; a >= 0; a--)
+    {
+        Bootloader_FieldMul(c, c, c);
+        if(a != 1)
+        {
+            Bootloader_FieldMul(c, c, i);
+        }
+    }
+    memcpy(o, c, sizeof(Field));
+}
+
+/**
+ * @brief  This function adds two points: p = p + q. The formula is unified,
+ *         so it is also used for doubling.
+ */
+static void Bootloader_PointAdd(Point p, Point q)
+{
+    Field a, b, c, d, t, e, f, g, h;
+
+    Bootloader_FieldSub(a, p[1], p[0]);
+    Bootloader_FieldSub(t, q[1], q[0]);
+    Bootloader_FieldMul(a, a, t);
+    Bootloader_FieldAdd(b, p[0], p[1]);
+    Bootloader_FieldAdd(t, q[0], q[1]);
+    Bootloader_FieldMul(b, b, t);
+    Bootloader_FieldMul(c, p[3], q[3]);
+    Bootloader_FieldMul(c, c, FieldD2);
+    Bootloader_FieldMul(d, p[2], q[2]);
+    Bootloader_FieldAdd(d, d, d);
+    Bootloader_FieldSub(e, b, a);
+    Bootloader_FieldSub(f, d, c);
+    Bootloader_FieldAdd(g, d, c);
+    Bootloader_FieldAdd(h, b, a);
+
+    Bootloader_FieldMul(p[0], e, f);
+    Bootloader_FieldMul(p[1], h, g);
+    Bootloader_FieldMul(p[2], g, f);
+    Bootloader_FieldMul(p[3], e, h);
+}
+
+/**
+ * @brief  This function encodes a point into 32 bytes.
+ */
+static void Bootloader_PointPack(uint8_t* r, Point p)
+{
+    Field tx;
+    Field ty;
+    Field zi;
+
+    Bootloader_FieldInvert(zi, p[2]);
+    Bootloader_FieldMul(tx, p[0], zi);
+    Bootloader_FieldMul(ty, p[1], zi);
+    Bootloader_FieldPack(r, ty);
+    r[31] ^= Bootloader_FieldParity(tx) << 7;
+}
+
+/**
+ * @brief  This function decodes a point and negates it. Non-canonical
+ *         encodings are rejected.
+ * @param  r: negated point (output)
+ * @param  p: encoded point (32 bytes)
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ * @retval BL_OK: upon success
+ * @retval BL_SIGNATURE_ERROR: if the encoding is invalid
+ */
+static uint8_t Bootloader_PointUnpackNeg(Point r, const uint8_t* p)
+{
+    Field t, chk, num, den, den2, den4, den6;
+    uint8_t y[32];
+
+    memset(r[2], 0, sizeof(Field));
+    r[2][0] = 1;
+    Bootloader_FieldUnpack(r[1], p);
+
+    /* The y coordinate must be smaller than p */
+    Bootloader_FieldPack(y, r[1]);
+    y[31] |= p[31] & 0x80;
+    if(memcmp(y, p, 32) != 0)
+    {
+        return BL_SIGNATURE_ERROR;
+    }
+
+    /* x^2 = (y^2 - 1) / (d*y^2 + 1) */
+    Bootloader_FieldMul(num, r[1], r[1]);
+    Bootloader_FieldMul(den, num, FieldD);
+    Bootloader_FieldSub(num, num, r[2]);
+    Bootloader_FieldAdd(den, r[2], den);
+
+    Bootloader_FieldMul(den2, den, den);
+    Bootloader_FieldMul(den4, den2, den2);
+    Bootloader_FieldMul(den6, den4, den2);
+    Bootloader_FieldMul(t, den6, num);
+    Bootloader_FieldMul(t, t, den);
+
+    Bootloader_FieldPow2523(t, t);
+    Bootloader_FieldMul(t, t, num);
+    Bootloader_FieldMul(t, t, den);
+    Bootloader_FieldMul(t, t, den);
+    Bootloader_FieldMul(r[0], t, den);
+
+    Bootloader_FieldMul(chk, r[0], r[0]);
+    Bootloader_FieldMul(chk, chk, den);
+    if(!Bootloader_FieldEqual(chk, num))
+    {
+        Bootloader_FieldMul(r[0], r[0], FieldI);
+    }
+
+    Bootloader_FieldMul(chk, r[0], r[0]);
+    Bootloader_FieldMul(chk, chk, den);
+    if(!Bootloader_FieldEqual(chk, num))
+    {
+        return BL_SIGNATURE_ERROR;
+    }
+
+    if(Bootloader_FieldParity(r[0]) == (p[31] >> 7))
+    {
+        memset(t, 0, sizeof(Field));
+        Bootloader_FieldSub(r[0], t, r[0]);
+    }
+
+    Bootloader_FieldMul(r[3], r[0], r[1]);
+    return BL_OK;
+}
+
+/**
+ * @brief  This function reduces a 64-byte hash modulo the group order L.
+ * @param  r: reduced scalar (32 bytes, output)
+ * @param  hash: hash value (64 bytes, little-endian)
+ */
+static void Bootloader_ScalarReduce(uint8_t* r, const uint8_t* hash)
+{
+    int64_t x[64];
+    int64_t carry;
+    int32_t i;
+    int32_t j;
+
+    for(i = 0; i < 64; i++)
+    {
+        x[i] = hash[i];
+    }
+
+    for(i = 63; i >= 32; i--)
+    {
+        carry = 0;
+        for(j = i - 32; j < i - 12; j++)
+        {
+            x[j] += carry - 16 * x[i] * ScalarL[j - (i - 32)];
+            carry = (x[j] + 128) >> 8;
+            x[j] -= carry * 256;
+        }
+        x[j] += carry;
+        x[i] = 0;
+    }
+
+    carry = 0;
+    for(j = 0; j < 32; j++)
+    {
+        x[j] += carry - (x[31] >> 4) * ScalarL[j];
+        carry = x[j] >> 8;
+        x[j] &= 255;
+    }
+    for(j = 0; j < 32; j++)
+    {
+        x[j] -= carry * ScalarL[j];
+    }
+    for(i = 0; i < 32; i++)
+    {
+        x[i + 1] += x[i] >> 8;
+        r[i] = (uint8_t)(x[i] & 255);
+    }
+}
+
+/**
+ * @brief  This function checks that a scalar is smaller than the group order
+ *         L, which makes the signature non-malleable.
+ * @param  s: scalar (32 bytes, little-endian)
+ * @return Bootloader error code ::eBootloaderErrorCodes
+ * @retval BL_OK: if the scalar is smaller than L
+ * @retval BL_SIGNATURE_ERROR: otherwise
+ */
+static uint8_t Bootloader_ScalarCheck(const uint8_t* s)
+{
+    int32_t i;
+
+    for(i = 31; i >= 0; i--)
+    {
+        if(s[i] != ScalarL[i])
+        {
+            return (s[i] < ScalarL[i]) ? BL_OK : BL_SIGNATURE_ERROR;
+        }
+    }
+    return BL_SIGNATURE_ERROR;
+}
@@ -0,0 +1,45 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader Signature Verification Header
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   signature.h
+ * @brief  This file contains the definitions and function prototypes of the
+ *	       image signature verification.
+ *
+ * @see    Please refer to README for detailed information.
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+#ifndef __SIGNATURE_H
+#define __SIGNATURE_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Defines -------------------------------------------------------------------*/
+#define SIGNATURE_LENGTH     (64) /*!< Size of a signature in bytes */
+#define SIGNATURE_KEY_LENGTH (32) /*!< Size of a public key in bytes */
+
+/** Public key of the image signatures: replace it with the output of
+ * `python -m python.sign_image pubkey <key>`. The default value is not a
+ * valid key, so every signature is rejected. The key can also be defined by
+ * the build.
+ */
+#ifndef SIGNATURE_PUBLIC_KEY
+#define SIGNATURE_PUBLIC_KEY                                                  \
+    {                                                                         \
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,     \
+            0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, \
+            0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF        \
+    }
+#endif
+
+/* Functions -----------------------------------------------------------------*/
+uint8_t Bootloader_SignatureVerify(const uint8_t* digest,
+                                   const uint8_t* signature,
+                                   const uint8_t* key);
+
+#endif /* __SIGNATURE_H */
@@ -0,0 +1,184 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader Boot Timeline Source
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   timeline.c
+ * @brief  This file contains the boot timeline: the end of every boot phase
+ *	       is recorded with a timestamp of the DWT cycle counter and the CPU
+ *	       clock into a ring buffer. The buffer is located in RAM which is not
+ *	       initialized at startup (::TIMELINE_ADDRESS), so it survives system
+ *	       resets and the jump into the application, which can record its own
+ *	       phases. Every boot appends its phases, starting with
+ *	       ::TIMELINE_START.
+ *
+ *	       The timeline is dumped as text lines, one entry per line:
+ *	       "TL <phase> <mhz> <cycles>" (hexadecimal), which are turned into a
+ *	       per-phase latency table on the host by python/timeline.py.
+ *
+ *	       On host builds the buffer, the cycle counter and the CPU clock are
+ *	       emulated by variables.
+ *
+ * @see    Please refer to README for detailed information.
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "timeline.h"
+
+/* Private defines -----------------------------------------------------------*/
+#if defined(USE_HAL_DRIVER)
+/** Timeline in RAM which is not initialized at startup */
+#define TIMELINE ((TimelineTypeDef*)TIMELINE_ADDRESS)
+/** Cycle counter */
+#define TIMELINE_CYCLES (DWT->CYCCNT)
+/** CPU clock in MHz */
+#define TIMELINE_MHZ (SystemCoreClock / 1000000)
+#else
+/** Emulated timeline */
+#define TIMELINE        (&Timeline)
+/** Emulated cycle counter */
+#define TIMELINE_CYCLES (Bootloader_TimelineCycles)
+/** Emulated CPU clock */
+#define TIMELINE_MHZ    (Bootloader_TimelineMhz)
+#endif
+
+/** Content of the request field if a dump is requested */
+#define TIMELINE_REQUEST (uint32_t)0x44554D50
+
+/* Public variables ----------------------------------------------------------*/
+#if !defined(USE_HAL_DRIVER)
+uint32_t Bootloader_TimelineCycles;
+uint8_t Bootloader_TimelineMhz = 4;
+#endif
+
+/* Private variables ---------------------------------------------------------*/
+#if !defined(USE_HAL_DRIVER)
+static TimelineTypeDef Timeline;
+#endif
+
+/* Private function prototypes -----------------------------------------------*/
+static void Bootloader_TimelineHex(char* str, uint32_t value, uint8_t digits);
+
+/**
+ * @brief  This function starts the timeline of a boot: the cycle counter is
+ *         enabled and ::TIMELINE_START is recorded. The timeline of the
+ *         previous boots is kept unless the buffer is invalid (power-up).
+ *         It is called first thing in main().
+ */
+void Bootloader_TimelineStart(void)
+{
+#if defined(USE_HAL_DRIVER)
+    if(!(DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk))
+    {
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CYCCNT = 0;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    }
+#endif
+
+    if(TIMELINE->magic != TIMELINE_MAGIC)
+    {
+        TIMELINE->magic   = TIMELINE_MAGIC;
+        TIMELINE->count   = 0;
+        TIMELINE->request = 0;
+    }
+    Bootloader_TimelineMark(TIMELINE_START);
+}
+
+/**
+ * @brief  This function records the end of a phase.
+ * @param  phase: phase ::eTimelinePhases
+ */
+void Bootloader_TimelineMark(uint8_t phase)
+{
+    TimelineEntryTypeDef* entry =
+        &TIMELINE->entries[TIMELINE->count % TIMELINE_SIZE];
+
+    entry->cycles = TIMELINE_CYCLES;
+    entry->phase  = phase;
+    entry->mhz    = (uint8_t)TIMELINE_MHZ;
+    entry->flags  = 0;
+    TIMELINE->count++;
+}
+
+/**
+ * @brief  This function returns the timeline, e.g. for the application to
+ *         export it.
+ * @return Pointer to the timeline
+ */
+const TimelineTypeDef* Bootloader_TimelineGet(void)
+{
+    return TIMELINE;
+}
+
+/**
+ * @brief  This function requests a dump of the timeline from the bootloader
+ *         at the next boot. It is called by the application before a system
+ *         reset.
+ */
+void Bootloader_TimelineRequestDump(void)
+{
+    TIMELINE->request = TIMELINE_REQUEST;
+}
+
+/**
+ * @brief  This function checks whether a dump of the timeline is requested.
+ *         The request is consumed.
+ * @return 1 if a dump is requested, otherwise 0
+ */
+uint8_t Bootloader_TimelineDumpRequested(void)
+{
+    if((TIMELINE->magic != TIMELINE_MAGIC) ||
+       (TIMELINE->request != TIMELINE_REQUEST))
+    {
+        return 0;
+    }
+    TIMELINE->request = 0;
+    return 1;
+}
+
+/**
+ * @brief  This function dumps the entries of the ring buffer from the oldest
+ *         to the newest as text lines.
+ * @param  print: function which outputs a string (e.g. on VCP or SWO)
+ */
+void Bootloader_TimelineDump(void (*print)(const char* str))
+{
+    char line[19] = "TL pp mm cccccccc\n";
+    const TimelineEntryTypeDef* entry;
+    uint32_t i;
+
+    if(TIMELINE->magic != TIMELINE_MAGIC)
+    {
+        return;
+    }
+
+    i = (TIMELINE->count > TIMELINE_SIZE) ? (TIMELINE->count - TIMELINE_SIZE)
+                                          : 0;
+    for(; i < TIMELINE->count; i++)
+    {
+        entry = &TIMELINE->entries[i % TIMELINE_SIZE];
+        Bootloader_TimelineHex(&line[3], entry->phase, 2);
+        Bootloader_TimelineHex(&line[6], entry->mhz, 2);
+        Bootloader_TimelineHex(&line[9], entry->cycles, 8);
+        print(line);
+    }
+}
+
+/**
+ * @brief  This function formats a value as hexadecimal digits.
+ * @param  str: destination of the digits (not terminated)
+ * @param  value: value to be formatted
+ * @param  digits: number of digits
+ */
+static void Bootloader_TimelineHex(char* str, uint32_t value, uint8_t digits)
+{
+    while(digits--)
+    {
+        str[digits] = "0123456789ABCDEF"[value & 0xF];
+        value >>= 4;
+    }
+}
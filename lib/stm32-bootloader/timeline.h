@@ -0,0 +1,100 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader Boot Timeline Header
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   timeline.h
+ * @brief  This file contains the definitions and function prototypes of the
+ *	       boot timeline.
+ *
+ * @see    Please refer to README for detailed information.
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+#ifndef __TIMELINE_H
+#define __TIMELINE_H
+
+/* Includes ------------------------------------------------------------------*/
+#include "bootloader.h"
+#include <stdint.h>
+
+/* Defines -------------------------------------------------------------------*/
+/** Address of the timeline in RAM which is not initialized by the bootloader
+ * nor by the application: start of SRAM2. The application must not use it
+ * for other purposes.
+ */
+#define TIMELINE_ADDRESS (uint32_t)0x10000000
+
+/** Number of entries of the ring buffer (power of 2) */
+#define TIMELINE_SIZE (32)
+
+/** Magic number of a valid timeline */
+#define TIMELINE_MAGIC (uint32_t)0x544C494E
+
+/** Records the end of a phase if ::USE_TIMELINE is enabled */
+#if(USE_TIMELINE)
+#define TIMELINE_MARK(phase) Bootloader_TimelineMark(phase)
+#else
+#define TIMELINE_MARK(phase) \
+    do                       \
+    {                        \
+    } while(0)
+#endif
+
+/* Enumerations --------------------------------------------------------------*/
+/** Boot phases: an entry marks the end of a phase, which started at the
+ * previous entry
+ */
+enum eTimelinePhases
+{
+    TIMELINE_START = 0,  /*!< Reset: the timeline is started */
+    TIMELINE_HAL_INIT,   /*!< HAL_Init() */
+    TIMELINE_CLOCK,      /*!< SystemClock_Config() */
+    TIMELINE_BUTTON,     /*!< Sampling of the button */
+    TIMELINE_SD_INIT,    /*!< SD card initialization */
+    TIMELINE_MOUNT,      /*!< f_mount() */
+    TIMELINE_ERASE,      /*!< Flash erase */
+    TIMELINE_PROGRAM,    /*!< Flash programming */
+    TIMELINE_VERIFY,     /*!< Verification */
+    TIMELINE_CHECK,      /*!< Validation of the application */
+    TIMELINE_LAUNCH,     /*!< Shutdown of the peripherals before the jump */
+    TIMELINE_JUMP,       /*!< Jump and startup: marked by the application */
+    TIMELINE_USER = 0x80 /*!< First phase defined by the application */
+};
+
+/* Typedefs ------------------------------------------------------------------*/
+/** Entry of the timeline */
+typedef struct
+{
+    uint8_t phase;   /*!< Phase ::eTimelinePhases */
+    uint8_t mhz;     /*!< CPU clock at the end of the phase [MHz] */
+    uint16_t flags;  /*!< Reserved */
+    uint32_t cycles; /*!< DWT cycle counter at the end of the phase */
+} TimelineEntryTypeDef;
+
+/** Timeline: ring buffer of the last ::TIMELINE_SIZE entries */
+typedef struct
+{
+    uint32_t magic;   /*!< ::TIMELINE_MAGIC if the content is valid */
+    uint32_t count;   /*!< Number of entries recorded since power-up */
+    uint32_t request; /*!< Dump requested by the application */
+    TimelineEntryTypeDef entries[TIMELINE_SIZE];
+} TimelineTypeDef;
+
+/* Functions -----------------------------------------------------------------*/
+void Bootloader_TimelineStart(void);
+void Bootloader_TimelineMark(uint8_t phase);
+const TimelineTypeDef* Bootloader_TimelineGet(void);
+void Bootloader_TimelineRequestDump(void);
+uint8_t Bootloader_TimelineDumpRequested(void);
+void Bootloader_TimelineDump(void (*print)(const char* str));
+
+#if !defined(USE_HAL_DRIVER)
+/** Cycle counter and CPU clock of host builds: can be modified by tests */
+extern uint32_t Bootloader_TimelineCycles;
+extern uint8_t Bootloader_TimelineMhz;
+#endif
+
+#endif /* __TIMELINE_H */
@@ -15,11 +15,13 @@
 
 #include "main.h"
 #include "bootloader.h"
+#include "fastboot.h"
 #include "fatfs.h"
 #include "stm32l4xx.h"
 
 /* Private variables ---------------------------------------------------------*/
 static uint8_t BTNcounter = 0;
+static uint32_t SDBuffer[CONF_BUFFER_SIZE / 4];
 
 /* External variables --------------------------------------------------------*/
 extern char SDPath[4]; /* SD logical drive path */
@@ -28,6 +30,7 @@ extern FIL SDFile;     /* File object for SD */
 
 /* Function prototypes -------------------------------------------------------*/
 void Enter_Bootloader(void);
+void Fast_Boot(void);
 uint8_t SD_Init(void);
 void SD_DeInit(void);
 void SD_Eject(void);
@@ -40,10 +43,25 @@ void print(const char* str);
 /* Main ----------------------------------------------------------------------*/
 int main(void)
 {
+#if(USE_FAST_BOOT)
+    uint8_t action;
+
+    Bootloader_FastBootStart();
+#endif
     HAL_Init();
-    SystemClock_Config();
     GPIO_Init();
 
+#if(USE_FAST_BOOT)
+    /* Launch the application right away unless an update is triggered */
+    action = Bootloader_FastBootCheck(IS_BTN_PRESSED());
+    if(action == FASTBOOT_LAUNCH)
+    {
+        Fast_Boot();
+    }
+#endif
+
+    SystemClock_Config();
+
     LED_ALL_ON();
     print("\nPower up, Boot started.");
     HAL_Delay(500);
@@ -60,6 +78,15 @@ int main(void)
 #endif
     }
 
+#if(USE_FAST_BOOT)
+    /* Update requested by the application: no need to wait for the button */
+    if(action == FASTBOOT_REQUESTED)
+    {
+        print("Update requested, entering Bootloader...");
+        Enter_Bootloader();
+    }
+#endif
+
     /* Check for user action:
         - button is pressed >= 1 second:  Enter Bootloader. Green LED is
           blinking.
@@ -173,9 +200,8 @@ void Enter_Bootloader(void)
     UINT num;
     uint8_t i;
     uint8_t status;
-    uint64_t data;
     uint32_t cntr;
-    uint32_t addr;
+    BootloaderStatsTypeDef stats;
     char msg[40] = {0x00};
 
     /* Check for flash write protection */
@@ -253,11 +279,24 @@ void Enter_Bootloader(void)
     Bootloader_Init();
 
     /* Step 2: Erase Flash */
+#if(USE_LAZY_ERASE || USE_DIFF_UPDATE)
+    print("Flash is erased during programming.");
+#else
     print("Erasing flash...");
     LED_Y_ON();
-    Bootloader_Erase();
+    status = Bootloader_EraseRange(f_size(&SDFile));
     LED_Y_OFF();
+    if(status != BL_OK)
+    {
+        print("Flash erase error.");
+
+        f_close(&SDFile);
+        SD_Eject();
+        print("SD ejected.");
+        return;
+    }
     print("Flash erase finished.");
+#endif
 
     /* If BTN is pressed, then skip programming */
     if(IS_BTN_PRESSED())
@@ -277,18 +316,26 @@ void Enter_Bootloader(void)
     Bootloader_FlashBegin();
     do
     {
-        data = 0xFFFFFFFFFFFFFFFF;
-        fr   = f_read(&SDFile, &data, 8, &num);
+        fr = f_read(&SDFile, SDBuffer, sizeof(SDBuffer), &num);
         if(num)
         {
-            status = Bootloader_FlashNext(data);
+            status = Bootloader_FlashWrite((uint8_t*)SDBuffer, num);
             if(status == BL_OK)
             {
-                cntr++;
+                cntr += num;
             }
             else
             {
-                sprintf(msg, "Programming error at: %lu byte", (cntr * 8));
+                Bootloader_GetStats(&stats);
+                if(status == BL_VERIFY_ERROR)
+                {
+                    sprintf(msg, "Verification error at: %lu byte.",
+                            stats.mismatch);
+                }
+                else
+                {
+                    sprintf(msg, "Programming error at: %lu byte", stats.bytes);
+                }
                 print(msg);
 
                 f_close(&SDFile);
@@ -300,71 +347,53 @@ void Enter_Bootloader(void)
                 return;
             }
         }
-        if(cntr % 256 == 0)
+        if(cntr % 2048 == 0)
         {
             /* Toggle green LED during programming */
             LED_G_TG();
         }
     } while((fr == FR_OK) && (num > 0));
 
-    /* Step 4: Finalize Programming */
-    Bootloader_FlashEnd();
+    /* Step 4: Finalize Programming. The flash content is verified against
+     * the data read from the SD card during programming. */
+    status = Bootloader_FlashEnd();
     f_close(&SDFile);
     LED_G_OFF();
     LED_Y_OFF();
-    print("Programming finished.");
-    sprintf(msg, "Flashed: %lu bytes.", (cntr * 8));
-    print(msg);
-
-    /* Open file for verification */
-    fr = f_open(&SDFile, CONF_FILENAME, FA_READ);
-    if(fr != FR_OK)
+    Bootloader_GetStats(&stats);
+    if(status == BL_VERIFY_ERROR)
     {
-        /* f_open failed */
-        print("File cannot be opened.");
-        sprintf(msg, "FatFs error code: %u", fr);
+        sprintf(msg, "Verification error at: %lu byte.", stats.mismatch);
         print(msg);
 
         SD_Eject();
         print("SD ejected.");
         return;
     }
-
-    /* Step 5: Verify Flash Content */
-    addr = APP_ADDRESS;
-    cntr = 0;
-    do
+    else if(status != BL_OK)
     {
-        data = 0xFFFFFFFFFFFFFFFF;
-        fr   = f_read(&SDFile, &data, 4, &num);
-        if(num)
-        {
-            if(*(uint32_t*)addr == (uint32_t)data)
-            {
-                addr += 4;
-                cntr++;
-            }
-            else
-            {
-                sprintf(msg, "Verification error at: %lu byte.", (cntr * 4));
-                print(msg);
+        sprintf(msg, "Programming error at: %lu byte", stats.bytes);
+        print(msg);
 
-                f_close(&SDFile);
-                SD_Eject();
-                print("SD ejected.");
+        SD_Eject();
+        print("SD ejected.");
+        return;
+    }
+    print("Programming finished.");
+    sprintf(msg, "Flashed: %lu bytes.", cntr);
+    print(msg);
+    sprintf(msg, "Programming speed: %lu bytes/s.", stats.rate);
+    print(msg);
+#if(USE_LAZY_ERASE || USE_DIFF_UPDATE)
+    sprintf(msg, "Erased: %lu pages.", stats.erased);
+    print(msg);
+#endif
+#if(USE_DIFF_UPDATE)
+    sprintf(msg, "Unchanged: %lu pages.", stats.skipped);
+    print(msg);
+#endif
 
-                LED_G_OFF();
-                return;
-            }
-        }
-        if(cntr % 256 == 0)
-        {
-            /* Toggle green LED during verification */
-            LED_G_TG();
-        }
-    } while((fr == FR_OK) && (num > 0));
     print("Verification passed.");
-    LED_G_OFF();
 
     /* Eject SD card */
     SD_Eject();
@@ -381,6 +410,31 @@ void Enter_Bootloader(void)
 #endif
 }
 
+/**
+ * @brief  This function launches the application right after reset (fast
+ *         boot): the clock and the SD card are not initialized and the LED
+ *         sequence is skipped. The boot latency is reported to
+ *         Bootloader_FastBootHook().
+ * @return The function only returns if the application cannot be launched
+ */
+void Fast_Boot(void)
+{
+    if(Bootloader_CheckForApplication() != BL_OK)
+    {
+        return;
+    }
+#if(USE_CHECKSUM)
+    if(Bootloader_VerifyChecksum() != BL_OK)
+    {
+        return;
+    }
+#endif
+
+    GPIO_DeInit();
+    Bootloader_FastBootHook(Bootloader_FastBootCycles());
+    Bootloader_JumpToApplication();
+}
+
 /*** SD Card ******************************************************************/
 uint8_t SD_Init(void)
 {
@@ -6,6 +6,8 @@
 #define CONF_BUILD "2018-04-18"
 /* File name of application located on SD card */
 #define CONF_FILENAME "GPP.bin"
+/* Size of the data chunks read from SD card during programming [bytes] */
+#define CONF_BUFFER_SIZE 512
 /* For development/debugging: stdout/stderr via SWO trace */
 #define USE_SWO_TRACE 1
 /******************************************************************************/
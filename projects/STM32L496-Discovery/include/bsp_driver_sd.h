@@ -7,6 +7,21 @@
 /* Exported types ------------------------------------------------------------*/
 #define BSP_SD_CardInfo HAL_SD_CardInfoTypeDef
 
+/* Negotiated mode and statistics of the DMA reads */
+typedef struct
+{
+    uint8_t speed;      /* Bus speed mode: SD_SPEED_DEFAULT or SD_SPEED_HIGH */
+    uint32_t clock;     /* SDMMC_CK frequency in Hz */
+    uint32_t bytes;     /* Bytes read in DMA mode */
+    uint32_t cycles;    /* CPU cycles of the DMA reads (DWT) */
+    uint32_t errors;    /* Transfer errors */
+    uint32_t stepdowns; /* Clock step downs after errors */
+    uint32_t init;      /* Card initialization time in microseconds */
+    uint8_t cached;     /* 1: card parameters restored from the cache */
+    uint32_t hits;      /* Initializations using the cache since power-on */
+    uint32_t misses;    /* Initializations identifying the card */
+} BSP_SD_StatsTypeDef;
+
 /* Exported constants --------------------------------------------------------*/
 #define MSD_OK                   ((uint8_t)0x00)
 #define MSD_ERROR                ((uint8_t)0x01)
@@ -21,6 +36,48 @@
 
 #define SD_DATATIMEOUT (150U) /* ms */
 
+/* Card initialization */
+#define SD_INIT_TRIES     (5U)    /* Tries of the identification sequence */
+#define SD_ACMD41_TIMEOUT (1000U) /* ms, power up limit of the card */
+#define SD_POWERUP_TIME   (2U)    /* ms, supply ramp-up since the reset */
+#define SD_POWERUP_CLOCKS (74U)   /* Clocks before the first command */
+#define SD_OCR_POWERUP    ((uint32_t)0x80000000) /* OCR power up status */
+#define SD_CACHE_MAGIC    ((uint32_t)0x53444331) /* "SDC1" */
+
+/* Address of the cache of the card parameters in RAM which is not initialized
+ * by the bootloader nor by the application: SRAM2, after the boot timeline
+ * (timeline.h) and the handoff block (handoff.h). The application must not
+ * use it for other purposes. */
+#define SD_CACHE_ADDRESS ((uint32_t)0x10000400)
+
+/* Command sequences of multiple block reads */
+#define SD_READ_CMD12 ((uint8_t)0x00) /* READ_MULTIPLE_BLOCK + STOP */
+#define SD_READ_CMD23 ((uint8_t)0x01) /* SET_BLOCK_COUNT + READ_MULTIPLE */
+
+/* CMD23 support bit of the SCR (CMD_SUPPORT, bit 33 of the register) */
+#define SD_SCR_CMD23_SUPPORT ((uint32_t)0x00000002)
+
+/* Physical layer version of the SCR (SD_SPEC, bits 59..56 of the register) */
+#define SD_SCR_SPEC(scr) (((scr) >> 24) & 0x0F)
+
+/* Bus speed modes */
+#define SD_SPEED_DEFAULT ((uint8_t)0x00) /* Default Speed, up to 25 MHz */
+#define SD_SPEED_HIGH    ((uint8_t)0x01) /* High Speed, up to 50 MHz */
+
+/* Maximum clock frequency of High Speed mode in Hz */
+#define SD_HIGH_SPEED_MAX (50000000U)
+
+/* SWITCH_FUNC (CMD6) arguments: check or set function 1 (High Speed) of
+ * group 1, the other groups are left unchanged */
+#define SD_SWITCH_CHECK_HS ((uint32_t)0x00FFFFF1)
+#define SD_SWITCH_SET_HS   ((uint32_t)0x80FFFFF1)
+
+/* Errors after which the clock is stepped down */
+#define SD_STEPDOWN_ERRORS                                      \
+    (HAL_SD_ERROR_CMD_CRC_FAIL | HAL_SD_ERROR_DATA_CRC_FAIL |   \
+     HAL_SD_ERROR_CMD_RSP_TIMEOUT | HAL_SD_ERROR_DATA_TIMEOUT | \
+     HAL_SD_ERROR_TX_UNDERRUN | HAL_SD_ERROR_RX_OVERRUN)
+
 #define SDMMC_IRQ_PRIO  1
 #define SD_DMA_IRQ_PRIO 2
 
@@ -41,8 +98,11 @@ uint8_t BSP_SD_ReadBlocks_DMA(uint32_t* pData,
 uint8_t BSP_SD_WriteBlocks_DMA(uint32_t* pData,
                                uint32_t WriteAddr,
                                uint32_t NumOfBlocks);
+uint8_t BSP_SD_Abort(void);
 uint8_t BSP_SD_Erase(uint32_t StartAddr, uint32_t EndAddr);
 uint8_t BSP_SD_GetCardState(void);
+uint8_t BSP_SD_GetReadCommand(void);
+void BSP_SD_GetStats(BSP_SD_StatsTypeDef* stats);
 void BSP_SD_GetCardInfo(BSP_SD_CardInfo* CardInfo);
 uint8_t BSP_SD_IsDetected(void);
 
@@ -4,6 +4,22 @@
 /*** Application-Specific Configuration ***************************************/
 /* File name of application located on SD card */
 #define CONF_FILENAME "app-demo.bin"
+/* File name of delta patch located on SD card (see USE_DELTA_PATCH) */
+#define CONF_PATCHNAME "app-demo.patch"
+/* File name of compressed application on SD card (see USE_COMPRESSION) */
+#define CONF_COMPRESSEDNAME "app-demo.hs"
+/* File name of the signature of the installed image (see USE_SIGNATURE) */
+#define CONF_SIGNATURENAME "app-demo.sig"
+/* Size of the data chunks read from SD card during programming [bytes],
+ * multiple of the sector size: the next chunk is read into a second buffer
+ * while a chunk is programmed */
+#define CONF_BUFFER_SIZE 4096
+/* Size of the cluster link map table used for fast seek in the base image */
+#define CONF_CLMT_SIZE 64
+/* Read contiguous image files straight from the SD card, by raw sector reads
+ * of CONF_BUFFER_SIZE bytes instead of f_read() (see rawstream.h). Requires
+ * _USE_FASTSEEK of FatFs */
+#define USE_RAW_STREAM 1
 /* For development/debugging: print messages to ST-LINK VCP */
 #define USE_VCP 1
 /******************************************************************************/
@@ -34,6 +50,10 @@ enum eApplicationErrorCodes
     ERR_FLASH,
     ERR_VERIFY,
     ERR_OBP,
+    ERR_PATCH,
+    ERR_DECOMPRESS,
+    ERR_HEADER,
+    ERR_SIGNATURE,
 };
 
 /* Hardware Macros -----------------------------------------------------------*/
@@ -8,4 +8,7 @@
 /* Exported constants --------------------------------------------------------*/
 extern const Diskio_drvTypeDef SD_Driver;
 
+/* Exported functions --------------------------------------------------------*/
+void SD_ReadAhead(BYTE* buff, UINT count);
+
 #endif
@@ -20,6 +20,7 @@ void DebugMon_Handler(void);
 void PendSV_Handler(void);
 void SysTick_Handler(void);
 
+void DMA2_Channel4_IRQHandler(void);
 void DMA2_Channel5_IRQHandler(void);
 void SDMMC1_IRQHandler(void);
 
@@ -8,26 +8,95 @@
  *	       This file contains the implementation of the SD BSP driver used by
  *         the FatFs module. The driver uses the HAL library of ST.
  *
+ *         Cards supporting it are switched to High Speed mode (CMD6) and
+ *         clocked with the SDMMC kernel clock (clock bypass). Upon CRC or
+ *         timeout errors the clock is stepped down (see sd_clockdiv).
+ *
+ *         The card keeps its address, bus width and speed mode over a reset
+ *         of the MCU: its parameters are cached in SRAM2, which is not
+ *         initialized by the startup (SD_CACHE_ADDRESS), and restored instead
+ *         of running the identification sequence if the card answers with
+ *         the cached CID.
+ *
  *******************************************************************************
  * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
  *******************************************************************************
  */
 
 #include "bsp_driver_sd.h"
+#include <stddef.h>
+#include <string.h>
 
 /* Variables -----------------------------------------------------------------*/
 SD_HandleTypeDef hsd1;
 
+/* Private variables ---------------------------------------------------------*/
+static DMA_HandleTypeDef hdma_rx;
+static DMA_HandleTypeDef hdma_tx;
+
+/* Command sequence of multiple block reads, selected by the SCR of the card */
+static uint8_t sd_readcmd = SD_READ_CMD12;
+
+/* Clock steps: the kernel clock (bypass, High Speed mode only), then the
+ * kernel clock divided by (ClockDiv + 2) */
+#define SD_CLOCK_BYPASS 0xFF
+static const uint8_t sd_clockdiv[] = {SD_CLOCK_BYPASS, 0, 2, 6};
+static uint8_t sd_clockstep        = 1;
+
+/* SDMMC kernel clock, read by BSP_SD_Init(): the clock is stepped down by the
+ * error callback, which runs from RAM while the flash is modified, and the
+ * RCC extended driver stays in flash */
+static uint32_t sd_kernelclock = 0;
+
+/* Card parameters kept over a reset of the MCU (SD_CACHE_ADDRESS) */
+typedef struct
+{
+    uint32_t magic;
+    uint32_t cid[4];
+    uint32_t csd[4];
+    uint32_t scr[2];
+    HAL_SD_CardInfoTypeDef card;
+    uint32_t hits;   /* Initializations restoring the cached parameters */
+    uint32_t misses; /* Initializations identifying the card */
+    uint32_t check;
+} SD_CacheTypeDef;
+#define SD_CACHE ((SD_CacheTypeDef*)SD_CACHE_ADDRESS)
+
+/* Negotiated mode and transfer statistics */
+static BSP_SD_StatsTypeDef sd_stats;
+static uint32_t sd_xferstart = 0;
+static uint32_t sd_xferbytes = 0;
+
 /* Private function prototypes -----------------------------------------------*/
 static void BSP_SD_MspInit(void);
 static void BSP_SD_MspDeInit(void);
-static HAL_StatusTypeDef SD_DMAConfigRx(SD_HandleTypeDef* hsd);
-static HAL_StatusTypeDef SD_DMAConfigTx(SD_HandleTypeDef* hsd);
+static void SD_PowerOn(uint32_t ClockDiv);
+static uint32_t SD_IdentifyCard(void);
+static uint32_t SD_ResumeCard(void);
+static uint32_t SD_ConfigureBus(void);
+static uint32_t SD_CacheChecksum(void);
+static uint32_t SD_SendCommand(uint32_t index,
+                               uint32_t argument,
+                               uint32_t response);
+static void SD_GetLongResponse(uint32_t* pResponse);
+static HAL_StatusTypeDef SD_DMAConfigRx(void);
+static HAL_StatusTypeDef SD_DMAConfigTx(void);
+static uint32_t SD_ReadFIFO(uint32_t* pData, uint32_t NumOfWords);
+static uint32_t SD_ReadSCR(uint32_t* pSCR);
+static uint32_t SD_SwitchHighSpeed(void);
+static void SD_SetClock(uint8_t step);
+static uint32_t SD_CmdSetBlockCount(uint32_t NumOfBlocks);
+static HAL_StatusTypeDef SD_ReadBlocksCounted_DMA(uint8_t* pData,
+                                                  uint32_t ReadAddr,
+                                                  uint32_t NumOfBlocks);
+static void SD_DMAReadCplt(DMA_HandleTypeDef* hdma);
+static void SD_DMAReadError(DMA_HandleTypeDef* hdma);
 
 /* External function prototypes ----------------------------------------------*/
 extern void Error_Handler(void);
 extern void SD_ReadCpltCallback(void);
 extern void SD_WriteCpltCallback(void);
+extern void SD_ErrorCallback(void);
 
 /**
  * @brief  Initializes the SD card device.
@@ -35,7 +104,18 @@ extern void SD_WriteCpltCallback(void);
  */
 uint8_t BSP_SD_Init(void)
 {
+    uint32_t errorstate = HAL_SD_ERROR_REQUEST_NOT_APPLICABLE;
+    uint32_t start;
     uint8_t tries;
+    uint8_t valid;
+
+    /* Enable the cycle counter for the init time and transfer statistics */
+    if(!(DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk))
+    {
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    }
+    start = DWT->CYCCNT;
 
     /* Check if the SD card is plugged in the slot */
     if(BSP_SD_IsDetected() != SD_PRESENT)
@@ -52,30 +132,95 @@ uint8_t BSP_SD_Init(void)
     hsd1.Init.HardwareFlowControl = SDMMC_HARDWARE_FLOW_CONTROL_ENABLE;
     hsd1.Init.ClockDiv            = 0;
 
-    for(tries = 0; tries < 5; ++tries)
+    /* Msp SD initialization */
+    BSP_SD_MspDeInit();
+    BSP_SD_MspInit();
+    sd_kernelclock = HAL_RCCEx_GetPeriphCLKFreq(RCC_PERIPHCLK_SDMMC1);
+    hsd1.Lock      = HAL_UNLOCKED;
+    hsd1.State     = HAL_SD_STATE_BUSY;
+
+    /* The cache is invalid after a power-on */
+    valid = (SD_CACHE->magic == SD_CACHE_MAGIC) &&
+            (SD_CACHE->check == SD_CacheChecksum());
+
+    /* Fast path: the card is still selected or in standby state since the
+     * last run of the bootloader, its parameters are restored. The card is
+     * in data transfer mode, the commands are sent at the transfer clock. */
+    sd_stats.cached = 0;
+    if(valid)
     {
-        /* Msp SD initialization */
-        BSP_SD_MspDeInit();
-        BSP_SD_MspInit();
-
-        /* HAL SD initialization */
-        if(HAL_SD_Init(&hsd1) != HAL_OK)
+        SD_PowerOn(hsd1.Init.ClockDiv);
+        errorstate = SD_ResumeCard();
+        if(errorstate == HAL_SD_ERROR_NONE)
         {
-            continue;
+            SDMMC_Init(hsd1.Instance, hsd1.Init);
+            errorstate = SD_ConfigureBus();
         }
+        sd_stats.cached = (errorstate == HAL_SD_ERROR_NONE);
+    }
+    else
+    {
+        /* Cold start: the statistics of the cache start over */
+        SD_CACHE->hits   = 0;
+        SD_CACHE->misses = 0;
+    }
 
-        /* Enable wide operation */
-        if(HAL_SD_ConfigWideBusOperation(&hsd1, SDMMC_BUS_WIDE_4B) != HAL_OK)
+    /* Identification of the card */
+    if(errorstate != HAL_SD_ERROR_NONE)
+    {
+        SD_CACHE->magic = 0;
+    }
+    for(tries = 0; (errorstate != HAL_SD_ERROR_NONE) && (tries < SD_INIT_TRIES);
+        ++tries)
+    {
+        SD_PowerOn(SDMMC_INIT_CLK_DIV);
+        errorstate = SD_IdentifyCard();
+        if(errorstate == HAL_SD_ERROR_CMD_RSP_TIMEOUT)
         {
-            /* Retry */
-            continue;
+            /* No answer to CMD55: no card in the slot, do not retry */
+            hsd1.State = HAL_SD_STATE_READY;
+            return MSD_ERROR_SD_NOT_PRESENT;
         }
+        if(errorstate == HAL_SD_ERROR_NONE)
+        {
+            SDMMC_Init(hsd1.Instance, hsd1.Init);
+            errorstate = SD_ReadSCR(SD_CACHE->scr);
+        }
+        if(errorstate == HAL_SD_ERROR_NONE)
+        {
+            errorstate = SD_ConfigureBus();
+        }
+    }
+    if(errorstate != HAL_SD_ERROR_NONE)
+    {
+        hsd1.State = HAL_SD_STATE_READY;
+        return MSD_ERROR;
+    }
 
-        /* Everything is ok */
-        return MSD_OK;
+    /* Update the cache of the card parameters and its statistics */
+    if(sd_stats.cached)
+    {
+        SD_CACHE->hits++;
     }
+    else
+    {
+        memcpy(SD_CACHE->cid, hsd1.CID, sizeof(SD_CACHE->cid));
+        memcpy(SD_CACHE->csd, hsd1.CSD, sizeof(SD_CACHE->csd));
+        SD_CACHE->card = hsd1.SdCard;
+        SD_CACHE->misses++;
+    }
+    SD_CACHE->magic = SD_CACHE_MAGIC;
+    SD_CACHE->check = SD_CacheChecksum();
+    sd_stats.hits   = SD_CACHE->hits;
+    sd_stats.misses = SD_CACHE->misses;
+
+    hsd1.ErrorCode = HAL_SD_ERROR_NONE;
+    hsd1.Context   = SD_CONTEXT_NONE;
+    hsd1.State     = HAL_SD_STATE_READY;
+    sd_stats.init  = (DWT->CYCCNT - start) / (SystemCoreClock / 1000000U);
 
-    return MSD_ERROR;
+    /* Everything is ok */
+    return MSD_OK;
 }
 
 /**
@@ -181,15 +326,23 @@ uint8_t BSP_SD_ReadBlocks_DMA(uint32_t* pData,
 {
     HAL_StatusTypeDef sd_state = HAL_OK;
 
-    /* Invalidate the dma tx handle*/
+    /* Select the rx channel (configured in BSP_SD_MspInit), the HAL aborts
+     * the channel of the linked handle upon error */
+    hsd1.hdmarx = &hdma_rx;
     hsd1.hdmatx = NULL;
 
-    /* Prepare the dma channel for a read operation */
-    sd_state = SD_DMAConfigRx(&hsd1);
+    sd_xferstart = DWT->CYCCNT;
+    sd_xferbytes = NumOfBlocks * BLOCKSIZE;
 
-    if(sd_state == HAL_OK)
+    /* Read block(s) in DMA transfer mode: CMD17, CMD23 + CMD18 or
+     * CMD18 + CMD12 */
+    if((NumOfBlocks > 1) && (sd_readcmd == SD_READ_CMD23))
+    {
+        sd_state =
+            SD_ReadBlocksCounted_DMA((uint8_t*)pData, ReadAddr, NumOfBlocks);
+    }
+    else
     {
-        /* Read block(s) in DMA transfer mode */
         sd_state = HAL_SD_ReadBlocks_DMA(&hsd1, (uint8_t*)pData, ReadAddr,
                                          NumOfBlocks);
     }
@@ -210,22 +363,26 @@ uint8_t BSP_SD_WriteBlocks_DMA(uint32_t* pData,
 {
     HAL_StatusTypeDef sd_state = HAL_OK;
 
-    /* Invalidate the dma rx handle*/
+    /* Select the tx channel (configured in BSP_SD_MspInit) */
     hsd1.hdmarx = NULL;
+    hsd1.hdmatx = &hdma_tx;
 
-    /* Prepare the dma channel for a read operation */
-    sd_state = SD_DMAConfigTx(&hsd1);
-
-    if(sd_state == HAL_OK)
-    {
-        /* Write block(s) in DMA transfer mode */
-        sd_state = HAL_SD_WriteBlocks_DMA(&hsd1, (uint8_t*)pData, WriteAddr,
-                                          NumOfBlocks);
-    }
+    /* Write block(s) in DMA transfer mode */
+    sd_state =
+        HAL_SD_WriteBlocks_DMA(&hsd1, (uint8_t*)pData, WriteAddr, NumOfBlocks);
 
     return (sd_state == HAL_OK) ? MSD_OK : MSD_ERROR;
 }
 
+/**
+ * @brief  Aborts the running transfer.
+ * @retval SD status
+ */
+uint8_t BSP_SD_Abort(void)
+{
+    return (HAL_SD_Abort(&hsd1) == HAL_OK) ? MSD_OK : MSD_ERROR;
+}
+
 /**
  * @brief  Erases the specified memory area of the given SD card.
  * @param  StartAddr: Start byte address
@@ -244,6 +401,25 @@ uint8_t BSP_SD_Erase(uint32_t StartAddr, uint32_t EndAddr)
     return sd_state;
 }
 
+/**
+ * @brief  Gets the command sequence of multiple block reads.
+ * @retval SD_READ_CMD23 or SD_READ_CMD12
+ */
+uint8_t BSP_SD_GetReadCommand(void)
+{
+    return sd_readcmd;
+}
+
+/**
+ * @brief  Gets the negotiated mode and the transfer statistics.
+ * @param  stats: Pointer to the statistics
+ * @retval None
+ */
+void BSP_SD_GetStats(BSP_SD_StatsTypeDef* stats)
+{
+    *stats = sd_stats;
+}
+
 /**
  * @brief  Gets the current SD card data status.
  * @param  None
@@ -311,8 +487,18 @@ void HAL_SD_AbortCallback(SD_HandleTypeDef* hsd)
  */
 void HAL_SD_ErrorCallback(SD_HandleTypeDef* hsd)
 {
-    UNUSED(hsd);
-    Error_Handler();
+    sd_stats.errors++;
+
+    /* Step down the clock upon signal integrity errors, the transfer is
+     * retried by the caller */
+    if((hsd->ErrorCode & SD_STEPDOWN_ERRORS) &&
+       ((sd_clockstep + 1U) < (sizeof(sd_clockdiv) / sizeof(sd_clockdiv[0]))))
+    {
+        SD_SetClock(sd_clockstep + 1);
+        sd_stats.stepdowns++;
+    }
+
+    SD_ErrorCallback();
 }
 
 /**
@@ -322,6 +508,10 @@ void HAL_SD_ErrorCallback(SD_HandleTypeDef* hsd)
  */
 void HAL_SD_RxCpltCallback(SD_HandleTypeDef* hsd)
 {
+    UNUSED(hsd);
+    sd_stats.bytes += sd_xferbytes;
+    sd_stats.cycles += DWT->CYCCNT - sd_xferstart;
+
     SD_ReadCpltCallback();
 }
 
@@ -332,6 +522,7 @@ void HAL_SD_RxCpltCallback(SD_HandleTypeDef* hsd)
  */
 void HAL_SD_TxCpltCallback(SD_HandleTypeDef* hsd)
 {
+    UNUSED(hsd);
     SD_WriteCpltCallback();
 }
 
@@ -373,10 +564,12 @@ void BSP_SD_MspInit(void)
     HAL_NVIC_SetPriority(SDMMC1_IRQn, SDMMC_IRQ_PRIO, 0);
     HAL_NVIC_EnableIRQ(SDMMC1_IRQn);
 
-    /* DMA initialization should be done here but
-     * (as there is only one channel for RX and TX)
-     * it is configured and done directly when required.
-     */
+    /* DMA configuration: SDMMC1 is served by DMA2 Channel5 (rx) and
+     * Channel4 (tx), only the channel of the running transfer is enabled */
+    if((SD_DMAConfigRx() != HAL_OK) || (SD_DMAConfigTx() != HAL_OK))
+    {
+        Error_Handler();
+    }
 }
 
 /**
@@ -414,6 +607,20 @@ void BSP_SD_MspDeInit(void)
 
     /* NVIC configuration for SDMMC1 interrupts */
     HAL_NVIC_DisableIRQ(SDMMC1_IRQn);
+
+    /* DMA de-initialization */
+    HAL_NVIC_DisableIRQ(DMA2_Channel5_IRQn);
+    HAL_NVIC_DisableIRQ(DMA2_Channel4_IRQn);
+    if(hdma_rx.Instance != NULL)
+    {
+        HAL_DMA_DeInit(&hdma_rx);
+    }
+    if(hdma_tx.Instance != NULL)
+    {
+        HAL_DMA_DeInit(&hdma_tx);
+    }
+    hsd1.hdmarx = NULL;
+    hsd1.hdmatx = NULL;
 }
 
 /**
@@ -421,10 +628,9 @@ void BSP_SD_MspDeInit(void)
  * @retval
  *  HAL_ERROR or HAL_OK
  */
-static HAL_StatusTypeDef SD_DMAConfigRx(SD_HandleTypeDef* hsd)
+static HAL_StatusTypeDef SD_DMAConfigRx(void)
 {
-    static DMA_HandleTypeDef hdma_rx;
-    HAL_StatusTypeDef status = HAL_ERROR;
+    HAL_StatusTypeDef status;
 
     /* Configure DMA Rx parameters */
     hdma_rx.Instance                 = DMA2_Channel5;
@@ -437,13 +643,7 @@ static HAL_StatusTypeDef SD_DMAConfigRx(SD_HandleTypeDef* hsd)
     hdma_rx.Init.Priority            = DMA_PRIORITY_VERY_HIGH;
 
     /* Associate the DMA handle */
-    __HAL_LINKDMA(hsd, hdmarx, hdma_rx);
-
-    /* Stop any ongoing transfer and reset the state */
-    HAL_DMA_Abort(&hdma_rx);
-
-    /* Deinitialize the Channel for new transfer */
-    HAL_DMA_DeInit(&hdma_rx);
+    __HAL_LINKDMA(&hsd1, hdmarx, hdma_rx);
 
     /* Configure the DMA Channel */
     status = HAL_DMA_Init(&hdma_rx);
@@ -460,13 +660,12 @@ static HAL_StatusTypeDef SD_DMAConfigRx(SD_HandleTypeDef* hsd)
  * @retval
  *  HAL_ERROR or HAL_OK
  */
-static HAL_StatusTypeDef SD_DMAConfigTx(SD_HandleTypeDef* hsd)
+static HAL_StatusTypeDef SD_DMAConfigTx(void)
 {
-    static DMA_HandleTypeDef hdma_tx;
     HAL_StatusTypeDef status;
 
     /* Configure DMA Tx parameters */
-    hdma_tx.Instance                 = DMA2_Channel5;
+    hdma_tx.Instance                 = DMA2_Channel4;
     hdma_tx.Init.Request             = DMA_REQUEST_7;
     hdma_tx.Init.Direction           = DMA_MEMORY_TO_PERIPH;
     hdma_tx.Init.PeriphInc           = DMA_PINC_DISABLE;
@@ -476,20 +675,631 @@ static HAL_StatusTypeDef SD_DMAConfigTx(SD_HandleTypeDef* hsd)
     hdma_tx.Init.Priority            = DMA_PRIORITY_VERY_HIGH;
 
     /* Associate the DMA handle */
-    __HAL_LINKDMA(hsd, hdmatx, hdma_tx);
-
-    /* Stop any ongoing transfer and reset the state */
-    HAL_DMA_Abort(&hdma_tx);
-
-    /* Deinitialize the Channel for new transfer */
-    HAL_DMA_DeInit(&hdma_tx);
+    __HAL_LINKDMA(&hsd1, hdmatx, hdma_tx);
 
     /* Configure the DMA Channel */
     status = HAL_DMA_Init(&hdma_tx);
 
     /* NVIC configuration for DMA transfer complete interrupt */
-    HAL_NVIC_SetPriority(DMA2_Channel5_IRQn, SD_DMA_IRQ_PRIO, 0);
-    HAL_NVIC_EnableIRQ(DMA2_Channel5_IRQn);
+    HAL_NVIC_SetPriority(DMA2_Channel4_IRQn, SD_DMA_IRQ_PRIO, 0);
+    HAL_NVIC_EnableIRQ(DMA2_Channel4_IRQn);
 
     return status;
 }
+
+/**
+ * @brief Power on the SDMMC interface on 1 data line and wait for the power up
+ *        time of the card: 1 ms after the supply ramp-up (from the reset of
+ *        the MCU) and 74 clocks.
+ * @param ClockDiv: Clock divider, SDMMC_INIT_CLK_DIV for the identification
+ *        clock (400 kHz)
+ * @retval None
+ */
+static void SD_PowerOn(uint32_t ClockDiv)
+{
+    SDMMC_InitTypeDef init = hsd1.Init;
+    uint32_t cycles = SystemCoreClock / (sd_kernelclock / (ClockDiv + 2U)) *
+                      SD_POWERUP_CLOCKS;
+    uint32_t start;
+
+    init.ClockBypass         = SDMMC_CLOCK_BYPASS_DISABLE;
+    init.BusWide             = SDMMC_BUS_WIDE_1B;
+    init.HardwareFlowControl = SDMMC_HARDWARE_FLOW_CONTROL_DISABLE;
+    init.ClockDiv            = ClockDiv;
+    SDMMC_Init(hsd1.Instance, init);
+
+    __HAL_SD_DISABLE(&hsd1);
+    SDMMC_PowerState_ON(hsd1.Instance);
+    __HAL_SD_ENABLE(&hsd1);
+
+    while(HAL_GetTick() < SD_POWERUP_TIME)
+    {
+    }
+    start = DWT->CYCCNT;
+    while((DWT->CYCCNT - start) < cycles)
+    {
+    }
+}
+
+/**
+ * @brief Identify the card and select it: it follows HAL_SD_InitCard(), but
+ *        ACMD41 is polled back to back within the 1 s limit of the
+ *        specification instead of a number of trials.
+ * @retval SD error state (HAL_SD_ERROR_NONE upon success),
+ *         HAL_SD_ERROR_CMD_RSP_TIMEOUT if no card answers
+ */
+static uint32_t SD_IdentifyCard(void)
+{
+    HAL_SD_CardCSDTypedef csd;
+    uint32_t errorstate;
+    uint32_t argument;
+    uint32_t response;
+    uint32_t tickstart;
+    uint16_t rca = 1;
+
+    /* CMD0: GO_IDLE_STATE, CMD8: SEND_IF_COND (V2.0 cards only) */
+    errorstate = SDMMC_CmdGoIdleState(hsd1.Instance);
+    if(errorstate != HAL_SD_ERROR_NONE)
+    {
+        return errorstate;
+    }
+    if(SDMMC_CmdOperCond(hsd1.Instance) == HAL_SD_ERROR_NONE)
+    {
+        hsd1.SdCard.CardVersion = CARD_V2_X;
+        argument                = SDMMC_HIGH_CAPACITY;
+    }
+    else
+    {
+        hsd1.SdCard.CardVersion = CARD_V1_X;
+        argument                = SDMMC_STD_CAPACITY;
+    }
+
+    /* CMD55 + ACMD41: SD_SEND_OP_COND until the card is powered up */
+    tickstart = HAL_GetTick();
+    do
+    {
+        errorstate = SDMMC_CmdAppCommand(hsd1.Instance, 0);
+        if(errorstate != HAL_SD_ERROR_NONE)
+        {
+            return errorstate;
+        }
+        errorstate = SDMMC_CmdAppOperCommand(hsd1.Instance, argument);
+        if(errorstate != HAL_SD_ERROR_NONE)
+        {
+            return HAL_SD_ERROR_UNSUPPORTED_FEATURE;
+        }
+        response = SDMMC_GetResponse(hsd1.Instance, SDMMC_RESP1);
+        if(!(response & SD_OCR_POWERUP) &&
+           ((HAL_GetTick() - tickstart) >= SD_ACMD41_TIMEOUT))
+        {
+            return HAL_SD_ERROR_INVALID_VOLTRANGE;
+        }
+    } while(!(response & SD_OCR_POWERUP));
+    hsd1.SdCard.CardType =
+        (response & SDMMC_HIGH_CAPACITY) ? CARD_SDHC_SDXC : CARD_SDSC;
+
+    /* CMD2: ALL_SEND_CID, CMD3: SEND_RELATIVE_ADDR, CMD9: SEND_CSD */
+    errorstate = SDMMC_CmdSendCID(hsd1.Instance);
+    if(errorstate != HAL_SD_ERROR_NONE)
+    {
+        return errorstate;
+    }
+    SD_GetLongResponse(hsd1.CID);
+    errorstate = SDMMC_CmdSetRelAdd(hsd1.Instance, &rca);
+    if(errorstate != HAL_SD_ERROR_NONE)
+    {
+        return errorstate;
+    }
+    hsd1.SdCard.RelCardAdd = rca;
+    errorstate = SDMMC_CmdSendCSD(hsd1.Instance, (uint32_t)rca << 16);
+    if(errorstate != HAL_SD_ERROR_NONE)
+    {
+        return errorstate;
+    }
+    SD_GetLongResponse(hsd1.CSD);
+    hsd1.SdCard.Class = hsd1.CSD[1] >> 20;
+    HAL_SD_GetCardCSD(&hsd1, &csd);
+
+    /* CMD7: SELECT_CARD */
+    return SDMMC_CmdSelDesel(hsd1.Instance, (uint32_t)rca << 16);
+}
+
+/**
+ * @brief Restore the cached parameters of the card and select it. The card
+ *        must answer at the cached address (CMD13) with the cached CID.
+ * @retval SD error state (HAL_SD_ERROR_NONE upon success)
+ */
+static uint32_t SD_ResumeCard(void)
+{
+    uint32_t rca = SD_CACHE->card.RelCardAdd << 16;
+    uint32_t errorstate;
+    uint32_t cid[4];
+
+    /* CMD13: SEND_STATUS, a card which was reset does not answer */
+    errorstate = SDMMC_CmdSendStatus(hsd1.Instance, rca);
+    if(errorstate != HAL_SD_ERROR_NONE)
+    {
+        return errorstate;
+    }
+    switch((SDMMC_GetResponse(hsd1.Instance, SDMMC_RESP1) >> 9) & 0x0F)
+    {
+        case HAL_SD_CARD_TRANSFER:
+            /* CMD7 with address 0 deselects the card, without response */
+            errorstate =
+                SD_SendCommand(SDMMC_CMD_SEL_DESEL_CARD, 0, SDMMC_RESPONSE_NO);
+            break;
+        case HAL_SD_CARD_STANDBY:
+            break;
+        default:
+            errorstate = HAL_SD_ERROR_REQUEST_NOT_APPLICABLE;
+            break;
+    }
+    if(errorstate != HAL_SD_ERROR_NONE)
+    {
+        return errorstate;
+    }
+
+    /* CMD10: SEND_CID, the cache belongs to this card */
+    errorstate = SD_SendCommand(SDMMC_CMD_SEND_CID, rca, SDMMC_RESPONSE_LONG);
+    if(errorstate != HAL_SD_ERROR_NONE)
+    {
+        return errorstate;
+    }
+    SD_GetLongResponse(cid);
+    if(memcmp(cid, SD_CACHE->cid, sizeof(cid)) != 0)
+    {
+        return HAL_SD_ERROR_REQUEST_NOT_APPLICABLE;
+    }
+
+    memcpy(hsd1.CID, SD_CACHE->cid, sizeof(hsd1.CID));
+    memcpy(hsd1.CSD, SD_CACHE->csd, sizeof(hsd1.CSD));
+    hsd1.SdCard = SD_CACHE->card;
+
+    /* CMD7: SELECT_CARD */
+    return SDMMC_CmdSelDesel(hsd1.Instance, rca);
+}
+
+/**
+ * @brief Configure the 4-bit bus (ACMD6) and the capabilities of the card
+ *        given by its SCR: SET_BLOCK_COUNT (CMD23) is used instead of
+ *        STOP_TRANSMISSION (CMD12) if the card supports it, and High Speed
+ *        mode if the card implements CMD6 (SD_SPEC 1.10 or later).
+ * @retval SD error state (HAL_SD_ERROR_NONE upon success)
+ */
+static uint32_t SD_ConfigureBus(void)
+{
+    uint32_t errorstate;
+
+    if(!(SD_CACHE->scr[1] & SDMMC_WIDE_BUS_SUPPORT))
+    {
+        return HAL_SD_ERROR_REQUEST_NOT_APPLICABLE;
+    }
+    errorstate = SDMMC_CmdAppCommand(hsd1.Instance,
+                                     (uint32_t)hsd1.SdCard.RelCardAdd << 16);
+    if(errorstate != HAL_SD_ERROR_NONE)
+    {
+        return errorstate;
+    }
+    errorstate = SDMMC_CmdBusWidth(hsd1.Instance, 2);
+    if(errorstate != HAL_SD_ERROR_NONE)
+    {
+        return errorstate;
+    }
+
+    sd_readcmd     = (SD_CACHE->scr[1] & SD_SCR_CMD23_SUPPORT) ? SD_READ_CMD23
+                                                               : SD_READ_CMD12;
+    sd_stats.speed = SD_SPEED_DEFAULT;
+    SD_SetClock(1);
+    if((SD_SCR_SPEC(SD_CACHE->scr[1]) >= 1) &&
+       (SD_SwitchHighSpeed() == HAL_SD_ERROR_NONE))
+    {
+        sd_stats.speed = SD_SPEED_HIGH;
+        if(sd_kernelclock <= SD_HIGH_SPEED_MAX)
+        {
+            SD_SetClock(0);
+        }
+    }
+
+    return HAL_SD_ERROR_NONE;
+}
+
+/**
+ * @brief Compute the checksum of the cache of the card parameters
+ * @retval Checksum of the words preceding the check word of the cache
+ */
+static uint32_t SD_CacheChecksum(void)
+{
+    const uint32_t* word = (const uint32_t*)SD_CACHE;
+    uint32_t check       = 0;
+    uint32_t i;
+
+    for(i = 0; i < (offsetof(SD_CacheTypeDef, check) / sizeof(uint32_t)); i++)
+    {
+        check = ((check << 5) | (check >> 27)) ^ word[i];
+    }
+    return ~check;
+}
+
+/**
+ * @brief Send a command and wait for its response (or for its end if it has
+ *        no response). The response is not checked.
+ * @param index: Command index
+ * @param argument: Command argument
+ * @param response: SDMMC_RESPONSE_NO, SDMMC_RESPONSE_SHORT or
+ *        SDMMC_RESPONSE_LONG
+ * @retval SD error state (HAL_SD_ERROR_NONE upon success)
+ */
+static uint32_t SD_SendCommand(uint32_t index,
+                               uint32_t argument,
+                               uint32_t response)
+{
+    SDMMC_CmdInitTypeDef command;
+    uint32_t count = SDMMC_CMDTIMEOUT * (SystemCoreClock / 8U / 1000U);
+    uint32_t flags =
+        (response == SDMMC_RESPONSE_NO)
+            ? SDMMC_FLAG_CMDSENT
+            : (SDMMC_FLAG_CCRCFAIL | SDMMC_FLAG_CMDREND | SDMMC_FLAG_CTIMEOUT);
+
+    command.Argument         = argument;
+    command.CmdIndex         = index;
+    command.Response         = response;
+    command.WaitForInterrupt = SDMMC_WAIT_NO;
+    command.CPSM             = SDMMC_CPSM_ENABLE;
+    SDMMC_SendCommand(hsd1.Instance, &command);
+
+    /* The tick may not advance here (completion interrupt) */
+    while(!__HAL_SD_GET_FLAG(&hsd1, flags))
+    {
+        if(count-- == 0)
+        {
+            return HAL_SD_ERROR_TIMEOUT;
+        }
+    }
+
+    if(__HAL_SD_GET_FLAG(&hsd1, SDMMC_FLAG_CTIMEOUT))
+    {
+        __HAL_SD_CLEAR_FLAG(&hsd1, SDMMC_FLAG_CTIMEOUT);
+        return HAL_SD_ERROR_CMD_RSP_TIMEOUT;
+    }
+    if(__HAL_SD_GET_FLAG(&hsd1, SDMMC_FLAG_CCRCFAIL))
+    {
+        __HAL_SD_CLEAR_FLAG(&hsd1, SDMMC_FLAG_CCRCFAIL);
+        return HAL_SD_ERROR_CMD_CRC_FAIL;
+    }
+    __HAL_SD_CLEAR_FLAG(&hsd1, SDMMC_STATIC_FLAGS);
+
+    return HAL_SD_ERROR_NONE;
+}
+
+/**
+ * @brief Get the long response (R2) of the last command
+ * @param pResponse: Pointer to the 4 words of the response
+ * @retval None
+ */
+static void SD_GetLongResponse(uint32_t* pResponse)
+{
+    pResponse[0] = SDMMC_GetResponse(hsd1.Instance, SDMMC_RESP1);
+    pResponse[1] = SDMMC_GetResponse(hsd1.Instance, SDMMC_RESP2);
+    pResponse[2] = SDMMC_GetResponse(hsd1.Instance, SDMMC_RESP3);
+    pResponse[3] = SDMMC_GetResponse(hsd1.Instance, SDMMC_RESP4);
+}
+
+/**
+ * @brief Read the data block of a command in polling mode
+ * @param pData: Pointer to the buffer that will contain the data
+ * @param NumOfWords: Number of 32-bit words of the block
+ * @retval SD error state (HAL_SD_ERROR_NONE upon success)
+ */
+static uint32_t SD_ReadFIFO(uint32_t* pData, uint32_t NumOfWords)
+{
+    uint32_t errorstate = HAL_SD_ERROR_NONE;
+    uint32_t tickstart  = HAL_GetTick();
+    uint32_t index      = 0;
+
+    while(!__HAL_SD_GET_FLAG(&hsd1, SDMMC_FLAG_RXOVERR | SDMMC_FLAG_DCRCFAIL |
+                                        SDMMC_FLAG_DTIMEOUT |
+                                        SDMMC_FLAG_DBCKEND))
+    {
+        if(__HAL_SD_GET_FLAG(&hsd1, SDMMC_FLAG_RXDAVL) && (index < NumOfWords))
+        {
+            pData[index++] = SDMMC_ReadFIFO(hsd1.Instance);
+        }
+        if((HAL_GetTick() - tickstart) >= SD_DATATIMEOUT)
+        {
+            return HAL_SD_ERROR_TIMEOUT;
+        }
+    }
+
+    /* Empty the FIFO */
+    while(__HAL_SD_GET_FLAG(&hsd1, SDMMC_FLAG_RXDAVL) && (index < NumOfWords))
+    {
+        pData[index++] = SDMMC_ReadFIFO(hsd1.Instance);
+    }
+
+    if(__HAL_SD_GET_FLAG(&hsd1, SDMMC_FLAG_DTIMEOUT))
+    {
+        errorstate = HAL_SD_ERROR_DATA_TIMEOUT;
+    }
+    else if(__HAL_SD_GET_FLAG(&hsd1, SDMMC_FLAG_DCRCFAIL))
+    {
+        errorstate = HAL_SD_ERROR_DATA_CRC_FAIL;
+    }
+    else if(__HAL_SD_GET_FLAG(&hsd1, SDMMC_FLAG_RXOVERR) ||
+            (index < NumOfWords))
+    {
+        errorstate = HAL_SD_ERROR_RX_OVERRUN;
+    }
+    __HAL_SD_CLEAR_FLAG(&hsd1, SDMMC_STATIC_FLAGS);
+
+    return errorstate;
+}
+
+/**
+ * @brief Read the SD Configuration Register (ACMD51) in polling mode
+ * @param pSCR: SCR, pSCR[1] holds the bits 63..32
+ * @retval SD error state (HAL_SD_ERROR_NONE upon success)
+ */
+static uint32_t SD_ReadSCR(uint32_t* pSCR)
+{
+    SDMMC_DataInitTypeDef config;
+    uint32_t errorstate;
+    uint32_t data[2] = {0, 0};
+
+    errorstate = SDMMC_CmdBlockLength(hsd1.Instance, 8);
+    if(errorstate != HAL_SD_ERROR_NONE)
+    {
+        return errorstate;
+    }
+    errorstate = SDMMC_CmdAppCommand(hsd1.Instance,
+                                     (uint32_t)hsd1.SdCard.RelCardAdd << 16);
+    if(errorstate != HAL_SD_ERROR_NONE)
+    {
+        return errorstate;
+    }
+
+    config.DataTimeOut   = SDMMC_DATATIMEOUT;
+    config.DataLength    = 8;
+    config.DataBlockSize = SDMMC_DATABLOCK_SIZE_8B;
+    config.TransferDir   = SDMMC_TRANSFER_DIR_TO_SDMMC;
+    config.TransferMode  = SDMMC_TRANSFER_MODE_BLOCK;
+    config.DPSM          = SDMMC_DPSM_ENABLE;
+    SDMMC_ConfigData(hsd1.Instance, &config);
+
+    errorstate = SDMMC_CmdSendSCR(hsd1.Instance);
+    if(errorstate == HAL_SD_ERROR_NONE)
+    {
+        errorstate = SD_ReadFIFO(data, 2);
+    }
+
+    /* The SCR is sent MSB first */
+    pSCR[1] = __REV(data[0]);
+    pSCR[0] = __REV(data[1]);
+
+    return errorstate;
+}
+
+/**
+ * @brief Switch the card to High Speed mode (CMD6 SWITCH_FUNC): the support
+ *        of function 1 of group 1 is checked (mode 0), then the function is
+ *        selected (mode 1). The status is sent MSB first (bit 511).
+ * @retval SD error state (HAL_SD_ERROR_NONE upon success)
+ */
+static uint32_t SD_SwitchHighSpeed(void)
+{
+    static const uint32_t arguments[2] = {SD_SWITCH_CHECK_HS, SD_SWITCH_SET_HS};
+    SDMMC_DataInitTypeDef config;
+    uint32_t status[16];
+    uint8_t* bytes = (uint8_t*)status;
+    uint32_t errorstate;
+    uint8_t mode;
+
+    for(mode = 0; mode < 2; mode++)
+    {
+        errorstate = SDMMC_CmdBlockLength(hsd1.Instance, sizeof(status));
+        if(errorstate != HAL_SD_ERROR_NONE)
+        {
+            return errorstate;
+        }
+
+        config.DataTimeOut   = SDMMC_DATATIMEOUT;
+        config.DataLength    = sizeof(status);
+        config.DataBlockSize = SDMMC_DATABLOCK_SIZE_64B;
+        config.TransferDir   = SDMMC_TRANSFER_DIR_TO_SDMMC;
+        config.TransferMode  = SDMMC_TRANSFER_MODE_BLOCK;
+        config.DPSM          = SDMMC_DPSM_ENABLE;
+        SDMMC_ConfigData(hsd1.Instance, &config);
+
+        errorstate = SDMMC_CmdSwitch(hsd1.Instance, arguments[mode]);
+        if(errorstate == HAL_SD_ERROR_NONE)
+        {
+            errorstate = SD_ReadFIFO(status, 16);
+        }
+        if(errorstate != HAL_SD_ERROR_NONE)
+        {
+            return errorstate;
+        }
+
+        /* Bit 401: High Speed supported, bits 379..376: selected function */
+        if(!(bytes[13] & 0x02) || ((bytes[16] & 0x0F) != 0x01))
+        {
+            return HAL_SD_ERROR_UNSUPPORTED_FEATURE;
+        }
+    }
+
+    return HAL_SD_ERROR_NONE;
+}
+
+/**
+ * @brief Set the SDMMC clock of the 4-bit bus
+ * @param step: Clock step (index of sd_clockdiv)
+ * @retval None
+ */
+static void SD_SetClock(uint8_t step)
+{
+    SDMMC_InitTypeDef init = hsd1.Init;
+
+    init.BusWide = SDMMC_BUS_WIDE_4B;
+    if(sd_clockdiv[step] == SD_CLOCK_BYPASS)
+    {
+        init.ClockBypass = SDMMC_CLOCK_BYPASS_ENABLE;
+        init.ClockDiv    = 0;
+        sd_stats.clock   = sd_kernelclock;
+    }
+    else
+    {
+        init.ClockBypass = SDMMC_CLOCK_BYPASS_DISABLE;
+        init.ClockDiv    = sd_clockdiv[step];
+        sd_stats.clock   = sd_kernelclock / (sd_clockdiv[step] + 2);
+    }
+    SDMMC_Init(hsd1.Instance, init);
+    sd_clockstep = step;
+}
+
+/**
+ * @brief Send SET_BLOCK_COUNT (CMD23) and check the response
+ * @param NumOfBlocks: Number of blocks of the following CMD18
+ * @retval SD error state (HAL_SD_ERROR_NONE upon success)
+ */
+static uint32_t SD_CmdSetBlockCount(uint32_t NumOfBlocks)
+{
+    uint32_t errorstate;
+
+    errorstate = SD_SendCommand(SDMMC_CMD_SET_BLOCK_COUNT, NumOfBlocks,
+                                SDMMC_RESPONSE_SHORT);
+    if(errorstate != HAL_SD_ERROR_NONE)
+    {
+        return errorstate;
+    }
+
+    if((SDMMC_GetCommandResponse(hsd1.Instance) != SDMMC_CMD_SET_BLOCK_COUNT) ||
+       (SDMMC_GetResponse(hsd1.Instance, SDMMC_RESP1) & SDMMC_OCR_ERRORBITS))
+    {
+        return HAL_SD_ERROR_GENERAL_UNKNOWN_ERR;
+    }
+
+    return HAL_SD_ERROR_NONE;
+}
+
+/**
+ * @brief Read blocks in DMA mode with a pre-declared block count (CMD23 +
+ *        CMD18): the card ends the transfer by itself, so no STOP_TRANSMISSION
+ *        (CMD12) and no busy wait follow the data. It follows
+ *        HAL_SD_ReadBlocks_DMA(), the transfer is completed by
+ *        SD_DMAReadCplt().
+ * @param pData: Pointer to the buffer that will contain the data
+ * @param ReadAddr: Address from where data is to be read
+ * @param NumOfBlocks: Number of SD blocks to read (2..65535)
+ * @retval HAL status
+ */
+static HAL_StatusTypeDef SD_ReadBlocksCounted_DMA(uint8_t* pData,
+                                                  uint32_t ReadAddr,
+                                                  uint32_t NumOfBlocks)
+{
+    SDMMC_DataInitTypeDef config;
+    uint32_t errorstate;
+
+    if(hsd1.State != HAL_SD_STATE_READY)
+    {
+        return HAL_BUSY;
+    }
+    if(((ReadAddr + NumOfBlocks) > hsd1.SdCard.LogBlockNbr) ||
+       (NumOfBlocks > 0xFFFF))
+    {
+        hsd1.ErrorCode |= HAL_SD_ERROR_ADDR_OUT_OF_RANGE;
+        return HAL_ERROR;
+    }
+
+    hsd1.ErrorCode       = HAL_SD_ERROR_NONE;
+    hsd1.State           = HAL_SD_STATE_BUSY;
+    hsd1.Instance->DCTRL = 0U;
+
+    __HAL_SD_ENABLE_IT(&hsd1, (SDMMC_IT_DCRCFAIL | SDMMC_IT_DTIMEOUT |
+                               SDMMC_IT_RXOVERR | SDMMC_IT_DATAEND));
+
+    hsd1.hdmarx->XferCpltCallback  = SD_DMAReadCplt;
+    hsd1.hdmarx->XferErrorCallback = SD_DMAReadError;
+    hsd1.hdmarx->XferAbortCallback = NULL;
+    HAL_DMA_Start_IT(hsd1.hdmarx, (uint32_t)&hsd1.Instance->FIFO,
+                     (uint32_t)pData, (BLOCKSIZE * NumOfBlocks) / 4);
+    __HAL_SD_DMA_ENABLE(&hsd1);
+
+    if(hsd1.SdCard.CardType != CARD_SDHC_SDXC)
+    {
+        ReadAddr *= 512U;
+    }
+
+    /* CMD23 has to be followed by the read command */
+    errorstate = SDMMC_CmdBlockLength(hsd1.Instance, BLOCKSIZE);
+    if(errorstate == HAL_SD_ERROR_NONE)
+    {
+        errorstate = SD_CmdSetBlockCount(NumOfBlocks);
+    }
+    if(errorstate == HAL_SD_ERROR_NONE)
+    {
+        config.DataTimeOut   = SDMMC_DATATIMEOUT;
+        config.DataLength    = BLOCKSIZE * NumOfBlocks;
+        config.DataBlockSize = SDMMC_DATABLOCK_SIZE_512B;
+        config.TransferDir   = SDMMC_TRANSFER_DIR_TO_SDMMC;
+        config.TransferMode  = SDMMC_TRANSFER_MODE_BLOCK;
+        config.DPSM          = SDMMC_DPSM_ENABLE;
+        SDMMC_ConfigData(hsd1.Instance, &config);
+
+        /* The HAL does not send CMD12 at the end of single block contexts */
+        hsd1.Context = (SD_CONTEXT_READ_SINGLE_BLOCK | SD_CONTEXT_DMA);
+        errorstate   = SDMMC_CmdReadMultiBlock(hsd1.Instance, ReadAddr);
+    }
+
+    if(errorstate != HAL_SD_ERROR_NONE)
+    {
+        __HAL_SD_DISABLE_IT(&hsd1, (SDMMC_IT_DCRCFAIL | SDMMC_IT_DTIMEOUT |
+                                    SDMMC_IT_RXOVERR | SDMMC_IT_DATAEND));
+        hsd1.Instance->DCTRL &= ~SDMMC_DCTRL_DMAEN;
+        HAL_DMA_Abort(hsd1.hdmarx);
+        __HAL_SD_CLEAR_FLAG(&hsd1, SDMMC_STATIC_FLAGS);
+        hsd1.ErrorCode |= errorstate;
+        hsd1.Context = SD_CONTEXT_NONE;
+        hsd1.State   = HAL_SD_STATE_READY;
+        return HAL_ERROR;
+    }
+
+    return HAL_OK;
+}
+
+/**
+ * @brief DMA complete callback of SD_ReadBlocksCounted_DMA()
+ * @param hdma: DMA handle
+ * @retval None
+ */
+static void SD_DMAReadCplt(DMA_HandleTypeDef* hdma)
+{
+    UNUSED(hdma);
+
+    hsd1.Instance->DCTRL &= ~SDMMC_DCTRL_DMAEN;
+    __HAL_SD_CLEAR_FLAG(&hsd1, SDMMC_STATIC_DATA_FLAGS);
+    hsd1.Context = SD_CONTEXT_NONE;
+    hsd1.State   = HAL_SD_STATE_READY;
+
+    HAL_SD_RxCpltCallback(&hsd1);
+}
+
+/**
+ * @brief DMA error callback of SD_ReadBlocksCounted_DMA()
+ * @param hdma: DMA handle
+ * @retval None
+ */
+static void SD_DMAReadError(DMA_HandleTypeDef* hdma)
+{
+    UNUSED(hdma);
+
+    __HAL_SD_DISABLE_IT(&hsd1, (SDMMC_IT_DCRCFAIL | SDMMC_IT_DTIMEOUT |
+                                SDMMC_IT_RXOVERR | SDMMC_IT_DATAEND));
+    __HAL_SD_CLEAR_FLAG(&hsd1, SDMMC_STATIC_FLAGS);
+
+    /* The card may still be sending the remaining blocks */
+    hsd1.ErrorCode |= HAL_SD_ERROR_DMA;
+    hsd1.ErrorCode |= SDMMC_CmdStopTransfer(hsd1.Instance);
+    hsd1.Context = SD_CONTEXT_NONE;
+    hsd1.State   = HAL_SD_STATE_READY;
+
+    HAL_SD_ErrorCallback(&hsd1);
+}
@@ -14,14 +14,54 @@
  */
 
 #include "main.h"
+#include "bank.h"
 #include "bootloader.h"
+#include "decompress.h"
+#include "fastboot.h"
 #include "fatfs.h"
+#include "flashops.h"
+#include "image.h"
+#include "patch.h"
+#include "rawstream.h"
+#include "signature.h"
 #include "stm32l4xx.h"
+#include "timeline.h"
 #include <string.h>
 
+/* Private typedef -----------------------------------------------------------*/
+/** Consumer of the file content during programming */
+typedef uint8_t (*pStreamWrite)(const uint8_t* data, uint32_t length);
+
 /* Private variables ---------------------------------------------------------*/
 static uint8_t BTNcounter = 0;
+/** Chunks read from the SD card: one is programmed while the SD card fills
+ * the other one (see SD_ReadAhead) */
+static uint32_t SDBuffer[2][CONF_BUFFER_SIZE / 4];
 static UART_HandleTypeDef huart2;
+#if(USE_DELTA_PATCH)
+static FIL PatchFile;
+static DWORD PatchClmt[CONF_CLMT_SIZE];
+static BootloaderPatchTypeDef Patch;
+#endif
+#if(USE_COMPRESSION)
+static BootloaderDecompressTypeDef Decomp;
+#endif
+#if(USE_RAW_STREAM)
+static BootloaderRawStreamTypeDef RawStream;
+#endif
+#if(USE_FLASH_RAMFUNC)
+/** Vector table used while the bootloader modifies the flash (see
+ * Vectors_Relocate): system exceptions and interrupts of the device, aligned
+ * to the next power of two of its size as required by VTOR */
+#define VECTORS_SIZE (16 + DMA2D_IRQn + 1)
+#if defined(__ICCARM__)
+#pragma data_alignment = 512
+static uint32_t Vectors[VECTORS_SIZE];
+#else
+static uint32_t Vectors[VECTORS_SIZE] __attribute__((aligned(512)));
+#endif
+static uint32_t VectorsFlash;
+#endif
 
 /* External variables --------------------------------------------------------*/
 extern char SDPath[4]; /* SD logical drive path */
@@ -30,6 +70,25 @@ extern FIL SDFile;     /* File object for SD */
 
 /* Function prototypes -------------------------------------------------------*/
 uint8_t Enter_Bootloader(void);
+uint8_t Program_Stream(FIL* file,
+                       uint32_t size,
+                       pStreamWrite write,
+                       uint8_t readAhead);
+uint8_t Verify_Signature(void);
+void Activate_Update(void);
+void Enable_WriteProtection(void);
+#if(USE_DELTA_PATCH)
+uint8_t Apply_Patch(void);
+uint8_t Patch_ReadBase(uint32_t offset, uint8_t* data, uint32_t length);
+uint8_t Patch_Write(const uint8_t* data, uint32_t length);
+#endif
+#if(USE_COMPRESSION)
+uint8_t Apply_Compressed(void);
+uint8_t Decompress_Write(const uint8_t* data, uint32_t length);
+#endif
+void Fast_Boot(void);
+void Vectors_Relocate(void);
+void Vectors_Restore(void);
 uint8_t SD_Init(void);
 void SD_DeInit(void);
 void SD_Eject(void);
@@ -44,14 +103,42 @@ void print(const char* str);
 /* Main ----------------------------------------------------------------------*/
 int main(void)
 {
+#if(USE_FAST_BOOT)
+    uint8_t action;
+
+    Bootloader_FastBootStart();
+#endif
+#if(USE_TIMELINE)
+    Bootloader_TimelineStart();
+#endif
     HAL_Init();
-    SystemClock_Config();
+    TIMELINE_MARK(TIMELINE_HAL_INIT);
     GPIO_Init();
 
+#if(USE_FAST_BOOT)
+    /* Launch the application right away unless an update is triggered */
+    action = Bootloader_FastBootCheck(IS_BTN_PRESSED());
+    if(action == FASTBOOT_LAUNCH)
+    {
+        Fast_Boot();
+    }
+#endif
+
+    SystemClock_Config();
+    TIMELINE_MARK(TIMELINE_CLOCK);
+
 #if(USE_VCP)
     UART2_Init();
 #endif /* USE_VCP */
 
+#if(USE_TIMELINE)
+    /* Dump the timeline of the previous boots if requested */
+    if(Bootloader_TimelineDumpRequested())
+    {
+        Bootloader_TimelineDump(print);
+    }
+#endif
+
     print("\nPower up, Boot started.\n");
 
     /* Check system reset flags */
@@ -65,6 +152,17 @@ int main(void)
 #endif
     }
 
+#if(USE_FAST_BOOT)
+    /* Update requested by the application: no need to wait for the button */
+    if(action == FASTBOOT_REQUESTED)
+    {
+        print("Update requested, entering Bootloader...\n");
+        Vectors_Relocate();
+        Enter_Bootloader();
+        Vectors_Restore();
+    }
+#endif
+
     /* Check for user action:
         - button is pressed >= 1 second:  Enter Bootloader. LD2 is blinking.
         - button is pressed >= 4 seconds: Enter ST System Memory. LD3 is
@@ -109,6 +207,7 @@ int main(void)
     }
 
     LED_ALL_OFF();
+    TIMELINE_MARK(TIMELINE_BUTTON);
 
     /* Perform required actions based on button press duration */
     if(BTNcounter < 90)
@@ -122,14 +221,27 @@ int main(void)
         else if(BTNcounter > 10)
         {
             print("Entering Bootloader...\n");
+            Vectors_Relocate();
             Enter_Bootloader();
+            Vectors_Restore();
         }
     }
 
+#if(USE_DUAL_BANK)
+    print((Bootloader_GetActiveBank() == BANK_1) ? "Active bank: 1\n"
+                                                 : "Active bank: 2\n");
+#endif
+#if(USE_DUAL_BANK || USE_ROLLBACK)
+    /* Select the bank with a valid application: if the application of the
+     * active bank is invalid or has not been confirmed by the application,
+     * the other bank is activated (system reset) */
+    if(Bootloader_SelectBank() == BL_OK)
+#else
     /* Check if there is application in user flash area */
     if(Bootloader_CheckForApplication() == BL_OK)
+#endif
     {
-#if(USE_CHECKSUM)
+#if(USE_CHECKSUM && !USE_DUAL_BANK)
         /* Verify application checksum */
         if(Bootloader_VerifyChecksum() != BL_OK)
         {
@@ -141,6 +253,7 @@ int main(void)
             print("Checksum OK.\n");
         }
 #endif
+        TIMELINE_MARK(TIMELINE_CHECK);
 
         print("Launching Application.\n");
         LED_G1_ON();
@@ -157,6 +270,7 @@ int main(void)
 #if(USE_VCP)
         UART2_DeInit();
 #endif /* USE_VCP */
+        TIMELINE_MARK(TIMELINE_LAUNCH);
 
         /* Launch application */
         Bootloader_JumpToApplication();
@@ -181,11 +295,20 @@ uint8_t Enter_Bootloader(void)
     FRESULT fr;
     UINT num;
     uint8_t i;
+    uint8_t buf;
     uint8_t status;
-    uint64_t data;
     uint32_t cntr;
-    uint32_t addr;
+    BootloaderStatsTypeDef stats;
+    BootloaderFlashBusyTypeDef busy;
+    BSP_SD_StatsTypeDef sdstats;
+    uint32_t rate;
     char msg[40] = {0x00};
+#if(USE_RAW_STREAM)
+    uint8_t raw;
+#endif
+#if(USE_IMAGE_HEADER)
+    BootloaderImageHeaderTypeDef header;
+#endif
 
     /* Check for flash write protection */
     if(Bootloader_GetProtectionStatus() & BL_PROTECTION_WRP)
@@ -217,6 +340,7 @@ uint8_t Enter_Bootloader(void)
         print("SD card cannot be initialized.\n");
         return ERR_SD_INIT;
     }
+    TIMELINE_MARK(TIMELINE_SD_INIT);
 
     /* Mount SD card */
     fr = f_mount(&SDFatFs, (TCHAR const*)SDPath, 1);
@@ -228,7 +352,64 @@ uint8_t Enter_Bootloader(void)
         print(msg);
         return ERR_SD_MOUNT;
     }
+    TIMELINE_MARK(TIMELINE_MOUNT);
     print("SD mounted.\n");
+    BSP_SD_GetStats(&sdstats);
+    sprintf(msg, "SD mode: %s, %lu kHz.\n",
+            (sdstats.speed == SD_SPEED_HIGH) ? "High Speed" : "Default",
+            sdstats.clock / 1000);
+    print(msg);
+    sprintf(msg, "SD init: %lu us%s.\n", sdstats.init,
+            sdstats.cached ? " (cached)" : "");
+    print(msg);
+    sprintf(msg, "SD cache: %lu hits,\n", sdstats.hits);
+    print(msg);
+    sprintf(msg, "%lu misses.\n", sdstats.misses);
+    print(msg);
+
+#if(USE_DELTA_PATCH)
+    /* Apply delta patch if present */
+    if(f_open(&PatchFile, CONF_PATCHNAME, FA_READ) == FR_OK)
+    {
+        print("Patch found on SD.\n");
+        status = Apply_Patch();
+        f_close(&PatchFile);
+        if(status == ERR_OK)
+        {
+            status = Verify_Signature();
+        }
+        SD_Eject();
+        print("SD ejected.\n");
+        if(status == ERR_OK)
+        {
+            Activate_Update();
+            Enable_WriteProtection();
+        }
+        return status;
+    }
+#endif
+
+#if(USE_COMPRESSION)
+    /* Program compressed image if present */
+    if(f_open(&SDFile, CONF_COMPRESSEDNAME, FA_READ) == FR_OK)
+    {
+        print("Compressed software found on SD.\n");
+        status = Apply_Compressed();
+        f_close(&SDFile);
+        if(status == ERR_OK)
+        {
+            status = Verify_Signature();
+        }
+        SD_Eject();
+        print("SD ejected.\n");
+        if(status == ERR_OK)
+        {
+            Activate_Update();
+            Enable_WriteProtection();
+        }
+        return status;
+    }
+#endif
 
     /* Open file for programming */
     fr = f_open(&SDFile, CONF_FILENAME, FA_READ);
@@ -257,15 +438,48 @@ uint8_t Enter_Bootloader(void)
     }
     print("App size OK.\n");
 
+#if(USE_IMAGE_HEADER)
+    /* Check the image header: the file must contain the complete image */
+    fr = f_read(&SDFile, SDBuffer[0], IMAGE_HEADER_LENGTH, &num);
+    if((fr != FR_OK) || (num != IMAGE_HEADER_LENGTH) ||
+       (Bootloader_ImageParse((uint8_t*)SDBuffer[0], &header) != BL_OK) ||
+       (f_size(&SDFile) != (IMAGE_HEADER_SIZE + header.length)) ||
+       (f_lseek(&SDFile, 0) != FR_OK))
+    {
+        print("Error: invalid image header.\n");
+
+        f_close(&SDFile);
+        SD_Eject();
+        print("SD ejected.\n");
+        return ERR_HEADER;
+    }
+    sprintf(msg, "App version: 0x%08lX\n", header.appVersion);
+    print(msg);
+#endif
+
     /* Step 1: Init Bootloader and Flash */
     Bootloader_Init();
 
     /* Step 2: Erase Flash */
+#if(USE_LAZY_ERASE || USE_DIFF_UPDATE)
+    print("Flash is erased during programming.\n");
+#else
     print("Erasing flash...\n");
     LED_G2_ON();
-    Bootloader_Erase();
+    status = Bootloader_EraseRange(f_size(&SDFile));
+    TIMELINE_MARK(TIMELINE_ERASE);
     LED_G2_OFF();
+    if(status != BL_OK)
+    {
+        print("Flash erase error.\n");
+
+        f_close(&SDFile);
+        SD_Eject();
+        print("SD ejected.\n");
+        return ERR_FLASH;
+    }
     print("Flash erase finished.\n");
+#endif
 
     /* If BTN is pressed, then skip programming */
     if(IS_BTN_PRESSED())
@@ -278,25 +492,58 @@ uint8_t Enter_Bootloader(void)
         return ERR_OK;
     }
 
+#if(USE_RAW_STREAM)
+    /* The sectors of a contiguous image are read straight from the SD card */
+    raw = (Bootloader_RawStreamOpen(&RawStream, &SDFile) == 0);
+    print(raw ? "Image is contiguous.\n" : "Image is fragmented.\n");
+#endif
+
     /* Step 3: Programming */
     print("Starting programming...\n");
     LED_G2_ON();
     cntr = 0;
+    buf  = 0;
     Bootloader_FlashBegin();
     do
     {
-        data = 0xFFFFFFFFFFFFFFFF;
-        fr   = f_read(&SDFile, &data, 8, &num);
+#if(USE_RAW_STREAM)
+        if(raw)
+        {
+            fr = Bootloader_RawStreamRead(&RawStream, SDBuffer[buf],
+                                          CONF_BUFFER_SIZE, &num);
+        }
+        else
+#endif
+        {
+            fr = f_read(&SDFile, SDBuffer[buf], CONF_BUFFER_SIZE, &num);
+        }
         if(num)
         {
-            status = Bootloader_FlashNext(data);
+            /* Read the next chunk while this one is programmed */
+            if(num == CONF_BUFFER_SIZE)
+            {
+                SD_ReadAhead((BYTE*)SDBuffer[buf ^ 1],
+                             CONF_BUFFER_SIZE / BLOCKSIZE);
+            }
+            status = Bootloader_FlashWrite((uint8_t*)SDBuffer[buf], num);
             if(status == BL_OK)
             {
-                cntr++;
+                cntr += num;
+                buf ^= 1;
             }
             else
             {
-                sprintf(msg, "Programming error at: %lu byte\n", (cntr * 8));
+                Bootloader_GetStats(&stats);
+                if(status == BL_VERIFY_ERROR)
+                {
+                    sprintf(msg, "Verification error at: %lu byte.\n",
+                            stats.mismatch);
+                }
+                else
+                {
+                    sprintf(msg, "Programming error at: %lu byte\n",
+                            stats.bytes);
+                }
                 print(msg);
 
                 f_close(&SDFile);
@@ -304,79 +551,286 @@ uint8_t Enter_Bootloader(void)
                 print("SD ejected.\n");
 
                 LED_ALL_OFF();
-                return ERR_FLASH;
+                return (status == BL_VERIFY_ERROR) ? ERR_VERIFY : ERR_FLASH;
             }
         }
-        if(cntr % 256 == 0)
+        if(cntr % 2048 == 0)
         {
             /* Toggle green LED during programming */
             LED_G1_TG();
         }
     } while((fr == FR_OK) && (num > 0));
+    SD_ReadAhead(NULL, 0);
 
-    /* Step 4: Finalize Programming */
-    Bootloader_FlashEnd();
+    /* Step 4: Finalize Programming. The flash content is verified against
+     * the data read from the SD card during programming. */
+    status = Bootloader_FlashEnd();
+    TIMELINE_MARK(TIMELINE_PROGRAM);
     f_close(&SDFile);
     LED_ALL_OFF();
-    print("Programming finished.\n");
-    sprintf(msg, "Flashed: %lu bytes.\n", (cntr * 8));
-    print(msg);
+    Bootloader_GetStats(&stats);
+    if(status == BL_VERIFY_ERROR)
+    {
+        sprintf(msg, "Verification error at: %lu byte.\n", stats.mismatch);
+        print(msg);
 
-    /* Open file for verification */
-    fr = f_open(&SDFile, CONF_FILENAME, FA_READ);
-    if(fr != FR_OK)
+        SD_Eject();
+        print("SD ejected.\n");
+        return ERR_VERIFY;
+    }
+    else if(status != BL_OK)
     {
-        /* f_open failed */
-        print("File cannot be opened.\n");
-        sprintf(msg, "FatFs error code: %u\n", fr);
+        sprintf(msg, "Programming error at: %lu byte\n", stats.bytes);
         print(msg);
 
         SD_Eject();
-        print("SD ejected.");
-        return ERR_SD_FILE;
+        print("SD ejected.\n");
+        return ERR_FLASH;
     }
+    print("Programming finished.\n");
+    sprintf(msg, "Flashed: %lu bytes.\n", cntr);
+    print(msg);
+    sprintf(msg, "Programming speed: %lu bytes/s.\n", stats.rate);
+    print(msg);
+    sprintf(msg, "Checksum: 0x%08lX\n", stats.crc);
+    print(msg);
+#if(USE_LAZY_ERASE || USE_DIFF_UPDATE)
+    sprintf(msg, "Erased: %lu pages.\n", stats.erased);
+    print(msg);
+#endif
+#if(USE_DIFF_UPDATE)
+    sprintf(msg, "Unchanged: %lu pages.\n", stats.skipped);
+    print(msg);
+#endif
+    Bootloader_FlashOpsGetBusy(&busy);
+    sprintf(msg, "Flash busy: %lu cycles,\n", busy.cycles);
+    print(msg);
+    sprintf(msg, "%lu polls, %lu operations.\n", busy.polls, busy.operations);
+    print(msg);
+    BSP_SD_GetStats(&sdstats);
+    rate = (sdstats.cycles == 0)
+               ? 0
+               : (uint32_t)(((uint64_t)sdstats.bytes * SystemCoreClock) /
+                            sdstats.cycles);
+    sprintf(msg, "SD read: %lu.%02lu MB/s,\n", rate / 1000000,
+            (rate % 1000000) / 10000);
+    print(msg);
+    sprintf(msg, "%lu errors, %lu clock steps.\n", sdstats.errors,
+            sdstats.stepdowns);
+    print(msg);
+
+    TIMELINE_MARK(TIMELINE_VERIFY);
+    print("Verification passed.\n");
+
+    /* Step 5: Verify Signature */
+    if(Verify_Signature() != ERR_OK)
+    {
+        SD_Eject();
+        print("SD ejected.\n");
+        return ERR_SIGNATURE;
+    }
+
+    /* Eject SD card */
+    SD_Eject();
+    print("SD ejected.\n");
+
+    /* Activate the update and enable flash write protection */
+    Activate_Update();
+    Enable_WriteProtection();
 
-    /* Step 5: Verify Flash Content */
-    addr = APP_ADDRESS;
+    return ERR_OK;
+}
+
+/**
+ * @brief  This function programs the content of an opened file: the file is
+ *         read in chunks and passed to the given consumer, which writes the
+ *         resulting image into flash with Bootloader_FlashWrite().
+ * @param  file: pointer to the opened file
+ * @param  size: size of the image to be programmed
+ * @param  write: consumer of the file content
+ * @param  readAhead: read the next chunk from the SD card while a chunk is
+ *         processed (the consumer must not read the SD card)
+ * @retval Application error code ::eApplicationErrorCodes
+ */
+uint8_t Program_Stream(FIL* file,
+                       uint32_t size,
+                       pStreamWrite write,
+                       uint8_t readAhead)
+{
+    FRESULT fr;
+    UINT num;
+    uint8_t buf;
+    uint8_t status;
+    uint32_t cntr;
+    BootloaderStatsTypeDef stats;
+    char msg[40] = {0x00};
+
+    /* Init Bootloader and Flash */
+    Bootloader_Init();
+
+    /* Erase Flash */
+#if(USE_LAZY_ERASE || USE_DIFF_UPDATE)
+    print("Flash is erased during programming.\n");
+#else
+    print("Erasing flash...\n");
+    LED_G2_ON();
+    status = Bootloader_EraseRange(size);
+    TIMELINE_MARK(TIMELINE_ERASE);
+    LED_G2_OFF();
+    if(status != BL_OK)
+    {
+        print("Flash erase error.\n");
+        return ERR_FLASH;
+    }
+    print("Flash erase finished.\n");
+#endif
+
+    /* Programming */
+    print("Starting programming...\n");
+    LED_G2_ON();
     cntr = 0;
+    buf  = 0;
+    Bootloader_FlashBegin();
     do
     {
-        data = 0xFFFFFFFFFFFFFFFF;
-        fr   = f_read(&SDFile, &data, 4, &num);
+        fr = f_read(file, SDBuffer[buf], CONF_BUFFER_SIZE, &num);
         if(num)
         {
-            if(*(uint32_t*)addr == (uint32_t)data)
+            /* Read the next chunk while this one is processed */
+            if(readAhead && (num == CONF_BUFFER_SIZE))
             {
-                addr += 4;
-                cntr++;
+                SD_ReadAhead((BYTE*)SDBuffer[buf ^ 1],
+                             CONF_BUFFER_SIZE / BLOCKSIZE);
             }
-            else
+            status = write((uint8_t*)SDBuffer[buf], num);
+            buf ^= 1;
+            if(status != BL_OK)
             {
-                sprintf(msg, "Verification error at: %lu byte.\n", (cntr * 4));
+                SD_ReadAhead(NULL, 0);
+                Bootloader_FlashEnd();
+                Bootloader_GetStats(&stats);
+                if(status == BL_VERIFY_ERROR)
+                {
+                    sprintf(msg, "Verification error at: %lu byte.\n",
+                            stats.mismatch);
+                    print(msg);
+
+                    LED_ALL_OFF();
+                    return ERR_VERIFY;
+                }
+                sprintf(msg, "Programming error at: %lu byte\n", stats.bytes);
                 print(msg);
 
-                f_close(&SDFile);
-                SD_Eject();
-                print("SD ejected.\n");
-
-                LED_G1_OFF();
-                return ERR_VERIFY;
+                LED_ALL_OFF();
+                if(status == BL_PATCH_ERROR)
+                {
+                    return ERR_PATCH;
+                }
+                return (status == BL_DECOMPRESS_ERROR) ? ERR_DECOMPRESS
+                                                       : ERR_FLASH;
             }
+            cntr += num;
         }
-        if(cntr % 256 == 0)
+        if(cntr % 2048 == 0)
         {
-            /* Toggle green LED during verification */
+            /* Toggle green LED during programming */
             LED_G1_TG();
         }
     } while((fr == FR_OK) && (num > 0));
-    print("Verification passed.\n");
-    LED_G1_OFF();
+    SD_ReadAhead(NULL, 0);
 
-    /* Eject SD card */
-    SD_Eject();
-    print("SD ejected.\n");
+    /* Finalize Programming */
+    status = Bootloader_FlashEnd();
+    TIMELINE_MARK(TIMELINE_PROGRAM);
+    LED_ALL_OFF();
+    Bootloader_GetStats(&stats);
+    if(status == BL_VERIFY_ERROR)
+    {
+        sprintf(msg, "Verification error at: %lu byte.\n", stats.mismatch);
+        print(msg);
+        return ERR_VERIFY;
+    }
+    else if(status != BL_OK)
+    {
+        sprintf(msg, "Programming error at: %lu byte\n", stats.bytes);
+        print(msg);
+        return ERR_FLASH;
+    }
+    print("Programming finished.\n");
+    sprintf(msg, "Read: %lu bytes.\n", cntr);
+    print(msg);
+    sprintf(msg, "Flashed: %lu bytes.\n", stats.bytes);
+    print(msg);
+    sprintf(msg, "Programming speed: %lu bytes/s.\n", stats.rate);
+    print(msg);
+    sprintf(msg, "Checksum: 0x%08lX\n", stats.crc);
+    print(msg);
+
+    return ERR_OK;
+}
 
-    /* Enable flash write protection */
+/**
+ * @brief  This function verifies the signature of the programmed image (if
+ *         configured). The signature is read from the SD card; a missing
+ *         signature is treated as an invalid one. The bootloader erases an
+ *         image with an invalid signature.
+ * @param  None
+ * @retval Application error code ::eApplicationErrorCodes
+ */
+uint8_t Verify_Signature(void)
+{
+#if(USE_SIGNATURE)
+    uint8_t signature[SIGNATURE_LENGTH] = {0x00};
+    UINT num;
+
+    if(f_open(&SDFile, CONF_SIGNATURENAME, FA_READ) == FR_OK)
+    {
+        f_read(&SDFile, signature, sizeof(signature), &num);
+        f_close(&SDFile);
+    }
+    else
+    {
+        print("Signature cannot be opened.\n");
+    }
+
+    if(Bootloader_VerifySignature(signature) != BL_OK)
+    {
+        print("Signature error, app erased.\n");
+        return ERR_SIGNATURE;
+    }
+    print("Signature OK.\n");
+#endif
+    return ERR_OK;
+}
+
+/**
+ * @brief  This function activates the update programmed into the inactive bank
+ *         (if dual-bank update is configured) and starts its trial (if
+ *         rollback is configured). The bank switch generates a system reset.
+ * @param  None
+ * @retval None
+ */
+void Activate_Update(void)
+{
+#if(USE_DUAL_BANK)
+    print("Activating update and generating system reset...\n");
+#endif
+#if(USE_DUAL_BANK || USE_ROLLBACK)
+    if(Bootloader_ActivateUpdate() != BL_OK)
+    {
+        print("Failed to activate update.\n");
+        print("Exiting Bootloader.\n");
+    }
+#endif
+}
+
+/**
+ * @brief  This function enables the flash write protection (if configured).
+ * @param  None
+ * @retval None
+ */
+void Enable_WriteProtection(void)
+{
 #if(USE_WRITE_PROTECTION)
     print("Enablig flash write protection and generating system reset...\n");
     if(Bootloader_ConfigProtection(BL_PROTECTION_WRP) != BL_OK)
@@ -385,10 +839,242 @@ uint8_t Enter_Bootloader(void)
         print("Exiting Bootloader.\n");
     }
 #endif
+}
+
+#if(USE_DELTA_PATCH)
+/**
+ * @brief  This function builds the new application from the installed
+ *         application (base image on SD card) and the delta patch, and
+ *         programs it into flash. The patch file must be opened beforehand.
+ * @param  None
+ * @retval Application error code ::eApplicationErrorCodes
+ */
+uint8_t Apply_Patch(void)
+{
+    FRESULT fr;
+    UINT num;
+    uint8_t status;
+    char msg[40] = {0x00};
+
+    /* Open base image; random access is accelerated by fast seek */
+    fr = f_open(&SDFile, CONF_FILENAME, FA_READ);
+    if(fr != FR_OK)
+    {
+        print("Base image cannot be opened.\n");
+        sprintf(msg, "FatFs error code: %u\n", fr);
+        print(msg);
+        return ERR_SD_FILE;
+    }
+    PatchClmt[0] = CONF_CLMT_SIZE;
+    SDFile.cltbl = PatchClmt;
+    if(f_lseek(&SDFile, CREATE_LINKMAP) != FR_OK)
+    {
+        /* Base image is too fragmented: use normal seek */
+        SDFile.cltbl = NULL;
+    }
+
+    /* Check patch header */
+    Bootloader_PatchInit(&Patch, Patch_ReadBase, Bootloader_FlashWrite);
+    fr = f_read(&PatchFile, SDBuffer[0], PATCH_HEADER_SIZE, &num);
+    if((fr != FR_OK) || (num != PATCH_HEADER_SIZE) ||
+       (Bootloader_PatchWrite(&Patch, (uint8_t*)SDBuffer[0], num) != BL_OK) ||
+       (Patch.baseSize != f_size(&SDFile)))
+    {
+        print("Patch does not match the base image.\n");
+        f_close(&SDFile);
+        return ERR_PATCH;
+    }
+    if(Bootloader_CheckSize(Patch.targetSize) != BL_OK)
+    {
+        print("Error: patched app is too large.\n");
+        f_close(&SDFile);
+        return ERR_APP_LARGE;
+    }
+    print("Patch OK.\n");
+
+    /* Build and program the new image */
+    status = Program_Stream(&PatchFile, Patch.targetSize, Patch_Write, 0);
+    f_close(&SDFile);
+    if(status != ERR_OK)
+    {
+        return status;
+    }
+
+    /* Verify the new image */
+    if(Bootloader_PatchEnd(&Patch) != BL_OK)
+    {
+        print("Patched app checksum error.\n");
+        return ERR_VERIFY;
+    }
+    print("Verification passed.\n");
+
+    return ERR_OK;
+}
+
+/**
+ * @brief  This function reads the base image for the patch decoder.
+ * @param  offset: offset in the base image
+ * @param  data: pointer to the destination buffer
+ * @param  length: number of bytes to read
+ * @retval Bootloader error code ::eBootloaderErrorCodes
+ */
+uint8_t Patch_ReadBase(uint32_t offset, uint8_t* data, uint32_t length)
+{
+    UINT num;
+
+    if((f_tell(&SDFile) != offset) && (f_lseek(&SDFile, offset) != FR_OK))
+    {
+        return BL_PATCH_ERROR;
+    }
+    if((f_read(&SDFile, data, length, &num) != FR_OK) || (num != length))
+    {
+        return BL_PATCH_ERROR;
+    }
+    return BL_OK;
+}
+
+/**
+ * @brief  This function passes the patch to the patch decoder.
+ * @param  data: pointer to the patch data
+ * @param  length: length of the data in bytes
+ * @retval Bootloader error code ::eBootloaderErrorCodes
+ */
+uint8_t Patch_Write(const uint8_t* data, uint32_t length)
+{
+    return Bootloader_PatchWrite(&Patch, data, length);
+}
+#endif /* USE_DELTA_PATCH */
+
+#if(USE_COMPRESSION)
+/**
+ * @brief  This function decompresses the compressed application image and
+ *         programs it into flash. The compressed image must be opened
+ *         beforehand.
+ * @param  None
+ * @retval Application error code ::eApplicationErrorCodes
+ */
+uint8_t Apply_Compressed(void)
+{
+    FRESULT fr;
+    UINT num;
+    uint8_t status;
+
+    /* Check header */
+    Bootloader_DecompressInit(&Decomp, Bootloader_FlashWrite);
+    fr = f_read(&SDFile, SDBuffer[0], DECOMPRESS_HEADER_SIZE, &num);
+    if((fr != FR_OK) || (num != DECOMPRESS_HEADER_SIZE) ||
+       (Bootloader_DecompressWrite(&Decomp, (uint8_t*)SDBuffer[0], num) !=
+        BL_OK))
+    {
+        print("Invalid compressed image.\n");
+        return ERR_DECOMPRESS;
+    }
+    if(Bootloader_CheckSize(Decomp.size) != BL_OK)
+    {
+        print("Error: app on SD card is too large.\n");
+        return ERR_APP_LARGE;
+    }
+    print("App size OK.\n");
+
+    /* Decompress and program the image */
+    status = Program_Stream(&SDFile, Decomp.size, Decompress_Write, 1);
+    if(status != ERR_OK)
+    {
+        return status;
+    }
+    if(Bootloader_DecompressEnd(&Decomp) != BL_OK)
+    {
+        print("Compressed image is incomplete.\n");
+        return ERR_DECOMPRESS;
+    }
+
+    /* The decompressed image is verified during programming */
+    print("Verification passed.\n");
 
     return ERR_OK;
 }
 
+/**
+ * @brief  This function passes the compressed image to the decompressor.
+ * @param  data: pointer to the compressed data
+ * @param  length: length of the data in bytes
+ * @retval Bootloader error code ::eBootloaderErrorCodes
+ */
+uint8_t Decompress_Write(const uint8_t* data, uint32_t length)
+{
+    return Bootloader_DecompressWrite(&Decomp, data, length);
+}
+#endif /* USE_COMPRESSION */
+
+/**
+ * @brief  This function launches the application right after reset (fast
+ *         boot): the clock, the SD card and the UART are not initialized and
+ *         the LED sequence is skipped. The boot latency is reported to
+ *         Bootloader_FastBootHook().
+ * @param  None
+ * @retval None: the function only returns if the application cannot be
+ *         launched
+ */
+void Fast_Boot(void)
+{
+#if(USE_DUAL_BANK || USE_ROLLBACK)
+    if(Bootloader_SelectBank() != BL_OK)
+#else
+    if(Bootloader_CheckForApplication() != BL_OK)
+#endif
+    {
+        return;
+    }
+#if(USE_CHECKSUM && !USE_DUAL_BANK)
+    if(Bootloader_VerifyChecksum() != BL_OK)
+    {
+        return;
+    }
+#endif
+    TIMELINE_MARK(TIMELINE_CHECK);
+
+    GPIO_DeInit();
+    TIMELINE_MARK(TIMELINE_LAUNCH);
+    Bootloader_FastBootHook(Bootloader_FastBootCycles());
+    Bootloader_JumpToApplication();
+}
+
+/**
+ * @brief  This function moves the vector table into RAM (if
+ *         USE_FLASH_RAMFUNC is enabled): while a page of the bank of the
+ *         bootloader is erased or programmed, the interrupts are served
+ *         without fetching from flash. The linker script places the handlers
+ *         of the SD card transfers and of the system tick, and the code they
+ *         call, in RAM as well.
+ * @param  None
+ * @retval None
+ */
+void Vectors_Relocate(void)
+{
+#if(USE_FLASH_RAMFUNC)
+    VectorsFlash = SCB->VTOR;
+    memcpy(Vectors, (const void*)VectorsFlash, sizeof(Vectors));
+    SCB->VTOR = (uint32_t)Vectors;
+    __DSB();
+    __ISB();
+#endif
+}
+
+/**
+ * @brief  This function restores the vector table in flash (see
+ *         Vectors_Relocate).
+ * @param  None
+ * @retval None
+ */
+void Vectors_Restore(void)
+{
+#if(USE_FLASH_RAMFUNC)
+    SCB->VTOR = VectorsFlash;
+    __DSB();
+    __ISB();
+#endif
+}
+
 /**
  * @brief  This function initializes and mounts the SD card.
  * @param  None
@@ -429,6 +1115,7 @@ void SD_DeInit(void)
  */
 void SD_Eject(void)
 {
+    SD_ReadAhead(NULL, 0);
     f_mount(NULL, (TCHAR const*)SDPath, 0);
 }
 
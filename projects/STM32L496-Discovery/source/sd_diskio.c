@@ -8,6 +8,16 @@
  *	       This file contains the implementation of the SD diskio driver
  *         used by the FatFs module. The driver uses the HAL library of ST.
  *
+ *         In DMA mode, the transfers are requests of the SD request queue
+ *         (sdqueue.c): the completion interrupts end the requests and the
+ *         CPU sleeps (WFI) while waiting for a transfer.
+ *
+ *         The sectors following the last read can be read ahead (see
+ *         SD_ReadAhead()) into a buffer given by the application while the
+ *         application processes the data of the last read. A read of the
+ *         prefetched sectors waits for the end of the transfer instead of
+ *         starting a new one.
+ *
  *******************************************************************************
  * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
  *******************************************************************************
@@ -15,10 +25,15 @@
 
 #include "sd_diskio.h"
 #include "ff_gen_drv.h"
+#include "sdqueue.h"
+#include <string.h>
 
 /* Defines -------------------------------------------------------------------*/
 #define SD_TIMEOUT SD_DATATIMEOUT /* Defined in bsp_driver_sd.h */
 
+/* Number of tries of a read, the clock is stepped down after a failure */
+#define SD_READ_RETRIES 3
+
 /*
  * Depending on the use case, the SD card initialization could be done at the
  * application level: if it is the case, disable the define below to disable
@@ -41,13 +56,35 @@
  */
 //#define ENABLE_SD_DMA_CACHE_MAINTENANCE 1
 
+/* External variables --------------------------------------------------------*/
+extern SD_HandleTypeDef hsd1; /* Defined in bsp_driver_sd.c */
+
 /* Private variables ---------------------------------------------------------*/
-static volatile DSTATUS Stat     = STA_NOINIT; /* Disk status */
-static volatile UINT ReadStatus  = 0;
-static volatile UINT WriteStatus = 0;
+static volatile DSTATUS Stat = STA_NOINIT; /* Disk status */
+
+#if defined(ENABLE_SD_DMA_DRIVER)
+static DWORD NextSector = 0; /* Sector following the last read */
+
+/* Request of a read or a write, and request of the read-ahead: prefetched
+ * data is available if the read-ahead request is SD_REQUEST_DONE */
+static BootloaderSdRequestTypeDef Request;
+static BootloaderSdRequestTypeDef AheadRequest;
+#endif
 
 /* Private function prototypes -----------------------------------------------*/
 static DSTATUS SD_CheckStatus(BYTE lun);
+#if defined(ENABLE_SD_DMA_DRIVER)
+static uint8_t SD_StartRead(uint8_t* buffer, uint32_t sector, uint32_t count);
+static uint8_t SD_StartWrite(const uint8_t* buffer,
+                             uint32_t sector,
+                             uint32_t count);
+static uint8_t SD_CardReady(void);
+static void SD_Abort(void);
+static void SD_Idle(void);
+static void SD_InvalidateCache(BYTE* buff, UINT count);
+static uint8_t SD_ReadAheadComplete(void);
+static DRESULT SD_ReadAheadTake(BYTE* buff, DWORD sector, UINT count);
+#endif
 DSTATUS SD_initialize(BYTE);
 DSTATUS SD_status(BYTE);
 DRESULT SD_read(BYTE, BYTE*, DWORD, UINT);
@@ -70,6 +107,13 @@ const Diskio_drvTypeDef SD_Driver = {
 #endif /* _USE_IOCTL == 1 */
 };
 
+#if defined(ENABLE_SD_DMA_DRIVER)
+/* SD card driver of the request queue */
+static const BootloaderSdOpsTypeDef SD_Ops = {
+    SD_StartRead, SD_StartWrite, SD_CardReady, SD_Abort, SD_Idle, HAL_GetTick,
+};
+#endif
+
 /* Private functions ---------------------------------------------------------*/
 static DSTATUS SD_CheckStatus(BYTE lun)
 {
@@ -101,8 +145,12 @@ DSTATUS SD_initialize(BYTE lun)
     Stat = SD_CheckStatus(lun);
 #endif
 
-    ReadStatus  = 0;
-    WriteStatus = 0;
+#if defined(ENABLE_SD_DMA_DRIVER)
+    Bootloader_SdFlush();
+    Bootloader_SdInit(&SD_Ops);
+    AheadRequest.state = SD_REQUEST_IDLE;
+    NextSector         = 0;
+#endif
 
     return Stat;
 }
@@ -114,6 +162,14 @@ DSTATUS SD_initialize(BYTE lun)
  */
 DSTATUS SD_status(BYTE lun)
 {
+#if defined(ENABLE_SD_DMA_DRIVER)
+    /* The card is not queried while it transfers the read-ahead */
+    if((AheadRequest.state == SD_REQUEST_QUEUED) ||
+       (AheadRequest.state == SD_REQUEST_BUSY))
+    {
+        return Stat;
+    }
+#endif
     return SD_CheckStatus(lun);
 }
 
@@ -128,54 +184,35 @@ DSTATUS SD_status(BYTE lun)
 DRESULT SD_read(BYTE lun, BYTE* buff, DWORD sector, UINT count)
 {
     DRESULT res;
-    uint32_t timeout;
+#if defined(ENABLE_SD_DMA_DRIVER)
+    uint8_t retry;
+#endif
 
 #if defined(ENABLE_SD_DMA_DRIVER)
     /* Use SD Driver in DMA mode */
 
-#if defined(ENABLE_SD_DMA_CACHE_MAINTENANCE)
-    uint32_t alignedAddr;
-#endif /* SD_DMA_CACHE_MAINTENANCE */
-
-    res        = RES_ERROR;
-    ReadStatus = 0;
-
-    if(BSP_SD_ReadBlocks_DMA((uint32_t*)buff, (uint32_t)(sector), count) ==
-       MSD_OK)
+    /* Sectors read ahead do not need to be transferred again */
+    if(SD_ReadAheadTake(buff, sector, count) == RES_OK)
     {
-        /* Wait for DMA Complete */
-        timeout = HAL_GetTick();
-        while((ReadStatus == 0) && ((HAL_GetTick() - timeout) < SD_TIMEOUT))
-        {
-        }
+        NextSector = sector + count;
+        return RES_OK;
+    }
 
-        /* In case of a timeout return error */
-        if(ReadStatus == 0)
-        {
-            res = RES_ERROR;
-        }
-        else
+    /* Sleep until the end of the transfer. A failed transfer is retried:
+     * the BSP driver steps down the clock upon CRC and timeout errors. */
+    res = RES_ERROR;
+    for(retry = 0; (retry < SD_READ_RETRIES) && (res != RES_OK); retry++)
+    {
+        Request.buffer   = buff;
+        Request.sector   = sector;
+        Request.count    = count;
+        Request.write    = 0;
+        Request.callback = NULL;
+        if(Bootloader_SdTransfer(&Request) == 0)
         {
-            ReadStatus = 0;
-            timeout    = HAL_GetTick();
-            while((HAL_GetTick() - timeout) < SD_TIMEOUT)
-            {
-                if(BSP_SD_GetCardState() == SD_TRANSFER_OK)
-                {
-                    res = RES_OK;
-#if defined(ENABLE_SD_DMA_CACHE_MAINTENANCE)
-                    /* The SCB_InvalidateDCache_by_Addr() requires a 32-Byte
-                     * aligned address, adjust the address and the D-Cache size
-                     * to invalidate accordingly.
-                     */
-                    alignedAddr = (uint32_t)buff & ~0x1F;
-                    SCB_InvalidateDCache_by_Addr(
-                        (uint32_t*)alignedAddr,
-                        count * BLOCKSIZE + ((uint32_t)buff - alignedAddr));
-#endif /* SD_DMA_CACHE_MAINTENANCE */
-                    break;
-                }
-            }
+            SD_InvalidateCache(buff, count);
+            NextSector = sector + count;
+            res        = RES_OK;
         }
     }
 
@@ -183,6 +220,8 @@ DRESULT SD_read(BYTE lun, BYTE* buff, DWORD sector, UINT count)
 
 #else
     /* Use SD Driver in blocking mode */
+    uint32_t timeout;
+
     res = RES_ERROR;
     if(BSP_SD_ReadBlocks((uint32_t*)buff, (uint32_t)(sector), count,
                          SDMMC_HAL_TIMEOUT) == MSD_OK)
@@ -226,35 +265,29 @@ DRESULT SD_write(BYTE lun, const BYTE* buff, DWORD sector, UINT count)
                             count * BLOCKSIZE + ((uint32_t)buff - alignedAddr));
 #endif
 
-    res         = RES_ERROR;
-    WriteStatus = 0;
+    /* The written sectors may be prefetched */
+    SD_ReadAheadComplete();
+    AheadRequest.state = SD_REQUEST_IDLE;
+
+    Request.buffer   = (uint8_t*)buff;
+    Request.sector   = sector;
+    Request.count    = count;
+    Request.write    = 1;
+    Request.callback = NULL;
 
-    if(BSP_SD_WriteBlocks_DMA((uint32_t*)buff, (uint32_t)(sector), count) ==
-       MSD_OK)
+    res = RES_ERROR;
+    if(Bootloader_SdTransfer(&Request) == 0)
     {
-        /* Wait for DMA complete */
+        /* Sleep until the card has programmed the data */
         timeout = HAL_GetTick();
-        while((WriteStatus == 0) && ((HAL_GetTick() - timeout) < SD_TIMEOUT))
-        {
-        }
-
-        /* In case of a timeout return error */
-        if(WriteStatus == 0)
-        {
-            res = RES_ERROR;
-        }
-        else
+        while((HAL_GetTick() - timeout) < SD_TIMEOUT)
         {
-            WriteStatus = 0;
-            timeout     = HAL_GetTick();
-            while((HAL_GetTick() - timeout) < SD_TIMEOUT)
+            if(BSP_SD_GetCardState() == SD_TRANSFER_OK)
             {
-                if(BSP_SD_GetCardState() == SD_TRANSFER_OK)
-                {
-                    res = RES_OK;
-                    break;
-                }
+                res = RES_OK;
+                break;
             }
+            __WFI();
         }
     }
 
@@ -336,6 +369,199 @@ DRESULT SD_ioctl(BYTE lun, BYTE cmd, void* buff)
 }
 #endif /* _USE_IOCTL == 1 */
 
+#if defined(ENABLE_SD_DMA_DRIVER)
+/**
+ * @brief  Starts reading sectors in DMA mode (request queue driver)
+ * @param  *buffer: Data buffer to store read data
+ * @param  sector: Sector address (LBA)
+ * @param  count: Number of sectors to read
+ * @retval 0 if the transfer is started, otherwise 1
+ */
+static uint8_t SD_StartRead(uint8_t* buffer, uint32_t sector, uint32_t count)
+{
+    return (BSP_SD_ReadBlocks_DMA((uint32_t*)buffer, sector, count) != MSD_OK);
+}
+
+/**
+ * @brief  Starts writing sectors in DMA mode (request queue driver)
+ * @param  *buffer: Data to be written
+ * @param  sector: Sector address (LBA)
+ * @param  count: Number of sectors to write
+ * @retval 0 if the transfer is started, otherwise 1
+ */
+static uint8_t SD_StartWrite(const uint8_t* buffer,
+                             uint32_t sector,
+                             uint32_t count)
+{
+    return (BSP_SD_WriteBlocks_DMA((uint32_t*)buffer, sector, count) != MSD_OK);
+}
+
+/**
+ * @brief  Checks if the next transfer can be started (request queue driver):
+ *         the HAL has finished the last transfer (e.g. its error callback is
+ *         not running) and the card is in transfer state.
+ * @param  None
+ * @retval 1 if the card is ready, otherwise 0
+ */
+static uint8_t SD_CardReady(void)
+{
+    return (HAL_SD_GetState(&hsd1) == HAL_SD_STATE_READY) &&
+           (BSP_SD_GetCardState() == SD_TRANSFER_OK);
+}
+
+/**
+ * @brief  Aborts the running transfer (request queue driver)
+ * @param  None
+ * @retval None
+ */
+static void SD_Abort(void)
+{
+    BSP_SD_Abort();
+}
+
+/**
+ * @brief  Sleeps until the next interrupt (request queue driver)
+ * @param  None
+ * @retval None
+ */
+static void SD_Idle(void)
+{
+    __WFI();
+}
+
+/**
+ * @brief  Invalidates the data cache of a buffer filled by DMA
+ * @param  *buff: Data buffer
+ * @param  count: Number of sectors
+ * @retval None
+ */
+static void SD_InvalidateCache(BYTE* buff, UINT count)
+{
+#if defined(ENABLE_SD_DMA_CACHE_MAINTENANCE)
+    /* The SCB_InvalidateDCache_by_Addr() requires a 32-Byte aligned address,
+     * adjust the address and the D-Cache size to invalidate accordingly.
+     */
+    uint32_t alignedAddr = (uint32_t)buff & ~0x1F;
+    SCB_InvalidateDCache_by_Addr((uint32_t*)alignedAddr,
+                                 count * BLOCKSIZE +
+                                     ((uint32_t)buff - alignedAddr));
+#else
+    UNUSED(buff);
+    UNUSED(count);
+#endif /* ENABLE_SD_DMA_CACHE_MAINTENANCE */
+}
+
+/**
+ * @brief  Waits for the end of the submitted read-ahead request
+ * @param  None
+ * @retval 1 if prefetched data is available, otherwise 0
+ */
+static uint8_t SD_ReadAheadComplete(void)
+{
+    if(AheadRequest.state == SD_REQUEST_IDLE)
+    {
+        return 0;
+    }
+
+    if(Bootloader_SdWait(&AheadRequest) != 0)
+    {
+        AheadRequest.state = SD_REQUEST_IDLE;
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief  Serves a read from the sectors read ahead. The data is only copied
+ *         if the destination differs from the read-ahead buffer. A read of
+ *         other sectors discards the prefetched data.
+ * @param  *buff: Data buffer to store read data
+ * @param  sector: Sector address (LBA)
+ * @param  count: Number of sectors to read
+ * @retval DRESULT: RES_OK if the read is served, otherwise RES_ERROR
+ */
+static DRESULT SD_ReadAheadTake(BYTE* buff, DWORD sector, UINT count)
+{
+    BYTE* data;
+
+    if(!SD_ReadAheadComplete())
+    {
+        return RES_ERROR;
+    }
+
+    if((sector < AheadRequest.sector) ||
+       ((sector + count) > (AheadRequest.sector + AheadRequest.count)))
+    {
+        AheadRequest.state = SD_REQUEST_IDLE;
+        return RES_ERROR;
+    }
+
+    SD_InvalidateCache(AheadRequest.buffer, AheadRequest.count);
+
+    data = AheadRequest.buffer + ((sector - AheadRequest.sector) * BLOCKSIZE);
+    if(data != buff)
+    {
+        memmove(buff, data, count * BLOCKSIZE);
+        if((buff < (AheadRequest.buffer + (AheadRequest.count * BLOCKSIZE))) &&
+           ((buff + (count * BLOCKSIZE)) > AheadRequest.buffer))
+        {
+            /* Prefetched data is overwritten */
+            AheadRequest.state = SD_REQUEST_IDLE;
+        }
+    }
+
+    return RES_OK;
+}
+#endif /* ENABLE_SD_DMA_DRIVER */
+
+/**
+ * @brief  Submits a read of the sectors following the last read into the
+ *         given buffer and returns without waiting (read-ahead). The
+ *         buffer must not be accessed until it is filled by a read of these
+ *         sectors or the read-ahead is stopped. A running read-ahead is
+ *         completed first.
+ * @param  *buff: Data buffer to store the sectors, NULL to stop the
+ *         read-ahead (waits for the end of the running transfer)
+ * @param  count: Number of sectors to read ahead
+ * @retval None
+ */
+void SD_ReadAhead(BYTE* buff, UINT count)
+{
+#if defined(ENABLE_SD_DMA_DRIVER)
+    BSP_SD_CardInfo CardInfo;
+
+    SD_ReadAheadComplete();
+    AheadRequest.state = SD_REQUEST_IDLE;
+
+    if((buff == NULL) || (count == 0) || (Stat & STA_NOINIT))
+    {
+        return;
+    }
+
+    /* Do not read beyond the end of the card */
+    BSP_SD_GetCardInfo(&CardInfo);
+    if(NextSector >= CardInfo.LogBlockNbr)
+    {
+        return;
+    }
+    if(count > (CardInfo.LogBlockNbr - NextSector))
+    {
+        count = CardInfo.LogBlockNbr - NextSector;
+    }
+
+    AheadRequest.buffer   = buff;
+    AheadRequest.sector   = NextSector;
+    AheadRequest.count    = count;
+    AheadRequest.write    = 0;
+    AheadRequest.callback = NULL;
+    Bootloader_SdSubmit(&AheadRequest);
+#else
+    UNUSED(buff);
+    UNUSED(count);
+#endif /* ENABLE_SD_DMA_DRIVER */
+}
+
 /**
  * @brief SD Rx Transfer complete callback
  * @param None
@@ -343,7 +569,10 @@ DRESULT SD_ioctl(BYTE lun, BYTE cmd, void* buff)
  */
 void SD_ReadCpltCallback(void)
 {
-    ReadStatus = 1;
+#if defined(ENABLE_SD_DMA_DRIVER)
+    /* Completes the read (or the read-ahead) in progress */
+    Bootloader_SdComplete(0);
+#endif
 }
 
 /**
@@ -353,5 +582,19 @@ void SD_ReadCpltCallback(void)
  */
 void SD_WriteCpltCallback(void)
 {
-    WriteStatus = 1;
+#if defined(ENABLE_SD_DMA_DRIVER)
+    Bootloader_SdComplete(0);
+#endif
+}
+
+/**
+ * @brief SD Error callback
+ * @param None
+ * @retval None
+ */
+void SD_ErrorCallback(void)
+{
+#if defined(ENABLE_SD_DMA_DRIVER)
+    Bootloader_SdComplete(1);
+#endif
 }
@@ -105,24 +105,28 @@ void SysTick_Handler(void)
 /* STM32L4xx Peripheral Interrupt Handlers                                    */
 /******************************************************************************/
 
+/**
+ * @brief DMA2 Channel4 ISR
+ * @note  SDMMC DMA Tx
+ */
+void DMA2_Channel4_IRQHandler(void)
+{
+    if(hsd1.hdmatx != NULL)
+    {
+        HAL_DMA_IRQHandler(hsd1.hdmatx);
+    }
+}
+
 /**
  * @brief DMA2 Channel5 ISR
- * @note  SDMMC DMA Tx, Rx
+ * @note  SDMMC DMA Rx
  */
 void DMA2_Channel5_IRQHandler(void)
 {
-    if((hsd1.Context == (SD_CONTEXT_DMA | SD_CONTEXT_READ_SINGLE_BLOCK)) ||
-       (hsd1.Context == (SD_CONTEXT_DMA | SD_CONTEXT_READ_MULTIPLE_BLOCK)))
+    if(hsd1.hdmarx != NULL)
     {
         HAL_DMA_IRQHandler(hsd1.hdmarx);
     }
-    else if((hsd1.Context ==
-             (SD_CONTEXT_DMA | SD_CONTEXT_WRITE_SINGLE_BLOCK)) ||
-            (hsd1.Context ==
-             (SD_CONTEXT_DMA | SD_CONTEXT_WRITE_MULTIPLE_BLOCK)))
-    {
-        HAL_DMA_IRQHandler(hsd1.hdmatx);
-    }
 }
 
 /**
@@ -0,0 +1,69 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+"""Host benchmark of the decompressor of the STM32 bootloader.
+
+Compresses the given application images, decompresses them with the
+decompressor of the bootloader built for the host, and reports the
+compression ratio and the decode speed.
+
+Usage (from the root of the repository):
+    python -m python.bench_decompress [-w BITS] [-l BITS] [app.bin ...]
+"""
+
+import argparse
+import os
+import subprocess
+import tempfile
+
+from python.common import build_host_program
+from python.pack_image import COUNT_BITS, WINDOW_BITS, compress
+
+DEFAULT_IMAGE = os.path.join(os.path.dirname(os.path.dirname(
+    os.path.abspath(__file__))), "projects", "STM32L496-Discovery",
+    "app-demo.bin")
+
+# Size of the chunks passed to the decompressor (same as CONF_BUFFER_SIZE)
+CHUNK_SIZE = 512
+# Amount of data decompressed for the speed measurement
+DECODE_BYTES = 64 * 1024 * 1024
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Benchmark the decompressor of the STM32 bootloader")
+    parser.add_argument("images", nargs="*", default=[DEFAULT_IMAGE],
+                        help="application images (default: app-demo.bin)")
+    parser.add_argument("-w", "--window-bits", type=int, default=WINDOW_BITS,
+                        help="window size: 2^N bytes (default: %(default)s)")
+    parser.add_argument("-l", "--count-bits", type=int, default=COUNT_BITS,
+                        help="back-reference count size in bits "
+                        "(default: %(default)s)")
+    args = parser.parse_args()
+
+    with tempfile.TemporaryDirectory() as tmp:
+        executable = build_host_program(
+            ["tests/host/decompress_sim.c",
+             "lib/stm32-bootloader/decompress.c"],
+            os.path.join(tmp, "decompress_sim"), flags=["-O2"])
+        if executable is None:
+            raise SystemExit("Error: host compiler is not available")
+
+        for image in args.images:
+            with open(image, "rb") as f:
+                data = f.read()
+            packed = os.path.join(tmp, "image.hs")
+            with open(packed, "wb") as f:
+                f.write(compress(data, args.window_bits, args.count_bits))
+
+            print(os.path.basename(image))
+            output = os.path.join(tmp, "image.bin")
+            iterations = max(1, DECODE_BYTES // len(data))
+            subprocess.check_call([executable, packed, output,
+                                   str(CHUNK_SIZE), str(iterations)])
+            with open(output, "rb") as f:
+                if f.read() != data:
+                    raise SystemExit("Error: decompressed image differs")
+
+
+if __name__ == "__main__":
+    main()
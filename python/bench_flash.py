@@ -0,0 +1,92 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+"""Host benchmark of the flash programming of the STM32 bootloader.
+
+Runs the erase and programming functions of the bootloader on the NOR flash
+simulator (tests/host/norflash.c) and reports the predicted duration of the
+update of the given application images, based on the typical durations of
+the flash operations of the datasheet. Fast programming requires a mass
+erased bank, so rows are only fast programmed in the bank mass erased by the
+erase: the update space of the dual bank build, or the second bank of the
+single bank build.
+
+Usage (from the root of the repository):
+    python -m python.bench_flash [app.bin ...]
+"""
+
+import argparse
+import os
+import subprocess
+import tempfile
+
+from python.common import build_host_program
+
+DEFAULT_IMAGE = os.path.join(os.path.dirname(os.path.dirname(
+    os.path.abspath(__file__))), "projects", "STM32L496-Discovery",
+    "app-demo.bin")
+
+SOURCES = ["tests/host/flash_sim.c", "tests/host/norflash.c"] + [
+    "lib/stm32-bootloader/{}.c".format(name) for name in (
+        "bootloader", "bank", "crc", "image", "imagecache", "rollback",
+        "sha512", "signature")]
+
+# Size of the chunks passed to Bootloader_FlashWrite (CONF_BUFFER_SIZE)
+CHUNK_SIZE = 4096
+
+# Builds to be simulated: name, compiler flags
+BUILDS = [
+    ("Single bank", []),
+    ("Dual bank (USE_DUAL_BANK)",
+     ["-DSIM_USE_DUAL_BANK=1", "-DSIM_USE_CHECKSUM=1"]),
+]
+
+# Updates to be simulated: name, operations
+UPDATES = [
+    ("Erase application space, row programming",
+     ["erase", "write:{}".format(CHUNK_SIZE)]),
+    ("Erase image pages, row programming",
+     ["erase-image", "write:{}".format(CHUNK_SIZE)]),
+    ("Erase image pages, double word programming",
+     ["erase-image", "next"]),
+]
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Predict the update duration of the STM32 bootloader")
+    parser.add_argument("images", nargs="*", default=[DEFAULT_IMAGE],
+                        help="application images (default: app-demo.bin)")
+    args = parser.parse_args()
+
+    with tempfile.TemporaryDirectory() as tmp:
+        executables = []
+        for index, (build, flags) in enumerate(BUILDS):
+            executable = build_host_program(
+                SOURCES, os.path.join(tmp, "flash_sim{}".format(index)),
+                flags=["-O2", "-Wno-int-to-pointer-cast"] + flags)
+            if executable is None:
+                raise SystemExit("Error: host compiler is not available")
+            executables.append((build, executable))
+
+        for image in args.images:
+            print("{} ({} bytes)".format(os.path.basename(image),
+                                         os.path.getsize(image)))
+            for build, executable in executables:
+                print("  {}:".format(build))
+                for name, operations in UPDATES:
+                    output = subprocess.check_output(
+                        [executable, image] + operations + ["verify",
+                                                           "stats"])
+                    output = output.decode().splitlines()
+                    if output[:-1] != ["ok"] * len(operations) + ["match"]:
+                        raise SystemExit("Error: update failed: " + name)
+                    erased, programmed, rows, _, time = map(
+                        int, output[-1].split())
+                    print("    {}:".format(name))
+                    print("      {} pages erased, {} rows, {} double words: "
+                          "{:.1f} ms".format(erased, rows, programmed,
+                                             time / 1000.0))
+
+
+if __name__ == "__main__":
+    main()
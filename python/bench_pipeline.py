@@ -0,0 +1,114 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+"""Host model of the programming pipeline of the STM32 bootloader.
+
+The image is read from the SD card in chunks of CONF_BUFFER_SIZE bytes. In
+the serial loop, a chunk is read, then programmed, so the SD latency and the
+flash programming time add up. With the read-ahead of the SD driver
+(SD_ReadAhead), the next chunk is read by DMA into the second buffer while a
+chunk is programmed, so the update takes about the longer of the two.
+
+The duration of reading a chunk is the command latency of the SD card plus
+the transfer at the given rate. The duration of programming a chunk follows
+from the given flash rate, by default from the typical duration of fast
+programming a row of the datasheet (tests/host/norflash.h). Fast programming
+requires a mass erased bank (the update space of a dual bank build); page
+erased flash is programmed double word by double word, at about 96 KB/s.
+
+Usage (from the root of the repository):
+    python -m python.bench_pipeline [--sd-latency US] [--sd-rate KBPS]
+                                    [--flash-rate KBPS] [app.bin ...]
+"""
+
+import argparse
+import os
+
+DEFAULT_IMAGE = os.path.join(os.path.dirname(os.path.dirname(
+    os.path.abspath(__file__))), "projects", "STM32L496-Discovery",
+    "app-demo.bin")
+
+# Size of the chunks read from the SD card (CONF_BUFFER_SIZE)
+CHUNK_SIZE = 4096
+
+# Fast programming of a row (FLASH_ROW_SIZE, NORFLASH_ROW_TIME)
+ROW_SIZE = 256
+ROW_TIME_US = 1910.0
+
+# Flash programming rate in KB/s, based on the fast programming of rows into
+# a mass erased bank
+FLASH_RATE = ROW_SIZE / ROW_TIME_US * 1e6 / 1024.0
+
+
+def chunks(size, chunk=CHUNK_SIZE):
+    """Return the sizes of the chunks of an image of the given size."""
+    return [min(chunk, size - pos) for pos in range(0, size, chunk)]
+
+
+def read_time(length, latency, rate):
+    """Return the duration of reading a chunk in microseconds."""
+    return latency + length * 1e6 / (rate * 1024.0)
+
+
+def program_time(length, rate):
+    """Return the duration of programming a chunk in microseconds."""
+    return length * 1e6 / (rate * 1024.0)
+
+
+def serial(reads, programs):
+    """Return the duration of the update if every chunk is read, then
+    programmed."""
+    return sum(reads) + sum(programs)
+
+
+def pipelined(reads, programs):
+    """Return the duration of the update if the next chunk is read while a
+    chunk is programmed. The read of the next chunk is started when the
+    programming of a chunk starts, and a chunk is programmed once it is read
+    and the previous chunk is programmed."""
+    read_done = reads[0]
+    program_done = 0.0
+    for i, duration in enumerate(programs):
+        start = max(read_done, program_done)
+        if i + 1 < len(reads):
+            read_done = start + reads[i + 1]
+        program_done = start + duration
+    return program_done
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Model the programming pipeline of the STM32 bootloader")
+    parser.add_argument("images", nargs="*", default=[DEFAULT_IMAGE],
+                        help="application images (default: app-demo.bin)")
+    parser.add_argument("--chunk", type=int, default=CHUNK_SIZE,
+                        help="size of the chunks in bytes "
+                             "(default: %(default)s)")
+    parser.add_argument("--sd-latency", type=float, default=1000.0,
+                        help="latency of a read command in microseconds "
+                             "(default: %(default)s)")
+    parser.add_argument("--sd-rate", type=float, default=2048.0,
+                        help="SD transfer rate in KB/s (default: %(default)s)")
+    parser.add_argument("--flash-rate", type=float, default=FLASH_RATE,
+                        help="flash programming rate in KB/s "
+                             "(default: fast programming, %(default).1f)")
+    args = parser.parse_args()
+
+    for image in args.images:
+        size = os.path.getsize(image)
+        sizes = chunks(size, args.chunk)
+        reads = [read_time(n, args.sd_latency, args.sd_rate) for n in sizes]
+        programs = [program_time(n, args.flash_rate) for n in sizes]
+
+        print("{} ({} bytes, {} chunks)".format(os.path.basename(image),
+                                                size, len(sizes)))
+        print("  SD reads:     {:10.1f} ms".format(sum(reads) / 1000.0))
+        print("  Programming:  {:10.1f} ms".format(sum(programs) / 1000.0))
+        for name, duration in (("Serial", serial(reads, programs)),
+                               ("Pipelined", pipelined(reads, programs))):
+            print("  {:13} {:10.1f} ms, {:8.1f} KB/s".format(
+                name + ":", duration / 1000.0,
+                size * 1e6 / 1024.0 / duration))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,112 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+"""Host benchmark of the raw streaming of contiguous images.
+
+Writes an image of the size of the given application image to a FAT volume
+in memory, for every cluster size, and reads it with the host build of
+FatFs and of the raw stream (rawstream.c) in chunks of CONF_BUFFER_SIZE
+bytes, as the bootloader does. The disk counts the read transfers, the
+sectors and the transfers into the sector window of the file system; their
+duration on the card is modelled with bench_sd (CMD23 multiple block reads).
+
+Usage (from the root of the repository):
+    python -m python.bench_rawstream [--chunk BYTES] [--size BYTES]
+                                     [--clock MHZ] [--access US] [app.bin]
+"""
+
+import argparse
+import os
+import subprocess
+import tempfile
+
+from python.bench_sd import BLOCK_CLOCKS, Card, throughput, transfer_time
+from python.common import build_host_program
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+DEFAULT_IMAGE = os.path.join(ROOT, "projects", "STM32L496-Discovery",
+                             "app-demo.bin")
+
+# Size of the programming buffers (CONF_BUFFER_SIZE)
+CHUNK_SIZE = 4096
+
+# Sectors of the FAT volume and cluster sizes in bytes
+VOLUME_SECTORS = 100000
+CLUSTER_SIZES = (512, 1024, 2048, 4096, 8192, 16384, 32768)
+
+SIM_SOURCES = ["tests/host/rawstream_sim.c", "lib/fatfs/ff.c",
+               "lib/stm32-bootloader/rawstream.c"]
+SIM_FLAGS = ["-I" + os.path.join(ROOT, "tests", "host"),
+             "-I" + os.path.join(ROOT, "lib", "fatfs")]
+
+
+def build_sim(output, flags=()):
+    """Build the host program of the raw stream, return its path or None."""
+    return build_host_program(SIM_SOURCES, output,
+                              SIM_FLAGS + list(flags))
+
+
+def parse_read(line):
+    """Return the path, transfers, sectors and window transfers of a read
+    line of the host program."""
+    fields = line.split()
+    if len(fields) != 9 or fields[8] != "ok":
+        raise ValueError("read failed: {}".format(line))
+    return fields[0], int(fields[2]), int(fields[4]), int(fields[6])
+
+
+def stream_time(card, transfers, sectors):
+    """Return the duration of reading sectors in the given number of CMD23
+    transfers in microseconds, the sectors being evenly spread over the
+    transfers."""
+    fixed = transfer_time(card, 1, "cmd23") - BLOCK_CLOCKS / card.clock
+    return (transfers * (fixed - card.gap) +
+            sectors * (BLOCK_CLOCKS / card.clock + card.gap))
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Benchmark the raw streaming of contiguous images")
+    parser.add_argument("image", nargs="?", default=DEFAULT_IMAGE,
+                        help="application image (default: app-demo.bin)")
+    parser.add_argument("--chunk", type=int, default=CHUNK_SIZE,
+                        help="size of the reads in bytes "
+                             "(default: %(default)s)")
+    parser.add_argument("--size", type=int,
+                        help="size of the image in bytes (default: size of "
+                             "the application image)")
+    parser.add_argument("--clock", type=float, default=48.0,
+                        help="SDMMC clock in MHz (default: %(default)s)")
+    parser.add_argument("--access", type=float, default=100.0,
+                        help="read access time in microseconds "
+                             "(default: %(default)s)")
+    args = parser.parse_args()
+    size = args.size or os.path.getsize(args.image)
+    card = Card(clock=args.clock, access=args.access)
+
+    with tempfile.TemporaryDirectory() as tmp:
+        executable = build_sim(os.path.join(tmp, "rawstream_sim"), ["-O2"])
+        if executable is None:
+            raise SystemExit("Error: host compiler is not available")
+
+        print("{} bytes in reads of {} bytes, {:.0f} MHz".format(
+            size, args.chunk, args.clock))
+        print("  {:>8} {:>24} {:>24}".format(
+            "cluster", "f_read: xfers (win) MB/s", "raw: xfers (win) MB/s"))
+        for cluster in CLUSTER_SIZES:
+            output = subprocess.check_output([
+                executable, "mkfs:{}:{}".format(VOLUME_SECTORS, cluster),
+                "write:APP.BIN:{}".format(size),
+                "read:APP.BIN:{}".format(args.chunk),
+                "raw:APP.BIN:{}".format(args.chunk)])
+            line = "  {:8}".format(cluster)
+            for read in output.decode().splitlines()[1:]:
+                _, transfers, sectors, window = parse_read(read)
+                line += " {:14} ({:3}) {:5.2f}".format(
+                    transfers, window, throughput(
+                        size, stream_time(card, transfers, sectors)))
+            print(line)
+
+
+if __name__ == "__main__":
+    main()
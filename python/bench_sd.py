@@ -0,0 +1,252 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+"""Behavioral model of SD card reads of the STM32 bootloader.
+
+A read is modelled as the sequence of commands the SD driver sends and the
+data blocks the card returns on the 4-bit bus:
+
+- single:  SET_BLOCKLEN (CMD16) + READ_SINGLE_BLOCK (CMD17) for every sector
+- cmd12:   CMD16 + READ_MULTIPLE_BLOCK (CMD18), the blocks, then
+           STOP_TRANSMISSION (CMD12) and its busy time
+- cmd23:   CMD16 + SET_BLOCK_COUNT (CMD23) + CMD18, the blocks; the card ends
+           the transfer by itself (SCR CMD_SUPPORT bit 33)
+
+A command with its response takes 48 + NCR + 48 + 8 clocks. The card returns
+the first block after the read access time, the next ones after a gap. A block
+takes 1 + 1024 + 16 + 1 clocks on 4 data lines (start bit, 512 bytes, CRC16,
+end bit). Every transfer also costs the driver overhead (DMA setup,
+completion interrupt).
+
+The model gives the throughput per transfer size, and the effect of
+coalescing adjacent requests of the SD request queue (sdqueue.c) into
+transfers of at most SDQUEUE_MAX_COUNT sectors.
+
+The SDMMC clock follows the clock steps of the BSP driver (sd_clockdiv of
+bsp_driver_sd.c): the kernel clock in High Speed mode (clock bypass, up to
+50 MHz), then the kernel clock divided by ClockDiv + 2. The driver steps the
+clock down after a CRC or timeout error.
+
+The card initialization is modelled by the commands of its paths:
+
+- hal:     HAL_SD_Init(): 2 ms delay, identification at 400 kHz, up to five
+           tries (with no card in the slot, every try fails)
+- cold:    identification at 400 kHz, ACMD41 polled back to back; with no
+           card in the slot it stops at the first CMD55
+- warm:    the card kept its state over a reset of the MCU: CMD13, CMD7,
+           CMD10 (cached CID) and CMD7 at the transfer clock
+
+Usage (from the root of the repository):
+    python -m python.bench_sd [--clock MHZ] [--access US] [--request N]
+                              [--kernel MHZ] [--busy MS]
+"""
+
+import argparse
+
+# Size of a sector in bytes (SDQUEUE_SECTOR_SIZE)
+SECTOR_SIZE = 512
+
+# Maximum number of sectors of a transfer (SDQUEUE_MAX_COUNT)
+MAX_COUNT = 128
+
+# Clocks of a command and its R1 response (NCR: up to 64 clocks)
+COMMAND_CLOCKS = 48 + 64 + 48 + 8
+
+# Clocks of a data block on 4 lines: start bit, data, CRC16, end bit
+BLOCK_CLOCKS = 1 + SECTOR_SIZE * 2 + 16 + 1
+
+SEQUENCES = ("single", "cmd12", "cmd23")
+
+# Clocks of a command without response (CMD0, CMD7 deselecting the card)
+NO_RESPONSE_CLOCKS = 48 + 8
+
+# Clocks of a command and its R2 response (CMD2, CMD9, CMD10)
+LONG_RESPONSE_CLOCKS = 48 + 64 + 136 + 8
+
+# Identification clock in MHz: 48 MHz / (SDMMC_INIT_CLK_DIV + 2)
+INIT_CLOCK = 48.0 / (0x76 + 2)
+
+# Clocks before the first command (SD_POWERUP_CLOCKS)
+POWERUP_CLOCKS = 74
+
+# Tries of the identification (SD_INIT_TRIES) and HAL_Delay(2) of a try
+INIT_TRIES = 5
+HAL_DELAY = 2000.0
+
+INIT_PATHS = ("hal", "cold", "warm")
+
+# Clock dividers of the clock steps, None: clock bypass (sd_clockdiv)
+CLOCK_DIVIDERS = (None, 0, 2, 6)
+
+# Maximum clock of Default Speed and of High Speed mode in MHz
+DEFAULT_SPEED_MAX = 25.0
+HIGH_SPEED_MAX = 50.0
+
+
+class Card(object):
+    """Timing of an SD card and of the driver, durations in microseconds."""
+
+    def __init__(self, clock=24.0, access=100.0, gap=2.0, stop_busy=30.0,
+                 overhead=15.0):
+        self.clock = clock          # SDMMC clock in MHz
+        self.access = access        # read access time of the first block
+        self.gap = gap              # gap between the blocks of a transfer
+        self.stop_busy = stop_busy  # busy time after CMD12
+        self.overhead = overhead    # driver overhead of a transfer
+
+    def command(self):
+        """Return the duration of a command with its response."""
+        return COMMAND_CLOCKS / self.clock
+
+    def blocks(self, count):
+        """Return the duration of count blocks of a multiple block read."""
+        return (self.access + count * BLOCK_CLOCKS / self.clock +
+                (count - 1) * self.gap)
+
+
+def transfer_time(card, count, sequence):
+    """Return the duration of reading count sectors with a single request
+    of the driver, in microseconds."""
+    if sequence == "single" or count == 1:
+        return count * (card.overhead + 2 * card.command() + card.blocks(1))
+    if sequence == "cmd12":
+        return (card.overhead + 3 * card.command() + card.blocks(count) +
+                card.stop_busy)
+    if sequence == "cmd23":
+        return card.overhead + 3 * card.command() + card.blocks(count)
+    raise ValueError("unknown sequence: {}".format(sequence))
+
+
+def clock_steps(kernel=48.0, high_speed=True):
+    """Return the SDMMC clocks in MHz the driver steps through, from the
+    first one, for the given SDMMC kernel clock."""
+    steps = []
+    for divider in CLOCK_DIVIDERS:
+        if divider is None:
+            if high_speed and kernel <= HIGH_SPEED_MAX:
+                steps.append(kernel)
+        else:
+            steps.append(kernel / (divider + 2))
+    limit = HIGH_SPEED_MAX if high_speed else DEFAULT_SPEED_MAX
+    return [clock for clock in steps if clock <= limit]
+
+
+def init_time(path, present=True, busy=50.0, clock=24.0):
+    """Return the duration of the card initialization in microseconds.
+
+    busy is the power up time of the card after CMD0 in milliseconds, during
+    which ACMD41 reports it busy; clock is the transfer clock in MHz."""
+    if path not in INIT_PATHS:
+        raise ValueError("unknown path: {}".format(path))
+    if not present:
+        # CMD0, then no response to CMD8 and to CMD55 (warm: to CMD13)
+        if path == "warm":
+            return (POWERUP_CLOCKS + COMMAND_CLOCKS) / clock
+        absent = (POWERUP_CLOCKS + NO_RESPONSE_CLOCKS +
+                  2 * COMMAND_CLOCKS) / INIT_CLOCK
+        return INIT_TRIES * (HAL_DELAY + absent) if path == "hal" else absent
+
+    # ACMD6, then CMD6 twice (64 bytes on 4 lines)
+    bus = (2 * COMMAND_CLOCKS + 2 * (COMMAND_CLOCKS + 128 + 17)) / clock
+    if path == "warm":
+        return (POWERUP_CLOCKS + 2 * COMMAND_CLOCKS + NO_RESPONSE_CLOCKS +
+                LONG_RESPONSE_CLOCKS) / clock + bus
+    # ACMD51 (8 bytes on 1 line)
+    scr = (2 * COMMAND_CLOCKS + 64 + 17) / clock
+    polls = int(busy * 1000.0 / (2 * COMMAND_CLOCKS / INIT_CLOCK)) + 1
+    identify = (POWERUP_CLOCKS + NO_RESPONSE_CLOCKS + COMMAND_CLOCKS +
+                polls * 2 * COMMAND_CLOCKS + 2 * LONG_RESPONSE_CLOCKS +
+                2 * COMMAND_CLOCKS) / INIT_CLOCK
+    return identify + scr + bus + (HAL_DELAY if path == "hal" else 0.0)
+
+
+def coalesce(requests, max_count=MAX_COUNT):
+    """Return the sizes of the transfers of adjacent requests of the given
+    sizes once coalesced (see Bootloader_SdStart())."""
+    transfers = []
+    count = 0
+    for size in requests:
+        if count and count + size > max_count:
+            transfers.append(count)
+            count = 0
+        count += size
+    if count:
+        transfers.append(count)
+    return transfers
+
+
+def read_time(card, transfers, sequence):
+    """Return the duration of the given transfers in microseconds."""
+    return sum(transfer_time(card, n, sequence) for n in transfers)
+
+
+def throughput(size, duration):
+    """Return the throughput in MB/s of size bytes in duration
+    microseconds."""
+    return size / duration
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Model SD card reads of the STM32 bootloader")
+    parser.add_argument("--clock", type=float, default=24.0,
+                        help="SDMMC clock in MHz (default: %(default)s)")
+    parser.add_argument("--access", type=float, default=100.0,
+                        help="read access time in microseconds "
+                             "(default: %(default)s)")
+    parser.add_argument("--request", type=int, default=8,
+                        help="size of the requests in sectors for the "
+                             "coalescing (default: %(default)s)")
+    parser.add_argument("--size", type=int, default=512 * 1024,
+                        help="size of the data read for the coalescing in "
+                             "bytes (default: %(default)s)")
+    parser.add_argument("--kernel", type=float, default=48.0,
+                        help="SDMMC kernel clock in MHz for the clock steps "
+                             "(default: %(default)s)")
+    parser.add_argument("--busy", type=float, default=50.0,
+                        help="power up time of the card after CMD0 in "
+                             "milliseconds (default: %(default)s)")
+    args = parser.parse_args()
+    card = Card(clock=args.clock, access=args.access)
+
+    print("Throughput per transfer size (MB/s), {:.0f} MHz, 4-bit bus".format(
+        args.clock))
+    print("  {:>8} {:>8}".format("sectors", "bytes") +
+          "".join(" {:>8}".format(s) for s in SEQUENCES))
+    count = 1
+    while count <= MAX_COUNT:
+        print("  {:8} {:8}".format(count, count * SECTOR_SIZE) + "".join(
+            " {:8.2f}".format(throughput(count * SECTOR_SIZE,
+                                         transfer_time(card, count, s)))
+            for s in SEQUENCES))
+        count *= 2
+
+    requests = [args.request] * (args.size // (args.request * SECTOR_SIZE))
+    transfers = coalesce(requests)
+    print("Requests of {} sectors, {} bytes: {} requests, {} transfers "
+          "coalesced".format(args.request, args.size, len(requests),
+                             len(transfers)))
+    for sequence in SEQUENCES[1:]:
+        print("  {:6} {:8.2f} MB/s, coalesced {:8.2f} MB/s".format(
+            sequence,
+            throughput(args.size, read_time(card, requests, sequence)),
+            throughput(args.size, read_time(card, transfers, sequence))))
+
+    print("Clock steps of {:.0f} MHz kernel clock, coalesced cmd23 "
+          "(MB/s)".format(args.kernel))
+    for high_speed in (True, False):
+        print("  {:10}".format("High Speed" if high_speed else "Default") +
+              "".join(" {:5.1f} MHz {:6.2f}".format(
+                  clock, throughput(args.size, read_time(
+                      Card(clock=clock, access=args.access), transfers,
+                      "cmd23")))
+                  for clock in clock_steps(args.kernel, high_speed)))
+
+    print("Card initialization (ms), power up {:.0f} ms".format(args.busy))
+    for path in INIT_PATHS:
+        print("  {:4} {:8.2f}, no card {:6.2f}".format(
+            path, init_time(path, True, args.busy) / 1000.0,
+            init_time(path, False, args.busy) / 1000.0))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,70 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+"""Host benchmark of the signature verification of the STM32 bootloader.
+
+Signs the given application images with a throwaway key, hashes and verifies
+them with the SHA-512 and Ed25519ph code of the bootloader built for the
+host, and reports the cost of hashing in cycles per byte and the cost of one
+signature verification in cycles.
+
+Usage (from the root of the repository):
+    python -m python.bench_signature [-n ITERATIONS] [app.bin ...]
+"""
+
+import argparse
+import os
+import subprocess
+import tempfile
+
+from python.common import build_host_program
+from python.sign_image import public_key, sign
+
+DEFAULT_IMAGE = os.path.join(os.path.dirname(os.path.dirname(
+    os.path.abspath(__file__))), "projects", "STM32L496-Discovery",
+    "app-demo.bin")
+
+# Size of the chunks passed to the hash (same as CONF_BUFFER_SIZE)
+CHUNK_SIZE = 512
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Benchmark the signature verification of the STM32 "
+        "bootloader")
+    parser.add_argument("images", nargs="*", default=[DEFAULT_IMAGE],
+                        help="application images (default: app-demo.bin)")
+    parser.add_argument("-n", "--iterations", type=int, default=50,
+                        help="number of iterations (default: %(default)s)")
+    args = parser.parse_args()
+
+    secret = os.urandom(32)
+    with tempfile.TemporaryDirectory() as tmp:
+        executable = build_host_program(
+            ["tests/host/signature_sim.c", "lib/stm32-bootloader/sha512.c",
+             "lib/stm32-bootloader/signature.c"],
+            os.path.join(tmp, "signature_sim"), flags=["-O2"])
+        if executable is None:
+            raise SystemExit("Error: host compiler is not available")
+
+        key = os.path.join(tmp, "key.bin")
+        with open(key, "wb") as f:
+            f.write(public_key(secret))
+
+        for image in args.images:
+            with open(image, "rb") as f:
+                data = f.read()
+            signature = os.path.join(tmp, "image.sig")
+            with open(signature, "wb") as f:
+                f.write(sign(secret, data))
+
+            print(os.path.basename(image))
+            output = subprocess.check_output(
+                [executable, image, signature, key, str(CHUNK_SIZE),
+                 str(args.iterations)]).decode().splitlines()
+            if output[1] != "ok":
+                raise SystemExit("Error: signature verification failed")
+            print("\n".join(output[2:]))
+
+
+if __name__ == "__main__":
+    main()
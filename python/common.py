@@ -1,6 +1,8 @@
 #!/usr/bin/env python
 # -*- coding: utf-8 -*-
 import os
+import shutil
+import subprocess
 
 
 def collect_source_files():
@@ -9,7 +11,8 @@ def collect_source_files():
 
     # Souce files, relative to project path
     source_list = ["lib/stm32-bootloader/",
-                   "projects/"]
+                   "projects/",
+                   "tests/host/"]
 
     # This module resides one folder down delative to project path, thus
     # the source list needs to be adjusted accordingly.
@@ -24,3 +27,55 @@ def collect_source_files():
                 if f.endswith(source_pattern):
                     file_list.append(os.path.join(root, f))
     return file_list
+
+
+def _crc32_table():
+    table = []
+    for i in range(256):
+        crc = i << 24
+        for _ in range(8):
+            if crc & 0x80000000:
+                crc = ((crc << 1) ^ 0x04C11DB7) & 0xFFFFFFFF
+            else:
+                crc = (crc << 1) & 0xFFFFFFFF
+        table.append(crc)
+    return table
+
+
+CRC32_TABLE = _crc32_table()
+
+
+def stm32_crc32(data, crc=0xFFFFFFFF):
+    # Checksum as calculated by the CRC peripheral of the STM32 with default
+    # settings: the data is processed as little-endian 32-bit words, most
+    # significant bit first. Incomplete last word is padded with 0xFF bytes,
+    # i.e. with the content of the erased flash.
+    data = bytes(data) + b"\xff" * (-len(data) % 4)
+    for i in range(0, len(data), 4):
+        for b in reversed(data[i:i + 4]):
+            crc = ((crc << 8) & 0xFFFFFFFF) ^ CRC32_TABLE[(crc >> 24) ^ b]
+    return crc
+
+
+def build_host_program(sources, output, flags=()):
+    # Builds a host program from the given sources of the bootloader library
+    # and of tests/host (paths relative to project path). Returns the path of
+    # the executable, or None if no host compiler is available.
+    compiler = shutil.which("gcc") or shutil.which("cc")
+    if compiler is None:
+        return None
+
+    root = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+    include_list = ["lib/stm32-bootloader",
+                    "tests/host",
+                    "drivers/CMSIS/Include",
+                    "drivers/CMSIS/Device/ST/STM32L4xx/Include"]
+
+    args = [compiler, "-std=gnu99", "-Wall", "-DSTM32L496xx"]
+    args.extend(flags)
+    args.extend("-I" + os.path.join(root, os.path.normpath(i))
+                for i in include_list)
+    args.extend(os.path.join(root, os.path.normpath(s)) for s in sources)
+    args.extend(["-o", output])
+    subprocess.check_call(args)
+    return output
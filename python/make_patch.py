@@ -0,0 +1,188 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+"""Delta patch generator for the STM32 bootloader.
+
+The patch rebuilds the new application image from the installed image (base)
+and is applied by the bootloader in a streaming manner, see patch.c.
+
+Usage (from the root of the repository):
+    python -m python.make_patch <base.bin> <new.bin> <output.patch>
+"""
+
+import argparse
+import struct
+
+from python.common import stm32_crc32
+
+PATCH_MAGIC = 0x54504C42
+PATCH_VERSION = 1
+PATCH_HEADER = struct.Struct("<IHHIII")
+PATCH_CONTROL = struct.Struct("<IIi")
+
+# Length of the blocks used for finding matches in the base image
+BLOCK_SIZE = 8
+# Matches are searched at word-aligned offsets of the base image
+BLOCK_STRIDE = 4
+# Shorter matches are stored as extra bytes: a record costs 12 bytes
+MIN_MATCH = 16
+
+
+def _index(base):
+    index = {}
+    for i in range(0, len(base) - BLOCK_SIZE + 1, BLOCK_STRIDE):
+        index.setdefault(base[i:i + BLOCK_SIZE], i)
+    return index
+
+
+def _match_length(base, target, t, b, chunk=256):
+    length = 0
+    limit = min(len(target) - t, len(base) - b)
+    while length < limit:
+        n = min(chunk, limit - length)
+        i = t + length
+        j = b + length
+        if target[i:i + n] == base[j:j + n]:
+            length += n
+        elif n > 1:
+            chunk = max(1, n // 2)
+        else:
+            break
+    return length
+
+
+def _find_regions(base, target):
+    # Returns the (target offset, base offset, length) of the regions which
+    # can be copied from the base image
+    index = _index(base)
+    regions = []
+    t = 0
+    start = 0
+    offset = 0
+    while t + BLOCK_SIZE <= len(target):
+        # Continue at the alignment of the previous match if possible, so that
+        # small changes are not looked up in the whole base image
+        block = target[t:t + BLOCK_SIZE]
+        b = t + offset
+        if b < 0 or base[b:b + BLOCK_SIZE] != block:
+            b = index.get(block)
+        if b is None:
+            t += 1
+            continue
+
+        # Extend match backward into the bytes not yet covered
+        back = 0
+        while (t - back > start and b - back > 0 and
+               target[t - back - 1] == base[b - back - 1]):
+            back += 1
+        length = back + _match_length(base, target, t, b)
+        if length < MIN_MATCH:
+            t += 1
+            continue
+
+        regions.append((t - back, b - back, length))
+        offset = b - t
+        t += length - back
+        start = t
+    return regions
+
+
+def create_patch(base, target):
+    """Return the patch which rebuilds target from base."""
+    base = bytes(base)
+    target = bytes(target)
+    regions = _find_regions(base, target)
+
+    patch = bytearray(PATCH_HEADER.pack(PATCH_MAGIC, PATCH_VERSION,
+                                        PATCH_HEADER.size, len(base),
+                                        len(target), stm32_crc32(target)))
+
+    # Leading bytes without a match are stored in a record without copy
+    t_end = regions[0][0] if regions else len(target)
+    if t_end > 0 or not regions:
+        seek = regions[0][1] if regions else 0
+        patch += PATCH_CONTROL.pack(0, t_end, seek)
+        patch += target[:t_end]
+
+    for k, (t, b, length) in enumerate(regions):
+        if k + 1 < len(regions):
+            t_end = regions[k + 1][0]
+            seek = regions[k + 1][1] - (b + length)
+        else:
+            t_end = len(target)
+            seek = 0
+        patch += PATCH_CONTROL.pack(length, t_end - t - length, seek)
+        patch += target[t + length:t_end]
+
+    return bytes(patch)
+
+
+def apply_patch(base, patch):
+    """Return the image rebuilt from base and patch. Raises ValueError if the
+    patch is invalid or does not belong to base."""
+    base = bytes(base)
+    patch = bytes(patch)
+    if len(patch) < PATCH_HEADER.size:
+        raise ValueError("Patch is too short")
+    magic, version, header_size, base_size, target_size, crc = \
+        PATCH_HEADER.unpack_from(patch)
+    if (magic != PATCH_MAGIC or version != PATCH_VERSION or
+            header_size != PATCH_HEADER.size or target_size == 0):
+        raise ValueError("Invalid patch header")
+    if base_size != len(base):
+        raise ValueError("Patch does not match the base image")
+
+    target = bytearray()
+    pos = header_size
+    base_pos = 0
+    while len(target) < target_size:
+        if pos + PATCH_CONTROL.size > len(patch):
+            raise ValueError("Patch is truncated")
+        copy_len, extra_len, seek = PATCH_CONTROL.unpack_from(patch, pos)
+        pos += PATCH_CONTROL.size
+        if (copy_len > base_size - base_pos or
+                copy_len + extra_len > target_size - len(target) or
+                pos + extra_len > len(patch)):
+            raise ValueError("Invalid patch record")
+        target += base[base_pos:base_pos + copy_len]
+        base_pos += copy_len
+        target += patch[pos:pos + extra_len]
+        pos += extra_len
+        base_pos += seek
+        if not 0 <= base_pos <= base_size:
+            raise ValueError("Invalid patch record")
+
+    if pos != len(patch):
+        raise ValueError("Trailing data in patch")
+    if stm32_crc32(target) != crc:
+        raise ValueError("Checksum error")
+    return bytes(target)
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Create delta patch for the STM32 bootloader")
+    parser.add_argument("base", help="installed application image")
+    parser.add_argument("target", help="new application image")
+    parser.add_argument("output", help="patch file to be created")
+    args = parser.parse_args()
+
+    with open(args.base, "rb") as f:
+        base = f.read()
+    with open(args.target, "rb") as f:
+        target = f.read()
+
+    patch = create_patch(base, target)
+    if apply_patch(base, patch) != target:
+        raise SystemExit("Error: patch verification failed")
+
+    with open(args.output, "wb") as f:
+        f.write(patch)
+
+    print("Base image: {} bytes".format(len(base)))
+    print("New image:  {} bytes".format(len(target)))
+    print("Patch:      {} bytes ({:.1f}%)".format(
+        len(patch), 100.0 * len(patch) / len(target)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,245 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+"""Application image packer for the STM32 bootloader.
+
+Compresses the application image into the format decompressed by the
+bootloader on the fly, see decompress.c. Optionally the image header parsed
+by the bootloader (USE_IMAGE_HEADER, see image.c) is added in front of the
+application; the application must be linked to the load address.
+
+Usage (from the root of the repository):
+    python -m python.pack_image [-w BITS] [-l BITS] <app.bin> <output.hs>
+    python -m python.pack_image --header [--app-version VERSION]
+                                [--raw] <app.bin> <output>
+"""
+
+import argparse
+import struct
+
+from python.common import stm32_crc32
+
+COMPRESS_MAGIC = 0x53484C42
+COMPRESS_VERSION = 1
+COMPRESS_HEADER = struct.Struct("<IBBBBI")
+
+# Default window size (2^N bytes) and back-reference count size (bits). The
+# window must not be larger than DECOMPRESS_WINDOW_BITS of the bootloader.
+WINDOW_BITS = 8
+COUNT_BITS = 4
+
+# Number of candidate positions checked when searching for a match
+MAX_CANDIDATES = 32
+
+IMAGE_MAGIC = 0x48494C42
+IMAGE_VERSION = 1
+# Header fields covered by the header checksum
+IMAGE_HEADER = struct.Struct("<IHHIIII")
+# Size of the header area (IMAGE_HEADER_SIZE of the bootloader)
+IMAGE_HEADER_SIZE = 0x200
+# Start of the application space (APP_ADDRESS of the bootloader)
+APP_ADDRESS = 0x08008000
+
+
+class _BitWriter(object):
+    def __init__(self):
+        self.data = bytearray()
+        self.value = 0
+        self.count = 0
+
+    def write(self, value, bits):
+        self.value = (self.value << bits) | value
+        self.count += bits
+        while self.count >= 8:
+            self.count -= 8
+            self.data.append((self.value >> self.count) & 0xFF)
+        self.value &= (1 << self.count) - 1
+
+    def flush(self):
+        if self.count:
+            self.data.append((self.value << (8 - self.count)) & 0xFF)
+            self.count = 0
+        return bytes(self.data)
+
+
+def compress(data, window_bits=WINDOW_BITS, count_bits=COUNT_BITS):
+    """Return the compressed image (header and LZSS bitstream)."""
+    if not 4 <= window_bits or not 3 <= count_bits < window_bits:
+        raise ValueError("Invalid window or count size")
+    data = bytes(data)
+    window = 1 << window_bits
+    max_count = 1 << count_bits
+    # Back-references shorter than this are not smaller than the literals
+    min_match = (1 + window_bits + count_bits) // 9 + 1
+
+    out = _BitWriter()
+    chains = {}
+    pos = 0
+    while pos < len(data):
+        best_len = 0
+        best_offset = 0
+        key = data[pos:pos + min_match]
+        limit = min(max_count, len(data) - pos)
+        candidates = chains.get(key, [])
+        for candidate in reversed(candidates[-MAX_CANDIDATES:]):
+            offset = pos - candidate
+            if offset > window:
+                break
+            length = 0
+            while (length < limit and
+                   data[candidate + length] == data[pos + length]):
+                length += 1
+            if length > best_len:
+                best_len = length
+                best_offset = offset
+                if length == limit:
+                    break
+
+        if best_len >= min_match:
+            out.write(0, 1)
+            out.write(best_offset - 1, window_bits)
+            out.write(best_len - 1, count_bits)
+            step = best_len
+        else:
+            out.write(1, 1)
+            out.write(data[pos], 8)
+            step = 1
+
+        for i in range(pos, pos + step):
+            chain = chains.setdefault(data[i:i + min_match], [])
+            chain.append(i)
+            if len(chain) > 2 * MAX_CANDIDATES:
+                del chain[:MAX_CANDIDATES]
+        pos += step
+
+    header = COMPRESS_HEADER.pack(COMPRESS_MAGIC, COMPRESS_VERSION,
+                                  window_bits, count_bits, 0, len(data))
+    return header + out.flush()
+
+
+def decompress(packed):
+    """Return the image decompressed from packed. Raises ValueError if the
+    compressed image is invalid."""
+    packed = bytes(packed)
+    if len(packed) < COMPRESS_HEADER.size:
+        raise ValueError("Compressed image is too short")
+    magic, version, window_bits, count_bits, _, size = \
+        COMPRESS_HEADER.unpack_from(packed)
+    if (magic != COMPRESS_MAGIC or version != COMPRESS_VERSION or
+            not 4 <= window_bits or not 3 <= count_bits < window_bits or
+            size == 0):
+        raise ValueError("Invalid header")
+
+    bits = 0
+    bit_count = 0
+    pos = COMPRESS_HEADER.size
+    out = bytearray()
+
+    def read(n):
+        nonlocal bits, bit_count, pos
+        while bit_count < n:
+            if pos >= len(packed):
+                raise ValueError("Compressed image is truncated")
+            bits = (bits << 8) | packed[pos]
+            bit_count += 8
+            pos += 1
+        bit_count -= n
+        value = (bits >> bit_count) & ((1 << n) - 1)
+        bits &= (1 << bit_count) - 1
+        return value
+
+    while len(out) < size:
+        if read(1):
+            out.append(read(8))
+        else:
+            offset = read(window_bits) + 1
+            count = read(count_bits) + 1
+            if offset > len(out) or count > size - len(out):
+                raise ValueError("Invalid back-reference")
+            for _ in range(count):
+                out.append(out[-offset])
+
+    if pos != len(packed):
+        raise ValueError("Trailing data in compressed image")
+    return bytes(out)
+
+
+def add_header(data, app_version=0, app_address=APP_ADDRESS):
+    """Return the image with the image header in front of the application."""
+    data = bytes(data)
+    if not data:
+        raise ValueError("Empty application")
+    header = IMAGE_HEADER.pack(IMAGE_MAGIC, IMAGE_VERSION, IMAGE_HEADER_SIZE,
+                               len(data), app_address + IMAGE_HEADER_SIZE,
+                               stm32_crc32(data), app_version)
+    header += struct.pack("<I", stm32_crc32(header))
+    return header.ljust(IMAGE_HEADER_SIZE, b"\xff") + data
+
+
+def parse_header(image, app_address=APP_ADDRESS):
+    """Return the fields of the image header as a dictionary. Raises
+    ValueError if the header or the checksum of the application is invalid."""
+    image = bytes(image)
+    if len(image) < IMAGE_HEADER_SIZE:
+        raise ValueError("Image is too short")
+    fields = IMAGE_HEADER.unpack_from(image)
+    magic, version, header_size, length, load_address, crc, app_version = \
+        fields
+    header_crc, = struct.unpack_from("<I", image, IMAGE_HEADER.size)
+    if (magic != IMAGE_MAGIC or version != IMAGE_VERSION or
+            header_size != IMAGE_HEADER_SIZE or
+            header_crc != stm32_crc32(image[:IMAGE_HEADER.size])):
+        raise ValueError("Invalid header")
+    if load_address != app_address + IMAGE_HEADER_SIZE or length == 0:
+        raise ValueError("Invalid load address or length")
+    if len(image) != IMAGE_HEADER_SIZE + length:
+        raise ValueError("Image length does not match the header")
+    if stm32_crc32(image[IMAGE_HEADER_SIZE:]) != crc:
+        raise ValueError("Checksum error")
+    return {"length": length, "load_address": load_address, "crc": crc,
+            "app_version": app_version}
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Pack application image for the STM32 bootloader")
+    parser.add_argument("input", help="application image")
+    parser.add_argument("output", help="compressed image to be created")
+    parser.add_argument("-w", "--window-bits", type=int, default=WINDOW_BITS,
+                        help="window size: 2^N bytes (default: %(default)s)")
+    parser.add_argument("-l", "--count-bits", type=int, default=COUNT_BITS,
+                        help="back-reference count size in bits "
+                        "(default: %(default)s)")
+    parser.add_argument("--header", action="store_true",
+                        help="add image header in front of the application")
+    parser.add_argument("--app-version", type=lambda x: int(x, 0),
+                        default=0, help="application version stored in the "
+                        "image header (default: %(default)s)")
+    parser.add_argument("--raw", action="store_true",
+                        help="do not compress the image")
+    args = parser.parse_args()
+
+    with open(args.input, "rb") as f:
+        data = f.read()
+
+    if args.header:
+        data = add_header(data, args.app_version)
+        parse_header(data)
+
+    if args.raw:
+        packed = data
+    else:
+        packed = compress(data, args.window_bits, args.count_bits)
+        if decompress(packed) != data:
+            raise SystemExit("Error: compressed image verification failed")
+
+    with open(args.output, "wb") as f:
+        f.write(packed)
+
+    print("Image:      {} bytes".format(len(data)))
+    if not args.raw:
+        print("Compressed: {} bytes ({:.1f}%)".format(
+            len(packed), 100.0 * len(packed) / len(data)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,210 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+"""Application image signing tool for the STM32 bootloader.
+
+Signs application images with Ed25519ph (RFC 8032, empty context): the
+SHA-512 digest of the image is signed, so the bootloader can hash the image
+while it is being programmed (USE_SIGNATURE, see signature.c). The detached
+64-byte signature is stored next to the image on the SD card.
+
+The private key is a file of 32 random bytes. The public key is printed as a
+C initializer for SIGNATURE_PUBLIC_KEY of the bootloader.
+
+Usage (from the root of the repository):
+    python -m python.sign_image keygen <key>
+    python -m python.sign_image pubkey <key>
+    python -m python.sign_image sign <key> <app.bin> <app.sig>
+    python -m python.sign_image verify <pubkey.bin> <app.bin> <app.sig>
+"""
+
+import argparse
+import hashlib
+import os
+
+# Field prime and group order
+P = 2 ** 255 - 19
+L = 2 ** 252 + 27742317777372353535851937790883648493
+# Curve constant d = -121665 / 121666
+D = -121665 * pow(121666, P - 2, P) % P
+# Square root of -1
+SQRT_M1 = pow(2, (P - 1) // 4, P)
+
+# dom2(phflag=1, context="") prefix of Ed25519ph
+DOM2 = b"SigEd25519 no Ed25519 collisions" + bytes([1, 0])
+
+KEY_LENGTH = 32
+SIGNATURE_LENGTH = 64
+
+
+def _recover_x(y, sign):
+    if y >= P:
+        return None
+    x2 = (y * y - 1) * pow(D * y * y + 1, P - 2, P)
+    if x2 == 0:
+        return None if sign else 0
+    x = pow(x2, (P + 3) // 8, P)
+    if (x * x - x2) % P != 0:
+        x = x * SQRT_M1 % P
+    if (x * x - x2) % P != 0:
+        return None
+    if (x & 1) != sign:
+        x = P - x
+    return x
+
+
+# Base point in extended coordinates (X, Y, Z, T)
+_BY = 4 * pow(5, P - 2, P) % P
+_BX = _recover_x(_BY, 0)
+BASE = (_BX, _BY, 1, _BX * _BY % P)
+NEUTRAL = (0, 1, 1, 0)
+
+
+def _add(p, q):
+    a = (p[1] - p[0]) * (q[1] - q[0]) % P
+    b = (p[1] + p[0]) * (q[1] + q[0]) % P
+    c = 2 * p[3] * q[3] * D % P
+    d = 2 * p[2] * q[2] % P
+    e, f, g, h = b - a, d - c, d + c, b + a
+    return (e * f % P, g * h % P, f * g % P, e * h % P)
+
+
+def _mul(s, p):
+    q = NEUTRAL
+    while s > 0:
+        if s & 1:
+            q = _add(q, p)
+        p = _add(p, p)
+        s >>= 1
+    return q
+
+
+def _equal(p, q):
+    return ((p[0] * q[2] - q[0] * p[2]) % P == 0 and
+            (p[1] * q[2] - q[1] * p[2]) % P == 0)
+
+
+def _compress(p):
+    zinv = pow(p[2], P - 2, P)
+    x = p[0] * zinv % P
+    y = p[1] * zinv % P
+    return int.to_bytes(y | ((x & 1) << 255), 32, "little")
+
+
+def _decompress(s):
+    if len(s) != 32:
+        return None
+    y = int.from_bytes(s, "little")
+    sign = y >> 255
+    y &= (1 << 255) - 1
+    x = _recover_x(y, sign)
+    if x is None:
+        return None
+    return (x, y, 1, x * y % P)
+
+
+def _hash_int(*parts):
+    h = hashlib.sha512()
+    for part in parts:
+        h.update(part)
+    return int.from_bytes(h.digest(), "little")
+
+
+def _expand(secret):
+    h = hashlib.sha512(secret).digest()
+    a = int.from_bytes(h[:32], "little")
+    a &= (1 << 254) - 8
+    a |= 1 << 254
+    return a, h[32:]
+
+
+def public_key(secret):
+    a, _ = _expand(secret)
+    return _compress(_mul(a, BASE))
+
+
+def sign(secret, data):
+    # Ed25519ph signature of the data
+    a, prefix = _expand(secret)
+    pub = _compress(_mul(a, BASE))
+    digest = hashlib.sha512(data).digest()
+    r = _hash_int(DOM2, prefix, digest) % L
+    rs = _compress(_mul(r, BASE))
+    k = _hash_int(DOM2, rs, pub, digest) % L
+    s = (r + k * a) % L
+    return rs + int.to_bytes(s, 32, "little")
+
+
+def verify(pub, data, signature):
+    if len(signature) != SIGNATURE_LENGTH:
+        return False
+    a = _decompress(pub)
+    r = _decompress(signature[:32])
+    s = int.from_bytes(signature[32:], "little")
+    if a is None or r is None or s >= L:
+        return False
+    digest = hashlib.sha512(data).digest()
+    k = _hash_int(DOM2, signature[:32], pub, digest) % L
+    return _equal(_mul(s, BASE), _add(r, _mul(k, a)))
+
+
+def c_initializer(data):
+    lines = []
+    for i in range(0, len(data), 8):
+        lines.append("    " + ", ".join("0x{:02X}".format(b)
+                                        for b in data[i:i + 8]))
+    return "{ \\\n" + ", \\\n".join(lines) + " \\\n}"
+
+
+def _read(path):
+    with open(path, "rb") as f:
+        return f.read()
+
+
+def _read_key(path):
+    secret = _read(path)
+    if len(secret) != KEY_LENGTH:
+        raise SystemExit("Error: the key must be {} bytes".format(KEY_LENGTH))
+    return secret
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Sign application images of the STM32 bootloader")
+    commands = parser.add_subparsers(dest="command")
+    command = commands.add_parser("keygen", help="create a private key")
+    command.add_argument("key", help="private key file to be created")
+    command = commands.add_parser("pubkey", help="print the public key")
+    command.add_argument("key", help="private key file")
+    command = commands.add_parser("sign", help="sign an application image")
+    command.add_argument("key", help="private key file")
+    command.add_argument("input", help="application image")
+    command.add_argument("output", help="signature file to be created")
+    command = commands.add_parser("verify", help="verify a signature")
+    command.add_argument("pubkey", help="public key file (32 bytes)")
+    command.add_argument("input", help="application image")
+    command.add_argument("signature", help="signature file")
+    args = parser.parse_args()
+
+    if args.command == "keygen":
+        if os.path.exists(args.key):
+            raise SystemExit("Error: {} already exists".format(args.key))
+        with open(args.key, "wb") as f:
+            f.write(os.urandom(KEY_LENGTH))
+        print(c_initializer(public_key(_read_key(args.key))))
+    elif args.command == "pubkey":
+        print(c_initializer(public_key(_read_key(args.key))))
+    elif args.command == "sign":
+        signature = sign(_read_key(args.key), _read(args.input))
+        with open(args.output, "wb") as f:
+            f.write(signature)
+    elif args.command == "verify":
+        if not verify(_read(args.pubkey), _read(args.input),
+                      _read(args.signature)):
+            raise SystemExit("Error: invalid signature")
+        print("Signature OK")
+    else:
+        parser.print_help()
+
+
+if __name__ == "__main__":
+    main()
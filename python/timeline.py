@@ -0,0 +1,94 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+"""Decoder of the boot timeline of the STM32 bootloader.
+
+Reads a timeline dump (lib/stm32-bootloader/timeline.c), e.g. a log of the
+VCP or SWO output in which the dump lines ("TL <phase> <mhz> <cycles>") are
+mixed with other messages, and prints the latency of every boot phase.
+
+An entry marks the end of a phase, which started at the previous entry of the
+same boot. The cycles of a phase are converted to time with the CPU clock at
+its start. Entries recorded before the first start of a boot in the dump
+(overwritten part of the ring buffer) are ignored.
+
+Usage (from the root of the repository):
+    python -m python.timeline [dump.txt]
+"""
+
+import argparse
+import sys
+
+# Boot phases (eTimelinePhases)
+START = 0x00
+USER = 0x80
+PHASES = {
+    START: "start",
+    0x01: "HAL_Init",
+    0x02: "SystemClock_Config",
+    0x03: "button",
+    0x04: "SD init",
+    0x05: "f_mount",
+    0x06: "erase",
+    0x07: "programming",
+    0x08: "verification",
+    0x09: "application check",
+    0x0A: "launch",
+    0x0B: "jump",
+}
+
+
+def phase_name(phase):
+    if phase >= USER:
+        return "user {}".format(phase - USER)
+    return PHASES.get(phase, "phase 0x{:02X}".format(phase))
+
+
+def parse(lines):
+    """Return the boots of a dump: lists of (phase, mhz, cycles) entries."""
+    boots = []
+    for line in lines:
+        fields = line.split()
+        if len(fields) != 4 or fields[0] != "TL":
+            continue
+        phase, mhz, cycles = (int(field, 16) for field in fields[1:])
+        if phase == START:
+            boots.append([])
+        if boots:
+            boots[-1].append((phase, mhz, cycles))
+    return boots
+
+
+def latencies(boot):
+    """Return the (name, cycles, microseconds) of the phases of a boot."""
+    result = []
+    for previous, entry in zip(boot, boot[1:]):
+        cycles = (entry[2] - previous[2]) & 0xFFFFFFFF
+        mhz = previous[1] if previous[1] else 1
+        result.append((phase_name(entry[0]), cycles, cycles / float(mhz)))
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Decode the boot timeline of the STM32 bootloader")
+    parser.add_argument("dump", nargs="?", type=argparse.FileType("r"),
+                        default=sys.stdin,
+                        help="timeline dump (default: standard input)")
+    args = parser.parse_args()
+
+    boots = parse(args.dump)
+    if not boots:
+        raise SystemExit("Error: no timeline found")
+
+    for index, boot in enumerate(boots):
+        print("Boot {}".format(index + 1))
+        print("  {:<20} {:>12} {:>12}".format("Phase", "Cycles", "Time [us]"))
+        total = 0.0
+        for name, cycles, time in latencies(boot):
+            print("  {:<20} {:>12} {:>12.1f}".format(name, cycles, time))
+            total += time
+        print("  {:<20} {:>12} {:>12.1f}".format("total", "", total))
+
+
+if __name__ == "__main__":
+    main()
@@ -1,7 +1,12 @@
 #!/usr/bin/env python
 # -*- coding: utf-8 -*-
+import os
+import subprocess
+
 import pytest
 
+from python.common import build_host_program
+
 
 def pytest_addoption(parser):
     parser.addoption(
@@ -13,3 +18,45 @@ def pytest_addoption(parser):
 @pytest.fixture
 def clang_format_executable(request):
     return request.config.getoption("--executable")
+
+
+@pytest.fixture(scope="session")
+def host_programs():
+    # Host programs built in the session: (sources, flags) -> executable
+    return {}
+
+
+@pytest.fixture
+def host_sim(request, host_programs, tmp_path_factory):
+    # Host program of the test module, built from SIM_SOURCES (paths relative
+    # to project path) with the compiler flags SIM_FLAGS, or from the
+    # (sources, flags) parameter of an indirectly parametrised test. Every
+    # program is built once per session.
+    if hasattr(request, "param"):
+        sources, flags = request.param
+    else:
+        sources = request.module.SIM_SOURCES
+        flags = getattr(request.module, "SIM_FLAGS", ())
+    key = (tuple(sources), tuple(flags))
+    if key not in host_programs:
+        name = os.path.splitext(os.path.basename(sources[0]))[0]
+        host_programs[key] = build_host_program(
+            list(sources), str(tmp_path_factory.mktemp("sim") / name),
+            list(flags))
+    if host_programs[key] is None:
+        pytest.skip("host compiler is not available")
+    return host_programs[key]
+
+
+def run_sim(executable, *arguments, check=True):
+    # Runs a host program and returns the lines of its output. If the program
+    # fails, CalledProcessError is raised, or None is returned if check is
+    # not set.
+    args = [executable] + [str(argument) for argument in arguments]
+    process = subprocess.run(args, stdout=subprocess.PIPE)
+    if process.returncode != 0:
+        if check:
+            raise subprocess.CalledProcessError(process.returncode, args,
+                                                process.stdout)
+        return None
+    return process.stdout.decode().splitlines()
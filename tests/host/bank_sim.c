@@ -0,0 +1,289 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader Dual-Bank Host Simulation
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   bank_sim.c
+ * @brief  Host program which simulates the dual-bank update of a device: the
+ *	       content of the banks, the BFB2 option bit and the boot sequence
+ *	       (system memory, then the bootloader of the booted bank) are
+ *	       emulated, while the boot decisions are made by bank.c and
+ *	       rollback.c. The state is kept between the operations, like on a
+ *	       device.
+ *
+ *	       Operations:
+ *	        - boot            reset the device, prints the bank whose
+ *	                          application is launched ("app:<bank>") or
+ *	                          "none"
+ *	        - update          program a valid update into the inactive bank
+ *	        - update-bad      program an invalid (e.g. interrupted) update
+ *	        - activate        activate the update: prints "refused" if the
+ *	                          update is invalid, otherwise boots the device
+ *	        - corrupt         corrupt the application of the active bank
+ *	        - switch-fault    the next bank switch fails (e.g. the option
+ *	                          bytes cannot be programmed)
+ *	        - page:<p>:<a>    prints the physical bank and page of page <p>
+ *	                          of the memory map if bank <a> is active
+ *	        - rollback        enable the boot-attempt counter (USE_ROLLBACK)
+ *	        - confirm         the application confirms the running image
+ *	        - clear           clear the backup register (power loss)
+ *	        - state           prints the rollback state ("confirmed",
+ *	                          "trial:<unconfirmed boots>" or
+ *	                          "reverting:<bank>")
+ *
+ *	       Usage: bank_sim <operation> [operation ...]
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "bank.h"
+#include "bootloader.h"
+#include "rollback.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Private variables ---------------------------------------------------------*/
+/** Content of the physical banks (index 0 is unused) */
+static struct
+{
+    uint8_t bootloader; /*!< The bank holds the bootloader */
+    uint8_t app;        /*!< The bank holds a valid application */
+} Banks[3] = {{0, 0}, {1, 1}, {0, 0}};
+
+/** BFB2 option bit: boot bank */
+static uint8_t Bfb2 = BANK_1;
+
+/** Active bank (mapped to the start of flash) */
+static uint8_t Active = BANK_1;
+
+/** Boot-attempt counter is enabled */
+static uint8_t Rollback = 0;
+
+/** The next bank switch fails */
+static uint8_t SwitchFault = 0;
+
+/* Private functions ---------------------------------------------------------*/
+static uint8_t SwitchBank(void)
+{
+    uint8_t inactive = Bootloader_BankOther(Active);
+
+    /* Bootloader_SwitchBank(): verify, copy bootloader, select bank */
+    if(!Banks[inactive].app)
+    {
+        return BL_CHKS_ERROR;
+    }
+    if(SwitchFault)
+    {
+        SwitchFault = 0;
+        return BL_OBP_ERROR;
+    }
+    Banks[inactive].bootloader = 1;
+    Bfb2                       = inactive;
+    return BL_OK;
+}
+
+static uint8_t Activate(void)
+{
+    uint8_t status;
+
+    /* Bootloader_ActivateUpdate(): the bank switch resets the device */
+    if(Rollback)
+    {
+        Bootloader_RollbackStart();
+    }
+    status = SwitchBank();
+    if(Rollback && (status != BL_OK))
+    {
+        Bootloader_ConfirmImage();
+    }
+    return status;
+}
+
+static uint8_t CountBoot(void)
+{
+    /* Bootloader_CountBoot(): revert to the last known good image */
+    if(!Rollback || (Bootloader_RollbackBoot(Active) != ROLLBACK_REVERT))
+    {
+        return BL_OK;
+    }
+    if(Banks[Bootloader_BankOther(Active)].app)
+    {
+        Bootloader_RollbackRevert(Bootloader_BankOther(Active));
+        SwitchBank();
+    }
+    return BL_NO_APP;
+}
+
+static void Boot(void)
+{
+    BootloaderBankStateTypeDef state;
+    uint8_t resets;
+
+    for(resets = 0; resets < 4; resets++)
+    {
+        /* System memory boots bank 2 if selected and bootable */
+        Active =
+            ((Bfb2 == BANK_2) && Banks[BANK_2].bootloader) ? BANK_2 : BANK_1;
+
+        /* Bootloader_SelectBank() */
+        state.active      = Active;
+        state.boot        = Bfb2;
+        state.activeValid = Banks[Active].app;
+        state.inactiveValid =
+            !state.activeValid && Banks[Bootloader_BankOther(Active)].app;
+
+        switch(Bootloader_BankDecide(&state))
+        {
+            case BANK_BOOT:
+                if(CountBoot() == BL_OK)
+                {
+                    printf("app:%u\n", Active);
+                    return;
+                }
+                if(Bfb2 == Active)
+                {
+                    printf("none\n");
+                    return;
+                }
+                break;
+
+            case BANK_CONFIRM:
+                if(Rollback)
+                {
+                    Bootloader_ConfirmImage();
+                }
+                /* Programming the option bit resets the device */
+                Bfb2 = Active;
+                break;
+
+            case BANK_SWITCH:
+                if(Rollback)
+                {
+                    Bootloader_ConfirmImage();
+                }
+                if(SwitchBank() != BL_OK)
+                {
+                    printf("none\n");
+                    return;
+                }
+                break;
+
+            default:
+                printf("none\n");
+                return;
+        }
+    }
+    printf("loop\n");
+}
+
+static void PrintState(void)
+{
+    uint8_t value;
+
+    switch(Bootloader_RollbackGetState(&value))
+    {
+        case ROLLBACK_TRIAL:
+            printf("trial:%u\n", value);
+            break;
+
+        case ROLLBACK_REVERTING:
+            printf("reverting:%u\n", value);
+            break;
+
+        default:
+            printf("confirmed\n");
+            break;
+    }
+}
+
+static int ParsePage(const char* op)
+{
+    unsigned long page;
+    unsigned long active;
+    char* end;
+
+    page = strtoul(op + 5, &end, 0);
+    if(*end != ':')
+    {
+        return 0;
+    }
+    active = strtoul(end + 1, &end, 0);
+    if((*end != '\0') || ((active != BANK_1) && (active != BANK_2)))
+    {
+        return 0;
+    }
+    printf("%u:%lu\n", Bootloader_BankOfPage(page, (uint8_t)active),
+           (unsigned long)Bootloader_BankPage(page));
+    return 1;
+}
+
+int main(int argc, char** argv)
+{
+    int i;
+
+    if(argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <operation> [operation ...]\n", argv[0]);
+        return 2;
+    }
+
+    for(i = 1; i < argc; i++)
+    {
+        if(!strcmp(argv[i], "boot"))
+        {
+            Boot();
+        }
+        else if(!strcmp(argv[i], "update"))
+        {
+            Banks[Bootloader_BankOther(Active)].app = 1;
+        }
+        else if(!strcmp(argv[i], "update-bad"))
+        {
+            Banks[Bootloader_BankOther(Active)].app = 0;
+        }
+        else if(!strcmp(argv[i], "activate"))
+        {
+            if(Activate() == BL_OK)
+            {
+                Boot();
+            }
+            else
+            {
+                printf("refused\n");
+            }
+        }
+        else if(!strcmp(argv[i], "corrupt"))
+        {
+            Banks[Active].app = 0;
+        }
+        else if(!strcmp(argv[i], "switch-fault"))
+        {
+            SwitchFault = 1;
+        }
+        else if(!strcmp(argv[i], "rollback"))
+        {
+            Rollback = 1;
+        }
+        else if(!strcmp(argv[i], "confirm"))
+        {
+            Bootloader_ConfirmImage();
+        }
+        else if(!strcmp(argv[i], "clear"))
+        {
+            Bootloader_RollbackRegister = 0;
+        }
+        else if(!strcmp(argv[i], "state"))
+        {
+            PrintState();
+        }
+        else if(strncmp(argv[i], "page:", 5) || !ParsePage(argv[i]))
+        {
+            fprintf(stderr, "Invalid operation: %s\n", argv[i]);
+            return 2;
+        }
+    }
+    return 0;
+}
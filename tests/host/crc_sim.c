@@ -0,0 +1,60 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader Checksum Host Simulation
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   crc_sim.c
+ * @brief  Host program which calculates the checksum of a file with the
+ *	       streaming checksum calculation of the bootloader. The file is fed
+ *	       in chunks of the given size, starting at the given offset of the
+ *	       buffer in order to test unaligned data as well.
+ *
+ *	       Usage: crc_sim <file> <chunk size> <buffer offset>
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "crc.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(int argc, char** argv)
+{
+    static uint8_t buffer[4096 + 4];
+    BootloaderCrcTypeDef crc;
+    FILE* file;
+    size_t chunk;
+    size_t offset;
+    size_t num;
+
+    if(argc != 4)
+    {
+        fprintf(stderr, "Usage: %s <file> <chunk> <offset>\n", argv[0]);
+        return 2;
+    }
+    chunk  = (size_t)strtoul(argv[2], NULL, 0);
+    offset = (size_t)strtoul(argv[3], NULL, 0) % 4;
+    if((chunk == 0) || (chunk > (sizeof(buffer) - 4)))
+    {
+        chunk = sizeof(buffer) - 4;
+    }
+
+    file = fopen(argv[1], "rb");
+    if(!file)
+    {
+        fprintf(stderr, "Cannot open file\n");
+        return 2;
+    }
+
+    Bootloader_CrcInit(&crc);
+    while((num = fread(&buffer[offset], 1, chunk, file)) > 0)
+    {
+        Bootloader_CrcUpdate(&crc, &buffer[offset], (uint32_t)num);
+    }
+    fclose(file);
+
+    printf("0x%08lX\n", (unsigned long)Bootloader_CrcFinal(&crc));
+    return 0;
+}
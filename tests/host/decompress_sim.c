@@ -0,0 +1,142 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader Decompression Host Simulation
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   decompress_sim.c
+ * @brief  Host program which decompresses a compressed image with the
+ *	       decompressor of the bootloader. The compressed image is fed in
+ *	       chunks of the given size, the decompressed image is written to a
+ *	       file instead of flash. If the number of iterations is given, the
+ *	       decompression is repeated and the compression ratio and the decode
+ *	       speed are reported.
+ *
+ *	       Usage: decompress_sim <input> <output> <chunk size> [iterations]
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "bootloader.h"
+#include "decompress.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Private variables ---------------------------------------------------------*/
+static uint8_t* image;
+static uint32_t imageLength;
+static uint32_t imageSize;
+
+/* Private functions ---------------------------------------------------------*/
+static uint8_t Write(const uint8_t* data, uint32_t length)
+{
+    if(length > (imageSize - imageLength))
+    {
+        return BL_WRITE_ERROR;
+    }
+    memcpy(&image[imageLength], data, length);
+    imageLength += length;
+    return BL_OK;
+}
+
+static uint8_t Decompress(const uint8_t* input, size_t length, size_t chunk)
+{
+    static BootloaderDecompressTypeDef decomp;
+    uint8_t status = BL_OK;
+    size_t pos;
+    size_t size;
+
+    imageLength = 0;
+    Bootloader_DecompressInit(&decomp, Write);
+    for(pos = 0; (pos < length) && (status == BL_OK); pos += size)
+    {
+        size   = ((length - pos) < chunk) ? (length - pos) : chunk;
+        status = Bootloader_DecompressWrite(&decomp, &input[pos], size);
+    }
+    return (status == BL_OK) ? Bootloader_DecompressEnd(&decomp) : status;
+}
+
+int main(int argc, char** argv)
+{
+    FILE* file;
+    uint8_t* input;
+    long length;
+    size_t chunk;
+    unsigned long iterations = 0;
+    unsigned long i;
+    uint8_t status;
+    clock_t start;
+    double seconds;
+
+    if((argc != 4) && (argc != 5))
+    {
+        fprintf(stderr, "Usage: %s <input> <output> <chunk> [iterations]\n",
+                argv[0]);
+        return 2;
+    }
+    chunk = (size_t)strtoul(argv[3], NULL, 0);
+    chunk = (chunk == 0) ? 1 : chunk;
+    if(argc == 5)
+    {
+        iterations = strtoul(argv[4], NULL, 0);
+    }
+
+    file = fopen(argv[1], "rb");
+    if(!file || fseek(file, 0, SEEK_END) || ((length = ftell(file)) <= 0))
+    {
+        fprintf(stderr, "Cannot read input\n");
+        return 2;
+    }
+    rewind(file);
+    input = malloc((size_t)length);
+    if(!input || (fread(input, 1, (size_t)length, file) != (size_t)length))
+    {
+        fprintf(stderr, "Cannot read input\n");
+        return 2;
+    }
+    fclose(file);
+
+    /* Output cannot be larger than the flash */
+    imageSize = 2 * 1024 * 1024;
+    image     = malloc(imageSize);
+
+    status = Decompress(input, (size_t)length, chunk);
+    if(status != BL_OK)
+    {
+        fprintf(stderr, "Decompression error: %u\n", status);
+        return 1;
+    }
+
+    file = fopen(argv[2], "wb");
+    if(!file || (fwrite(image, 1, imageLength, file) != imageLength))
+    {
+        fprintf(stderr, "Cannot write output\n");
+        return 2;
+    }
+    fclose(file);
+
+    if(iterations > 0)
+    {
+        start = clock();
+        for(i = 0; i < iterations; i++)
+        {
+            Decompress(input, (size_t)length, chunk);
+        }
+        seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+        printf("Image:      %lu bytes\n", (unsigned long)imageLength);
+        printf("Compressed: %ld bytes (%.1f%%)\n", length,
+               100.0 * length / imageLength);
+        printf("Decode:     %.1f MB/s\n",
+               (seconds > 0)
+                   ? (iterations * (double)imageLength / seconds / 1e6)
+                   : 0.0);
+    }
+
+    free(input);
+    free(image);
+    return 0;
+}
@@ -0,0 +1,73 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader Fast Boot Host Simulation
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   fastboot_sim.c
+ * @brief  Host program which simulates the update triggers of the fast-boot
+ *	       path (fastboot.c). The backup register is kept between the
+ *	       operations, like on a device.
+ *
+ *	       Operations:
+ *	        - boot            reset the device, prints the action of the
+ *	                          bootloader ("launch", "update" or "request")
+ *	        - boot-button     reset the device with the button pressed
+ *	        - request         the application requests an update
+ *	        - clear           clear the backup register (power loss)
+ *
+ *	       Usage: fastboot_sim <operation> [operation ...]
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "fastboot.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Private functions ---------------------------------------------------------*/
+static void Boot(uint8_t button)
+{
+    static const char* const actions[] = {"launch", "update", "request"};
+
+    printf("%s\n", actions[Bootloader_FastBootCheck(button)]);
+}
+
+int main(int argc, char** argv)
+{
+    int i;
+
+    if(argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <operation> [operation ...]\n", argv[0]);
+        return 2;
+    }
+
+    for(i = 1; i < argc; i++)
+    {
+        if(!strcmp(argv[i], "boot"))
+        {
+            Boot(0);
+        }
+        else if(!strcmp(argv[i], "boot-button"))
+        {
+            Boot(1);
+        }
+        else if(!strcmp(argv[i], "request"))
+        {
+            Bootloader_RequestUpdate();
+        }
+        else if(!strcmp(argv[i], "clear"))
+        {
+            Bootloader_FastBootRegister = 0;
+        }
+        else
+        {
+            fprintf(stderr, "Invalid operation: %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    return 0;
+}
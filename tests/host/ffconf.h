@@ -0,0 +1,61 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader FatFs Host Configuration
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   ffconf.h
+ * @brief  FatFs configuration of the host programs: the options of the
+ *	       projects (fast seek, 512-byte sectors, single volume), with
+ *	       writing and f_mkfs() enabled to create the test volumes, and
+ *	       without long file names and timestamps.
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+#ifndef _FFCONF
+#define _FFCONF 68300 /* Revision ID */
+
+/* Function configurations */
+#define _FS_READONLY  0
+#define _FS_MINIMIZE  0
+#define _USE_STRFUNC  0
+#define _USE_FIND     0
+#define _USE_MKFS     1
+#define _USE_FASTSEEK 1
+#define _USE_EXPAND   0
+#define _USE_CHMOD    0
+#define _USE_LABEL    0
+#define _USE_FORWARD  0
+
+/* Locale and namespace configurations */
+#define _CODE_PAGE   437
+#define _USE_LFN     0
+#define _MAX_LFN     255
+#define _LFN_UNICODE 0
+#define _STRF_ENCODE 3
+#define _FS_RPATH    0
+
+/* Drive/volume configurations */
+#define _VOLUMES         1
+#define _STR_VOLUME_ID   0
+#define _VOLUME_STRS     "RAM"
+#define _MULTI_PARTITION 0
+#define _MIN_SS          512
+#define _MAX_SS          512
+#define _USE_TRIM        0
+#define _FS_NOFSINFO     0
+
+/* System configurations */
+#define _FS_TINY      0
+#define _FS_EXFAT     0
+#define _FS_NORTC     1
+#define _NORTC_MON    1
+#define _NORTC_MDAY   1
+#define _NORTC_YEAR   2020
+#define _FS_LOCK      0
+#define _FS_REENTRANT 0
+#define _FS_TIMEOUT   1000
+#define _SYNC_t       int
+
+#endif /* _FFCONF */
@@ -0,0 +1,522 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader Flash Programming Host Simulation
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   flash_sim.c
+ * @brief  Host program which runs the erase, programming and verification
+ *	       functions of bootloader.c on the NOR flash simulator (norflash.c).
+ *	       The operations are performed in the given order on the same
+ *	       simulated flash; every operation prints its result ("ok" or
+ *	       "error:<code>") unless noted otherwise.
+ *
+ *	       Operations:
+ *	        - no-init          (first operation only) start without calling
+ *	                           Bootloader_Init(), like a project using the
+ *	                           bootloader before initializing it (no output)
+ *	        - erase            erase the application space
+ *	        - erase-image      erase the pages covered by the image
+ *	        - erase-range:<l>  erase the pages covered by an image of <l>
+ *	                           bytes
+ *	        - write:<chunk>    program the image with Bootloader_FlashWrite()
+ *	                           in chunks of the given size
+ *	        - next             program the image with Bootloader_FlashNext()
+ *	        - sd:<buffer>      program the image with Bootloader_FlashWrite()
+ *	                           read from a simulated SD card into a buffer
+ *	                           of the given size, like the example projects
+ *	        - sd-reads         prints the number of sectors read from the
+ *	                           simulated SD card
+ *	        - fault:<a>:<m>    inject a faulty flash cell: the bits <m> of
+ *	                           the byte at address <a> stay set (hexadecimal)
+ *	        - unlock-fault     make every later unlock of the flash fail
+ *	        - mismatch         prints the offset of the first byte which
+ *	                           does not match the image
+ *	        - session          prints the number of pages erased and of
+ *	                           pages skipped by the last programming session
+ *	        - load             write the image into the application space
+ *	                           directly, like a preinstalled image (no
+ *	                           output)
+ *	        - bootloader       write the start of the image into the
+ *	                           bootloader area of the active bank directly,
+ *	                           like a bootloader which differs from its copy
+ *	                           in the other bank (no output)
+ *	        - flip:<o>         invert the byte at offset <o> of the
+ *	                           application space directly, without the
+ *	                           rules of the flash (no output)
+ *	        - program:<o>:<d>  program the double word <d> (hexadecimal) at
+ *	                           offset <o> of the application space directly
+ *	                           with the backend
+ *	        - read:<o>         prints the double word at offset <o> of the
+ *	                           application space (hexadecimal)
+ *	        - protect          enable the write protection
+ *	        - wrp:<s>:<e>      set WRP area B of bank 1 to the addresses
+ *	                           [s, e) in the option bytes
+ *	        - pcrop:<s>:<e>    set the PCROP area of bank 1 to the addresses
+ *	                           [s, e) in the option bytes
+ *	        - rdp:<level>      set the RDP level in the option bytes
+ *	        - reset            reset the bootloader (Bootloader_Init), which
+ *	                           takes the snapshot of the flash protection
+ *	        - writable:<a>:<l> check whether the range of <l> bytes at
+ *	                           address <a> is writable
+ *	        - status           prints the protection status of the
+ *	                           application space
+ *	        - option-reads     prints the number of option byte reads
+ *	        - verify           prints "match" if the application space holds
+ *	                           the image, otherwise "mismatch"
+ *	        - checksum         verify the checksum of the application
+ *	                           (Bootloader_VerifyChecksum)
+ *	        - activate         activate the update
+ *	                           (Bootloader_ActivateUpdate)
+ *	        - signature:<file> verify the signature of the last programming
+ *	                           session (Bootloader_VerifySignature) read
+ *	                           from a file
+ *	        - dump:<file>      write the content of the application space
+ *	                           into a file (no output)
+ *	        - restore:<file>   write the content of a file into the
+ *	                           application space directly (no output): a
+ *	                           dump restored by another run of the program
+ *	                           is the flash after a reset
+ *	        - stats            prints the number of erased pages, double
+ *	                           words, rows, rejected operations and the
+ *	                           duration of the operations in microseconds
+ *	        - launch           launch the application: prints the initial
+ *	                           stack pointer of the jump and ends the
+ *	                           program, or prints "refused"
+ *
+ *	       Usage: flash_sim <image> <operation> [operation ...]
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "bootloader.h"
+#include "norflash.h"
+#include "signature.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Private defines -----------------------------------------------------------*/
+#define SD_SECTOR_SIZE 512 /*!< Sector size of the simulated SD card */
+
+/* Private variables ---------------------------------------------------------*/
+static uint8_t* Image;
+static uint32_t ImageLength;
+
+/** Sectors read from the simulated SD card and the sector held in the
+ * window of the file system */
+static uint32_t SdReads;
+static uint32_t SdWindow = 0xFFFFFFFF;
+
+/** Protection option bytes set by the operations */
+static BootloaderProtectionTypeDef Options;
+
+/* Public functions ----------------------------------------------------------*/
+void Host_Jump(uint32_t stack)
+{
+    printf("jump:%08x\n", (unsigned)stack);
+    exit(0);
+}
+
+/* Private functions ---------------------------------------------------------*/
+static uint8_t* ReadFile(const char* path, uint32_t* length)
+{
+    FILE* file = fopen(path, "rb");
+    uint8_t* data;
+    long size;
+
+    if(!file || fseek(file, 0, SEEK_END) || ((size = ftell(file)) < 0))
+    {
+        return NULL;
+    }
+    rewind(file);
+    data = malloc((size_t)size + 1);
+    if(!data || (fread(data, 1, (size_t)size, file) != (size_t)size))
+    {
+        return NULL;
+    }
+    fclose(file);
+    *length = (uint32_t)size;
+    return data;
+}
+
+static uint8_t Write(uint32_t chunk)
+{
+    uint32_t pos;
+    uint32_t size;
+    uint8_t status = Bootloader_FlashBegin();
+
+    if(status != BL_OK)
+    {
+        return status;
+    }
+    for(pos = 0; pos < ImageLength; pos += size)
+    {
+        size   = ((ImageLength - pos) < chunk) ? (ImageLength - pos) : chunk;
+        status = Bootloader_FlashWrite(&Image[pos], size);
+        if(status != BL_OK)
+        {
+            Bootloader_FlashEnd();
+            return status;
+        }
+    }
+    return Bootloader_FlashEnd();
+}
+
+static uint32_t SdRead(uint32_t pos, uint8_t* data, uint32_t length)
+{
+    uint32_t first = pos / SD_SECTOR_SIZE;
+    uint32_t last;
+
+    if(length > (ImageLength - pos))
+    {
+        length = ImageLength - pos;
+    }
+    if(length > 0)
+    {
+        /* Every sector is read once, the sector in the window is reused */
+        last = (pos + length - 1) / SD_SECTOR_SIZE;
+        SdReads += (last - first + 1) - ((first == SdWindow) ? 1 : 0);
+        SdWindow = last;
+        memcpy(data, &Image[pos], length);
+    }
+    return length;
+}
+
+static uint8_t Sd(uint32_t buffer)
+{
+    uint8_t* data = malloc(buffer);
+    uint32_t pos  = 0;
+    uint32_t num;
+    uint8_t status = Bootloader_FlashBegin();
+
+    while((status == BL_OK) && ((num = SdRead(pos, data, buffer)) > 0))
+    {
+        status = Bootloader_FlashWrite(data, num);
+        pos += num;
+    }
+    if(status == BL_OK)
+    {
+        status = Bootloader_FlashEnd();
+    }
+    else
+    {
+        Bootloader_FlashEnd();
+    }
+    free(data);
+    return status;
+}
+
+static uint8_t Next(void)
+{
+    uint32_t pos;
+    uint64_t data;
+    uint8_t status = Bootloader_FlashBegin();
+
+    if(status != BL_OK)
+    {
+        return status;
+    }
+    for(pos = 0; (pos < ImageLength) && (status == BL_OK); pos += 8)
+    {
+        /* The last double word is padded with erased flash value */
+        data = 0xFFFFFFFFFFFFFFFF;
+        memcpy(&data, &Image[pos],
+               ((ImageLength - pos) < 8) ? (ImageLength - pos) : 8);
+        status = Bootloader_FlashNext(data);
+    }
+    Bootloader_FlashEnd();
+    return status;
+}
+
+static uint8_t Dump(const char* path)
+{
+    FILE* file      = fopen(path, "wb");
+    uint32_t length = FLASH_BASE + FLASH_SIZE - UPDATE_ADDRESS;
+    uint8_t error;
+
+    if(!file)
+    {
+        return 1;
+    }
+    error = (fwrite((void*)UPDATE_ADDRESS, 1, length, file) != length);
+    return (fclose(file) != 0) || error;
+}
+
+static uint8_t Restore(const char* path)
+{
+    uint32_t length;
+    uint8_t* data = ReadFile(path, &length);
+
+    if(!data || (length > (FLASH_BASE + FLASH_SIZE - UPDATE_ADDRESS)))
+    {
+        free(data);
+        return 1;
+    }
+    NorFlash_Load(UPDATE_ADDRESS, data, length);
+    free(data);
+    return 0;
+}
+
+static uint8_t Signature(const char* path)
+{
+    uint32_t length;
+    uint8_t* data = ReadFile(path, &length);
+    uint8_t status;
+
+    if(!data || (length != SIGNATURE_LENGTH))
+    {
+        free(data);
+        return BL_SIGNATURE_ERROR;
+    }
+    status = Bootloader_VerifySignature(data);
+    free(data);
+    return status;
+}
+
+static uint8_t Program(uint32_t offset, uint64_t data)
+{
+    uint8_t status;
+
+    NorFlash_Ops.unlock();
+    status = NorFlash_Ops.program(UPDATE_ADDRESS + offset, data);
+    NorFlash_Ops.lock();
+    return status;
+}
+
+int main(int argc, char** argv)
+{
+    NorFlashStatsTypeDef stats;
+    BootloaderStatsTypeDef flash;
+    unsigned long offset;
+    unsigned long address;
+    unsigned long long data;
+    uint8_t byte;
+    uint8_t status;
+    int i;
+
+    if(argc < 3)
+    {
+        fprintf(stderr, "Usage: %s <image> <operation> [operation ...]\n",
+                argv[0]);
+        return 2;
+    }
+    Image = ReadFile(argv[1], &ImageLength);
+    if(!Image)
+    {
+        fprintf(stderr, "Cannot read %s\n", argv[1]);
+        return 2;
+    }
+    if(NorFlash_Init() != 0)
+    {
+        fprintf(stderr, "Cannot map the simulated flash\n");
+        return 2;
+    }
+    Bootloader_SetFlashOps(&NorFlash_Ops);
+    if(strcmp(argv[2], "no-init") != 0)
+    {
+        Bootloader_Init();
+    }
+
+    for(i = 2; i < argc; i++)
+    {
+        if(strcmp(argv[i], "no-init") == 0)
+        {
+            continue;
+        }
+        else if(strcmp(argv[i], "erase") == 0)
+        {
+            status = Bootloader_Erase();
+        }
+        else if(strcmp(argv[i], "erase-image") == 0)
+        {
+            status = Bootloader_EraseRange(ImageLength);
+        }
+        else if(sscanf(argv[i], "erase-range:%lu", &offset) == 1)
+        {
+            status = Bootloader_EraseRange((uint32_t)offset);
+        }
+        else if(strncmp(argv[i], "write:", 6) == 0)
+        {
+            status = Write((uint32_t)strtoul(&argv[i][6], NULL, 0));
+        }
+        else if(strcmp(argv[i], "next") == 0)
+        {
+            status = Next();
+        }
+        else if(sscanf(argv[i], "sd:%lu", &offset) == 1)
+        {
+            status = Sd((uint32_t)offset);
+        }
+        else if(strcmp(argv[i], "sd-reads") == 0)
+        {
+            printf("%u\n", SdReads);
+            continue;
+        }
+        else if(sscanf(argv[i], "fault:%lx:%lx", &address, &offset) == 2)
+        {
+            NorFlash_InjectFault((uint32_t)address, (uint8_t)offset);
+            status = BL_OK;
+        }
+        else if(strcmp(argv[i], "unlock-fault") == 0)
+        {
+            NorFlash_InjectUnlockFault();
+            status = BL_OK;
+        }
+        else if(strcmp(argv[i], "mismatch") == 0)
+        {
+            Bootloader_GetStats(&flash);
+            printf("%u\n", flash.mismatch);
+            continue;
+        }
+        else if(strcmp(argv[i], "session") == 0)
+        {
+            Bootloader_GetStats(&flash);
+            printf("%u %u\n", flash.erased, flash.skipped);
+            continue;
+        }
+        else if(strcmp(argv[i], "load") == 0)
+        {
+            NorFlash_Load(UPDATE_ADDRESS, Image, ImageLength);
+            continue;
+        }
+        else if(strcmp(argv[i], "bootloader") == 0)
+        {
+            NorFlash_Load(FLASH_BASE, Image,
+                          (ImageLength < (APP_ADDRESS - FLASH_BASE))
+                              ? ImageLength
+                              : (APP_ADDRESS - FLASH_BASE));
+            continue;
+        }
+        else if(sscanf(argv[i], "flip:%lu", &offset) == 1)
+        {
+            byte = (uint8_t) ~*(uint8_t*)(UPDATE_ADDRESS + offset);
+            NorFlash_Load(UPDATE_ADDRESS + (uint32_t)offset, &byte, 1);
+            continue;
+        }
+        else if(sscanf(argv[i], "program:%lu:%llx", &offset, &data) == 2)
+        {
+            status = Program((uint32_t)offset, (uint64_t)data);
+        }
+        else if(sscanf(argv[i], "read:%lu", &offset) == 1)
+        {
+            printf("%016llx\n",
+                   (unsigned long long)*(uint64_t*)(UPDATE_ADDRESS + offset));
+            continue;
+        }
+        else if(strcmp(argv[i], "protect") == 0)
+        {
+            status = Bootloader_ConfigProtection(BL_PROTECTION_WRP);
+        }
+        else if(sscanf(argv[i], "wrp:%lx:%lx", &address, &offset) == 2)
+        {
+            Options.wrp[0][1].start = (uint32_t)address;
+            Options.wrp[0][1].end   = (uint32_t)offset;
+            NorFlash_SetProtection(&Options);
+            status = BL_OK;
+        }
+        else if(sscanf(argv[i], "pcrop:%lx:%lx", &address, &offset) == 2)
+        {
+            Options.pcrop[0].start = (uint32_t)address;
+            Options.pcrop[0].end   = (uint32_t)offset;
+            NorFlash_SetProtection(&Options);
+            status = BL_OK;
+        }
+        else if(sscanf(argv[i], "rdp:%lu", &offset) == 1)
+        {
+            Options.rdp = (uint8_t)offset;
+            NorFlash_SetProtection(&Options);
+            status = BL_OK;
+        }
+        else if(strcmp(argv[i], "reset") == 0)
+        {
+            status = Bootloader_Init();
+        }
+        else if(sscanf(argv[i], "writable:%lx:%lu", &address, &offset) == 2)
+        {
+            status =
+                Bootloader_IsRangeWritable((uint32_t)address, (uint32_t)offset);
+        }
+        else if(strcmp(argv[i], "status") == 0)
+        {
+            printf("%u\n", Bootloader_GetProtectionStatus());
+            continue;
+        }
+        else if(strcmp(argv[i], "option-reads") == 0)
+        {
+            NorFlash_GetStats(&stats);
+            printf("%u\n", stats.reads);
+            continue;
+        }
+        else if(strcmp(argv[i], "verify") == 0)
+        {
+            printf("%s\n",
+                   (memcmp((void*)UPDATE_ADDRESS, Image, ImageLength) == 0)
+                       ? "match"
+                       : "mismatch");
+            continue;
+        }
+        else if(strcmp(argv[i], "checksum") == 0)
+        {
+            status = Bootloader_VerifyChecksum();
+        }
+        else if(strcmp(argv[i], "activate") == 0)
+        {
+            status = Bootloader_ActivateUpdate();
+        }
+        else if(strncmp(argv[i], "signature:", 10) == 0)
+        {
+            status = Signature(&argv[i][10]);
+        }
+        else if(strncmp(argv[i], "dump:", 5) == 0)
+        {
+            if(Dump(&argv[i][5]))
+            {
+                fprintf(stderr, "Cannot write %s\n", &argv[i][5]);
+                return 2;
+            }
+            continue;
+        }
+        else if(strncmp(argv[i], "restore:", 8) == 0)
+        {
+            if(Restore(&argv[i][8]))
+            {
+                fprintf(stderr, "Cannot read %s\n", &argv[i][8]);
+                return 2;
+            }
+            continue;
+        }
+        else if(strcmp(argv[i], "stats") == 0)
+        {
+            NorFlash_GetStats(&stats);
+            printf("%u %u %u %u %llu\n", stats.erased, stats.programmed,
+                   stats.rows, stats.errors,
+                   (unsigned long long)(stats.time / 1000));
+            continue;
+        }
+        else if(strcmp(argv[i], "launch") == 0)
+        {
+            Bootloader_JumpToApplication();
+            printf("refused\n");
+            continue;
+        }
+        else
+        {
+            fprintf(stderr, "Unknown operation: %s\n", argv[i]);
+            return 2;
+        }
+
+        if(status == BL_OK)
+        {
+            printf("ok\n");
+        }
+        else
+        {
+            printf("error:%u\n", status);
+        }
+    }
+
+    free(Image);
+    return 0;
+}
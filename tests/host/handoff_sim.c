@@ -0,0 +1,100 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader Clock Handoff Host Simulation
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   handoff_sim.c
+ * @brief  Host program which simulates the clock handoff of handoff.c: the
+ *	       clock registers are emulated and kept between the operations, like
+ *	       the handoff block in RAM.
+ *
+ *	       Operations:
+ *	        - pll             the clock runs from the PLL at 80 MHz
+ *	        - msi             the clock runs from the MSI at 4 MHz (reset)
+ *	        - publish         the bootloader publishes the handoff block
+ *	        - valid           prints 1 if the handoff block is valid,
+ *	                          otherwise 0
+ *	        - resume:<hz>     the application takes the clock over at <hz>:
+ *	                          prints 1 if it is taken over, otherwise 0
+ *	        - corrupt         corrupt the handoff block
+ *	        - reclock         change the PLL configuration
+ *
+ *	       Usage: handoff_sim <operation> [operation ...]
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "bootloader.h"
+#include "handoff.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Private functions ---------------------------------------------------------*/
+static void SetClock(uint8_t pll)
+{
+    /* RCC_CR, RCC_CFGR, RCC_PLLCFGR, FLASH_ACR, PWR_CR1 */
+    const uint32_t msi[5]   = {RCC_CR_MSION | RCC_CR_MSIRDY, 0, 0x00001000,
+                               0x00000600, PWR_CR1_VOS_0};
+    const uint32_t pll80[5] = {
+        RCC_CR_MSION | RCC_CR_MSIRDY | RCC_CR_PLLON | RCC_CR_PLLRDY,
+        RCC_CFGR_SW_PLL | RCC_CFGR_SWS_PLL, 0x01002811,
+        0x00000600 | FLASH_ACR_LATENCY_4WS, PWR_CR1_VOS_0};
+
+    memcpy(Bootloader_HandoffRegisters, pll ? pll80 : msi,
+           sizeof(Bootloader_HandoffRegisters));
+    Bootloader_HandoffClock = pll ? 80000000 : 4000000;
+}
+
+int main(int argc, char** argv)
+{
+    unsigned long hz;
+    int i;
+
+    if(argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <operation> [operation ...]\n", argv[0]);
+        return 2;
+    }
+
+    SetClock(0);
+    for(i = 1; i < argc; i++)
+    {
+        if(!strcmp(argv[i], "pll"))
+        {
+            SetClock(1);
+        }
+        else if(!strcmp(argv[i], "msi"))
+        {
+            SetClock(0);
+        }
+        else if(!strcmp(argv[i], "publish"))
+        {
+            Bootloader_HandoffPublish();
+        }
+        else if(!strcmp(argv[i], "valid"))
+        {
+            printf("%u\n", Bootloader_HandoffValid());
+        }
+        else if(sscanf(argv[i], "resume:%lu", &hz) == 1)
+        {
+            printf("%u\n", Bootloader_HandoffResume((uint32_t)hz));
+        }
+        else if(!strcmp(argv[i], "corrupt"))
+        {
+            ((HandoffTypeDef*)Bootloader_HandoffGet())->sysclk ^= 1;
+        }
+        else if(!strcmp(argv[i], "reclock"))
+        {
+            Bootloader_HandoffRegisters[2] ^= RCC_PLLCFGR_PLLN_0;
+        }
+        else
+        {
+            fprintf(stderr, "Invalid operation: %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    return 0;
+}
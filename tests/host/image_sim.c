@@ -0,0 +1,78 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader Image Header Host Simulation
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   image_sim.c
+ * @brief  Host program which checks an image with header like the bootloader
+ *	       does on startup: the header is parsed, then the checksum of the
+ *	       application is verified over the length given by the header. The
+ *	       length, checksum and version of the application are printed.
+ *
+ *	       Usage: image_sim <image>
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "bootloader.h"
+#include "crc.h"
+#include "image.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(int argc, char** argv)
+{
+    BootloaderImageHeaderTypeDef header;
+    BootloaderCrcTypeDef crc;
+    FILE* file;
+    uint8_t* image;
+    long length;
+
+    if(argc != 2)
+    {
+        fprintf(stderr, "Usage: %s <image>\n", argv[0]);
+        return 2;
+    }
+
+    file = fopen(argv[1], "rb");
+    if(!file || fseek(file, 0, SEEK_END) || ((length = ftell(file)) < 0))
+    {
+        fprintf(stderr, "Cannot read image\n");
+        return 2;
+    }
+    rewind(file);
+    image = malloc((size_t)length + IMAGE_HEADER_LENGTH);
+    if(!image || (fread(image, 1, (size_t)length, file) != (size_t)length))
+    {
+        fprintf(stderr, "Cannot read image\n");
+        return 2;
+    }
+    fclose(file);
+
+    if((length < IMAGE_HEADER_SIZE) ||
+       (Bootloader_ImageParse(image, &header) != BL_OK))
+    {
+        fprintf(stderr, "Invalid header\n");
+        return 1;
+    }
+    if((unsigned long)length != (IMAGE_HEADER_SIZE + header.length))
+    {
+        fprintf(stderr, "Invalid length\n");
+        return 1;
+    }
+
+    Bootloader_CrcInit(&crc);
+    Bootloader_CrcUpdate(&crc, &image[IMAGE_HEADER_SIZE], header.length);
+    if(Bootloader_CrcFinal(&crc) != header.crc)
+    {
+        fprintf(stderr, "Checksum error\n");
+        return 1;
+    }
+
+    printf("%lu 0x%08lX 0x%08lX\n", (unsigned long)header.length,
+           (unsigned long)header.crc, (unsigned long)header.appVersion);
+    free(image);
+    return 0;
+}
@@ -0,0 +1,101 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader Verified Image Cache Host Simulation
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   imagecache_sim.c
+ * @brief  Host program which executes a sequence of operations on the
+ *	       verified image cache. The backup registers are emulated in RAM and
+ *	       are kept between the operations, like during consecutive boots.
+ *	       The result of every check is printed in a separate line ("ok" or
+ *	       "fail").
+ *
+ *	       Operations:
+ *	        - check:<size>:<crc>  check the record of an image
+ *	        - store:<size>:<crc>  store the record of a verified image
+ *	        - invalidate          invalidate the record (flash write)
+ *	        - clear               clear the backup registers (power loss)
+ *	        - poke:<index>:<val>  overwrite a backup register
+ *
+ *	       Usage: imagecache_sim <operation> [operation ...]
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "bootloader.h"
+#include "imagecache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Private functions ---------------------------------------------------------*/
+static int ParseArguments(const char* op, uint32_t* first, uint32_t* second)
+{
+    char* end;
+
+    op = strchr(op, ':');
+    if(!op)
+    {
+        return 0;
+    }
+    *first = (uint32_t)strtoul(op + 1, &end, 0);
+    if(*end != ':')
+    {
+        return 0;
+    }
+    *second = (uint32_t)strtoul(end + 1, &end, 0);
+    return (*end == '\0');
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t first;
+    uint32_t second;
+    int i;
+
+    if(argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <operation> [operation ...]\n", argv[0]);
+        return 2;
+    }
+
+    for(i = 1; i < argc; i++)
+    {
+        if(!strcmp(argv[i], "invalidate"))
+        {
+            Bootloader_CacheInvalidate();
+        }
+        else if(!strcmp(argv[i], "clear"))
+        {
+            memset(Bootloader_CacheRegisters, 0,
+                   sizeof(Bootloader_CacheRegisters));
+        }
+        else if(!ParseArguments(argv[i], &first, &second))
+        {
+            fprintf(stderr, "Invalid operation: %s\n", argv[i]);
+            return 2;
+        }
+        else if(!strncmp(argv[i], "check:", 6))
+        {
+            printf("%s\n", (Bootloader_CacheCheck(first, second) == BL_OK)
+                               ? "ok"
+                               : "fail");
+        }
+        else if(!strncmp(argv[i], "store:", 6))
+        {
+            Bootloader_CacheStore(first, second);
+        }
+        else if(!strncmp(argv[i], "poke:", 5) && (first < CACHE_NBREGISTERS))
+        {
+            Bootloader_CacheRegisters[first] = second;
+        }
+        else
+        {
+            fprintf(stderr, "Invalid operation: %s\n", argv[i]);
+            return 2;
+        }
+    }
+    return 0;
+}
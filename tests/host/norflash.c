@@ -0,0 +1,384 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader NOR Flash Simulator
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   norflash.c
+ * @brief  Flash backend of host builds which simulates the dual-bank NOR
+ *	       flash of the STM32L496 (Linux). The flash is mapped read-only to
+ *	       ::FLASH_BASE, so the bootloader reads it like on the device, and it
+ *	       can only be modified through the backend, which enforces the rules
+ *	       of the flash controller:
+ *	        - the flash must be unlocked for erase and programming
+ *	        - pages of 2 KB are erased to 0xFF
+ *	        - double words are programmed at addresses aligned to 8 bytes,
+ *	          bits can only be cleared: a double word can be programmed once
+ *	          after erase (or cleared to zero)
+ *	        - rows are fast programmed at aligned addresses into erased rows
+ *	          of a mass erased bank (a page erase in the bank ends it), and
+ *	          no other operation is allowed while a fast programming
+ *	          sequence is open
+ *	        - pages covered by a WRP or PCROP area cannot be modified
+ *
+ *	       A faulty cell can be injected: its bits stay set when programmed,
+ *	       although the operation succeeds.
+ *
+ *	       Every operation is charged with its typical duration of the
+ *	       datasheet, so the duration of an update can be predicted.
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "norflash.h"
+#include "bank.h"
+#include "bootloader.h"
+#include <string.h>
+#include <sys/mman.h>
+
+/* Private defines -----------------------------------------------------------*/
+/** Memory of the simulated flash */
+#define FLASH_MEMORY ((uint8_t*)(uintptr_t)FLASH_BASE)
+
+/* Private variables ---------------------------------------------------------*/
+static uint8_t Locked  = 1; /*!< Flash is locked */
+static uint8_t RowOpen = 0; /*!< Fast programming sequence is open */
+static BootloaderProtectionTypeDef Options; /*!< Protection option bytes */
+static uint8_t Active   = BANK_1; /*!< Bank mapped to the start of flash */
+static uint8_t BootBank = BANK_1; /*!< BFB2 option bit */
+static NorFlashStatsTypeDef Stats;
+static uint32_t FaultAddress = 0; /*!< Address of the faulty byte */
+static uint8_t FaultMask     = 0; /*!< Bits of the faulty byte stuck at 1 */
+static uint8_t UnlockFault   = 0; /*!< The unlock sequence is rejected */
+static uint8_t MassErased[2] = {
+    0, 0}; /*!< Bank mass erased, no page erase since */
+
+/* Private function prototypes -----------------------------------------------*/
+static void Init(void);
+static uint8_t Unlock(void);
+static void Lock(void);
+static uint8_t Erase(uint8_t bank, uint32_t page, uint32_t count);
+static uint8_t EraseBank(uint8_t bank);
+static uint8_t Program(uint32_t address, uint64_t data);
+static uint8_t ProgramRow(uint32_t address, const uint64_t* data, uint8_t last);
+static void CloseRow(void);
+static void ReadProtection(BootloaderProtectionTypeDef* protection);
+static uint8_t SetProtection(uint32_t protection);
+static uint8_t GetActiveBank(void);
+static uint8_t GetBootBank(void);
+static uint8_t SetBootBank(uint8_t bank);
+static uint32_t GetTick(void);
+
+/* Public variables ----------------------------------------------------------*/
+const BootloaderFlashOpsTypeDef NorFlash_Ops = {
+    Init,          Unlock,      Lock,        Erase,          EraseBank,
+    Program,       ProgramRow,  CloseRow,    ReadProtection, SetProtection,
+    GetActiveBank, GetBootBank, SetBootBank, GetTick};
+
+/* Private functions ---------------------------------------------------------*/
+static void Writable(int writable)
+{
+    mprotect(FLASH_MEMORY, FLASH_SIZE,
+             writable ? (PROT_READ | PROT_WRITE) : PROT_READ);
+}
+
+static uint8_t Overlaps(const BootloaderRangeTypeDef* range,
+                        uint32_t address,
+                        uint32_t length)
+{
+    return (address < range->end) && (range->start < (address + length));
+}
+
+static uint8_t Modifiable(uint32_t address, uint32_t length)
+{
+    if(Locked || RowOpen || (address < FLASH_BASE) ||
+       ((address - FLASH_BASE) > (FLASH_SIZE - length)))
+    {
+        return 0;
+    }
+
+    return !(Overlaps(&Options.wrp[0][0], address, length) ||
+             Overlaps(&Options.wrp[0][1], address, length) ||
+             Overlaps(&Options.wrp[1][0], address, length) ||
+             Overlaps(&Options.wrp[1][1], address, length) ||
+             Overlaps(&Options.pcrop[0], address, length) ||
+             Overlaps(&Options.pcrop[1], address, length));
+}
+
+static uint8_t BankOf(uint32_t address)
+{
+    if(address < (FLASH_BASE + FLASH_BANK_OFFSET))
+    {
+        return Active;
+    }
+    return (Active == BANK_1) ? BANK_2 : BANK_1;
+}
+
+static uint8_t Erased(uint32_t address, uint32_t length)
+{
+    uint32_t i;
+
+    for(i = 0; i < length; i++)
+    {
+        if(FLASH_MEMORY[address - FLASH_BASE + i] != 0xFF)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void Fault(uint32_t address, uint32_t length)
+{
+    if((FaultAddress >= address) && (FaultAddress < (address + length)))
+    {
+        FLASH_MEMORY[FaultAddress - FLASH_BASE] |= FaultMask;
+    }
+}
+
+static uint8_t Reject(uint8_t status)
+{
+    Stats.errors++;
+    return status;
+}
+
+static void Init(void)
+{
+    Locked  = 1;
+    RowOpen = 0;
+}
+
+static uint8_t Unlock(void)
+{
+    if(UnlockFault)
+    {
+        Stats.errors++;
+        return BL_WRITE_ERROR;
+    }
+    Locked = 0;
+    return BL_OK;
+}
+
+static void Lock(void)
+{
+    Locked = 1;
+}
+
+static uint8_t Erase(uint8_t bank, uint32_t page, uint32_t count)
+{
+    uint32_t address = FLASH_BASE + (page * FLASH_PAGE_SIZE) +
+                       ((bank == Active) ? 0 : FLASH_BANK_OFFSET);
+
+    if(((page + count) > FLASH_PAGE_NBPERBANK) ||
+       !Modifiable(address, count * FLASH_PAGE_SIZE))
+    {
+        return Reject(BL_ERASE_ERROR);
+    }
+
+    Writable(1);
+    memset(&FLASH_MEMORY[address - FLASH_BASE], 0xFF, count * FLASH_PAGE_SIZE);
+    Writable(0);
+
+    MassErased[bank - BANK_1] = 0;
+    Stats.erased += count;
+    Stats.time += (uint64_t)count * NORFLASH_ERASE_TIME;
+    return BL_OK;
+}
+
+static uint8_t EraseBank(uint8_t bank)
+{
+    uint32_t address = FLASH_BASE + ((bank == Active) ? 0 : FLASH_BANK_OFFSET);
+
+    if(!Modifiable(address, FLASH_BANK_OFFSET))
+    {
+        return Reject(BL_ERASE_ERROR);
+    }
+
+    Writable(1);
+    memset(&FLASH_MEMORY[address - FLASH_BASE], 0xFF, FLASH_BANK_OFFSET);
+    Writable(0);
+
+    MassErased[bank - BANK_1] = 1;
+    Stats.erased += FLASH_PAGE_NBPERBANK;
+    Stats.time += NORFLASH_MASS_ERASE_TIME;
+    return BL_OK;
+}
+
+static uint8_t Program(uint32_t address, uint64_t data)
+{
+    uint64_t* dword = (uint64_t*)&FLASH_MEMORY[address - FLASH_BASE];
+
+    if((address % 8) || !Modifiable(address, 8))
+    {
+        return Reject(BL_WRITE_ERROR);
+    }
+    if((*dword != 0xFFFFFFFFFFFFFFFF) && (data != 0))
+    {
+        /* Programmed bits cannot be set without erase */
+        return Reject(BL_WRITE_ERROR);
+    }
+
+    Writable(1);
+    *dword &= data;
+    Fault(address, 8);
+    Writable(0);
+
+    Stats.programmed++;
+    Stats.time += NORFLASH_PROGRAM_TIME;
+    return BL_OK;
+}
+
+static uint8_t ProgramRow(uint32_t address, const uint64_t* data, uint8_t last)
+{
+    RowOpen = 0;
+    if((address % FLASH_ROW_SIZE) || !Modifiable(address, FLASH_ROW_SIZE) ||
+       !MassErased[BankOf(address) - BANK_1] ||
+       !Erased(address, FLASH_ROW_SIZE))
+    {
+        return Reject(BL_WRITE_ERROR);
+    }
+
+    Writable(1);
+    memcpy(&FLASH_MEMORY[address - FLASH_BASE], data, FLASH_ROW_SIZE);
+    Fault(address, FLASH_ROW_SIZE);
+    Writable(0);
+
+    RowOpen = !last;
+    Stats.rows++;
+    Stats.time += NORFLASH_ROW_TIME;
+    return BL_OK;
+}
+
+static void CloseRow(void)
+{
+    RowOpen = 0;
+}
+
+static void ReadProtection(BootloaderProtectionTypeDef* protection)
+{
+    *protection = Options;
+    Stats.reads++;
+}
+
+static uint8_t SetProtection(uint32_t protection)
+{
+    if(Locked)
+    {
+        return Reject(BL_OBP_ERROR);
+    }
+
+    /* Area A of both banks covers the application space, like the HAL
+     * backend configures it */
+    memset(&Options.wrp, 0, sizeof(Options.wrp));
+    if(protection & BL_PROTECTION_WRP)
+    {
+        Options.wrp[0][0].start = APP_ADDRESS;
+        Options.wrp[0][0].end   = FLASH_BASE + FLASH_BANK_OFFSET;
+        Options.wrp[1][0].start = FLASH_BASE + FLASH_BANK_OFFSET;
+        Options.wrp[1][0].end   = FLASH_BASE + FLASH_SIZE;
+    }
+    return BL_OK;
+}
+
+static uint8_t GetActiveBank(void)
+{
+    return Active;
+}
+
+static uint8_t GetBootBank(void)
+{
+    return BootBank;
+}
+
+static uint8_t SetBootBank(uint8_t bank)
+{
+    if(Locked)
+    {
+        return Reject(BL_OBP_ERROR);
+    }
+    BootBank = bank;
+    return BL_OK;
+}
+
+static uint32_t GetTick(void)
+{
+    return (uint32_t)(Stats.time / 1000000);
+}
+
+/* Public functions ----------------------------------------------------------*/
+/**
+ * @brief  This function maps the simulated flash to ::FLASH_BASE and erases
+ *         it.
+ * @return 0 upon success, -1 if the flash cannot be mapped
+ */
+int NorFlash_Init(void)
+{
+    void* memory = mmap(FLASH_MEMORY, FLASH_SIZE, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if(memory != FLASH_MEMORY)
+    {
+        return -1;
+    }
+    memset(memory, 0xFF, FLASH_SIZE);
+    Writable(0);
+    memset(&Stats, 0, sizeof(Stats));
+    return 0;
+}
+
+/**
+ * @brief  This function writes the flash content directly, without the rules
+ *         and the durations of the flash operations (e.g. to preload an
+ *         installed image).
+ * @param  address: flash address
+ * @param  data: pointer to the data
+ * @param  length: number of bytes
+ */
+void NorFlash_Load(uint32_t address, const uint8_t* data, uint32_t length)
+{
+    Writable(1);
+    memcpy(&FLASH_MEMORY[address - FLASH_BASE], data, length);
+    Writable(0);
+}
+
+/**
+ * @brief  This function programs the protection option bytes directly. Like
+ *         on the device, the bootloader takes it into account after a reset
+ *         (Bootloader_Init).
+ * @param  protection: WRP and PCROP ranges and RDP level
+ */
+void NorFlash_SetProtection(const BootloaderProtectionTypeDef* protection)
+{
+    Options = *protection;
+}
+
+/**
+ * @brief  This function injects a faulty cell: the given bits of the byte
+ *         stay set when the byte is programmed.
+ * @param  address: flash address of the faulty byte
+ * @param  mask: bits stuck at 1
+ */
+void NorFlash_InjectFault(uint32_t address, uint8_t mask)
+{
+    FaultAddress = address;
+    FaultMask    = mask;
+}
+
+/**
+ * @brief  This function makes the unlock sequence fail, like a flash
+ *         controller locked until the next reset after a wrong key.
+ */
+void NorFlash_InjectUnlockFault(void)
+{
+    UnlockFault = 1;
+}
+
+/**
+ * @brief  This function returns the statistics of the flash operations.
+ * @param  stats: pointer to the structure to be filled
+ */
+void NorFlash_GetStats(NorFlashStatsTypeDef* stats)
+{
+    *stats = Stats;
+}
@@ -0,0 +1,52 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader NOR Flash Simulator Header
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   norflash.h
+ * @brief  This file contains the definitions and function prototypes of the
+ *	       NOR flash simulator, a flash backend of host builds.
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+#ifndef __NORFLASH_H
+#define __NORFLASH_H
+
+/* Includes ------------------------------------------------------------------*/
+#include "flashops.h"
+#include <stdint.h>
+
+/* Defines -------------------------------------------------------------------*/
+/* Typical durations of the flash operations of the STM32L496 datasheet in
+ * nanoseconds */
+#define NORFLASH_ERASE_TIME      (22020000) /*!< tERASE: page (2 KB) erase */
+#define NORFLASH_MASS_ERASE_TIME (22130000) /*!< tME: bank mass erase */
+#define NORFLASH_PROGRAM_TIME    (81700)    /*!< tPROG: double word */
+#define NORFLASH_ROW_TIME        (1910000)  /*!< tPROG_ROW: row, fast mode */
+
+/* Typedefs ------------------------------------------------------------------*/
+/** Statistics of the simulated flash operations */
+typedef struct
+{
+    uint32_t erased;     /*!< Number of erased pages (a bank counts all) */
+    uint32_t programmed; /*!< Number of double words programmed one by one */
+    uint32_t rows;       /*!< Number of rows programmed with fast programming */
+    uint32_t errors;     /*!< Number of rejected operations */
+    uint32_t reads;      /*!< Number of option byte (protection) reads */
+    uint64_t time;       /*!< Duration of the operations in nanoseconds */
+} NorFlashStatsTypeDef;
+
+/* Variables -----------------------------------------------------------------*/
+extern const BootloaderFlashOpsTypeDef NorFlash_Ops;
+
+/* Functions -----------------------------------------------------------------*/
+int NorFlash_Init(void);
+void NorFlash_Load(uint32_t address, const uint8_t* data, uint32_t length);
+void NorFlash_SetProtection(const BootloaderProtectionTypeDef* protection);
+void NorFlash_InjectFault(uint32_t address, uint8_t mask);
+void NorFlash_InjectUnlockFault(void);
+void NorFlash_GetStats(NorFlashStatsTypeDef* stats);
+
+#endif /* __NORFLASH_H */
@@ -0,0 +1,93 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader Delta Patch Host Simulation
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   patch_sim.c
+ * @brief  Host program which applies a delta patch with the decoder of the
+ *	       bootloader. The patch is fed in chunks of the given size, the new
+ *	       image is written to a file instead of flash.
+ *
+ *	       Usage: patch_sim <base> <patch> <output> <chunk size>
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "bootloader.h"
+#include "patch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Private variables ---------------------------------------------------------*/
+static FILE* base;
+static FILE* output;
+
+/* Private functions ---------------------------------------------------------*/
+static uint8_t ReadBase(uint32_t offset, uint8_t* data, uint32_t length)
+{
+    if((fseek(base, (long)offset, SEEK_SET) != 0) ||
+       (fread(data, 1, length, base) != length))
+    {
+        return BL_PATCH_ERROR;
+    }
+    return BL_OK;
+}
+
+static uint8_t Write(const uint8_t* data, uint32_t length)
+{
+    return (fwrite(data, 1, length, output) == length) ? BL_OK : BL_WRITE_ERROR;
+}
+
+int main(int argc, char** argv)
+{
+    static BootloaderPatchTypeDef patch;
+    static uint8_t buffer[4096];
+    FILE* input;
+    size_t chunk;
+    size_t num;
+    uint8_t status = BL_OK;
+
+    if(argc != 5)
+    {
+        fprintf(stderr, "Usage: %s <base> <patch> <output> <chunk>\n", argv[0]);
+        return 2;
+    }
+    chunk = (size_t)strtoul(argv[4], NULL, 0);
+    if((chunk == 0) || (chunk > sizeof(buffer)))
+    {
+        chunk = sizeof(buffer);
+    }
+
+    base   = fopen(argv[1], "rb");
+    input  = fopen(argv[2], "rb");
+    output = fopen(argv[3], "wb");
+    if(!base || !input || !output)
+    {
+        fprintf(stderr, "Cannot open files\n");
+        return 2;
+    }
+
+    Bootloader_PatchInit(&patch, ReadBase, Write);
+    while((status == BL_OK) && ((num = fread(buffer, 1, chunk, input)) > 0))
+    {
+        status = Bootloader_PatchWrite(&patch, buffer, (uint32_t)num);
+    }
+    if(status == BL_OK)
+    {
+        status = Bootloader_PatchEnd(&patch);
+    }
+
+    fclose(base);
+    fclose(input);
+    fclose(output);
+
+    if(status != BL_OK)
+    {
+        fprintf(stderr, "Patch error: %u\n", status);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,297 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader Raw File Stream Host Simulation
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   rawstream_sim.c
+ * @brief  Host program which reads files of a FAT volume in memory with
+ *	       f_read() and with the raw stream (rawstream.c), as the bootloader
+ *	       reads the application image. The disk counts the transfers
+ *	       (disk_read calls), the sectors and the transfers into the sector
+ *	       window of the file system (FAT and directory lookups, partial
+ *	       sectors).
+ *
+ *	       The byte i of a file holds ((i / 512) * 31 + i) & 0xFF.
+ *
+ *	       Operations:
+ *	        - mkfs:<n>:<c>         format a volume of n sectors with
+ *	                               clusters of c bytes and mount it
+ *	        - write:<name>:<b>     write a file of b bytes
+ *	        - fragment:<name>:<b>  write a file of b bytes whose clusters
+ *	                               alternate with the ones of a deleted file
+ *	        - read:<name>:<r>      read a file with f_read() by r bytes
+ *	        - raw:<name>:<r>[:<o>] read a file with the raw stream by r bytes
+ *	                               from offset o (default: 0), or with
+ *	                               f_read() if it cannot be streamed
+ *
+ *	       A read prints the path, the number of transfers, of sectors, of
+ *	       transfers into the sector window, and whether the data is right.
+ *
+ *	       Usage: rawstream_sim <operation> [operation ...]
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "diskio.h"
+#include "ff.h"
+#include "rawstream.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Defines -------------------------------------------------------------------*/
+#define SECTOR_SIZE 512
+#define MAX_SECTORS 131072
+#define BUFFER_SIZE 32768
+
+/* Private variables ---------------------------------------------------------*/
+static uint8_t* disk      = NULL;
+static DWORD disk_sectors = 0;
+static FATFS fs;
+static uint8_t buffer[BUFFER_SIZE] __attribute__((aligned(4)));
+
+static uint32_t transfers = 0;
+static uint32_t sectors   = 0;
+static uint32_t window    = 0;
+
+/* Disk interface of FatFs ---------------------------------------------------*/
+DSTATUS disk_status(BYTE pdrv)
+{
+    return (pdrv == 0 && disk) ? 0 : STA_NOINIT;
+}
+
+DSTATUS disk_initialize(BYTE pdrv)
+{
+    return disk_status(pdrv);
+}
+
+DRESULT disk_read(BYTE pdrv, BYTE* buff, DWORD sector, UINT count)
+{
+    if(pdrv != 0 || (sector + count) > disk_sectors)
+    {
+        return RES_PARERR;
+    }
+    transfers++;
+    sectors += count;
+    if(buff == fs.win)
+    {
+        window++;
+    }
+    memcpy(buff, disk + (sector * SECTOR_SIZE), count * SECTOR_SIZE);
+    return RES_OK;
+}
+
+DRESULT disk_write(BYTE pdrv, const BYTE* buff, DWORD sector, UINT count)
+{
+    if(pdrv != 0 || (sector + count) > disk_sectors)
+    {
+        return RES_PARERR;
+    }
+    memcpy(disk + (sector * SECTOR_SIZE), buff, count * SECTOR_SIZE);
+    return RES_OK;
+}
+
+DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void* buff)
+{
+    switch(cmd)
+    {
+        case CTRL_SYNC:
+            return RES_OK;
+        case GET_SECTOR_COUNT:
+            *(DWORD*)buff = disk_sectors;
+            return RES_OK;
+        case GET_BLOCK_SIZE:
+            *(DWORD*)buff = 1;
+            return RES_OK;
+        default:
+            return RES_PARERR;
+    }
+}
+
+/* Private functions ---------------------------------------------------------*/
+static uint8_t Pattern(FSIZE_t offset)
+{
+    return (uint8_t)(((offset / SECTOR_SIZE) * 31) + offset);
+}
+
+static uint8_t Mkfs(unsigned int count, unsigned int cluster)
+{
+    static uint8_t work[_MAX_SS];
+
+    if(count > MAX_SECTORS)
+    {
+        return 1;
+    }
+    free(disk);
+    disk         = calloc(count, SECTOR_SIZE);
+    disk_sectors = count;
+    if(disk == NULL ||
+       f_mkfs("", FM_ANY | FM_SFD, cluster, work, sizeof(work)) != FR_OK ||
+       f_mount(&fs, "", 1) != FR_OK)
+    {
+        return 1;
+    }
+    printf("mkfs FAT%d cluster %u\n",
+           (fs.fs_type == FS_FAT12)   ? 12
+           : (fs.fs_type == FS_FAT16) ? 16
+                                      : 32,
+           (unsigned)(fs.csize * SECTOR_SIZE));
+    return 0;
+}
+
+/* Writes the bytes [offset, offset + count) of a file */
+static uint8_t WriteData(FIL* file, FSIZE_t offset, UINT count)
+{
+    UINT bw;
+    UINT i;
+
+    for(i = 0; i < count; i++)
+    {
+        buffer[i] = Pattern(offset + i);
+    }
+    return (f_write(file, buffer, count, &bw) != FR_OK || bw != count);
+}
+
+static uint8_t Write(const char* name, unsigned int size, uint8_t fragment)
+{
+    FIL file;
+    FIL filler;
+    UINT cluster = fs.csize * SECTOR_SIZE;
+    FSIZE_t offset;
+    UINT count;
+    uint8_t error = 0;
+
+    if(f_open(&file, name, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK)
+    {
+        return 1;
+    }
+    if(fragment && f_open(&filler, "FILLER", FA_CREATE_ALWAYS | FA_WRITE))
+    {
+        f_close(&file);
+        return 1;
+    }
+
+    for(offset = 0; !error && offset < size; offset += count)
+    {
+        count = (size - offset) < cluster ? (UINT)(size - offset) : cluster;
+        count = count < BUFFER_SIZE ? count : BUFFER_SIZE;
+        error = WriteData(&file, offset, count);
+        if(fragment && !error)
+        {
+            /* The next cluster of the file follows a cluster of the filler */
+            error = WriteData(&filler, 0, count);
+        }
+    }
+
+    error |= (f_close(&file) != FR_OK);
+    if(fragment)
+    {
+        error |= (f_close(&filler) != FR_OK);
+        error |= (f_unlink("FILLER") != FR_OK);
+    }
+    return error;
+}
+
+/* Reads a file to its end and checks the data */
+static void Read(const char* name,
+                 unsigned int chunk,
+                 uint8_t raw,
+                 unsigned int start)
+{
+    static BootloaderRawStreamTypeDef stream;
+    FIL file;
+    FSIZE_t offset = start;
+    uint8_t streamed;
+    uint8_t ok = 1;
+    FRESULT fr;
+    UINT br;
+    UINT i;
+
+    if(f_open(&file, name, FA_READ) != FR_OK || f_lseek(&file, start))
+    {
+        printf("%s open error\n", raw ? "raw" : "read");
+        return;
+    }
+
+    transfers = 0;
+    sectors   = 0;
+    window    = 0;
+    streamed  = raw && (Bootloader_RawStreamOpen(&stream, &file) == 0);
+
+    do
+    {
+        fr = streamed ? Bootloader_RawStreamRead(&stream, buffer, chunk, &br)
+                      : f_read(&file, buffer, chunk, &br);
+        for(i = 0; i < br; i++)
+        {
+            ok &= (buffer[i] == Pattern(offset + i));
+        }
+        offset += br;
+    } while(fr == FR_OK && br == chunk);
+    ok &= (fr == FR_OK && offset == f_size(&file));
+    f_close(&file);
+
+    printf("%s transfers %u sectors %u window %u data %s\n",
+           streamed ? "raw" : "read", (unsigned)transfers, (unsigned)sectors,
+           (unsigned)window, ok ? "ok" : "bad");
+}
+
+int main(int argc, char** argv)
+{
+    char name[13];
+    unsigned int count;
+    unsigned int value;
+    unsigned int start;
+    uint8_t error = 0;
+    int i;
+
+    if(argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <operation> [operation ...]\n", argv[0]);
+        return 2;
+    }
+
+    for(i = 1; i < argc; i++)
+    {
+        start = 0;
+        if(sscanf(argv[i], "mkfs:%u:%u", &count, &value) == 2)
+        {
+            error = Mkfs(count, value);
+        }
+        else if(sscanf(argv[i], "write:%12[^:]:%u", name, &value) == 2)
+        {
+            error = Write(name, value, 0);
+        }
+        else if(sscanf(argv[i], "fragment:%12[^:]:%u", name, &value) == 2)
+        {
+            error = Write(name, value, 1);
+        }
+        else if(sscanf(argv[i], "read:%12[^:]:%u", name, &value) == 2 &&
+                value > 0 && value <= BUFFER_SIZE)
+        {
+            Read(name, value, 0, 0);
+        }
+        else if(sscanf(argv[i], "raw:%12[^:]:%u:%u", name, &value, &start) >=
+                    2 &&
+                value > 0 && value <= BUFFER_SIZE)
+        {
+            Read(name, value, 1, start);
+        }
+        else
+        {
+            fprintf(stderr, "Invalid operation: %s\n", argv[i]);
+            return 2;
+        }
+
+        if(error)
+        {
+            fprintf(stderr, "Operation failed: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    free(disk);
+    return 0;
+}
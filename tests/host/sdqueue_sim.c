@@ -0,0 +1,330 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader SD Request Queue Host Simulation
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   sdqueue_sim.c
+ * @brief  Host program which serves the SD request queue (sdqueue.c) with a
+ *	       mock of the BSP driver: a transfer takes a number of sleeps of
+ *	       the waiting CPU (idle, one millisecond each), at the end of which
+ *	       the completion "interrupt" copies the data from or to the card
+ *	       and calls Bootloader_SdComplete(). The sector n of the card holds
+ *	       the byte (n & 0xFF), until it is written.
+ *
+ *	       Every transfer, completion, abort and callback is printed.
+ *
+ *	       Operations (requests use slots 0..3 of 16 sectors):
+ *	        - read:<s>:<n>     read n sectors from sector s and wait
+ *	        - write:<s>:<n>    write n sectors of 0xA5 from sector s and wait
+ *	        - submit:<q>:<s>:<n> submit a read of slot q without waiting
+ *	        - append:<q>:<s>:<n> submit a read of slot q into the buffer
+ *	                           following the buffer of the last submission
+ *	        - wait:<q>         wait for the request of slot q
+ *	        - flush            wait for every submitted request
+ *	        - irq              deliver the completion interrupt now
+ *	        - spurious         report a completion with no transfer running
+ *	        - latency:<t>      transfers take t sleeps (default: 1)
+ *	        - busy:<p>         the card programs a write for p ready() polls
+ *	        - error            the next transfer completes with an error
+ *	        - reject           the next transfer cannot be started
+ *	        - hang             the next transfer never completes
+ *	        - stats            prints the number of sleeps, of polls and of
+ *	                           transfers
+ *
+ *	       Usage: sdqueue_sim <operation> [operation ...]
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sdqueue.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Defines -------------------------------------------------------------------*/
+#define SECTOR_SIZE  512
+#define CARD_SECTORS 256
+#define SLOTS        4
+#define SLOT_SECTORS 16
+
+/* Private variables ---------------------------------------------------------*/
+static uint8_t card[CARD_SECTORS][SECTOR_SIZE];
+static uint8_t memory[SLOTS * SLOT_SECTORS * SECTOR_SIZE];
+static BootloaderSdRequestTypeDef requests[SLOTS];
+static uint8_t* last_end = memory;
+
+/* Running transfer */
+static uint8_t* xfer_buffer;
+static uint32_t xfer_sector;
+static uint32_t xfer_count;
+static uint8_t xfer_write;
+static uint8_t xfer_running;
+static uint32_t xfer_left;
+
+/* Behaviour of the card */
+static uint32_t latency     = 1;
+static uint32_t program     = 0;
+static uint32_t programming = 0;
+static uint8_t fail_next    = 0;
+static uint8_t reject_next  = 0;
+static uint8_t hang_next    = 0;
+static uint8_t hanging      = 0;
+
+static uint32_t tick      = 0;
+static uint32_t sleeps    = 0;
+static uint32_t polls     = 0;
+static uint32_t transfers = 0;
+
+static const char* const states[] = {"idle", "queued", "busy", "done", "error"};
+
+/* Private functions ---------------------------------------------------------*/
+static uint8_t Start(uint8_t* buffer,
+                     uint32_t sector,
+                     uint32_t count,
+                     uint8_t write)
+{
+    printf("start %s %u %u\n", write ? "write" : "read", (unsigned)sector,
+           (unsigned)count);
+    if(reject_next || ((sector + count) > CARD_SECTORS))
+    {
+        reject_next = 0;
+        printf("rejected\n");
+        return 1;
+    }
+
+    transfers++;
+    xfer_buffer  = buffer;
+    xfer_sector  = sector;
+    xfer_count   = count;
+    xfer_write   = write;
+    xfer_running = 1;
+    xfer_left    = latency;
+    hanging      = hang_next;
+    hang_next    = 0;
+    return 0;
+}
+
+static uint8_t MockRead(uint8_t* buffer, uint32_t sector, uint32_t count)
+{
+    return Start(buffer, sector, count, 0);
+}
+
+static uint8_t MockWrite(const uint8_t* buffer, uint32_t sector, uint32_t count)
+{
+    return Start((uint8_t*)buffer, sector, count, 1);
+}
+
+static uint8_t MockReady(void)
+{
+    polls++;
+    if(programming)
+    {
+        programming--;
+        return 0;
+    }
+    return 1;
+}
+
+static void MockAbort(void)
+{
+    printf("abort\n");
+    xfer_running = 0;
+}
+
+/* Completion interrupt of the running transfer */
+static void Interrupt(void)
+{
+    uint8_t error = fail_next;
+
+    if(!xfer_running)
+    {
+        return;
+    }
+    xfer_running = 0;
+    fail_next    = 0;
+
+    if(!error)
+    {
+        if(xfer_write)
+        {
+            memcpy(card[xfer_sector], xfer_buffer, xfer_count * SECTOR_SIZE);
+            programming = program;
+        }
+        else
+        {
+            memcpy(xfer_buffer, card[xfer_sector], xfer_count * SECTOR_SIZE);
+        }
+    }
+    printf("complete %s\n", error ? "error" : "ok");
+    Bootloader_SdComplete(error);
+}
+
+/* WFI: the SysTick or the completion interrupt wakes up the CPU */
+static void MockIdle(void)
+{
+    sleeps++;
+    tick++;
+    if(xfer_running && !hanging && (xfer_left == 0 || --xfer_left == 0))
+    {
+        Interrupt();
+    }
+}
+
+static uint32_t MockGetTick(void)
+{
+    return tick;
+}
+
+static const BootloaderSdOpsTypeDef mock_ops = {
+    MockRead, MockWrite, MockReady, MockAbort, MockIdle, MockGetTick,
+};
+
+static void Callback(BootloaderSdRequestTypeDef* request)
+{
+    printf("callback %d %s\n", (int)(request - requests),
+           states[request->state]);
+}
+
+static uint8_t* Slot(unsigned int slot)
+{
+    return memory + (slot * SLOT_SECTORS * SECTOR_SIZE);
+}
+
+static void Submit(unsigned int slot,
+                   uint8_t* buffer,
+                   uint32_t sector,
+                   uint32_t count,
+                   uint8_t write)
+{
+    BootloaderSdRequestTypeDef* request = &requests[slot];
+
+    request->buffer   = buffer;
+    request->sector   = sector;
+    request->count    = count;
+    request->write    = write;
+    request->callback = Callback;
+    memset(buffer, write ? 0xA5 : 0xEE, count * SECTOR_SIZE);
+    last_end = buffer + (count * SECTOR_SIZE);
+    Bootloader_SdSubmit(request);
+}
+
+/* Checks the data of a completed read against the card */
+static void Result(unsigned int slot, uint8_t status)
+{
+    BootloaderSdRequestTypeDef* request = &requests[slot];
+
+    if(status)
+    {
+        printf("result %u error\n", slot);
+    }
+    else if(!request->write && memcmp(request->buffer, card[request->sector],
+                                      request->count * SECTOR_SIZE) != 0)
+    {
+        printf("result %u bad data\n", slot);
+    }
+    else
+    {
+        printf("result %u ok\n", slot);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int slot;
+    unsigned int sector;
+    unsigned int count;
+    unsigned int value;
+    uint8_t status;
+    int i;
+
+    if(argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <operation> [operation ...]\n", argv[0]);
+        return 2;
+    }
+
+    for(i = 0; i < CARD_SECTORS; i++)
+    {
+        memset(card[i], i & 0xFF, SECTOR_SIZE);
+    }
+    Bootloader_SdInit(&mock_ops);
+
+    for(i = 1; i < argc; i++)
+    {
+        if(sscanf(argv[i], "read:%u:%u", &sector, &count) == 2 &&
+           count <= SLOT_SECTORS)
+        {
+            Submit(0, Slot(0), sector, count, 0);
+            Result(0, Bootloader_SdWait(&requests[0]));
+        }
+        else if(sscanf(argv[i], "write:%u:%u", &sector, &count) == 2 &&
+                count <= SLOT_SECTORS)
+        {
+            Submit(0, Slot(0), sector, count, 1);
+            Result(0, Bootloader_SdWait(&requests[0]));
+        }
+        else if(sscanf(argv[i], "submit:%u:%u:%u", &slot, &sector, &count) ==
+                    3 &&
+                slot < SLOTS && count <= SLOT_SECTORS)
+        {
+            Submit(slot, Slot(slot), sector, count, 0);
+        }
+        else if(sscanf(argv[i], "append:%u:%u:%u", &slot, &sector, &count) ==
+                    3 &&
+                slot < SLOTS &&
+                (last_end + (count * SECTOR_SIZE)) <= (memory + sizeof(memory)))
+        {
+            Submit(slot, last_end, sector, count, 0);
+        }
+        else if(sscanf(argv[i], "wait:%u", &slot) == 1 && slot < SLOTS)
+        {
+            Result(slot, Bootloader_SdWait(&requests[slot]));
+        }
+        else if(strcmp(argv[i], "flush") == 0)
+        {
+            status = Bootloader_SdFlush();
+            printf("flush %s\n", status ? "error" : "ok");
+        }
+        else if(strcmp(argv[i], "irq") == 0)
+        {
+            Interrupt();
+        }
+        else if(strcmp(argv[i], "spurious") == 0)
+        {
+            Bootloader_SdComplete(0);
+        }
+        else if(sscanf(argv[i], "latency:%u", &value) == 1)
+        {
+            latency = value;
+        }
+        else if(sscanf(argv[i], "busy:%u", &value) == 1)
+        {
+            program = value;
+        }
+        else if(strcmp(argv[i], "error") == 0)
+        {
+            fail_next = 1;
+        }
+        else if(strcmp(argv[i], "reject") == 0)
+        {
+            reject_next = 1;
+        }
+        else if(strcmp(argv[i], "hang") == 0)
+        {
+            hang_next = 1;
+        }
+        else if(strcmp(argv[i], "stats") == 0)
+        {
+            printf("sleeps %u polls %u transfers %u\n", (unsigned)sleeps,
+                   (unsigned)polls, (unsigned)transfers);
+        }
+        else
+        {
+            fprintf(stderr, "Invalid operation: %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    return 0;
+}
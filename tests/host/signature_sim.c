@@ -0,0 +1,167 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader Signature Verification Host Simulation
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   signature_sim.c
+ * @brief  Host program which verifies the signature of an image like the
+ *	       bootloader does: the image is hashed in chunks of the given size
+ *	       (as it is passed to the flash programming), then the signature of
+ *	       the digest is verified. The digest and the result ("ok" or "fail")
+ *	       are printed in separate lines. If the number of iterations is
+ *	       given, the hashing and the verification are repeated and their
+ *	       cost is reported in CPU cycles (time stamp counter on x86 hosts,
+ *	       nanoseconds otherwise).
+ *
+ *	       Usage: signature_sim <image> <signature> <key> <chunk>
+ *	                            [iterations]
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "bootloader.h"
+#include "sha512.h"
+#include "signature.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#define CYCLES_UNIT "cycles"
+#else
+#define CYCLES_UNIT "ns"
+#endif
+
+/* Private functions ---------------------------------------------------------*/
+static uint64_t Cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    uint32_t lo;
+    uint32_t hi;
+
+    /* Time stamp counter (x86intrin.h conflicts with the CMSIS headers) */
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static uint8_t* ReadFile(const char* path, long* length)
+{
+    FILE* file = fopen(path, "rb");
+    uint8_t* data;
+
+    if(!file || fseek(file, 0, SEEK_END) || ((*length = ftell(file)) < 0))
+    {
+        return NULL;
+    }
+    rewind(file);
+    data = malloc((size_t)*length + 1);
+    if(!data || (fread(data, 1, (size_t)*length, file) != (size_t)*length))
+    {
+        return NULL;
+    }
+    fclose(file);
+    return data;
+}
+
+static void Hash(const uint8_t* data,
+                 size_t length,
+                 size_t chunk,
+                 uint8_t* digest)
+{
+    BootloaderSha512TypeDef sha;
+    size_t pos;
+    size_t size;
+
+    Bootloader_Sha512Init(&sha);
+    for(pos = 0; pos < length; pos += size)
+    {
+        size = ((length - pos) < chunk) ? (length - pos) : chunk;
+        Bootloader_Sha512Update(&sha, &data[pos], (uint32_t)size);
+    }
+    Bootloader_Sha512Final(&sha, digest);
+}
+
+int main(int argc, char** argv)
+{
+    uint8_t digest[SHA512_DIGEST_LENGTH];
+    uint8_t* image;
+    uint8_t* signature;
+    uint8_t* key;
+    long length;
+    long signatureLength;
+    long keyLength;
+    size_t chunk;
+    unsigned long iterations = 0;
+    unsigned long i;
+    uint8_t status;
+    uint64_t start;
+    double hashCycles;
+    double verifyCycles;
+
+    if((argc != 5) && (argc != 6))
+    {
+        fprintf(stderr,
+                "Usage: %s <image> <signature> <key> <chunk> [iterations]\n",
+                argv[0]);
+        return 2;
+    }
+    chunk = (size_t)strtoul(argv[4], NULL, 0);
+    chunk = (chunk == 0) ? 1 : chunk;
+    if(argc == 6)
+    {
+        iterations = strtoul(argv[5], NULL, 0);
+    }
+
+    image     = ReadFile(argv[1], &length);
+    signature = ReadFile(argv[2], &signatureLength);
+    key       = ReadFile(argv[3], &keyLength);
+    if(!image || !signature || !key || (signatureLength != SIGNATURE_LENGTH) ||
+       (keyLength != SIGNATURE_KEY_LENGTH))
+    {
+        fprintf(stderr, "Cannot read input\n");
+        return 2;
+    }
+
+    Hash(image, (size_t)length, chunk, digest);
+    status = Bootloader_SignatureVerify(digest, signature, key);
+    for(i = 0; i < SHA512_DIGEST_LENGTH; i++)
+    {
+        printf("%02x", digest[i]);
+    }
+    printf("\n%s\n", (status == BL_OK) ? "ok" : "fail");
+
+    if(iterations > 0)
+    {
+        start = Cycles();
+        for(i = 0; i < iterations; i++)
+        {
+            Hash(image, (size_t)length, chunk, digest);
+        }
+        hashCycles = (double)(Cycles() - start) / iterations;
+
+        start = Cycles();
+        for(i = 0; i < iterations; i++)
+        {
+            Bootloader_SignatureVerify(digest, signature, key);
+        }
+        verifyCycles = (double)(Cycles() - start) / iterations;
+
+        printf("Image:  %ld bytes\n", length);
+        printf("Hash:   %.2f " CYCLES_UNIT "/byte\n",
+               (length > 0) ? (hashCycles / length) : 0.0);
+        printf("Verify: %.0f " CYCLES_UNIT "\n", verifyCycles);
+    }
+
+    free(image);
+    free(signature);
+    free(key);
+    return 0;
+}
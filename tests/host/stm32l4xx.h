@@ -0,0 +1,96 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader Host Device Header
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   stm32l4xx.h
+ * @brief  Device header of the host programs. It includes the CMSIS device
+ *	       header and provides what the HAL driver provides on the target:
+ *	       the flash geometry, and the system functions of the jumps, which
+ *	       operate on host variables instead of the core peripherals.
+ *
+ *	       A jump of the bootloader (__set_MSP) ends the host program in
+ *	       Host_Jump(), which is defined by the host programs that launch
+ *	       the application.
+ *
+ *	       As the header is included right after the configuration block of
+ *	       bootloader.h, it also lets the host programs be built with other
+ *	       options: -DSIM_<option>=<value> overrides the option.
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+#ifndef __HOST_STM32L4XX_H
+#define __HOST_STM32L4XX_H
+
+/* Includes ------------------------------------------------------------------*/
+#include_next "stm32l4xx.h"
+
+/* Configuration -------------------------------------------------------------*/
+#if defined(SIM_USE_CHECKSUM)
+#undef USE_CHECKSUM
+#define USE_CHECKSUM SIM_USE_CHECKSUM
+#endif
+#if defined(SIM_USE_VERIFY_CACHE)
+#undef USE_VERIFY_CACHE
+#define USE_VERIFY_CACHE SIM_USE_VERIFY_CACHE
+#endif
+#if defined(SIM_USE_LAZY_ERASE)
+#undef USE_LAZY_ERASE
+#define USE_LAZY_ERASE SIM_USE_LAZY_ERASE
+#endif
+#if defined(SIM_USE_DIFF_UPDATE)
+#undef USE_DIFF_UPDATE
+#define USE_DIFF_UPDATE SIM_USE_DIFF_UPDATE
+#endif
+#if defined(SIM_USE_IMAGE_HEADER)
+#undef USE_IMAGE_HEADER
+#define USE_IMAGE_HEADER SIM_USE_IMAGE_HEADER
+#endif
+#if defined(SIM_USE_SIGNATURE)
+#undef USE_SIGNATURE
+#define USE_SIGNATURE SIM_USE_SIGNATURE
+#endif
+#if defined(SIM_USE_DUAL_BANK)
+#undef USE_DUAL_BANK
+#define USE_DUAL_BANK SIM_USE_DUAL_BANK
+#if(SIM_USE_DUAL_BANK)
+/* The application space ends with the first bank */
+#undef END_ADDRESS
+#undef CRC_ADDRESS
+#define END_ADDRESS (uint32_t)0x0807FFFB
+#define CRC_ADDRESS (uint32_t)0x0807FFFC
+#endif
+#endif
+
+/* Defines -------------------------------------------------------------------*/
+/* Flash geometry (HAL flash driver) */
+#define FLASH_PAGE_SIZE ((uint32_t)0x800)
+#define FLASH_SIZE      (2 * FLASH_BANK_OFFSET)
+
+/* Reset and clock control (HAL driver) */
+#define HAL_RCC_DeInit()                       ((void)0)
+#define HAL_DeInit()                           ((void)0)
+#define __HAL_RCC_CRC_FORCE_RESET()            ((void)0)
+#define __HAL_RCC_CRC_RELEASE_RESET()          ((void)0)
+#define __HAL_RCC_SYSCFG_CLK_ENABLE()          ((void)0)
+#define __HAL_SYSCFG_REMAPMEMORY_SYSTEMFLASH() ((void)0)
+
+/* Core peripherals */
+#undef SysTick
+#undef SCB
+#define SysTick (&Host_SysTick)
+#define SCB     (&Host_Scb)
+
+/* Stack pointer of the jumps */
+#define __set_MSP(stack) Host_Jump(stack)
+
+/* Variables -----------------------------------------------------------------*/
+__attribute__((unused)) static SysTick_Type Host_SysTick;
+__attribute__((unused)) static SCB_Type Host_Scb;
+
+/* Function prototypes -------------------------------------------------------*/
+void Host_Jump(uint32_t stack);
+
+#endif /* __HOST_STM32L4XX_H */
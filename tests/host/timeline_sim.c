@@ -0,0 +1,85 @@
+/**
+ *******************************************************************************
+ * STM32 Bootloader Boot Timeline Host Simulation
+ *******************************************************************************
+ * @author Akos Pasztor
+ * @file   timeline_sim.c
+ * @brief  Host program which records boot timelines with timeline.c. The
+ *	       cycle counter and the CPU clock are given by the operations, the
+ *	       timeline is kept between the operations, like in the RAM of a
+ *	       device which is not initialized at startup.
+ *
+ *	       Operations:
+ *	        - start:<c>:<m>   reset: start the timeline at cycle <c> with a
+ *	                          CPU clock of <m> MHz
+ *	        - mark:<p>:<c>:<m> record the end of phase <p> at cycle <c> with
+ *	                          a CPU clock of <m> MHz
+ *	        - request         the application requests a dump
+ *	        - requested       prints 1 if a dump is requested, otherwise 0
+ *	        - dump            prints the timeline
+ *
+ *	       Usage: timeline_sim <operation> [operation ...]
+ *******************************************************************************
+ * @copyright (c) 2020 Akos Pasztor.                    https://akospasztor.com
+ *******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "timeline.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Private functions ---------------------------------------------------------*/
+static void Print(const char* str)
+{
+    fputs(str, stdout);
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int phase;
+    unsigned long cycles;
+    unsigned int mhz;
+    int i;
+
+    if(argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <operation> [operation ...]\n", argv[0]);
+        return 2;
+    }
+
+    for(i = 1; i < argc; i++)
+    {
+        if(sscanf(argv[i], "start:%lu:%u", &cycles, &mhz) == 2)
+        {
+            Bootloader_TimelineCycles = (uint32_t)cycles;
+            Bootloader_TimelineMhz    = (uint8_t)mhz;
+            Bootloader_TimelineStart();
+        }
+        else if(sscanf(argv[i], "mark:%u:%lu:%u", &phase, &cycles, &mhz) == 3)
+        {
+            Bootloader_TimelineCycles = (uint32_t)cycles;
+            Bootloader_TimelineMhz    = (uint8_t)mhz;
+            Bootloader_TimelineMark((uint8_t)phase);
+        }
+        else if(!strcmp(argv[i], "request"))
+        {
+            Bootloader_TimelineRequestDump();
+        }
+        else if(!strcmp(argv[i], "requested"))
+        {
+            printf("%u\n", Bootloader_TimelineDumpRequested());
+        }
+        else if(!strcmp(argv[i], "dump"))
+        {
+            Bootloader_TimelineDump(Print);
+        }
+        else
+        {
+            fprintf(stderr, "Invalid operation: %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,125 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+import pytest
+
+from tests.conftest import run_sim
+
+# Number of pages per bank (FLASH_PAGE_NBPERBANK)
+PAGES = 256
+
+# Unconfirmed boots before rollback (ROLLBACK_MAX_ATTEMPTS)
+ATTEMPTS = 3
+
+SIM_SOURCES = ["tests/host/bank_sim.c", "lib/stm32-bootloader/bank.c",
+               "lib/stm32-bootloader/rollback.c"]
+
+
+@pytest.mark.parametrize("page, active, expected", [
+    (0, 1, "1:0"), (PAGES - 1, 1, "1:255"), (PAGES, 1, "2:0"),
+    (2 * PAGES - 1, 1, "2:255"), (0, 2, "2:0"), (16, 2, "2:16"),
+    (PAGES + 44, 2, "1:44"),
+])
+def test_bank_addressing(host_sim, page, active, expected):
+    # Pages of the memory map are translated to physical banks
+    assert run_sim(host_sim, "page:{}:{}".format(page, active)) == [expected]
+
+
+def test_update_alternates_banks(host_sim):
+    assert run_sim(host_sim, "boot", "update", "activate", "boot", "update",
+                   "activate", "boot") == \
+        ["app:1", "app:2", "app:2", "app:1", "app:1"]
+
+
+def test_invalid_update_is_not_activated(host_sim):
+    # An interrupted or corrupted update keeps the running image
+    assert run_sim(host_sim, "update-bad", "activate", "boot") == \
+        ["refused", "app:1"]
+    assert run_sim(host_sim, "update", "activate", "update-bad", "activate",
+                   "boot") == ["app:2", "refused", "app:2"]
+
+
+def test_update_without_activation(host_sim):
+    assert run_sim(host_sim, "update", "boot", "boot") == ["app:1", "app:1"]
+
+
+def test_fallback_to_other_bank(host_sim):
+    # The other bank is booted if the active application is invalid
+    assert run_sim(host_sim, "update", "activate", "corrupt", "boot",
+                   "boot") == ["app:2", "app:1", "app:1"]
+    assert run_sim(host_sim, "update", "corrupt", "boot") == ["app:2"]
+
+
+def test_no_valid_application(host_sim):
+    assert run_sim(host_sim, "corrupt", "boot") == ["none"]
+    assert run_sim(host_sim, "update-bad", "corrupt", "boot") == ["none"]
+
+
+def test_rollback_confirmed_update(host_sim):
+    boots = ["boot"] * (ATTEMPTS + 2)
+    assert run_sim(host_sim, "rollback", "update", "activate", "state",
+                   "confirm", "state", *boots) == \
+        ["app:2", "trial:1", "confirmed"] + ["app:2"] * len(boots)
+
+
+def test_rollback_unconfirmed_update(host_sim):
+    # The update is booted ATTEMPTS times, then the previous image is
+    # restored without intervention
+    boots = ["boot"] * (ATTEMPTS + 1)
+    assert run_sim(host_sim, "rollback", "update", "activate", *boots,
+                   "state") == \
+        ["app:2"] * ATTEMPTS + ["app:1", "app:1", "confirmed"]
+
+
+def test_rollback_counts_boots(host_sim):
+    assert run_sim(host_sim, "rollback", "update", "activate", "boot",
+                   "state", "confirm", "boot", "boot", "boot", "state") == \
+        ["app:2", "app:2", "trial:2", "app:2", "app:2", "app:2", "confirmed"]
+
+
+def test_rollback_next_update(host_sim):
+    # A new trial is started by every activation
+    boots = ["boot"] * ATTEMPTS
+    assert run_sim(host_sim, "rollback", "update", "activate", *boots,
+                   "update", "activate", "confirm", *boots) == \
+        ["app:2"] * ATTEMPTS + ["app:1"] + ["app:2"] * (ATTEMPTS + 1)
+
+
+def test_rollback_refused_update(host_sim):
+    # The running image stays confirmed if the activation fails
+    assert run_sim(host_sim, "rollback", "update-bad", "activate", "state",
+                   *["boot"] * (ATTEMPTS + 1)) == \
+        ["refused", "confirmed"] + ["app:1"] * (ATTEMPTS + 1)
+
+
+def test_rollback_invalid_update(host_sim):
+    # The previous image is restored at once if the update is corrupted
+    assert run_sim(host_sim, "rollback", "update", "activate", "corrupt",
+                   "boot", "state", "boot") == \
+        ["app:2", "app:1", "confirmed", "app:1"]
+
+
+def test_rollback_without_previous_image(host_sim):
+    # The unconfirmed image is not launched anymore
+    boots = ["boot"] * (ATTEMPTS + 1)
+    assert run_sim(host_sim, "rollback", "update", "activate",
+                   "update-bad", *boots) == \
+        ["app:2"] * ATTEMPTS + ["none", "none"]
+
+
+def test_rollback_power_loss(host_sim):
+    # The trial is lost with the backup domain: the update is kept
+    assert run_sim(host_sim, "rollback", "update", "activate", "clear",
+                   "state", *["boot"] * (ATTEMPTS + 1)) == \
+        ["app:2", "confirmed"] + ["app:2"] * (ATTEMPTS + 1)
+
+
+def test_rollback_switch_failure(host_sim):
+    # A revert which cannot switch the bank does not confirm the failed
+    # image: the revert is retried by the next boot, and the previous image
+    # is confirmed once it is booted
+    boots = ["boot"] * (ATTEMPTS - 1)
+    assert run_sim(host_sim, "rollback", "update", "activate", *boots,
+                   "switch-fault", "boot", "state", "boot", "state",
+                   "boot") == \
+        ["app:2"] * ATTEMPTS + ["none", "reverting:1", "app:1", "confirmed",
+                                "app:1"]
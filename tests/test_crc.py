@@ -0,0 +1,73 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+import os
+
+import pytest
+
+from python.common import stm32_crc32
+from tests.conftest import run_sim
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+IMAGE = os.path.join(ROOT, "projects", "STM32L496-Discovery", "app-demo.bin")
+
+SIM_SOURCES = ["tests/host/crc_sim.c", "lib/stm32-bootloader/crc.c"]
+
+# Checksums calculated by the CRC peripheral of the STM32
+KNOWN_VALUES = [
+    (b"\x00\x00\x00\x00", 0xC704DD7B),
+    (b"\x78\x56\x34\x12", 0xDF8A8A2B),
+]
+
+
+def crc32_reference(data):
+    # Bit by bit implementation of the convention documented in the README
+    data = bytes(data) + b"\xff" * (-len(data) % 4)
+    crc = 0xFFFFFFFF
+    for i in range(0, len(data), 4):
+        crc ^= int.from_bytes(data[i:i + 4], "little")
+        for _ in range(32):
+            crc = (crc << 1) ^ 0x04C11DB7 if crc & 0x80000000 else crc << 1
+            crc &= 0xFFFFFFFF
+    return crc
+
+
+def checksum(executable, tmp_path, data, chunk, offset):
+    file = str(tmp_path / "data.bin")
+    with open(file, "wb") as f:
+        f.write(data)
+    return int(run_sim(executable, file, chunk, offset)[0], 16)
+
+
+@pytest.mark.parametrize("data, crc", KNOWN_VALUES)
+def test_crc32_known_values(data, crc):
+    assert stm32_crc32(data) == crc
+    assert crc32_reference(data) == crc
+
+
+def test_crc32_reference():
+    for data in (b"", b"\x12", b"123456789", bytes(range(256))):
+        assert stm32_crc32(data) == crc32_reference(data)
+
+
+@pytest.mark.parametrize("data, crc", KNOWN_VALUES)
+def test_crc_sim_known_values(host_sim, tmp_path, data, crc):
+    assert checksum(host_sim, tmp_path, data, 4, 0) == crc
+
+
+@pytest.mark.parametrize("chunk, offset", [(1, 0), (3, 1), (7, 2),
+                                           (256, 3), (4096, 0)])
+def test_crc_sim_streaming(host_sim, tmp_path, chunk, offset):
+    with open(IMAGE, "rb") as f:
+        image = f.read()
+    for length in (len(image), len(image) - 1, len(image) - 2, 5):
+        data = image[:length]
+        assert checksum(host_sim, tmp_path, data, chunk, offset) == \
+            stm32_crc32(data)
+
+
+def test_crc_residue():
+    # Checksum appended to the data as a little-endian word yields zero
+    with open(IMAGE, "rb") as f:
+        image = f.read()
+    image += b"\xff" * (-len(image) % 4)
+    assert stm32_crc32(image + stm32_crc32(image).to_bytes(4, "little")) == 0
@@ -0,0 +1,62 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+import os
+
+import pytest
+
+from python.pack_image import compress, decompress
+from tests.conftest import run_sim
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+IMAGE = os.path.join(ROOT, "projects", "STM32L496-Discovery", "app-demo.bin")
+
+SIM_SOURCES = ["tests/host/decompress_sim.c",
+               "lib/stm32-bootloader/decompress.c"]
+
+
+@pytest.fixture
+def image():
+    with open(IMAGE, "rb") as f:
+        # Flash images usually contain long runs of erased bytes as well
+        return f.read() + b"\xff" * 1000
+
+
+def unpack(executable, tmp_path, packed, chunk=512):
+    packed_file = str(tmp_path / "image.hs")
+    output_file = str(tmp_path / "image.bin")
+    with open(packed_file, "wb") as f:
+        f.write(packed)
+    if run_sim(executable, packed_file, output_file, chunk,
+               check=False) is None:
+        return None
+    with open(output_file, "rb") as f:
+        return f.read()
+
+
+@pytest.mark.parametrize("window_bits, count_bits", [(8, 4), (10, 5)])
+def test_compress_roundtrip(image, window_bits, count_bits):
+    packed = compress(image, window_bits, count_bits)
+    assert len(packed) < len(image)
+    assert decompress(packed) == image
+
+
+def test_decompress_corrupted(image):
+    packed = compress(image)
+    with pytest.raises(ValueError):
+        decompress(packed[:-1])
+    with pytest.raises(ValueError):
+        decompress(packed + b"\x00")
+
+
+@pytest.mark.parametrize("chunk", [1, 3, 512, 65536])
+def test_decompress_sim(image, host_sim, tmp_path, chunk):
+    packed = compress(image)
+    assert unpack(host_sim, tmp_path, packed, chunk) == image
+
+
+def test_decompress_sim_invalid(image, host_sim, tmp_path):
+    # Truncated stream, trailing data and too large window are rejected
+    packed = compress(image)
+    assert unpack(host_sim, tmp_path, packed[:-1]) is None
+    assert unpack(host_sim, tmp_path, packed + b"\x00") is None
+    assert unpack(host_sim, tmp_path, compress(image, 11, 4)) is None
@@ -0,0 +1,31 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+from tests.conftest import run_sim
+
+SIM_SOURCES = ["tests/host/fastboot_sim.c", "lib/stm32-bootloader/fastboot.c"]
+
+
+def test_launch_without_trigger(host_sim):
+    assert run_sim(host_sim, "boot", "boot") == ["launch", "launch"]
+
+
+def test_button_triggers_update(host_sim):
+    assert run_sim(host_sim, "boot-button", "boot") == \
+        ["update", "launch"]
+
+
+def test_request_is_consumed(host_sim):
+    # The request enters the update directly, and a failed update does not
+    # trap the device in the bootloader
+    assert run_sim(host_sim, "request", "boot", "boot") == \
+        ["request", "launch"]
+
+
+def test_request_with_button(host_sim):
+    # The button still selects the action of the bootloader
+    assert run_sim(host_sim, "request", "boot-button", "boot") == \
+        ["update", "launch"]
+
+
+def test_request_lost_on_power_loss(host_sim):
+    assert run_sim(host_sim, "request", "clear", "boot") == ["launch"]
@@ -0,0 +1,467 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+import os
+
+import pytest
+
+from python.common import stm32_crc32
+from tests.conftest import run_sim
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+IMAGE = os.path.join(ROOT, "projects", "STM32L496-Discovery", "app-demo.bin")
+
+# Flash geometry (FLASH_PAGE_SIZE, FLASH_ROW_SIZE) and application space
+PAGE_SIZE = 2048
+ROW_SIZE = 256
+APP_ADDRESS = 0x08008000
+APP_PAGES = (0x100000 - 0x8000) // PAGE_SIZE
+APP_SPACE = APP_PAGES * PAGE_SIZE
+
+# Pages of a bank (FLASH_PAGE_NBPERBANK): the second bank is mass erased
+# (FLASH_MASS_ERASE_PAGE), the application space in front of it is page erased
+BANK_PAGES = 256
+PAGE_ERASED = APP_PAGES - BANK_PAGES
+
+# Update space of the dual bank build (UPDATE_ADDRESS)
+UPDATE_ADDRESS = APP_ADDRESS + 0x80000
+
+# Offset of the double word holding the checksum (CRC_ADDRESS)
+CRC_OFFSET = APP_SPACE - 8
+SECTOR_SIZE = 512
+
+# Typical durations of the flash operations in nanoseconds (norflash.h)
+ERASE_TIME = 22020000
+MASS_ERASE_TIME = 22130000
+PROGRAM_TIME = 81700
+ROW_TIME = 1910000
+
+# Bootloader error codes (eBootloaderErrorCodes)
+BL_SIZE_ERROR = 2
+BL_ERASE_ERROR = 4
+BL_WRITE_ERROR = 5
+BL_VERIFY_ERROR = 11
+
+# Protection status (eBootloaderProtectionStatus)
+BL_PROTECTION_WRP = 0x1
+BL_PROTECTION_RDP = 0x2
+BL_PROTECTION_PCROP = 0x4
+
+SIM_SOURCES = ["tests/host/flash_sim.c", "tests/host/norflash.c"] + [
+    "lib/stm32-bootloader/{}.c".format(name) for name in (
+        "bootloader", "bank", "crc", "image", "imagecache", "rollback",
+        "sha512", "signature")]
+
+# Flash addresses are 32-bit integers, as on the device
+SIM_FLAGS = ["-Wno-int-to-pointer-cast"]
+
+# Host program of the default options
+SINGLE_BANK = (SIM_SOURCES, SIM_FLAGS)
+
+# Host program with the application checksum (USE_CHECKSUM)
+CHECKSUM = (SIM_SOURCES, SIM_FLAGS + ["-DSIM_USE_CHECKSUM=1"])
+
+# Host program erasing the pages during programming (USE_LAZY_ERASE)
+LAZY_ERASE = (SIM_SOURCES, SIM_FLAGS + ["-DSIM_USE_LAZY_ERASE=1"])
+
+# Host program skipping the unchanged pages (USE_DIFF_UPDATE)
+DIFF_UPDATE = (SIM_SOURCES, SIM_FLAGS + ["-DSIM_USE_DIFF_UPDATE=1"])
+
+# Host program updating the inactive bank (USE_DUAL_BANK)
+DUAL_BANK = (SIM_SOURCES, SIM_FLAGS + ["-DSIM_USE_DUAL_BANK=1",
+                                       "-DSIM_USE_CHECKSUM=1"])
+
+# Host program of the dual bank build erasing the pages during programming
+DUAL_BANK_LAZY_ERASE = (SIM_SOURCES, DUAL_BANK[1] +
+                        ["-DSIM_USE_LAZY_ERASE=1"])
+
+
+@pytest.fixture(scope="module")
+def image():
+    with open(IMAGE, "rb") as f:
+        return f.read()
+
+
+def stats(line):
+    erased, programmed, rows, errors, time = map(int, line.split())
+    return erased, programmed, rows, errors, time
+
+
+def expected_time(erased, programmed, rows, mass_erased=0):
+    return (erased * ERASE_TIME + mass_erased * MASS_ERASE_TIME +
+            programmed * PROGRAM_TIME + rows * ROW_TIME) // 1000
+
+
+@pytest.mark.parametrize("chunk", [1, 7, 256, 512, 4096])
+def test_update(host_sim, image, chunk):
+    # The image fits into the first bank, which is page erased: fast
+    # programming is not accepted there, every double word is programmed one
+    # by one
+    output = run_sim(host_sim, IMAGE, "erase", "write:{}".format(chunk),
+                     "verify", "stats")
+    assert output[:3] == ["ok", "ok", "match"]
+    programmed = (len(image) + 7) // 8
+    assert stats(output[3]) == (APP_PAGES, programmed, 0, 0,
+                                expected_time(PAGE_ERASED, programmed, 0, 1))
+
+
+@pytest.mark.parametrize("host_sim", [DUAL_BANK], indirect=True)
+@pytest.mark.parametrize("chunk", [1, 7, 256, 512, 4096])
+@pytest.mark.parametrize("operation", ["erase", "erase-image"])
+def test_update_dual_bank(host_sim, image, chunk, operation):
+    # The inactive bank is mass erased: full rows are fast programmed, the
+    # rest double word by double word
+    output = run_sim(host_sim, IMAGE, operation, "write:{}".format(chunk),
+                     "verify", "stats")
+    assert output[:3] == ["ok", "ok", "match"]
+    rows = len(image) // ROW_SIZE
+    programmed = (len(image) % ROW_SIZE + 7) // 8
+    assert stats(output[3]) == (BANK_PAGES, programmed, rows, 0,
+                                expected_time(0, programmed, rows, 1))
+
+
+def test_update_second_bank(host_sim, tmp_path):
+    # An image reaching the second bank is fast programmed from the start of
+    # the mass erased bank only
+    data = str(tmp_path / "image.bin")
+    size = PAGE_ERASED * PAGE_SIZE + 480 * ROW_SIZE
+    with open(data, "wb") as f:
+        f.write(bytes(i * 7 % 251 for i in range(size)))
+    output = run_sim(host_sim, data, "erase-image", "write:4096", "verify",
+                     "stats")
+    assert output[:3] == ["ok", "ok", "match"]
+    programmed = PAGE_ERASED * PAGE_SIZE // 8
+    assert stats(output[3]) == (APP_PAGES, programmed, 480, 0,
+                                expected_time(PAGE_ERASED, programmed, 480,
+                                              1))
+
+
+@pytest.mark.parametrize("host_sim", [DUAL_BANK_LAZY_ERASE], indirect=True)
+def test_page_erase_no_rows(host_sim, image):
+    # Pages erased one by one are not mass erased: no row is fast programmed
+    # into them
+    pages = (len(image) + PAGE_SIZE - 1) // PAGE_SIZE
+    output = run_sim(host_sim, IMAGE, "write:4096", "verify", "stats")
+    assert output[:2] == ["ok", "match"]
+    assert stats(output[2])[:4] == (pages, (len(image) + 7) // 8, 0, 0)
+
+
+def test_update_double_words(host_sim, image):
+    output = run_sim(host_sim, IMAGE, "erase-image", "next", "verify",
+                     "stats")
+    assert output[:3] == ["ok", "ok", "match"]
+    pages = (len(image) + PAGE_SIZE - 1) // PAGE_SIZE
+    programmed = (len(image) + 7) // 8
+    assert stats(output[3]) == (pages, programmed, 0, 0,
+                                expected_time(pages, programmed, 0))
+
+
+def test_launch(host_sim, image):
+    # The jump loads the initial stack pointer of the vector table
+    stack = int.from_bytes(image[:4], "little")
+    assert run_sim(host_sim, IMAGE, "erase", "write:512", "launch") == \
+        ["ok", "ok", "jump:{:08x}".format(stack)]
+
+
+@pytest.mark.parametrize("host_sim", [DUAL_BANK], indirect=True)
+@pytest.mark.parametrize("length", [None, -1, -3, 256, 7])
+@pytest.mark.parametrize("chunk", [1, 7, 256, 4096])
+def test_rows_match_double_words(host_sim, image, tmp_path, length, chunk):
+    # Fast programming of rows leaves the flash bit-identical to programming
+    # the image double word by double word, including the padding of the
+    # last double word
+    data = str(tmp_path / "image.bin")
+    with open(data, "wb") as f:
+        f.write(image[:length])
+    rows = str(tmp_path / "rows.bin")
+    words = str(tmp_path / "words.bin")
+    assert run_sim(host_sim, data, "erase", "write:{}".format(chunk),
+                   "dump:" + rows) == ["ok", "ok"]
+    assert run_sim(host_sim, data, "erase", "next",
+                   "dump:" + words) == ["ok", "ok"]
+    with open(rows, "rb") as f, open(words, "rb") as g:
+        assert f.read() == g.read()
+
+
+def test_erase_range(host_sim, image):
+    # Only the pages covered by the image are erased, the rest of the
+    # application space is kept
+    pages = (len(image) + PAGE_SIZE - 1) // PAGE_SIZE
+    last = (pages - 1) * PAGE_SIZE
+    output = run_sim(host_sim, IMAGE, "erase",
+                     "program:{}:0".format(last),
+                     "program:{}:0".format(last + PAGE_SIZE),
+                     "program:{}:0".format(CRC_OFFSET), "erase-image",
+                     "read:{}".format(last),
+                     "read:{}".format(last + PAGE_SIZE),
+                     "read:{}".format(CRC_OFFSET), "stats")
+    assert output[:8] == ["ok"] * 5 + ["f" * 16, "0" * 16, "0" * 16]
+    assert stats(output[8])[0] == APP_PAGES + pages
+
+
+@pytest.mark.parametrize("host_sim", [CHECKSUM], indirect=True)
+def test_erase_range_checksum(host_sim, image):
+    # The page of the checksum at the end of the application space is erased
+    # as well
+    pages = (len(image) + PAGE_SIZE - 1) // PAGE_SIZE
+    output = run_sim(host_sim, IMAGE, "erase",
+                     "program:{}:0".format(CRC_OFFSET), "erase-image",
+                     "read:{}".format(CRC_OFFSET), "stats")
+    assert output[:4] == ["ok", "ok", "ok", "f" * 16]
+    assert stats(output[4])[0] == APP_PAGES + pages + 1
+
+
+@pytest.mark.parametrize("size, expected, pages", [
+    (0, "ok", 0),
+    (1, "ok", 1),
+    (PAGE_SIZE, "ok", 1),
+    (PAGE_SIZE + 1, "ok", 2),
+    (APP_SPACE, "ok", APP_PAGES),
+    (APP_SPACE + 1, "error:{}".format(BL_SIZE_ERROR), 0),
+])
+def test_erase_range_size(host_sim, size, expected, pages):
+    output = run_sim(host_sim, IMAGE, "erase-range:{}".format(size), "stats")
+    assert output[0] == expected
+    assert stats(output[1])[0] == pages
+
+
+@pytest.mark.parametrize("host_sim", [LAZY_ERASE], indirect=True)
+@pytest.mark.parametrize("operation", ["write:1", "write:512", "sd:4096",
+                                       "next"])
+def test_lazy_erase(host_sim, image, operation):
+    # The image is programmed over the previous one without erasing the
+    # application space first: only the pages of the image are erased, once
+    # each, and the flash beyond them is kept
+    pages = (len(image) + PAGE_SIZE - 1) // PAGE_SIZE
+    beyond = pages * PAGE_SIZE
+    output = run_sim(host_sim, IMAGE, "write:512",
+                     "program:{}:0".format(beyond), operation, "verify",
+                     "session", "read:{}".format(beyond), "stats")
+    assert output[:6] == ["ok", "ok", "ok", "match", "{} 0".format(pages),
+                          "0" * 16]
+    assert stats(output[6])[0] == 2 * pages
+
+
+@pytest.mark.parametrize("host_sim", [LAZY_ERASE], indirect=True)
+def test_lazy_erase_unlock_error(host_sim):
+    # Nothing is erased if the session cannot unlock the flash
+    output = run_sim(host_sim, IMAGE, "unlock-fault", "write:512", "stats")
+    assert output[:2] == ["ok", "error:{}".format(BL_WRITE_ERROR)]
+    assert stats(output[2])[:4] == (0, 0, 0, 1)
+
+
+@pytest.mark.parametrize("host_sim", [DIFF_UPDATE], indirect=True)
+@pytest.mark.parametrize("chunk", [1, 512, 4096])
+def test_diff_update_unchanged(host_sim, image, chunk):
+    # The installed image is not erased nor programmed again
+    pages = (len(image) + PAGE_SIZE - 1) // PAGE_SIZE
+    output = run_sim(host_sim, IMAGE, "write:512", "stats",
+                     "write:{}".format(chunk), "verify", "session", "stats")
+    assert output[0] == "ok"
+    assert output[2:5] == ["ok", "match", "0 {}".format(pages)]
+    assert stats(output[5])[:4] == stats(output[1])[:4]
+
+
+@pytest.mark.parametrize("host_sim", [DIFF_UPDATE], indirect=True)
+@pytest.mark.parametrize("page", [0, 1, -1])
+def test_diff_update_changed_page(host_sim, image, page):
+    # Only the page which differs from the image is erased and programmed
+    pages = (len(image) + PAGE_SIZE - 1) // PAGE_SIZE
+    offset = (page % pages) * PAGE_SIZE + 16
+    output = run_sim(host_sim, IMAGE, "write:512",
+                     "program:{}:0".format(offset), "stats", "write:512",
+                     "verify", "session", "stats")
+    assert output[0:2] == ["ok", "ok"]
+    assert output[3:6] == ["ok", "match", "1 {}".format(pages - 1)]
+    assert stats(output[6])[0] == stats(output[2])[0] + 1
+
+
+@pytest.mark.parametrize("host_sim", [DIFF_UPDATE], indirect=True)
+def test_diff_update_keeps_rest(host_sim, image):
+    # The flash beyond the new image is not modified
+    pages = (len(image) + PAGE_SIZE - 1) // PAGE_SIZE
+    beyond = pages * PAGE_SIZE
+    output = run_sim(host_sim, IMAGE, "program:{}:0".format(beyond),
+                     "write:512", "verify", "read:{}".format(beyond))
+    assert output == ["ok", "ok", "match", "0" * 16]
+
+
+def test_update_duration(host_sim):
+    # Regression of the predicted duration of an update of app-demo.bin: the
+    # pages of the image are erased one by one, so it is programmed double
+    # word by double word
+    output = run_sim(host_sim, IMAGE, "erase-image", "write:512", "stats")
+    assert stats(output[2])[4] == 126272
+
+
+@pytest.mark.parametrize("host_sim", [DUAL_BANK], indirect=True)
+def test_update_duration_dual_bank(host_sim):
+    # Regression of the predicted duration of an update of app-demo.bin into
+    # the mass erased inactive bank, fast programmed
+    output = run_sim(host_sim, IMAGE, "erase-image", "write:512", "stats")
+    assert stats(output[2])[4] == 66141
+
+
+def dual_bank_update(image, path):
+    # Application space of the dual bank build (APP_SIZE) holding the image,
+    # followed by its checksum (CRC_ADDRESS)
+    space = 0x0807FFFC - APP_ADDRESS
+    data = image + b"\xff" * (space - len(image))
+    with open(path, "wb") as f:
+        f.write(data + stm32_crc32(data).to_bytes(4, "little"))
+    return path
+
+
+@pytest.mark.parametrize("host_sim", [DUAL_BANK], indirect=True)
+def test_activate_copies_bootloader(host_sim, image, tmp_path):
+    # The bootloader is copied into the inactive bank (16 pages) before the
+    # bank is selected for boot
+    update = dual_bank_update(image, str(tmp_path / "update.bin"))
+    output = run_sim(host_sim, IMAGE, "restore:" + update, "bootloader",
+                     "activate", "stats")
+    assert output[0] == "ok"
+    assert stats(output[1])[0] == (APP_ADDRESS - 0x08000000) // PAGE_SIZE
+
+
+@pytest.mark.parametrize("host_sim", [DUAL_BANK], indirect=True)
+@pytest.mark.parametrize("operations, errors", [
+    (["unlock-fault"], 1),
+    (["wrp:08080000:08081000", "reset"], 0),
+])
+def test_activate_copy_error(host_sim, image, tmp_path, operations, errors):
+    # The copy of the bootloader is not erased if the flash cannot be
+    # unlocked or the copy is write protected
+    update = dual_bank_update(image, str(tmp_path / "update.bin"))
+    output = run_sim(host_sim, IMAGE, "restore:" + update, "bootloader",
+                     *operations, "activate", "stats")
+    assert output[-2] == "error:{}".format(BL_WRITE_ERROR)
+    assert stats(output[-1])[:4] == (0, 0, 0, errors)
+
+
+def test_single_pass(host_sim, image):
+    # The flash is verified while it is programmed: every sector of the SD
+    # card is read once, instead of once for programming and once for
+    # verification
+    output = run_sim(host_sim, IMAGE, "erase-image", "sd:4096", "verify",
+                     "sd-reads")
+    assert output[:3] == ["ok", "ok", "match"]
+    sectors = (len(image) + SECTOR_SIZE - 1) // SECTOR_SIZE
+    assert int(output[3]) == sectors
+
+
+@pytest.mark.parametrize("host_sim, address, offset, operation", [
+    (DUAL_BANK, UPDATE_ADDRESS, 0x1234, "sd:4096"),  # fast programmed row
+    (SINGLE_BANK, APP_ADDRESS, 0x1234, "sd:4096"),   # double word
+    (SINGLE_BANK, APP_ADDRESS, 0x1234, "next"),      # double word
+    (SINGLE_BANK, APP_ADDRESS, 0x0, "write:7"),      # first byte of image
+], indirect=["host_sim"])
+def test_verify_error(host_sim, address, offset, operation):
+    # A faulty cell is reported with the offset of the first mismatch
+    output = run_sim(host_sim, IMAGE, "erase-image",
+                     "fault:{:x}:01".format(address + offset), operation,
+                     "mismatch")
+    assert output == ["ok", "ok", "error:{}".format(BL_VERIFY_ERROR),
+                      str(offset)]
+
+
+@pytest.mark.parametrize("operation", ["erase", "erase-image"])
+def test_unlock_error(host_sim, operation):
+    # A flash which cannot be unlocked is reported as an erase error, and no
+    # erase is attempted (the only rejected operation is the unlock)
+    output = run_sim(host_sim, IMAGE, "unlock-fault", operation, "stats")
+    assert output[:2] == ["ok", "error:{}".format(BL_ERASE_ERROR)]
+    assert stats(output[2])[:4] == (0, 0, 0, 1)
+
+
+@pytest.mark.parametrize("operation", ["write:512", "sd:4096", "next"])
+def test_session_unlock_error(host_sim, operation):
+    # A programming session is not opened on a locked flash
+    output = run_sim(host_sim, IMAGE, "erase-image", "unlock-fault",
+                     operation, "stats")
+    assert output[:3] == ["ok", "ok", "error:{}".format(BL_WRITE_ERROR)]
+    assert stats(output[3])[1:4] == (0, 0, 1)
+
+
+def test_rewrite_requires_erase(host_sim):
+    # Programmed bits cannot be set again without erase
+    output = run_sim(host_sim, IMAGE, "erase", "write:512", "write:512",
+                     "erase-image", "write:512", "verify")
+    assert output == ["ok", "ok", "error:{}".format(BL_WRITE_ERROR), "ok",
+                      "ok", "match"]
+
+
+@pytest.mark.parametrize("operations, expected", [
+    (["program:0:0123456789abcdef"], ["ok"]),
+    (["program:0:0123456789abcdef", "program:0:0123456789abcdef"],
+     ["ok", "error:{}".format(BL_WRITE_ERROR)]),
+    (["program:0:0123456789abcdef", "program:0:0"], ["ok", "ok"]),
+    (["program:4:0123456789abcdef"], ["error:{}".format(BL_WRITE_ERROR)]),
+])
+def test_nor_semantics(host_sim, operations, expected):
+    assert run_sim(host_sim, IMAGE, *operations) == expected
+
+
+def test_write_protection(host_sim):
+    output = run_sim(host_sim, IMAGE, "protect", "erase", "stats")
+    assert output[:2] == ["ok", "error:{}".format(BL_ERASE_ERROR)]
+    assert stats(output[2])[0] == 0
+
+
+def test_protection_snapshot(host_sim):
+    # The option bytes are decoded once, and again only after a change
+    output = run_sim(host_sim, IMAGE, "status", "status", "status",
+                     "option-reads", "protect", "status", "option-reads")
+    assert output == ["0", "0", "0", "1", "ok", str(BL_PROTECTION_WRP), "2"]
+
+
+def test_protection_outside_sessions(host_sim):
+    # The option bytes are decoded by the reset and by the configuration of
+    # the protection, never by the erase or the programming
+    output = run_sim(host_sim, IMAGE, "erase", "write:512", "option-reads",
+                     "protect", "option-reads", "writable:08008000:8",
+                     "option-reads")
+    assert output == ["ok", "ok", "1", "ok", "2",
+                      "error:{}".format(BL_WRITE_ERROR), "2"]
+
+
+def test_protection_after_reset(host_sim):
+    # Option bytes programmed outside the bootloader apply after a reset
+    output = run_sim(host_sim, IMAGE, "wrp:08010000:08012000",
+                     "writable:08010000:8", "reset", "writable:08010000:8")
+    assert output == ["ok", "ok", "ok", "error:{}".format(BL_WRITE_ERROR)]
+
+
+def test_protection_before_init(host_sim):
+    # The snapshot is taken upon its first use if the bootloader is used
+    # before Bootloader_Init(), so the write protection is not missed
+    output = run_sim(host_sim, IMAGE, "no-init", "wrp:08008000:08010000",
+                     "status", "writable:08008000:8", "erase", "stats")
+    assert output[:4] == ["ok", str(BL_PROTECTION_WRP),
+                          "error:{}".format(BL_WRITE_ERROR),
+                          "error:{}".format(BL_ERASE_ERROR)]
+    assert stats(output[4])[0] == 0
+
+
+@pytest.mark.parametrize("address, length, writable", [
+    (0x0800fff8, 8, True),
+    (0x0800fff8, 16, False),
+    (0x08010800, 256, False),
+    (0x08011ff8, 8, False),
+    (0x08012000, 8, True),
+    (0x080ffff8, 8, True),
+    (0x080ffff8, 16, False),
+    (0x07fffff8, 8, False),
+])
+def test_range_writable(host_sim, address, length, writable):
+    output = run_sim(host_sim, IMAGE, "wrp:08010000:08012000", "reset",
+                     "writable:{:08x}:{}".format(address, length))
+    assert output[2] == ("ok" if writable else
+                         "error:{}".format(BL_WRITE_ERROR))
+
+
+def test_pcrop_and_rdp(host_sim):
+    # Application space partially covered by PCROP: nothing is erased
+    output = run_sim(host_sim, IMAGE, "pcrop:08009000:08009100", "rdp:1",
+                     "reset", "status", "erase-image", "stats")
+    assert output[3] == str(BL_PROTECTION_PCROP | BL_PROTECTION_RDP)
+    assert output[4] == "error:{}".format(BL_ERASE_ERROR)
+    assert stats(output[5])[0] == 0
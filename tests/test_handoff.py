@@ -0,0 +1,41 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+import pytest
+
+from tests.conftest import run_sim
+
+# SYSCLK frequencies of the simulated clock configurations [Hz]
+PLL = 80000000
+MSI = 4000000
+
+SIM_SOURCES = ["tests/host/handoff_sim.c", "lib/stm32-bootloader/handoff.c"]
+
+
+def test_no_handoff(host_sim):
+    # RAM content without a published block
+    assert run_sim(host_sim, "pll", "valid",
+                   "resume:{}".format(PLL)) == ["0", "0"]
+
+
+def test_resume(host_sim):
+    assert run_sim(host_sim, "pll", "publish", "valid",
+                   "resume:{}".format(PLL)) == ["1", "1"]
+
+
+def test_resume_other_frequency(host_sim):
+    # The application needs another clock: it configures its own
+    assert run_sim(host_sim, "msi", "publish", "valid",
+                   "resume:{}".format(PLL), "resume:{}".format(MSI)) == \
+        ["1", "0", "1"]
+
+
+def test_corrupted_block(host_sim):
+    assert run_sim(host_sim, "pll", "publish", "corrupt", "valid") == \
+        ["0"]
+
+
+@pytest.mark.parametrize("operations", [["reclock"], ["msi"]])
+def test_stale_block(host_sim, operations):
+    # The clock configuration has changed since the block was published
+    assert run_sim(host_sim, "pll", "publish", *operations + [
+        "valid", "resume:{}".format(PLL)]) == ["0", "0"]
@@ -0,0 +1,126 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+import os
+import struct
+
+import pytest
+
+from python.common import stm32_crc32
+from python.pack_image import (APP_ADDRESS, IMAGE_HEADER, IMAGE_HEADER_SIZE,
+                               IMAGE_MAGIC, IMAGE_VERSION, add_header,
+                               parse_header)
+from tests import test_flash
+from tests.conftest import run_sim
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+IMAGE = os.path.join(ROOT, "projects", "STM32L496-Discovery", "app-demo.bin")
+
+SIM_SOURCES = ["tests/host/image_sim.c", "lib/stm32-bootloader/image.c",
+               "lib/stm32-bootloader/crc.c"]
+
+# Flash host program verifying the application with header (USE_IMAGE_HEADER)
+FLASH_HEADER = (test_flash.SIM_SOURCES, test_flash.SIM_FLAGS + [
+    "-DSIM_USE_CHECKSUM=1", "-DSIM_USE_IMAGE_HEADER=1"])
+
+# Bootloader error code of a checksum error (BL_CHKS_ERROR)
+BL_CHKS_ERROR = 3
+
+
+@pytest.fixture
+def image():
+    with open(IMAGE, "rb") as f:
+        return f.read()
+
+
+def verify(executable, tmp_path, packed):
+    packed_file = str(tmp_path / "image.bin")
+    with open(packed_file, "wb") as f:
+        f.write(packed)
+    output = run_sim(executable, packed_file, check=False)
+    if output is None:
+        return None
+    length, crc, version = output[0].split()
+    return int(length), int(crc, 16), int(version, 16)
+
+
+def test_header_roundtrip(image):
+    packed = add_header(image, 0x00010203)
+    assert len(packed) == IMAGE_HEADER_SIZE + len(image)
+    assert packed[IMAGE_HEADER_SIZE:] == image
+    assert parse_header(packed) == {
+        "length": len(image), "load_address": APP_ADDRESS + IMAGE_HEADER_SIZE,
+        "crc": stm32_crc32(image), "app_version": 0x00010203}
+
+
+def test_header_invalid(image):
+    packed = add_header(image)
+    with pytest.raises(ValueError):
+        parse_header(packed[:-1])
+    with pytest.raises(ValueError):
+        parse_header(packed[:-1] + b"\x00")
+    with pytest.raises(ValueError):
+        parse_header(b"\x00" + packed[1:])
+    with pytest.raises(ValueError):
+        parse_header(add_header(image, app_address=APP_ADDRESS + 0x1000))
+
+
+@pytest.mark.parametrize("extra", [0, 1, 2, 3])
+def test_image_sim(image, host_sim, tmp_path, extra):
+    # Applications of any length are verified over their real length only
+    data = image + b"\x5a" * extra
+    assert verify(host_sim, tmp_path, add_header(data, 7)) == \
+        (len(data), stm32_crc32(data), 7)
+
+
+def test_image_sim_invalid(image, host_sim, tmp_path):
+    packed = add_header(image)
+    # Corrupted application, truncated or extended image
+    assert verify(host_sim, tmp_path, packed[:-1] + b"\x00") is None
+    assert verify(host_sim, tmp_path, packed[:-1]) is None
+    assert verify(host_sim, tmp_path, packed + b"\xff") is None
+    # Every header field is covered by the header checksum
+    for offset in range(0, 28, 4):
+        corrupted = bytearray(packed)
+        corrupted[offset] ^= 0x01
+        assert verify(host_sim, tmp_path, bytes(corrupted)) is None
+    # Image linked to a different address
+    assert verify(host_sim, tmp_path,
+                  add_header(image, app_address=0x08010000)) is None
+    # Raw image without header
+    assert verify(host_sim, tmp_path, image) is None
+
+
+def test_header_layout(image):
+    # Layout documented in image.h
+    packed = add_header(image, 0x11223344)
+    magic, version, size, length, load, crc, app_version, header_crc = \
+        struct.unpack_from("<IHHIIIII", packed)
+    assert (magic, version, size) == (0x48494C42, 1, IMAGE_HEADER_SIZE)
+    assert (length, load, crc) == (len(image), 0x08008200,
+                                   stm32_crc32(image))
+    assert app_version == 0x11223344
+    assert header_crc == stm32_crc32(packed[:24])
+    assert packed[28:IMAGE_HEADER_SIZE] == b"\xff" * (IMAGE_HEADER_SIZE - 28)
+
+
+def forge_header(length):
+    # Header with a valid header checksum and an arbitrary length
+    header = IMAGE_HEADER.pack(IMAGE_MAGIC, IMAGE_VERSION, IMAGE_HEADER_SIZE,
+                               length, APP_ADDRESS + IMAGE_HEADER_SIZE, 0, 0)
+    header += struct.pack("<I", stm32_crc32(header))
+    return header.ljust(IMAGE_HEADER_SIZE, b"\xff")
+
+
+@pytest.mark.parametrize("host_sim", [FLASH_HEADER], indirect=True)
+@pytest.mark.parametrize("length", [
+    0xFFFFFFF0,                                     # size wraps to 0x1F0
+    0x100000000 - IMAGE_HEADER_SIZE,                # size wraps to 0
+    test_flash.APP_SPACE - IMAGE_HEADER_SIZE + 1])  # one byte too long
+def test_forged_length(image, host_sim, tmp_path, length):
+    # A length beyond the application space is rejected by the parser,
+    # the checksum is not calculated beyond the flash
+    forged = str(tmp_path / "forged.bin")
+    with open(forged, "wb") as f:
+        f.write(forge_header(length) + image)
+    assert run_sim(host_sim, IMAGE, "restore:" + forged, "checksum") == \
+        ["error:{}".format(BL_CHKS_ERROR)]
@@ -0,0 +1,105 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+import os
+
+import pytest
+
+from python.common import stm32_crc32
+from tests import test_flash
+from tests.conftest import run_sim
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+IMAGE = os.path.join(ROOT, "projects", "STM32L496-Discovery", "app-demo.bin")
+
+SIZE = 0xF7FFC
+CRC = 0x12345678
+
+SIM_SOURCES = ["tests/host/imagecache_sim.c",
+               "lib/stm32-bootloader/imagecache.c",
+               "lib/stm32-bootloader/crc.c"]
+
+# Flash host program verifying the checksum with the cache (USE_CHECKSUM,
+# USE_VERIFY_CACHE)
+FLASH_SIM = (test_flash.SIM_SOURCES, test_flash.SIM_FLAGS + [
+    "-DSIM_USE_CHECKSUM=1", "-DSIM_USE_VERIFY_CACHE=1"])
+
+# Bootloader error codes (eBootloaderErrorCodes)
+BL_CHKS_ERROR = 3
+
+# Double word of the application modified behind the back of the bootloader
+CORRUPT = "flip:1024"
+
+
+@pytest.fixture(scope="module")
+def sealed_image(tmp_path_factory):
+    # Image filling the application space, with its checksum at CRC_ADDRESS
+    with open(IMAGE, "rb") as f:
+        image = f.read()
+    image += b"\xff" * (SIZE - len(image))
+    image += stm32_crc32(image).to_bytes(4, "little")
+    path = str(tmp_path_factory.mktemp("image") / "sealed.bin")
+    with open(path, "wb") as f:
+        f.write(image)
+    return path
+
+
+def check(size=SIZE, crc=CRC):
+    return "check:{}:{}".format(size, crc)
+
+
+def store(size=SIZE, crc=CRC):
+    return "store:{}:{}".format(size, crc)
+
+
+def test_cache_empty(host_sim):
+    # Backup registers are cleared on power loss
+    assert run_sim(host_sim, check()) == ["fail"]
+    assert run_sim(host_sim, store(), "clear", check()) == ["fail"]
+
+
+def test_cache_store(host_sim):
+    assert run_sim(host_sim, store(), check(), check()) == ["ok", "ok"]
+
+
+def test_cache_bound_to_image(host_sim):
+    assert run_sim(host_sim, store(), check(SIZE - 4),
+                   check(crc=CRC ^ 1)) == ["fail", "fail"]
+
+
+def test_cache_invalidate(host_sim):
+    # Every write invalidates the record until the image is verified again
+    assert run_sim(host_sim, store(), "invalidate", check(),
+                   "invalidate", check(), store(), check()) == \
+        ["fail", "fail", "ok"]
+
+
+@pytest.mark.parametrize("index", range(5))
+def test_cache_corrupted(host_sim, index):
+    # A modified register invalidates the record
+    assert run_sim(host_sim, "invalidate", store(),
+                   "poke:{}:{}".format(index, 0xDEADBEEF),
+                   check()) == ["fail"]
+
+
+@pytest.mark.parametrize("host_sim", [FLASH_SIM], indirect=True)
+def test_verified_image_is_cached(host_sim, sealed_image):
+    # The second verification uses the record: a modification which does
+    # not go through the bootloader is not noticed
+    assert run_sim(host_sim, sealed_image, "load", "checksum", CORRUPT,
+                   "checksum") == ["ok", "ok"]
+    assert run_sim(host_sim, sealed_image, "load", CORRUPT, "checksum",
+                   "checksum") == ["error:{}".format(BL_CHKS_ERROR)] * 2
+
+
+@pytest.mark.parametrize("host_sim", [FLASH_SIM], indirect=True)
+@pytest.mark.parametrize("operation", [
+    "erase", "erase-image", "erase-range:1", "write:4096", "next", "protect",
+])
+def test_write_paths_invalidate(host_sim, sealed_image, operation):
+    # Every erase, programming and protection path of the bootloader
+    # invalidates the record: the image is restored and modified behind the
+    # back of the bootloader, which notices it by calculating the checksum
+    output = run_sim(host_sim, sealed_image, "load", "checksum", operation,
+                     "load", CORRUPT, "checksum")
+    assert output[0] == "ok"
+    assert output[-1] == "error:{}".format(BL_CHKS_ERROR)
@@ -0,0 +1,72 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+import os
+
+import pytest
+
+from python.make_patch import apply_patch, create_patch
+from tests.conftest import run_sim
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+BASE_IMAGE = os.path.join(ROOT, "projects", "STM32L496-Discovery",
+                          "app-demo.bin")
+
+SIM_SOURCES = ["tests/host/patch_sim.c", "lib/stm32-bootloader/patch.c",
+               "lib/stm32-bootloader/crc.c"]
+
+
+@pytest.fixture
+def images():
+    with open(BASE_IMAGE, "rb") as f:
+        base = f.read()
+    target = bytearray(base)
+    target[100:100] = b"inserted bytes"
+    target[2000:2004] = b"\x01\x02\x03\x04"
+    del target[3000:3100]
+    target += b"appended"
+    return base, bytes(target)
+
+
+def test_patch_roundtrip(images):
+    base, target = images
+    patch = create_patch(base, target)
+    assert len(patch) < len(target) // 10
+    assert apply_patch(base, patch) == target
+
+
+def test_patch_corrupted(images):
+    base, target = images
+    patch = bytearray(create_patch(base, target))
+    patch[-1] ^= 0xFF
+    with pytest.raises(ValueError):
+        apply_patch(base, patch)
+    with pytest.raises(ValueError):
+        apply_patch(base[:-4], create_patch(base, target))
+
+
+@pytest.mark.parametrize("chunk", [1, 7, 512, 4096])
+def test_patch_sim(images, host_sim, tmp_path, chunk):
+    base, target = images
+    files = {name: str(tmp_path / name) for name in ("base", "patch", "out")}
+    with open(files["base"], "wb") as f:
+        f.write(base)
+    with open(files["patch"], "wb") as f:
+        f.write(create_patch(base, target))
+
+    run_sim(host_sim, files["base"], files["patch"], files["out"], chunk)
+    with open(files["out"], "rb") as f:
+        assert f.read() == target
+
+
+def test_patch_sim_corrupted(images, host_sim, tmp_path):
+    base, target = images
+    files = {name: str(tmp_path / name) for name in ("base", "patch", "out")}
+    patch = bytearray(create_patch(base, target))
+    patch[-1] ^= 0xFF
+    with open(files["base"], "wb") as f:
+        f.write(base)
+    with open(files["patch"], "wb") as f:
+        f.write(patch)
+
+    assert run_sim(host_sim, files["base"], files["patch"], files["out"],
+                   512, check=False) is None
@@ -0,0 +1,41 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+import pytest
+
+from python.bench_pipeline import (chunks, pipelined, program_time,
+                                   read_time, serial)
+
+
+def test_chunks():
+    assert chunks(10000, 4096) == [4096, 4096, 1808]
+    assert chunks(8192, 4096) == [4096, 4096]
+
+
+@pytest.mark.parametrize("read,program", [
+    (3.0, 30.0),    # programming is the bottleneck
+    (30.0, 3.0),    # SD card is the bottleneck
+    (10.0, 10.0),
+])
+def test_overlap(read, program):
+    # Only the first read and the last programming are not overlapped
+    count = 16
+    reads = [read] * count
+    programs = [program] * count
+    assert serial(reads, programs) == count * (read + program)
+    assert pipelined(reads, programs) == pytest.approx(
+        read + (count - 1) * max(read, program) + program)
+
+
+def test_single_chunk():
+    # Nothing to overlap
+    assert pipelined([5.0], [7.0]) == serial([5.0], [7.0])
+
+
+def test_rates():
+    # The pipeline approaches the slower of the SD card and the flash
+    sizes = chunks(1024 * 1024, 4096)
+    reads = [read_time(n, 500.0, 1024.0) for n in sizes]
+    programs = [program_time(n, 1024.0) for n in sizes]
+    assert pipelined(reads, programs) < serial(reads, programs)
+    assert pipelined(reads, programs) == pytest.approx(
+        max(sum(reads), sum(programs)), rel=0.01)
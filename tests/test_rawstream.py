@@ -0,0 +1,61 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+from python.bench_rawstream import SIM_FLAGS, SIM_SOURCES, parse_read
+from tests.conftest import run_sim
+
+# Volume of 8 MB with clusters of a single sector
+VOLUME = "mkfs:16384:512"
+
+
+def measure(executable, *operations):
+    """Return the path, the data transfers (without the transfers into the
+    sector window), the sectors and the window transfers of the reads."""
+    reads = [parse_read(line) for line in run_sim(executable, *operations)
+             if not line.startswith("mkfs")]
+    return [(path, transfers - window, sectors - window, window)
+            for path, transfers, sectors, window in reads]
+
+
+def test_contiguous_file_is_streamed(host_sim):
+    reads = measure(host_sim, VOLUME, "write:APP.BIN:100000",
+                    "read:APP.BIN:4096", "raw:APP.BIN:4096")
+    read, raw = reads
+    assert raw[0] == "raw"
+    # A transfer per chunk instead of per cluster, the same sectors and FAT
+    # lookups
+    assert read[1:] == ((100000 + 511) // 512, (100000 + 511) // 512, 1)
+    assert raw[1:] == ((100000 + 4095) // 4096, read[2], read[3])
+
+
+def test_fragmented_file_is_read_with_f_read(host_sim):
+    reads = measure(host_sim, VOLUME, "fragment:APP.BIN:20000",
+                    "read:APP.BIN:4096", "raw:APP.BIN:4096")
+    assert [read[0] for read in reads] == ["read", "read"]
+
+
+def test_large_clusters(host_sim):
+    # f_read() reads whole clusters straight into the buffer, the raw
+    # stream reads whole chunks of the cluster
+    reads = measure(host_sim, "mkfs:16384:32768",
+                    "write:APP.BIN:65536", "read:APP.BIN:8192",
+                    "raw:APP.BIN:8192", "raw:APP.BIN:32768")
+    assert [read[:3] for read in reads] == [
+        ("read", 8, 128), ("raw", 8, 128), ("raw", 2, 128)]
+
+
+def test_file_end(host_sim):
+    # The last partial sector is read whole, only the file bytes are
+    # returned
+    reads = measure(host_sim, VOLUME, "write:APP.BIN:1000",
+                    "raw:APP.BIN:4096", "write:EMPTY.BIN:0",
+                    "raw:EMPTY.BIN:4096")
+    assert reads[0][:3] == ("raw", 1, 2)
+    assert reads[1][:3] == ("read", 0, 0)
+
+
+def test_offset(host_sim):
+    # The stream starts at the file position if it is at a sector boundary
+    reads = measure(host_sim, VOLUME, "write:APP.BIN:8192",
+                    "raw:APP.BIN:4096:1024", "raw:APP.BIN:4096:1000")
+    assert reads[0][:3] == ("raw", 2, 14)
+    assert reads[1][0] == "read"
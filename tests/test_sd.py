@@ -0,0 +1,79 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+import pytest
+
+from python.bench_sd import (MAX_COUNT, SECTOR_SIZE, Card, clock_steps,
+                             coalesce, init_time, read_time, throughput,
+                             transfer_time)
+
+
+def test_coalesce():
+    assert coalesce([8] * 4) == [32]
+    assert coalesce([8] * 40) == [MAX_COUNT, MAX_COUNT, 64]
+    assert coalesce([100, 100]) == [100, 100]
+    assert coalesce([]) == []
+
+
+def test_single_sector():
+    # A single sector is read with CMD17 whatever the sequence
+    card = Card()
+    assert transfer_time(card, 1, "cmd12") == transfer_time(card, 1, "cmd23")
+    assert transfer_time(card, 1, "single") == transfer_time(card, 1, "cmd23")
+
+
+def test_cmd23_saves_the_stop():
+    card = Card()
+    for count in (2, 8, MAX_COUNT):
+        assert transfer_time(card, count, "cmd12") - transfer_time(
+            card, count, "cmd23") == pytest.approx(card.stop_busy)
+
+
+@pytest.mark.parametrize("sequence", ["cmd12", "cmd23"])
+def test_throughput_grows_with_transfer_size(sequence):
+    card = Card()
+    rates = [throughput(n * SECTOR_SIZE, transfer_time(card, n, sequence))
+             for n in (1, 2, 8, 32, MAX_COUNT)]
+    assert rates == sorted(rates)
+    # Large transfers approach the bus rate: 4 bits per clock
+    assert rates[-1] < card.clock / 2
+    assert rates[-1] > 0.8 * card.clock / 2 * 1024 / 1042
+
+
+def test_coalescing_is_faster():
+    card = Card()
+    requests = [2] * 256
+    assert read_time(card, coalesce(requests), "cmd23") < read_time(
+        card, requests, "cmd23") / 2
+
+
+def test_clock_steps():
+    # The 48 MHz kernel clock is used as is in High Speed mode only
+    assert clock_steps(48.0, True) == [48.0, 24.0, 12.0, 6.0]
+    assert clock_steps(48.0, False) == [24.0, 12.0, 6.0]
+    # The clock bypass is not used above 50 MHz
+    assert clock_steps(80.0, True) == [40.0, 20.0, 10.0]
+
+
+def test_high_speed_is_faster():
+    transfers = coalesce([8] * 128)
+    size = sum(transfers) * SECTOR_SIZE
+    rates = [throughput(size, read_time(Card(clock=clock), transfers,
+                                        "cmd23"))
+             for clock in clock_steps(48.0, True)]
+    assert rates == sorted(rates, reverse=True)
+    assert rates[0] > 1.5 * rates[1]
+
+
+def test_warm_init_skips_the_power_up():
+    # The cached parameters spare the identification and the power up busy
+    # time of the card
+    for busy in (0.0, 50.0, 500.0):
+        assert init_time("cold", busy=busy) > busy * 1000.0
+        assert init_time("warm", busy=busy) < 200.0
+    assert init_time("hal") - init_time("cold") == pytest.approx(2000.0)
+
+
+def test_missing_card_is_detected_at_once():
+    assert init_time("cold", present=False) < 2000.0
+    assert init_time("hal", present=False) > 5 * 2000.0
+    assert init_time("warm", present=False) < 20.0
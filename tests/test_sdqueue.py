@@ -0,0 +1,118 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+from tests.conftest import run_sim
+
+# Timeout of a request in milliseconds (SDQUEUE_TIMEOUT)
+TIMEOUT = 150
+
+SIM_SOURCES = ["tests/host/sdqueue_sim.c", "lib/stm32-bootloader/sdqueue.c"]
+
+
+def stats(lines):
+    """Return the sleeps and the polls of the last stats line."""
+    fields = [line.split() for line in lines if line.startswith("sleeps")]
+    return int(fields[-1][1]), int(fields[-1][3])
+
+
+def test_read(host_sim):
+    lines = run_sim(host_sim, "latency:5", "read:8:4", "stats")
+    assert lines[:4] == ["start read 8 4", "complete ok", "callback 0 done",
+                         "result 0 ok"]
+    # The CPU sleeps until the completion interrupt instead of polling
+    assert stats(lines) == (5, 1)
+
+
+def test_requests_are_chained_in_the_interrupt(host_sim):
+    # The next request is started by the completion of the previous one,
+    # without a waiting caller
+    lines = run_sim(host_sim, "submit:0:0:2", "submit:1:2:2",
+                    "submit:2:4:2", "irq", "irq", "irq", "stats",
+                    "wait:0", "wait:1", "wait:2")
+    assert lines == [
+        "start read 0 2", "complete ok", "callback 0 done",
+        "start read 2 2", "complete ok", "callback 1 done",
+        "start read 4 2", "complete ok", "callback 2 done",
+        "sleeps 0 polls 3 transfers 3",
+        "result 0 ok", "result 1 ok", "result 2 ok"]
+
+
+def test_flush(host_sim):
+    lines = run_sim(host_sim, "submit:0:0:1", "submit:1:1:1",
+                    "submit:2:2:1", "flush", "wait:0", "wait:1", "wait:2")
+    assert "flush ok" in lines
+    assert lines[-3:] == ["result 0 ok", "result 1 ok", "result 2 ok"]
+    assert [line for line in lines if line.startswith("start")] == [
+        "start read 0 1", "start read 1 1", "start read 2 1"]
+
+
+def test_card_busy_after_write(host_sim):
+    # The read is started once the card has programmed the written block
+    lines = run_sim(host_sim, "busy:3", "write:4:1", "read:4:1", "stats")
+    assert lines[:8] == [
+        "start write 4 1", "complete ok", "callback 0 done", "result 0 ok",
+        "start read 4 1", "complete ok", "callback 0 done", "result 0 ok"]
+    sleeps, polls = stats(lines)
+    assert sleeps == 1 + 3
+    assert polls == 1 + 3 + 1
+
+
+def test_transfer_error(host_sim):
+    lines = run_sim(host_sim, "error", "read:1:1", "read:3:1")
+    assert lines == [
+        "start read 1 1", "complete error", "callback 0 error",
+        "result 0 error",
+        "start read 3 1", "complete ok", "callback 0 done", "result 0 ok"]
+
+
+def test_rejected_request(host_sim):
+    # A request which cannot be started fails, the next one is served
+    lines = run_sim(host_sim, "submit:0:0:1", "reject", "submit:1:1:1",
+                    "submit:2:2:1", "flush", "wait:1", "wait:2")
+    assert "rejected" in lines
+    assert "callback 1 error" in lines
+    assert lines[-2:] == ["result 1 error", "result 2 ok"]
+
+
+def test_timeout(host_sim):
+    lines = run_sim(host_sim, "hang", "read:1:1", "stats", "read:2:1")
+    assert lines[:4] == ["start read 1 1", "abort", "callback 0 error",
+                         "result 0 error"]
+    assert stats(lines)[0] == TIMEOUT
+    assert lines[-1] == "result 0 ok"
+
+
+def test_spurious_completion(host_sim):
+    # A completion without a running transfer is ignored
+    lines = run_sim(host_sim, "spurious", "wait:3", "read:5:2")
+    assert lines == ["result 3 error", "start read 5 2", "complete ok",
+                     "callback 0 done", "result 0 ok"]
+
+
+def test_adjacent_requests_are_coalesced(host_sim):
+    # The first request starts right away, the next ones continue each other
+    # in sectors and in memory and are served by a single transfer
+    lines = run_sim(host_sim, "submit:0:0:2", "append:1:2:2",
+                    "append:2:4:3", "append:3:9:1", "flush", "wait:0",
+                    "wait:1", "wait:2", "wait:3", "stats")
+    assert [line for line in lines if line.startswith("start")] == [
+        "start read 0 2", "start read 2 5", "start read 9 1"]
+    assert lines[4:7] == ["complete ok", "callback 1 done", "callback 2 done"]
+    assert lines[-5:-1] == ["result 0 ok", "result 1 ok", "result 2 ok",
+                            "result 3 ok"]
+    assert lines[-1].endswith("transfers 3")
+
+
+def test_separate_buffers_are_not_coalesced(host_sim):
+    lines = run_sim(host_sim, "submit:0:0:1", "submit:1:1:1",
+                    "submit:2:2:1", "flush")
+    assert [line for line in lines if line.startswith("start")] == [
+        "start read 0 1", "start read 1 1", "start read 2 1"]
+
+
+def test_coalesced_requests_fail_together(host_sim):
+    lines = run_sim(host_sim, "submit:0:0:1", "append:1:1:1",
+                    "append:2:2:1", "irq", "error", "flush", "wait:1",
+                    "wait:2")
+    assert lines[3:7] == ["start read 1 2", "complete error",
+                          "callback 1 error", "callback 2 error"]
+    assert lines[-2:] == ["result 1 error", "result 2 error"]
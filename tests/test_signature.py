@@ -0,0 +1,213 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+import hashlib
+import os
+
+import pytest
+
+from python.sign_image import L, public_key, sign, verify
+from tests import test_flash
+from tests.conftest import run_sim
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+IMAGE = os.path.join(ROOT, "projects", "STM32L496-Discovery", "app-demo.bin")
+
+SIM_SOURCES = ["tests/host/signature_sim.c", "lib/stm32-bootloader/sha512.c",
+               "lib/stm32-bootloader/signature.c"]
+
+SECRET = bytes(range(32))
+
+# Bootloader error code of an invalid signature (BL_SIGNATURE_ERROR)
+BL_SIGNATURE_ERROR = 10
+
+# Ed25519ph test vector of RFC 8032 (section 7.3)
+RFC_SECRET = bytes.fromhex(
+    "833fe62409237b9d62ec77587520911e9a759cec1d19755b7da901b96dca3d42")
+RFC_SIGNATURE = bytes.fromhex(
+    "98a70222f0b8121aa9d30f813d683f809e462b469c7ff87639499bb94e6dae41"
+    "31f85042463c2a355a2003d062adf5aaa10b8c61e636062aaad11c2a26083406")
+
+
+def check(executable, tmp_path, data, signature, key, chunk=512):
+    files = []
+    for name, content in (("image", data), ("sig", signature), ("key", key)):
+        files.append(str(tmp_path / name))
+        with open(files[-1], "wb") as f:
+            f.write(content)
+    digest, result = run_sim(executable, *files, chunk)
+    return bytes.fromhex(digest), result
+
+
+def test_rfc8032_vector(host_sim, tmp_path):
+    assert sign(RFC_SECRET, b"abc") == RFC_SIGNATURE
+    _, result = check(host_sim, tmp_path, b"abc", RFC_SIGNATURE,
+                      public_key(RFC_SECRET))
+    assert result == "ok"
+
+
+@pytest.mark.parametrize("length", [0, 1, 111, 112, 127, 128, 129, 1000])
+@pytest.mark.parametrize("chunk", [1, 7, 128, 4096])
+def test_sha512(host_sim, tmp_path, length, chunk):
+    # The digest does not depend on the chunks fed into the hash
+    data = bytes((i * 13 + 5) & 0xFF for i in range(length))
+    digest, _ = check(host_sim, tmp_path, data, bytes(64), bytes(32),
+                      chunk)
+    assert digest == hashlib.sha512(data).digest()
+
+
+@pytest.mark.parametrize("chunk", [1, 100, 512])
+def test_signed_image(host_sim, tmp_path, chunk):
+    with open(IMAGE, "rb") as f:
+        data = f.read()
+    signature = sign(SECRET, data)
+    assert verify(public_key(SECRET), data, signature)
+    _, result = check(host_sim, tmp_path, data, signature,
+                      public_key(SECRET), chunk)
+    assert result == "ok"
+
+
+def test_modified_image(host_sim, tmp_path):
+    data = bytes(range(256)) * 16
+    signature = sign(SECRET, data)
+    modified = bytearray(data)
+    modified[1000] ^= 0x01
+    assert check(host_sim, tmp_path, bytes(modified), signature,
+                 public_key(SECRET))[1] == "fail"
+    assert check(host_sim, tmp_path, data + b"\xff", signature,
+                 public_key(SECRET))[1] == "fail"
+
+
+@pytest.mark.parametrize("index", [0, 31, 32, 63])
+def test_modified_signature(host_sim, tmp_path, index):
+    data = b"application"
+    signature = bytearray(sign(SECRET, data))
+    signature[index] ^= 0x01
+    assert check(host_sim, tmp_path, data, bytes(signature),
+                 public_key(SECRET))[1] == "fail"
+
+
+def test_malleable_signature(host_sim, tmp_path):
+    # S + L is rejected, although it satisfies the verification equation
+    data = b"application"
+    signature = sign(SECRET, data)
+    s = int.from_bytes(signature[32:], "little") + L
+    forged = signature[:32] + s.to_bytes(32, "little")
+    assert check(host_sim, tmp_path, data, forged,
+                 public_key(SECRET))[1] == "fail"
+
+
+def test_wrong_key(host_sim, tmp_path):
+    data = b"application"
+    signature = sign(SECRET, data)
+    assert check(host_sim, tmp_path, data, signature,
+                 public_key(RFC_SECRET))[1] == "fail"
+
+
+@pytest.mark.parametrize("key", [
+    b"\xff" * 32,                   # default SIGNATURE_PUBLIC_KEY
+    (2 ** 255 - 19).to_bytes(32, "little"),  # y = p (non-canonical)
+    (2).to_bytes(32, "little"),     # not on the curve
+])
+def test_invalid_key(host_sim, tmp_path, key):
+    data = b"application"
+    assert check(host_sim, tmp_path, data, sign(SECRET, data),
+                 key)[1] == "fail"
+
+
+def signed_build(*options):
+    # Host program of the flash with USE_SIGNATURE and the key of SECRET
+    key = ",".join(str(byte) for byte in public_key(SECRET))
+    return (test_flash.SIM_SOURCES,
+            test_flash.SIM_FLAGS + ["-DSIM_USE_SIGNATURE=1",
+                                    "-DSIGNATURE_PUBLIC_KEY={" + key + "}"] +
+            ["-DSIM_USE_{}=1".format(option) for option in options])
+
+
+SIGNED = signed_build()
+
+# Host program skipping the unchanged pages (USE_DIFF_UPDATE)
+SIGNED_DIFF_UPDATE = signed_build("DIFF_UPDATE")
+
+ERASED = "f" * 16
+
+
+@pytest.fixture
+def image():
+    with open(IMAGE, "rb") as f:
+        return f.read()
+
+
+@pytest.fixture
+def signature(image, tmp_path):
+    path = tmp_path / "image.sig"
+    path.write_bytes(sign(SECRET, image))
+    return str(path)
+
+
+def stack(image):
+    # Jump to the initial stack pointer of the image
+    return "jump:{:08x}".format(int.from_bytes(image[:4], "little"))
+
+
+def vectors(image):
+    # Double word holding the initial stack pointer of the image
+    return "{:016x}".format(int.from_bytes(image[:8], "little"))
+
+
+@pytest.mark.parametrize("host_sim", [SIGNED], indirect=True)
+@pytest.mark.parametrize("program", ["write:4096", "write:7", "next"])
+def test_authenticated_image(host_sim, image, tmp_path, program):
+    # The initial stack pointer is held back until the signature is verified.
+    # The image is a multiple of double words, as FlashNext() hashes the
+    # padding of the last double word.
+    data = tmp_path / "image.bin"
+    data.write_bytes(image[:len(image) // 8 * 8])
+    path = tmp_path / "image.sig"
+    path.write_bytes(sign(SECRET, data.read_bytes()))
+    dump = str(tmp_path / "flash.bin")
+    assert run_sim(host_sim, data, "erase", program, "read:0", "launch",
+                   "signature:" + str(path), "read:0", "verify",
+                   "dump:" + dump, "launch") == [
+        "ok", "ok", ERASED, "refused", "ok", vectors(image), "match",
+        stack(image)]
+    # The image is launched after a reset
+    assert run_sim(host_sim, data, "restore:" + dump, "launch") == [
+        stack(image)]
+
+
+@pytest.mark.parametrize("host_sim", [SIGNED], indirect=True)
+def test_reset_before_signature(host_sim, signature, tmp_path):
+    # A reset between the end of programming and the signature verification
+    # does not launch the unauthenticated image
+    dump = str(tmp_path / "flash.bin")
+    assert run_sim(host_sim, IMAGE, "erase", "write:4096",
+                   "dump:" + dump) == ["ok", "ok"]
+    assert run_sim(host_sim, IMAGE, "restore:" + dump, "read:0", "launch",
+                   "signature:" + signature, "launch") == [
+        ERASED, "refused", "error:{}".format(BL_SIGNATURE_ERROR), "refused"]
+
+
+@pytest.mark.parametrize("host_sim", [SIGNED], indirect=True)
+def test_invalid_signature(host_sim, image, tmp_path):
+    # The image is erased
+    path = tmp_path / "image.sig"
+    path.write_bytes(sign(RFC_SECRET, image))
+    assert run_sim(host_sim, IMAGE, "erase", "write:4096",
+                   "signature:" + str(path), "read:0", "read:8",
+                   "launch") == [
+        "ok", "ok", "error:{}".format(BL_SIGNATURE_ERROR), ERASED, ERASED,
+        "refused"]
+
+
+@pytest.mark.parametrize("host_sim", [SIGNED_DIFF_UPDATE], indirect=True)
+def test_unchanged_image_is_held_back(host_sim, image, signature, tmp_path):
+    # Programming the authenticated image again erases its initial stack
+    # pointer, although the image is unchanged
+    dump = str(tmp_path / "flash.bin")
+    assert run_sim(host_sim, IMAGE, "write:4096", "signature:" + signature,
+                   "write:4096", "session", "read:0",
+                   "dump:" + dump) == [
+        "ok", "ok", "ok", "1 {}".format((len(image) - 1) // 2048),
+        ERASED]
+    assert run_sim(host_sim, IMAGE, "restore:" + dump, "launch") == [
+        "refused"]
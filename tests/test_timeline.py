@@ -0,0 +1,59 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+from python.timeline import latencies, parse
+from tests.conftest import run_sim
+
+# Entries of the ring buffer (TIMELINE_SIZE)
+SIZE = 32
+
+# Boot phases (eTimelinePhases)
+HAL_INIT = 1
+CLOCK = 2
+JUMP = 11
+USER = 0x80
+
+SIM_SOURCES = ["tests/host/timeline_sim.c", "lib/stm32-bootloader/timeline.c"]
+
+
+def test_phase_latencies(host_sim):
+    # Phases are converted with the clock at their start
+    dump = run_sim(host_sim, "start:100:4", "mark:1:500:4",
+                   "mark:2:4500:80", "mark:11:84500:4", "dump")
+    assert dump[0] == "TL 00 04 00000064"
+    boots = parse(dump)
+    assert len(boots) == 1
+    assert latencies(boots[0]) == [("HAL_Init", 400, 100.0),
+                                   ("SystemClock_Config", 4000, 1000.0),
+                                   ("jump", 80000, 1000.0)]
+
+
+def test_boots_are_appended(host_sim):
+    # The timeline survives resets: every boot starts a new section
+    dump = run_sim(host_sim, "start:0:4", "mark:1:40:4", "start:7:4",
+                   "mark:{}:27:4".format(USER + 2), "dump")
+    boots = parse(["VCP output"] + dump)
+    assert [latencies(boot) for boot in boots] == [
+        [("HAL_Init", 40, 10.0)], [("user 2", 20, 5.0)]]
+
+
+def test_counter_wrap(host_sim):
+    dump = run_sim(host_sim, "start:4294967200:80", "mark:1:704:80",
+                   "dump")
+    assert latencies(parse(dump)[0]) == [("HAL_Init", 800, 10.0)]
+
+
+def test_ring_buffer(host_sim):
+    # Only the last entries are kept, the partial boot is ignored
+    marks = ["mark:1:{}:1".format(i) for i in range(1, SIZE)]
+    dump = run_sim(host_sim, "start:0:1", *marks + [
+        "start:1000:1", "mark:2:1010:1", "dump"])
+    assert len(dump) == SIZE
+    boots = parse(dump)
+    assert len(boots) == 1
+    assert latencies(boots[0]) == [("SystemClock_Config", 10, 10.0)]
+
+
+def test_dump_request_is_consumed(host_sim):
+    # Requested by the application, dumped at the next boot
+    assert run_sim(host_sim, "start:0:4", "requested", "request",
+                   "start:10:4", "requested", "requested") == ["0", "1", "0"]